@@ -0,0 +1,162 @@
+// The file benchmarks the latest pose publication (see pose_publisher.h) under contention: one writer publishes as
+// fast as it can while 0-N reader threads copy the latest pose in a loop. Reported: time per publication (also with a
+// subscriber) and per read, and the consistency of every read (all fields from one publication, sequence never
+// decreasing per reader). A torn or reordered read fails the run.
+// The pose queries of PoseInterpolator are timed on a constant velocity motion, where the interpolated and extrapolated
+// poses are exact, alone and while poses are added at 1 kHz. A query off the motion fails the run.
+// Usage: ./bench_pose_publisher [publications] [max_readers]
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+#include <se3.hpp>
+#include <pose_interpolation.h>
+#include <pose_publisher.h>
+
+namespace
+{
+
+struct Result{
+  double publish_ns;
+  double read_ns;
+  uint64_t reads;
+  uint64_t bad_reads;
+};
+
+// every field of publication i derives from i, so a read mixing two publications is detected
+odometry::PoseSample MakeSample(uint64_t i){
+  odometry::PoseSample sample;
+  sample.pose.setConstant(float(i % (1 << 24)));
+  sample.covariance.setConstant(float(i % (1 << 24)));
+  sample.timestamp = 0.1 * double(i);
+  sample.frame_id = i;
+  sample.status = (i % 2 == 0) ? odometry::kTrackingOk : odometry::kTrackingLost;
+  return sample;
+}
+
+bool Consistent(const odometry::PoseSample& sample){
+  float value = float(sample.frame_id % (1 << 24));
+  return (sample.pose.array() == value).all() && (sample.covariance.array() == value).all() &&
+         sample.timestamp == 0.1 * double(sample.frame_id) &&
+         sample.status == ((sample.frame_id % 2 == 0) ? odometry::kTrackingOk : odometry::kTrackingLost) &&
+         sample.sequence == sample.frame_id + 1;
+}
+
+Result Run(int publications, int num_readers, bool subscriber){
+  odometry::PosePublisher publisher;
+  std::atomic<uint64_t> received(0);
+  if (subscriber) publisher.Subscribe([&](const odometry::PoseSample& ){ received.fetch_add(1, std::memory_order_relaxed); });
+  std::atomic<bool> stop(false);
+  std::atomic<uint64_t> reads(0), bad_reads(0);
+  std::atomic<double> read_seconds(0.0);
+  std::vector<std::thread> readers;
+  for (int r = 0; r < num_readers; r++){
+    readers.emplace_back([&](){
+      odometry::PoseSample sample;
+      uint64_t last_sequence = 0, num = 0, bad = 0;
+      auto begin = std::chrono::steady_clock::now();
+      while (!stop.load(std::memory_order_relaxed)){
+        if (publisher.Latest(sample) == -1) continue;
+        if (!Consistent(sample) || sample.sequence < last_sequence) bad++;
+        last_sequence = sample.sequence;
+        num++;
+      }
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+      reads += num;
+      bad_reads += bad;
+      double old_seconds = read_seconds.load();
+      while (!read_seconds.compare_exchange_weak(old_seconds, old_seconds + seconds)){}
+    });
+  }
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < publications; i++){
+    publisher.Publish(MakeSample(uint64_t(i)));
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  stop = true;
+  for (auto& reader : readers) reader.join();
+  Result result;
+  result.publish_ns = 1e9 * seconds / publications;
+  result.reads = reads.load();
+  result.read_ns = result.reads > 0 ? 1e9 * read_seconds.load() / double(result.reads) : 0.0;
+  result.bad_reads = bad_reads.load() + (subscriber && received.load() != uint64_t(publications) ? 1 : 0);
+  return result;
+}
+
+// the motion at time t: constant velocity twist, 10 m/s and 0.5 rad/s
+odometry::Affine4f MotionAt(double t){
+  Eigen::Matrix<float, 6, 1> twist;
+  twist << 10.0f, 0.5f, 0.2f, 0.1f, 0.5f, 0.05f;
+  return Sophus::SE3<float>::exp(float(t) * twist).matrix();
+}
+
+// ns per query, queries off the motion counted in bad_queries
+double RunQueries(int queries, bool concurrent_writer, uint64_t& bad_queries){
+  const double kRate = 10.0; // Hz, as KITTI
+  odometry::PoseInterpolator interpolator(64, 0.3);
+  int num_poses = 20;
+  for (int i = 0; i < num_poses; i++) interpolator.Add(i / kRate, MotionAt(i / kRate));
+  std::atomic<double> newest((num_poses - 1) / kRate);
+  std::atomic<bool> stop(false);
+  std::thread writer;
+  if (concurrent_writer){
+    writer = std::thread([&](){
+      for (int i = num_poses; !stop.load(); i++){
+        interpolator.Add(i / kRate, MotionAt(i / kRate));
+        newest = i / kRate;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    });
+  }
+  odometry::Affine4f pose;
+  auto begin = std::chrono::steady_clock::now();
+  for (int q = 0; q < queries; q++){
+    // up to 1 s before and 0.2 s after the newest pose
+    double t = newest.load(std::memory_order_relaxed) - 1.0 + std::fmod(q * 0.000731, 1.2);
+    if (interpolator.PoseAt(t, pose) == -1 || !pose.isApprox(MotionAt(t), 1e-3f)) bad_queries++;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  stop = true;
+  if (writer.joinable()) writer.join();
+  return 1e9 * seconds / queries;
+}
+
+} // namespace
+
+int main(int argc, char** argv){
+  int publications = (argc > 1) ? std::atoi(argv[1]) : 1000000;
+  int max_readers = (argc > 2) ? std::atoi(argv[2]) : 4;
+  std::cout << publications << " publications, " << std::thread::hardware_concurrency() << " hardware threads"
+            << std::endl;
+  std::cout << std::fixed << std::setprecision(1);
+  uint64_t bad_reads = 0;
+  for (int subscriber = 0; subscriber <= 1; subscriber++){
+    for (int num_readers = 0; num_readers <= max_readers; num_readers = (num_readers == 0) ? 1 : 2 * num_readers){
+      Result result = Run(publications, num_readers, subscriber == 1);
+      std::cout << "  " << num_readers << " reader(s)" << (subscriber ? ", 1 subscriber" : "             ")
+                << "  publish " << std::setw(7) << result.publish_ns << " ns";
+      if (num_readers > 0)
+        std::cout << "  read " << std::setw(7) << result.read_ns << " ns (" << result.reads << " reads)";
+      std::cout << std::endl;
+      bad_reads += result.bad_reads;
+    }
+  }
+  uint64_t bad_queries = 0;
+  for (int writer = 0; writer <= 1; writer++){
+    double query_ns = RunQueries(publications, writer == 1, bad_queries);
+    std::cout << "  pose query" << (writer ? ", adds at 1 kHz" : "               ") << "  " << std::setw(7) << query_ns
+              << " ns" << std::endl;
+  }
+  if (bad_reads > 0 || bad_queries > 0){
+    std::cout << bad_reads << " inconsistent read(s), " << bad_queries << " wrong pose query(s)!" << std::endl;
+    return 1;
+  }
+  std::cout << "all reads consistent, all pose queries on the motion." << std::endl;
+  return 0;
+}
@@ -0,0 +1,135 @@
+// The file benchmarks the jitter of a periodic frame loop without and with the real-time mode (see realtime.h):
+// every period a frame sized buffer set is allocated and a pyramid is computed with the rows split over a ThreadPool,
+// like the pyramid stage of the pipeline. Reported per mode: wake-up lateness and frame latency (from the release time)
+// percentiles, page faults and involuntary context switches. The settings which fail (no privileges) are reported and
+// skipped, i.e. the second run shows the mode the host allows.
+// Usage: ./bench_realtime [frames] [period_ms] [fifo_priority]
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+#include <sys/resource.h>
+#include <realtime.h>
+#include <simd_dispatch.h>
+#include <thread_pool.h>
+
+namespace
+{
+
+const int kRows = 376;
+const int kCols = 1241;
+const int kStride = 1248;
+const int kLevels = 4;
+
+struct Jitter{
+  std::vector<double> lateness_us; // wake-up after the release time
+  std::vector<double> latency_us;  // end of the frame after the release time
+  long minor_faults;
+  long major_faults;
+  long involuntary_switches;
+};
+
+double Percentile(std::vector<double> values, double p){
+  std::sort(values.begin(), values.end());
+  return values[std::min(values.size() - 1, size_t(p * double(values.size())))];
+}
+
+Jitter RunFrames(odometry::ThreadPool& pool, int frames, double period_ms){
+  const odometry::SimdKernels& kernels = odometry::GetSimdKernels();
+  std::vector<float> image(kRows * kStride);
+  for (int i = 0; i < kRows * kStride; i++) image[i] = float((uint64_t(i) * 7919u) % 255u);
+  Jitter jitter;
+  rusage usage_begin, usage_end;
+  getrusage(RUSAGE_SELF, &usage_begin);
+  auto release = std::chrono::steady_clock::now();
+  for (int frame = 0; frame < frames; frame++){
+    release += std::chrono::microseconds(int64_t(period_ms * 1e3));
+    std::this_thread::sleep_until(release);
+    auto wake = std::chrono::steady_clock::now();
+    // new buffers per frame, as the pipeline allocates its frames
+    std::vector<std::vector<float>> levels(kLevels);
+    const float* src = image.data();
+    int rows = kRows, cols = kCols, stride = kStride;
+    for (int l = 0; l < kLevels; l++){
+      int dst_rows = rows / 2, dst_cols = cols / 2, dst_stride = (dst_cols + 7) / 8 * 8;
+      levels[l].resize(size_t(dst_rows + 1) * dst_stride);
+      float* dst = levels[l].data();
+      pool.ParallelFor(0, dst_rows, 16, [&](int row_begin, int row_end){
+        kernels.pyramid_down(src + 2 * row_begin * stride, stride, dst + row_begin * dst_stride, dst_stride,
+                             row_end - row_begin, dst_cols);
+      }, odometry::kPriorityHigh, "bench");
+      src = dst;
+      rows = dst_rows;
+      cols = dst_cols;
+      stride = dst_stride;
+    }
+    auto end = std::chrono::steady_clock::now();
+    jitter.lateness_us.push_back(std::chrono::duration<double, std::micro>(wake - release).count());
+    jitter.latency_us.push_back(std::chrono::duration<double, std::micro>(end - release).count());
+  }
+  getrusage(RUSAGE_SELF, &usage_end);
+  jitter.minor_faults = usage_end.ru_minflt - usage_begin.ru_minflt;
+  jitter.major_faults = usage_end.ru_majflt - usage_begin.ru_majflt;
+  jitter.involuntary_switches = usage_end.ru_nivcsw - usage_begin.ru_nivcsw;
+  return jitter;
+}
+
+void Report(const std::string& mode, const Jitter& jitter){
+  std::cout << std::fixed << std::setprecision(1);
+  const std::vector<double>* series[2] = {&jitter.lateness_us, &jitter.latency_us};
+  const char* names[2] = {"wake-up lateness", "frame latency"};
+  for (int i = 0; i < 2; i++){
+    std::cout << "  " << std::left << std::setw(10) << mode << std::setw(18) << names[i] << std::right
+              << " p50 " << std::setw(8) << Percentile(*series[i], 0.5) << " us"
+              << "  p99 " << std::setw(8) << Percentile(*series[i], 0.99) << " us"
+              << "  max " << std::setw(8) << Percentile(*series[i], 1.0) << " us" << std::endl;
+  }
+  std::cout << "  " << std::left << std::setw(10) << mode << std::right << "page faults " << jitter.minor_faults
+            << " minor, " << jitter.major_faults << " major, involuntary context switches "
+            << jitter.involuntary_switches << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv){
+  int frames = (argc > 1) ? std::atoi(argv[1]) : 500;
+  double period_ms = (argc > 2) ? std::atof(argv[2]) : 5.0;
+  int fifo_priority = (argc > 3) ? std::atoi(argv[3]) : 50;
+  int num_threads = odometry::DefaultNumThreads();
+  int num_cores = std::max(int(std::thread::hardware_concurrency()), 1);
+  std::cout << frames << " frames, period " << period_ms << " ms, " << num_threads << " threads" << std::endl;
+
+  Jitter normal;
+  {
+    odometry::ThreadPool pool(num_threads);
+    normal = RunFrames(pool, frames, period_ms);
+  }
+  Report("normal", normal);
+
+  // the calling thread on core 0, the workers on the next ones
+  odometry::RealtimeConfig config;
+  config.fifo_priority = fifo_priority;
+  config.driver_core = 0;
+  for (int i = 1; i < num_threads; i++) config.worker_cores.push_back(i % num_cores);
+  bool all_applied = odometry::LockMemory() == 0;
+  all_applied = odometry::SetThreadRealtime(config.driver_core, config.numa_local, config.fifo_priority) == 0 &&
+                all_applied;
+  Jitter realtime;
+  {
+    odometry::ThreadPool pool(num_threads, [&](int index){
+      odometry::SetThreadRealtime(config.worker_cores[index % config.worker_cores.size()], config.numa_local,
+                                  config.fifo_priority);
+    });
+    realtime = RunFrames(pool, frames, period_ms);
+  }
+  Report("realtime", realtime);
+  if (!all_applied) std::cout << "  (some settings failed, see above: realtime ran partly in the normal mode)" << std::endl;
+  return 0;
+}
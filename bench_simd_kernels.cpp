@@ -0,0 +1,261 @@
+// The file benchmarks every SIMD kernel variant supported by the running CPU on KITTI sized data (376x1241),
+// reports the time per call and the speed-up over the scalar reference.
+// The whole image warping is also timed with the rows split over DefaultThreadPool() (ODOMETRY_THREADS threads), the
+// pose residuals also on the compact uint8 / half float images (see PyramidStorage) and on sparse pattern anchors.
+// Usage: ./bench_simd_kernels [repetitions]
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <simd_dispatch.h>
+#include <thread_pool.h>
+
+namespace
+{
+
+const int kRows = 376;
+const int kCols = 1241;
+const int kStride = 1248;
+
+struct BenchData{
+  std::vector<float> img1, img2, inv_depth;
+  std::vector<float> jaco, residual, weight, dst, zbuffer;
+  std::vector<int> xs, ys;
+  std::vector<float> point_depth, jtwj, b, point_energy, point_residual;
+  std::vector<float> sample_u, sample_v, sample_value, sample_grad_x, sample_grad_y;
+  std::vector<unsigned char> sample_valid;
+  std::vector<unsigned char> img1_u8, img2_u8; // one padding row, see SimdKernels
+  std::vector<odometry::Float16> img1_f16, img2_f16;
+  std::vector<int> anchor_xs, anchor_ys;
+  std::vector<float> anchor_depth;
+  std::vector<float> klt_x, klt_y;
+  std::vector<unsigned char> klt_status;
+  std::vector<unsigned int> census1, census2, sgm_scratch;
+  std::vector<unsigned char> sgm_cost; // one row
+  std::vector<unsigned short> sgm_paths, sgm_sum; // two rows, one row
+};
+
+// mean time per call in milli-seconds
+double TimeMs(const std::function<void()>& fn, int reps){
+  fn(); // warm up caches
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < reps; i++) fn();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - begin).count() / reps;
+}
+
+void Report(const char* kernel, const char* level, double ms, double scalar_ms){
+  std::cout << "  " << std::left << std::setw(32) << kernel << std::setw(8) << level << std::right << std::fixed
+            << std::setprecision(4) << std::setw(10) << ms << " ms" << std::setprecision(2) << std::setw(8)
+            << scalar_ms / ms << "x" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv){
+  int reps = (argc > 1) ? std::atoi(argv[1]) : 20;
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+  BenchData data;
+  data.img1.resize(kRows * kStride);
+  data.img2.resize(kRows * kStride);
+  data.inv_depth.resize(kRows * kStride);
+  for (int i = 0; i < kRows * kStride; i++){
+    data.img1[i] = dist(rng);
+    data.img2[i] = dist(rng);
+    data.inv_depth[i] = dist(rng) < 0.5f ? 0.0f : 0.05f + 0.2f * dist(rng); // semi-dense: half of the pixels are invalid
+  }
+  data.img1_u8.resize((kRows + 1) * kStride);
+  data.img2_u8.resize((kRows + 1) * kStride);
+  data.img1_f16.resize((kRows + 1) * kStride);
+  data.img2_f16.resize((kRows + 1) * kStride);
+  for (int i = 0; i < kRows * kStride; i++){
+    data.img1_u8[i] = (unsigned char)(255.0f * data.img1[i]);
+    data.img2_u8[i] = (unsigned char)(255.0f * data.img2[i]);
+  }
+  odometry::GetSimdKernels().convert_to_half(data.img1.data(), kRows * kStride, data.img1_f16.data());
+  odometry::GetSimdKernels().convert_to_half(data.img2.data(), kRows * kStride, data.img2_f16.data());
+  int capacity = kRows * kCols;
+  data.jaco.resize(6 * capacity);
+  data.residual.resize(capacity);
+  data.weight.assign(capacity, 1.0f);
+  data.dst.resize(kRows * kStride);
+  data.zbuffer.resize(kRows * kStride);
+  const int kNumPoints = 5000;
+  std::uniform_int_distribution<int> dist_x(0, kCols - 1), dist_y(0, kRows - 1);
+  for (int i = 0; i < kNumPoints; i++){
+    data.xs.push_back(dist_x(rng));
+    data.ys.push_back(dist_y(rng));
+    data.point_depth.push_back(0.01f * dist(rng));
+  }
+  data.jtwj.resize(kNumPoints);
+  data.b.resize(kNumPoints);
+  data.point_energy.resize(kNumPoints);
+  data.point_residual.resize(kNumPoints);
+  // sub-pixel positions of one semi-dense pose optimization
+  const int kNumSamples = kRows * kCols / 2;
+  std::uniform_real_distribution<float> dist_u(0.0f, float(kCols)), dist_v(0.0f, float(kRows));
+  for (int i = 0; i < kNumSamples; i++){
+    data.sample_u.push_back(dist_u(rng));
+    data.sample_v.push_back(dist_v(rng));
+  }
+  data.sample_value.resize(kNumSamples);
+  data.sample_grad_x.resize(kNumSamples);
+  data.sample_grad_y.resize(kNumSamples);
+  data.sample_valid.resize(kNumSamples);
+  // pattern anchors: one per 3x3 cell with a valid inverse depth
+  for (int y = 4; y < kRows - 4; y += 3){
+    for (int x = 4; x < kCols - 4; x += 3){
+      if (data.inv_depth[y * kStride + x] == 0.0f) continue;
+      data.anchor_xs.push_back(x);
+      data.anchor_ys.push_back(y);
+      data.anchor_depth.push_back(data.inv_depth[y * kStride + x]);
+    }
+  }
+  int num_anchors = int(data.anchor_xs.size());
+  for (int y = 8; y < kRows - 8; y += 16){
+    for (int x = 8; x < kCols - 8; x += 16){
+      data.klt_x.push_back(float(x) + dist(rng));
+      data.klt_y.push_back(float(y) + dist(rng));
+    }
+  }
+  data.klt_status.resize(data.klt_x.size());
+  const int kNumDisp = 128;
+  data.census1.resize(kCols);
+  data.census2.resize(kCols);
+  data.sgm_scratch.resize(kCols + kNumDisp);
+  data.sgm_cost.resize(kCols * kNumDisp);
+  data.sgm_paths.resize(2 * kCols * (kNumDisp + 2));
+  data.sgm_sum.resize(kCols * kNumDisp);
+  const float kCamera[4] = {718.856f, 718.856f, 607.1928f, 185.2157f};
+  const float kTransform[12] = {1.0f, 0.0f, 0.0f, 0.01f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.3f};
+
+  odometry::ThreadPool& pool = odometry::DefaultThreadPool();
+  double scalar_ms[15] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+  for (int level = odometry::kSimdScalar; level <= odometry::kSimdAvx512; level++){
+    const odometry::SimdKernels* k = odometry::GetSimdKernels(odometry::SimdLevel(level));
+    if (k == nullptr) continue;
+    double ms[15];
+    // one disparity search per row along the full epipolar line
+    ms[0] = TimeMs([&](){
+      float pattern[8] = {0.1f, 0.2f, 0.3f, 0.4f, 0.5f, 0.6f, 0.7f, 0.8f};
+      float ssd;
+      for (int y = 2; y < kRows - 2; y++){
+        const float* rows[5];
+        for (int i = 0; i < 5; i++) rows[i] = data.img2.data() + (y - 2 + i) * kStride;
+        k->ssd_pattern8_search(pattern, rows, 2, kCols - 2, &ssd);
+      }
+    }, reps);
+    ms[1] = TimeMs([&](){
+      k->pyramid_down(data.img1.data(), kStride, data.dst.data(), kStride, kRows / 2, kCols / 2);
+    }, reps);
+    int num = 0;
+    ms[2] = TimeMs([&](){
+      num = k->pose_residual_jacobian(data.img1.data(), data.img2.data(), data.inv_depth.data(), kStride, kRows, kCols, 4,
+                                      kCamera, kTransform, data.jaco.data(), capacity, data.residual.data());
+    }, reps);
+    ms[3] = TimeMs([&](){
+      float h[36], g[6], c;
+      k->accumulate_normal_equations(data.jaco.data(), capacity, data.residual.data(), data.weight.data(), num, h, g, &c);
+    }, reps);
+    ms[4] = TimeMs([&](){
+      float err;
+      k->depth_residual_jacobian(data.img1.data(), data.img2.data(), kStride, kRows, kCols, data.xs.data(), data.ys.data(),
+                                 data.point_depth.data(), kNumPoints, 718.856f * 0.54f, 0.1f, data.jtwj.data(), data.b.data(),
+                                 data.point_energy.data(), data.point_residual.data(), &err);
+    }, reps);
+    // whole image warping: z-buffer splat, then bilinear sampling of the visible points
+    const float kInf = std::numeric_limits<float>::infinity();
+    ms[5] = TimeMs([&](){
+      std::fill(data.zbuffer.begin(), data.zbuffer.end(), kInf);
+      k->warp_depth_splat(data.inv_depth.data(), kStride, kRows, kCols, 0, kRows, kCamera, kTransform, data.zbuffer.data());
+      k->warp_image(data.img2.data(), data.inv_depth.data(), kStride, kRows, kCols, 0, kRows, kCamera, kTransform,
+                    data.zbuffer.data(), data.dst.data());
+    }, reps);
+    ms[6] = TimeMs([&](){
+      std::fill(data.zbuffer.begin(), data.zbuffer.end(), kInf);
+      pool.ParallelFor(0, kRows, 16, [&](int row_begin, int row_end){
+        k->warp_depth_splat(data.inv_depth.data(), kStride, kRows, kCols, row_begin, row_end, kCamera, kTransform,
+                            data.zbuffer.data());
+      });
+      pool.ParallelFor(0, kRows, 16, [&](int row_begin, int row_end){
+        k->warp_image(data.img2.data(), data.inv_depth.data(), kStride, kRows, kCols, row_begin, row_end, kCamera,
+                      kTransform, data.zbuffer.data(), data.dst.data());
+      });
+    }, reps);
+    ms[7] = TimeMs([&](){
+      k->sample_bilinear(data.img2.data(), kStride, kRows, kCols, data.sample_u.data(), data.sample_v.data(), kNumSamples,
+                         data.sample_value.data(), data.sample_grad_x.data(), data.sample_grad_y.data(),
+                         data.sample_valid.data());
+    }, reps);
+    ms[8] = TimeMs([&](){
+      k->pose_residual_jacobian_u8(data.img1_u8.data(), data.img2_u8.data(), data.inv_depth.data(), kStride, kRows, kCols,
+                                   4, kCamera, kTransform, data.jaco.data(), capacity, data.residual.data());
+    }, reps);
+    ms[9] = TimeMs([&](){
+      k->pose_residual_jacobian_f16(data.img1_f16.data(), data.img2_f16.data(), data.inv_depth.data(), kStride, kRows,
+                                    kCols, 4, kCamera, kTransform, data.jaco.data(), capacity, data.residual.data());
+    }, reps);
+    ms[10] = TimeMs([&](){
+      k->pose_residual_jacobian_pattern8(data.img1.data(), data.img2.data(), kStride, kRows, kCols, data.anchor_xs.data(),
+                                         data.anchor_ys.data(), data.anchor_depth.data(), num_anchors, kCamera, kTransform,
+                                         data.jaco.data(), capacity, data.residual.data());
+    }, reps);
+    // FAST scores of the whole image (intensities in [0, 1]), then KLT tracking of one feature per 16x16 cell
+    ms[11] = TimeMs([&](){
+      for (int y = 3; y < kRows - 3; y++){
+        k->fast_score_row(data.img1.data() + y * kStride, kStride, kCols, 0.08f, data.dst.data() + y * kStride);
+      }
+    }, reps);
+    ms[12] = TimeMs([&](){
+      std::vector<float> x2(data.klt_x.begin(), data.klt_x.end()), y2(data.klt_y.begin(), data.klt_y.end());
+      k->klt_track(data.img1.data(), data.img2.data(), kStride, kRows, kCols, data.klt_x.data(), data.klt_y.data(),
+                   int(data.klt_x.size()), 3, 10, x2.data(), y2.data(), data.klt_status.data());
+    }, reps);
+    // semi-global matching of the whole image with 128 disparities: census and costs, then one vertical path
+    ms[13] = TimeMs([&](){
+      for (int y = 2; y < kRows - 2; y++){
+        k->census_row(data.img1.data() + y * kStride, kStride, kCols, data.census1.data());
+        k->census_row(data.img2.data() + y * kStride, kStride, kCols, data.census2.data());
+        k->sgm_cost_row(data.census1.data(), data.census2.data(), kCols, kNumDisp, data.sgm_scratch.data(),
+                        data.sgm_cost.data());
+      }
+    }, reps);
+    ms[14] = TimeMs([&](){
+      const int kRowPaths = kCols * (kNumDisp + 2);
+      for (int y = 2; y < kRows - 2; y++){
+        unsigned short* cur = data.sgm_paths.data() + (y & 1) * kRowPaths;
+        const unsigned short* prev = (y == 2) ? nullptr : data.sgm_paths.data() + ((y + 1) & 1) * kRowPaths;
+        k->sgm_aggregate_row(data.sgm_cost.data(), kCols, kNumDisp, 0, prev, cur, data.sgm_sum.data(), 8, 96);
+      }
+    }, reps);
+    if (level == odometry::kSimdScalar){
+      for (int i = 0; i < 15; i++) scalar_ms[i] = ms[i];
+    }
+    std::cout << k->name << " (" << num << " pose residuals):" << std::endl;
+    Report("ssd_pattern8_search", k->name, ms[0], scalar_ms[0]);
+    Report("pyramid_down", k->name, ms[1], scalar_ms[1]);
+    Report("pose_residual_jacobian", k->name, ms[2], scalar_ms[2]);
+    Report("accumulate_normal_equations", k->name, ms[3], scalar_ms[3]);
+    Report("depth_residual_jacobian", k->name, ms[4], scalar_ms[4]);
+    Report("warp_image (1 thread)", k->name, ms[5], scalar_ms[5]);
+    std::string threaded = "warp_image (" + std::to_string(pool.NumThreads()) + " threads)";
+    Report(threaded.c_str(), k->name, ms[6], scalar_ms[5]);
+    Report("sample_bilinear", k->name, ms[7], scalar_ms[7]);
+    Report("pose_residual_jacobian_u8", k->name, ms[8], scalar_ms[8]);
+    Report("pose_residual_jacobian_f16", k->name, ms[9], scalar_ms[9]);
+    Report("pose_residual_jacobian_pattern8", k->name, ms[10], scalar_ms[10]);
+    Report("fast_score_row (whole image)", k->name, ms[11], scalar_ms[11]);
+    Report("klt_track", k->name, ms[12], scalar_ms[12]);
+    Report("census_row + sgm_cost_row", k->name, ms[13], scalar_ms[13]);
+    Report("sgm_aggregate_row (1 path)", k->name, ms[14], scalar_ms[14]);
+  }
+  return 0;
+}
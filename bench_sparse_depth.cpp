@@ -0,0 +1,139 @@
+// The file benchmarks the sparse depth encoding (see sparse_depth_codec.h) on the semi-dense depth maps of KITTI
+// frames, estimated by DepthEstimator with the parameters of run_odometry_kitti. Reported per frame: valid pixels and
+// the size against the float map with mask and against the 16 bit disparity PNG of the debug output; per SIMD level:
+// encode and decode time and throughput in GB/s of the dense map (float inverse depth and mask).
+// Without the KITTI images a generated semi-dense map of the same size is used.
+// Usage: ./bench_sparse_depth [kitti_dir] [frames] [repetitions]
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <depth_estimate.h>
+#include <sparse_depth_codec.h>
+
+namespace
+{
+
+const int kRows = 376;
+const int kCols = 1241;
+const int kFrameStep = 100; // frames 0, 100, 200, ...
+
+// mean time per call in milli-seconds
+double TimeMs(const std::function<void()>& fn, int reps){
+  fn(); // warm up caches
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < reps; i++) fn();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - begin).count() / reps;
+}
+
+bool LoadStereo(const std::string& kitti_dir, int frame_id, cv::Mat& left, cv::Mat& right){
+  std::string name = std::string(6 - std::to_string(frame_id).length(), '0') + std::to_string(frame_id) + ".png";
+  cv::Mat left_8u = cv::imread(kitti_dir + "/dataset/sequences/00/image_0/" + name, cv::IMREAD_GRAYSCALE);
+  cv::Mat right_8u = cv::imread(kitti_dir + "/dataset/sequences/00/image_1/" + name, cv::IMREAD_GRAYSCALE);
+  if (left_8u.empty() || right_8u.empty()) return false;
+  left_8u.convertTo(left, PixelType);
+  right_8u.convertTo(right, PixelType);
+  return true;
+}
+
+// short horizontal segments of valid pixels, about the density of the KITTI maps
+void MakeSemiDense(std::mt19937& rng, cv::Mat& inv_depth, cv::Mat& valid){
+  std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+  inv_depth.create(kRows, kCols, CV_32F);
+  valid.create(kRows, kCols, CV_8U);
+  for (int y = 0; y < kRows; y++){
+    int segment = 0;
+    for (int x = 0; x < kCols; x++){
+      if (segment == 0 && dist(rng) < 0.005f) segment = 1 + int(8.0f * dist(rng));
+      valid.at<uint8_t>(y, x) = uint8_t(segment > 0 ? 1 : 0);
+      if (segment > 0) segment--;
+      inv_depth.at<float>(y, x) = 0.0125f + 0.5f * dist(rng);
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv){
+  std::string kitti_dir = (argc > 1) ? argv[1] : "../dataset/kitti";
+  int num_frames = (argc > 2) ? std::atoi(argv[2]) : 5;
+  int reps = (argc > 3) ? std::atoi(argv[3]) : 50;
+
+  std::shared_ptr<odometry::CameraPyramid> left_cam_ptr = nullptr;
+  std::shared_ptr<odometry::CameraPyramid> right_cam_ptr = nullptr;
+  odometry::DepthEstimator depth_estimator(8.0f, 900.0f, 15.0f, 0.1f, 30.0f, 0.01f, 28.0f, 0.995f, 50, 4,
+                                           left_cam_ptr, right_cam_ptr, 386.1448f / 718.856f, 80000);
+  std::vector<cv::Mat> depths, valids;
+  for (int i = 0; i < num_frames; i++){
+    cv::Mat left, right;
+    if (!LoadStereo(kitti_dir, i * kFrameStep, left, right)) break;
+    cv::Mat valid(left.rows, left.cols, CV_8U, cv::Scalar(0));
+    cv::Mat disparity(left.rows, left.cols, PixelType, cv::Scalar(0));
+    cv::Mat inv_depth(left.rows, left.cols, PixelType, cv::Scalar(0));
+    if (depth_estimator.ComputeDepth(left, right, valid, disparity, inv_depth) == -1) continue;
+    depths.push_back(inv_depth);
+    valids.push_back(valid);
+  }
+  if (depths.empty()){
+    std::cout << "no KITTI frames in " << kitti_dir << ", using generated semi-dense maps." << std::endl;
+    std::mt19937 rng(7);
+    for (int i = 0; i < num_frames; i++){
+      depths.emplace_back();
+      valids.emplace_back();
+      MakeSemiDense(rng, depths.back(), valids.back());
+    }
+  }
+
+  // sizes: float map + mask, 16 bit disparity PNG (compression level 1, see DebugWriter), sparse
+  odometry::SparseDepthCodec codec;
+  std::vector<unsigned char> data, png;
+  double dense_bytes = 0.0;
+  std::cout << std::setw(6) << "frame" << std::setw(10) << "valid" << std::setw(12) << "dense" << std::setw(12) << "png"
+            << std::setw(12) << "sparse" << std::setw(10) << "ratio" << std::endl;
+  for (size_t i = 0; i < depths.size(); i++){
+    cv::Mat disparity(depths[i].rows, depths[i].cols, CV_16U);
+    for (int y = 0; y < disparity.rows; y++){
+      for (int x = 0; x < disparity.cols; x++){
+        disparity.at<uint16_t>(y, x) = valids[i].at<uint8_t>(y, x) != 0 ?
+                                       uint16_t(386.1448f * depths[i].at<float>(y, x)) : uint16_t(0);
+      }
+    }
+    cv::imencode(".png", disparity, png, {cv::IMWRITE_PNG_COMPRESSION, 1});
+    codec.Encode(depths[i], valids[i], data);
+    double dense = double(depths[i].total()) * (sizeof(float) + 1);
+    dense_bytes += dense;
+    std::cout << std::setw(6) << i * kFrameStep << std::setw(10) << cv::countNonZero(valids[i]) << std::setw(12)
+              << size_t(dense) << std::setw(12) << png.size() << std::setw(12) << data.size() << std::setw(9)
+              << std::fixed << std::setprecision(1) << dense / double(data.size()) << "x" << std::endl;
+  }
+
+  // throughput of all frames per level
+  std::vector<std::vector<unsigned char>> encoded(depths.size());
+  cv::Mat decoded_depth, decoded_valid;
+  for (int level = odometry::kSimdScalar; level <= odometry::kSimdAvx512; level++){
+    const odometry::SimdKernels* k = odometry::GetSimdKernels(odometry::SimdLevel(level));
+    if (k == nullptr) continue;
+    odometry::SparseDepthCodec level_codec(odometry::kSparseDepthStep, k);
+    double encode_ms = TimeMs([&](){
+      for (size_t i = 0; i < depths.size(); i++) level_codec.Encode(depths[i], valids[i], encoded[i]);
+    }, reps);
+    double decode_ms = TimeMs([&](){
+      for (size_t i = 0; i < depths.size(); i++)
+        level_codec.Decode(encoded[i].data(), encoded[i].size(), decoded_depth, decoded_valid);
+    }, reps);
+    std::cout << "  " << std::left << std::setw(8) << k->name << std::right << std::fixed << std::setprecision(4)
+              << "encode " << std::setw(8) << encode_ms / depths.size() << " ms/frame " << std::setprecision(2)
+              << std::setw(6) << dense_bytes / encode_ms * 1e-6 << " GB/s   decode " << std::setprecision(4)
+              << std::setw(8) << decode_ms / depths.size() << " ms/frame " << std::setprecision(2) << std::setw(6)
+              << dense_bytes / decode_ms * 1e-6 << " GB/s" << std::endl;
+  }
+  return 0;
+}
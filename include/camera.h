@@ -65,6 +65,13 @@ class CameraPyramid{
     //  * -1 if failed; otherwise success
     GlobalStatus UndistortRectify(const cv::Mat& src_raw, cv::Mat& dst, int interpolation, int borderMode, const cv::Scalar& borderValue);
 
+    // row band of UndistortRectify() for the row-streaming stereo: only the rows [row_begin, row_end) of dst are
+    // written, dst MUST be allocated with the size of the rectified image and the type of src_raw
+    // Outputs:
+    //  * -1 if failed; otherwise success
+    GlobalStatus UndistortRectifyRows(const cv::Mat& src_raw, cv::Mat& dst, int row_begin, int row_end, int interpolation,
+                                      int borderMode, const cv::Scalar& borderValue);
+
     /*************** Accessor for rectified camera intrinsics ****************/
     float fx_float(int level){ return float(intrinsic_[level].at<double>(0, 0)); }  // unit: pixels, = fy
     float fy_float(int level){ return float(intrinsic_[level].at<double>(1, 1)); }  // unit: pixels, = fx
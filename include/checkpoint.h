@@ -0,0 +1,58 @@
+// The header file contains the checkpoints of the offline odometry: the state a run needs to continue a sequence after
+// a frame with the same results as without the interruption:
+//  * the current keyframe: image pyramid as stored (compact with kStorageUint8/kStorageFloat16), depth pyramid and
+//    valid mask, and the frames and absolute poses of all keyframes
+//  * the last frame: pyramids (frame to frame tracking, see TrackConcurrently()), pose, pose to the keyframe and frame
+//    to frame motion (motion prior)
+//  * the state of the pose optimizers, see LevenbergMarquardtOptimizer::State
+// The predicted trajectory is not part of it, it is in the trajectory log (see TrajectoryWriter), which has to be
+// flushed before the checkpoint is saved.
+// SaveCheckpoint() replaces the file atomically (temporary file, sync, rename): a crash while saving keeps the previous
+// checkpoint. File: kCheckpointMagic, then the fields in the order of OdometryCheckpoint, native byte order, images as
+// type, rows, cols and the rows of pixels.
+
+#ifndef ODOMETRY_CHECKPOINT_H
+#define ODOMETRY_CHECKPOINT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <data_types.h>
+#include <image_pyramid.h>
+#include <lm_optimizer.h>
+
+namespace odometry
+{
+
+// first bytes of a checkpoint file, the version in the last two
+const char kCheckpointMagic[8] = {'O', 'D', 'O', 'C', 'K', 'P', '0', '1'};
+
+struct OdometryCheckpoint{
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  int frame_id = 0;                      // last frame processed, a resumed run continues with frame_id + 1
+  std::vector<int> keyframe_ids;         // frame of each keyframe, the last one is the current keyframe
+  std::vector<Affine4f> keyframe_poses;  // camera to world of each keyframe
+  std::shared_ptr<ImagePyramid> keyframe_image;
+  std::shared_ptr<DepthPyramid> keyframe_depth;
+  cv::Mat keyframe_valid;                // CV_8U valid depth mask
+  std::shared_ptr<ImagePyramid> frame_image;
+  std::shared_ptr<DepthPyramid> frame_depth;
+  Affine4f pose = Affine4f::Identity();              // camera to world of frame_id
+  Affine4f pose_to_keyframe = Affine4f::Identity();  // as returned by the tracking against the current keyframe
+  Affine4f frame_motion = Affine4f::Identity();      // X_frame = frame_motion * X_previous_frame
+  LevenbergMarquardtOptimizer::State keyframe_tracking; // optimizer tracking against the keyframe
+  LevenbergMarquardtOptimizer::State frame_tracking;    // optimizer tracking against the previous frame
+};
+
+// write checkpoint to file_name, atomically, see above. the pyramids must be set
+// Return: -1 if the file can not be written, the previous one is kept; otherwise success
+GlobalStatus SaveCheckpoint(const std::string& file_name, const OdometryCheckpoint& checkpoint);
+
+// Return: -1 if the file can not be opened, is no checkpoint or is cut; otherwise success
+GlobalStatus LoadCheckpoint(const std::string& file_name, OdometryCheckpoint& checkpoint);
+
+} // namespace odometry
+
+#endif //ODOMETRY_CHECKPOINT_H
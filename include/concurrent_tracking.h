@@ -0,0 +1,37 @@
+// The header file contains the concurrent tracking of a frame against the current keyframe and the previous frame.
+// Right before a keyframe switch the overlap with the keyframe is low and its tracking is slow and fragile, while the
+// previous frame still overlaps well. Both optimizations run at once on DefaultThreadPool() (one solve of wall time if
+// the pool has at least 2 threads, serial otherwise) and the better result is chained into the pose to the keyframe.
+
+#ifndef ODOMETRY_CONCURRENT_TRACKING_H
+#define ODOMETRY_CONCURRENT_TRACKING_H
+
+#include <data_types.h>
+#include <image_pyramid.h>
+#include <lm_optimizer.h>
+
+namespace odometry
+{
+
+// the tracking chained into the trajectory
+enum TrackingSource{
+  kKeyframeTracking = 0, // current frame against the keyframe
+  kFrameTracking = 1     // current frame against the previous frame, chained with the pose of the previous frame
+};
+
+// track kImagePyrCur against the keyframe (keyframe_optimizer) and the previous frame (frame_optimizer), both reset by
+// the caller to their priors. the frame to frame result wins if the keyframe tracking failed, or if its final cost
+// (LevenbergMarquardtOptimizer::GetFinalCost()) is lower and it keeps at least min_residual_ratio of the keyframe
+// residuals. keyframe tracking is preferred otherwise, it does not accumulate drift. writes:
+//  - pose_to_keyframe: transform from the keyframe to the current frame (X_cur = T * X_keyframe), with
+//    kPreviousToKeyframe (X_pre = T * X_keyframe) for kFrameTracking
+// return the chosen source, kKeyframeTracking if both failed (identity, as LevenbergMarquardtOptimizer::Solve())
+TrackingSource TrackConcurrently(LevenbergMarquardtOptimizer& keyframe_optimizer, const ImagePyramid& kImagePyrKeyframe,
+                                 const DepthPyramid& kDepthPyrKeyframe, LevenbergMarquardtOptimizer& frame_optimizer,
+                                 const ImagePyramid& kImagePyrPre, const DepthPyramid& kDepthPyrPre,
+                                 const ImagePyramid& kImagePyrCur, const Affine4f& kPreviousToKeyframe,
+                                 float min_residual_ratio, Affine4f& pose_to_keyframe);
+
+} // namespace odometry
+
+#endif //ODOMETRY_CONCURRENT_TRACKING_H
@@ -0,0 +1,114 @@
+// The header file contains the debug output of the keyframes (image, valid mask, disparity) written by a background
+// thread, so the dumps can stay on during production runs without costing frame time:
+//  * AddKeyframe() shares the keyframe data (no pixel copies) into a bounded queue and returns. a full queue drops the
+//    keyframe (see Dropped()) instead of blocking the tracking
+//  * the background thread decodes the image, converts the inverse depth to disparities and writes the files. a
+//    failed write is reported and counted, it never stops the run
+//  * sampling: every keyframe_stride-th keyframe is written
+// Formats (DebugFormat), files <directory>/gray_img_left/<keyframe>.<ext>, mask_left/... and disparity_left/...:
+//  * kDebugRaw: each image as a raw plane (.raw): type, rows, cols as int32, then the rows of pixels. no compression,
+//    the fastest to write
+//  * kDebugPng: PNG with compression level 1 (.png), a few times faster than level 9 at slightly larger files
+//  * kDebugSparseDepth: the image as PNG level 1, mask and inverse depth in one file of the valid pixels only, encoded
+//    by SparseDepthCodec (disparity_left/<keyframe>.spd, about 30 KB per KITTI keyframe)
+// The disparities are fx * baseline * inverse depth in pixels, truncated to uint16, 0 where the mask is 0.
+// Usage:
+//   DebugWriterConfig config;
+//   config.directory = "../data/kitti_result";
+//   DebugWriter writer(config);
+//   writer.AddKeyframe(keyframe_index, image_pyramid, depth_pyramid, valid); // tracking thread, never blocks
+//   ...
+//   writer.Close();
+
+#ifndef ODOMETRY_DEBUG_WRITER_H
+#define ODOMETRY_DEBUG_WRITER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <data_types.h>
+#include <image_pyramid.h>
+#include <sparse_depth_codec.h>
+
+namespace odometry
+{
+
+enum DebugFormat{
+  kDebugRaw = 0,
+  kDebugPng = 1,
+  kDebugSparseDepth = 2
+};
+
+struct DebugWriterConfig{
+  std::string directory = "../data/kitti_result"; // with the sub directories gray_img_left, mask_left, disparity_left
+  DebugFormat format = kDebugPng;
+  int keyframe_stride = 1;             // write keyframes 0, stride, 2 * stride, ..., 0: none
+  int queue_size = 8;                  // keyframes queued at most, the next ones are dropped
+  float disparity_scale = 386.1448f;   // fx * baseline in pixels * meters, KITTI sequence 00
+};
+
+class DebugWriter{
+  public:
+    // disable default constructor explicitly
+    DebugWriter() = delete;
+
+    explicit DebugWriter(const DebugWriterConfig& config);
+
+    // Close()
+    ~DebugWriter();
+
+    // disable copy constructor
+    DebugWriter(const DebugWriter& ) = delete;
+
+    // disable copy assignment
+    DebugWriter& operator= (const DebugWriter& ) = delete;
+
+    // queue keyframe keyframe_index for writing, if it is sampled. the pyramids and valid share the pixels, they must
+    // not be changed afterwards (the keyframes never are)
+    // Return: -1 if the keyframe was dropped (full queue or closed writer); otherwise success, also if it is not sampled
+    GlobalStatus AddKeyframe(int keyframe_index, const ImagePyramid& image, const DepthPyramid& depth,
+                             const cv::Mat& valid);
+
+    // write the queued keyframes and stop the background thread. the writer drops the keyframes added afterwards
+    // Return: -1 if a write failed; otherwise success
+    GlobalStatus Close();
+
+    // keyframes written, dropped by a full queue
+    uint64_t Written() const;
+    uint64_t Dropped() const;
+
+  private:
+    struct Keyframe{
+      int index;
+      std::shared_ptr<ImagePyramid> image;
+      std::shared_ptr<DepthPyramid> depth;
+      cv::Mat valid;
+    };
+
+    void WriteLoop();
+
+    // convert and write the files of keyframe, called by the background thread without the lock
+    GlobalStatus WriteKeyframe(const Keyframe& keyframe);
+
+    DebugWriterConfig config_;
+    SparseDepthCodec codec_;             // used by the background thread only
+    std::vector<unsigned char> encoded_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Keyframe> queue_;
+    uint64_t written_ = 0;
+    uint64_t dropped_ = 0;
+    bool failed_ = false;
+    bool stopped_ = false;
+    std::thread write_thread_;
+};
+
+} // namespace odometry
+
+#endif //ODOMETRY_DEBUG_WRITER_H
@@ -11,15 +11,31 @@
 #include <opencv2/highgui.hpp>
 #include <opencv2/calib3d.hpp>
 #include <math.h>
+#include <ctime>
+#include <functional>
 #include <iostream>
 #include "camera.h"
-#include <immintrin.h> // AVX instruction set
-#include <pmmintrin.h> // SSE3
-#include <xmmintrin.h> // SSE
+#include <simd_dispatch.h>
 
 namespace odometry
 {
 
+// disparity search of the selected points in DepthEstimator::ComputeDepth()
+enum DisparitySearch{
+  kEpipolarSearch = 0,  // brute force search along the whole epipolar line, cost grows with the disparity range (default)
+  kPatchMatchSearch = 1 // PatchMatch over the selected points, cost per point almost independent of the disparity range
+};
+
+// half width of the dispatched window search ending every PatchMatch iteration, in pixels
+const int kPatchMatchWindow = 4;
+
+// points are selected per block of a kDepthBlockRows x kDepthBlockCols grid over the image
+const int kDepthBlockRows = 16;
+const int kDepthBlockCols = 32;
+
+// rows rectified at once by DepthEstimator::ComputeDepthStreaming()
+const int kStreamingBandRows = 8;
+
 // NOTE that all input/output (or intermediate) images MUST be aligned against 32bit address
 class DepthEstimator{
   public:
@@ -50,9 +66,29 @@ class DepthEstimator{
     // Return: -1 if failed; otherwise success
     GlobalStatus ComputeDepth(const cv::Mat& left_img, const cv::Mat& right_img, cv::Mat& left_val, cv::Mat& left_disp, cv::Mat& left_dep);
 
+    // row-streaming variant of ComputeDepth() for raw camera images: the rows are rectified in bands of
+    // kStreamingBandRows (CameraPyramid::UndistortRectifyRows()), smoothed into a rolling window of a block row + 4 rows,
+    // and the points of a block row are selected and matched as soon as the window holds it. only the window and the
+    // gradients of one block row are touched between the bands, the full frame smoothed images are never built.
+    // INPUT: raw images, rectified already if the cameras are null (e.g. KITTI)
+    // OUTPUT:
+    //       * rectified images left_rect, right_rect (shallow copies of the inputs if the cameras are null)
+    //       * same left_val, left_disp, left_dep as ComputeDepth(), i.e. after the depth refinement of the whole frame
+    //       * rows_done(row_begin, row_end): optional, called in order as soon as the disparities of the rows are final
+    // Return: -1 if failed or with kPatchMatchSearch (it propagates over the whole frame); otherwise success
+    GlobalStatus ComputeDepthStreaming(const cv::Mat& left_raw, const cv::Mat& right_raw, cv::Mat& left_rect, cv::Mat& right_rect,
+                                       cv::Mat& left_val, cv::Mat& left_disp, cv::Mat& left_dep,
+                                       const std::function<void(int, int)>& rows_done = nullptr);
+
     // report optimizer status after computation
     void ReportStatus();
 
+    // select the disparity search. kPatchMatchSearch: random disparities within the depth bounds for every point, then
+    // iterations of spatial propagation (scan direction alternating per iteration) and refinement, with the same 8 point
+    // pattern cost as kEpipolarSearch. it selects up to max_residuals / 512 points per block instead of 80, i.e.
+    // near-dense depth. return -1 if iterations < 1
+    GlobalStatus SetDisparitySearch(DisparitySearch search, int iterations = 3);
+
   private:
 
     /************************************* Private data **************************************************/
@@ -73,6 +109,8 @@ class DepthEstimator{
     float lambda_;  // do not change it
     float precision_;
     int max_iters_;
+    DisparitySearch disparity_search_;
+    int patch_match_iters_;
     int iters_stat_;  // reset to 0 before each call automatically
     float cost_stat_; // reset to 0 before each call automatically
 
@@ -92,6 +130,27 @@ class DepthEstimator{
     //    * -1 if failed
     GlobalStatus DisparityDepthEstimate(const cv::Mat& left_rect, const cv::Mat& right_rect, cv::Mat& left_disp, cv::Mat& left_dep, cv::Mat& left_val);
 
+    // pointer to the smoothed row y, of the whole image or of the rolling window of ComputeDepthStreaming()
+    typedef std::function<const float*(int)> RowFn;
+
+    // select the points of the blocks in block row block_row into left_val, reads the smoothed rows of the block row
+    // and one row above and below
+    void SelectBlockRow(const RowFn& left_rows, int cols, int block_row, cv::Mat& left_val);
+
+    // kEpipolarSearch impl for the points of the rows [y_begin, y_end), reads the smoothed rows y_begin-2 .. y_end+1
+    void EpipolarSearchRows(const RowFn& left_rows, const RowFn& right_rows, int y_begin, int y_end, cv::Mat& left_disp,
+                            cv::Mat& left_dep, cv::Mat& left_val);
+
+    // kPatchMatchSearch impl of the search in DisparityDepthEstimate(): rows of one parity are processed in parallel
+    // (red-black rows) while the rows of the other parity are fixed. writes the disparity and inverse depth of the
+    // points of left_val, unset left_val if the ssd is larger than ssd_th_
+    void PatchMatchSearch(const cv::Mat& left_rect, const cv::Mat& right_rect, cv::Mat& left_disp, cv::Mat& left_dep, cv::Mat& left_val);
+
+    // depth refinement of ComputeDepth() and ComputeDepthStreaming() after the disparity search, with the stage metrics
+    // and the log of the time since begin
+    GlobalStatus RefineDepth(const cv::Mat& left_rect, const cv::Mat& right_rect, cv::Mat& left_val, cv::Mat& left_dep,
+                             clock_t begin);
+
     // depth optimization after initial disparity search, no pyramid
     // Parameter list:
     //  * rectified left img
@@ -99,10 +158,14 @@ class DepthEstimator{
     //  * left depth map (changed after optimization)
     //  * left valid map (changed after optimization)
     GlobalStatus DepthOptimization(const cv::Mat& left_rect, const cv::Mat& right_rect, cv::Mat& left_dep, cv::Mat& left_val);
+    // residuals of the 8 point pattern around every point at the continuous (sub-pixel) warped position, and the
+    // diagonal normal equations jtwj, b = -J^T W r and energy = r^T W r per point, err_now: mean energy of valid points.
+    // residuals: mean absolute photometric residual per point, -1000 if the point warps out of the image
     GlobalStatus ComputeResidualJacobian(const Eigen::Matrix<float, Eigen::Dynamic, 1>& tmp_depth,
-                                         const std::vector<std::pair<int, int>>& coord_vec,
-                                         Eigen::DiagonalMatrix<float, Eigen::Dynamic>& jtwj, Eigen::Matrix<float, Eigen::Dynamic, 1>& b,
-                                         float& err_now, const int num_residuals, const cv::Mat& left_img, const cv::Mat& right_img,
+                                         const std::vector<int>& xs, const std::vector<int>& ys,
+                                         Eigen::Matrix<float, Eigen::Dynamic, 1>& jtwj, Eigen::Matrix<float, Eigen::Dynamic, 1>& b,
+                                         Eigen::Matrix<float, Eigen::Dynamic, 1>& energy, float& err_now, const int num_residuals,
+                                         const cv::Mat& left_img, const cv::Mat& right_img,
                                          Eigen::Matrix<float, Eigen::Dynamic, 1>& residuals);
 
     // compute ssd error 5x5 given all the image row pointers
@@ -113,9 +176,6 @@ class DepthEstimator{
     inline float ComputeSsdPattern8(const float* left_pp_row_ptr, const float* left_p_row_ptr, const float* left_row_ptr, const float* left_n_row_ptr, const float* left_nn_row_ptr,
                              const float* right_pp_row_ptr, const float* right_p_row_ptr, const float* right_row_ptr, const float* right_n_row_ptr, const float* right_nn_row_ptr,
                              int left_x, int right_x);
-    // compute ssd error using path pattern from DSO paper, use sse impl.
-    inline void ComputeSsdPattern8Sse(const __m256& left_pattern, const float* right_pp_row_ptr, const float* right_p_row_ptr,
-                                                const float* right_row_ptr, const float* right_n_row_ptr, const float* right_nn_row_ptr, int x, float* result);
     // compute ssd error along one-dim epl
     inline float ComputeSsdLine(const float* left_row_ptr, const float* right_row_ptr, int left_x, int right_x);
 };
@@ -27,13 +27,31 @@ inline float GetCxLevel(float cx, int level){
   return new_cx;
 }
 
+inline float GetCyLevel(float cy, int level){
+  return GetCxLevel(cy, level);
+}
+
+// camera intrinsics of a pyramid level as {fx, fy, cx, cy}, those of KITTI sequence 00 without a camera (nullptr)
+inline void GetCameraLevel(const std::shared_ptr<CameraPyramid>& kCameraPtr, int level, float* camera){
+  if (kCameraPtr != nullptr){
+    camera[0] = kCameraPtr->fx_float(level);
+    camera[1] = kCameraPtr->fy_float(level);
+    camera[2] = kCameraPtr->cx_float(level);
+    camera[3] = kCameraPtr->cy_float(level);
+    return;
+  }
+  camera[0] = 718.856f / std::pow(2.0f, level);
+  camera[1] = camera[0];
+  camera[2] = GetCxLevel(607.1928f, level);
+  camera[3] = GetCyLevel(185.2157f, level);
+}
+
 // inlined function to re-project pixel-coord to current camera's 3d coord, assuming a valid depth value!
 inline void ReprojectToCameraFrame(const Vector4f& kIn_coord, const std::shared_ptr<CameraPyramid>& kCameraPtr, Vector4f& out_3d, int level){
-  // TODO: only for debug now
-//  out_3d(0) = kIn_coord(2) * (kIn_coord(0) - kCameraPtr->cx(level)) / kCameraPtr->fx(level);
-//  out_3d(1) = kIn_coord(2) * (kIn_coord(1) - kCameraPtr->cy(level)) / kCameraPtr->fy(level);
-  out_3d(0) = kIn_coord(2) * (kIn_coord(0) - GetCxLevel(607.1928, level)) / (718.856f / std::pow(2.0f, level));
-  out_3d(1) = kIn_coord(2) * (kIn_coord(1) - GetCxLevel(185.2157, level)) / (718.856f / std::pow(2.0f, level));
+  float camera[4];
+  GetCameraLevel(kCameraPtr, level, camera);
+  out_3d(0) = kIn_coord(2) * (kIn_coord(0) - camera[2]) / camera[0];
+  out_3d(1) = kIn_coord(2) * (kIn_coord(1) - camera[3]) / camera[1];
   out_3d(2) = kIn_coord(2);
   out_3d(3) = 1.0;
 }
@@ -44,11 +62,10 @@ inline GlobalStatus WarpPixel(const Vector4f& kIn_3d, const Affine4f& kTranform,
   right_3d = tmp;
   if (right_3d(2) <= 0.0f)
     return -1;
-  // TODO: only for debug now
-  //out_coord(0) = kCameraPtr->fx(level) * tmp(0) / tmp(2) + kCameraPtr->cx(level);
-  //out_coord(1) = kCameraPtr->fy(level) * tmp(1) / tmp(2) + kCameraPtr->cy(level);
-  out_coord(0) = (718.856f / std::pow(2.0f, level)) * tmp(0) / tmp(2) + GetCxLevel(607.1928, level);
-  out_coord(1) = (718.856f / std::pow(2.0f, level)) * tmp(1) / tmp(2) + GetCxLevel(185.2157, level);
+  float camera[4];
+  GetCameraLevel(kCameraPtr, level, camera);
+  out_coord(0) = camera[0] * tmp(0) / tmp(2) + camera[2];
+  out_coord(1) = camera[1] * tmp(1) / tmp(2) + camera[3];
   out_coord(2) = tmp(2);
   out_coord(3) = 1.0;
   if (std::floor(out_coord(0)) >= float(Width) || std::floor(out_coord(1)) >= float(Height)
@@ -94,11 +111,19 @@ GlobalStatus MedianDepthPyramidNaive(int num_levels, const cv::Mat& in_img, std:
 GlobalStatus MedianDepthPyramidSse(int num_levels, const cv::Mat& in_img, std::vector<cv::Mat>& out_pyramids, bool smooth);
 void PyramidDownSse(cv::Mat& in_img, cv::Mat& out_img, int rows, int cols);
 
-// TODO: using native c++ for loop combined with openmp to warp entire image
-void WarpImageNative(const cv::Mat& img_in, const Affine4f& kTransMat, cv::Mat& warped_img);
-// TODO: using sse to warp entire image
-void WarpImageSse(const cv::Mat& img_in, const Affine4f& kTransMat, cv::Mat& warped_img);
-
+// warp the entire image 2 into the frame of camera 1: warped(p) = img2(warp(p)) for every pixel p of camera 1 with a valid
+// (> 0) inverse depth, used for residual images, view prediction and validating tracking results
+//  * img2: image of camera 2, inv_depth1: inverse depth of camera 1, same size, CV_32F, continuous
+//  * kTransMat: transform from camera 1 to camera 2, level: pyramid level of the images (selects the intrinsics)
+//  * warped_img: (re-)allocated to the size of img2; bilinear sample of img2, or kWarpInvalid (see simd_dispatch.h) if
+//    the pixel has no depth, warps out of img2 or is occluded by a nearer point warped onto the same pixel (z-test)
+// both run row-parallel on DefaultThreadPool(), return status: -1 failed, otherwise success
+// native c++ reference implementation
+GlobalStatus WarpImageNative(const cv::Mat& img2, const cv::Mat& inv_depth1, const Affine4f& kTransMat,
+                             const std::shared_ptr<CameraPyramid>& kCameraPtr, int level, cv::Mat& warped_img);
+// SIMD implementation: dispatched kernels, see SimdKernels::warp_depth_splat/warp_image
+GlobalStatus WarpImageSse(const cv::Mat& img2, const cv::Mat& inv_depth1, const Affine4f& kTransMat,
+                          const std::shared_ptr<CameraPyramid>& kCameraPtr, int level, cv::Mat& warped_img);
 
 } // namespace odometry
 
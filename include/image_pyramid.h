@@ -11,6 +11,14 @@
 namespace odometry
 {
 
+// storage type of the image pyramid levels. tracking is bound by memory bandwidth at the fine levels, the compact types
+// cut the bytes read per pixel (and the footprint of the stored keyframes), the kernels convert to float in registers
+enum PyramidStorage{
+  kStorageFloat32 = 0, // CV_32F (PixelType), default
+  kStorageUint8 = 1,   // CV_8U, intensities rounded and saturated to [0, 255]: abs error <= 0.5
+  kStorageFloat16 = 2  // CV_16U holding IEEE half floats (Float16): relative error <= 2^-11, i.e. <= 0.125 below 256
+};
+
 class ImagePyramid{
   public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -18,10 +26,15 @@ class ImagePyramid{
     // disable default constructor explicitly
     ImagePyramid() = delete;
 
-    // parameterized constructor, the last argument indicates whether or not to smooth the level0 (default = true):
+    // parameterized constructor, the argument smooth indicates whether or not to smooth the level0 (default = true):
     // if the input image is already de-noised, then it should be set to false
     // if the input image is not de-nosied, then it is recommended to be set to true
-    ImagePyramid(int num_levels, const cv::Mat& in_img, bool smooth);
+    // the levels are computed in float and converted to storage afterwards
+    ImagePyramid(int num_levels, const cv::Mat& in_img, bool smooth, PyramidStorage storage = kStorageFloat32);
+
+    // constructor from the levels as stored (see GetPyramidData()), e.g. of a checkpoint. the levels are copied, the
+    // compact ones with a new padding row
+    ImagePyramid(const std::vector<cv::Mat>& levels, PyramidStorage storage);
 
     // disable copy constructor for now
     // ImagePyramid(const ImagePyramid& ) = delete;
@@ -32,11 +45,22 @@ class ImagePyramid{
     // get total number of pyramid levels, by default inline
     int GetNumberLevels() const{return num_levels_;};
 
-    // get the image from the corresponding pyramid level, return as const reference
+    // get the storage type of the levels
+    PyramidStorage GetStorage() const{return storage_;};
+
+    // get the image from the corresponding pyramid level, return as const reference. float storage only, see
+    // GetPyramidData() and DecodePyramidImage() for the compact ones
     const cv::Mat& GetPyramidImage(int level_idx) const;
 
+    // get the level as stored: CV_32F, CV_8U or CV_16U (Float16) with one padding row behind the last one
+    const cv::Mat& GetPyramidData(int level_idx) const;
+
+    // decode the level to a new CV_32F image, for any storage
+    void DecodePyramidImage(int level_idx, cv::Mat& out_img) const;
+
   private:
     int num_levels_; // total number of pyramid levels, default to 4
+    PyramidStorage storage_;
     std::vector<cv::Mat> pyramid_imgs_; // vector of pyramid images, store the actual data, not pointers/reference
 };
 
@@ -50,6 +74,9 @@ class DepthPyramid{
     // parameterized constructor, the last argument smooth has the meaning as in ImagePyramid
     DepthPyramid(int num_levels, const cv::Mat& in_depth, bool smooth);
 
+    // constructor from the levels (see GetPyramidDepth()), e.g. of a checkpoint. the levels are copied
+    explicit DepthPyramid(const std::vector<cv::Mat>& levels);
+
     // disable copy constructor for now
     //DepthPyramid(const DepthPyramid& ) = delete;
 
@@ -0,0 +1,80 @@
+// The header file contains the inertial motion prior of the pose tracking: recorded IMU streams (EuRoC csv) and the
+// preintegration of the gyroscope and accelerometer readings between two camera frames. The preintegrated rotation,
+// and optionally translation, seed LevenbergMarquardtOptimizer instead of the last relative pose.
+
+#ifndef ODOMETRY_IMU_PREINTEGRATION_H
+#define ODOMETRY_IMU_PREINTEGRATION_H
+
+#include <string>
+#include <vector>
+#include <Eigen/Core>
+#include <so3.hpp>
+#include <data_types.h>
+
+namespace odometry
+{
+
+// one IMU reading in the IMU frame
+struct ImuSample{
+  double timestamp; // [s]
+  Eigen::Vector3f gyro; // angular velocity [rad/s]
+  Eigen::Vector3f accel; // specific force [m/s^2]
+};
+
+// read a recorded IMU stream in the EuRoC csv format: timestamp [ns], w_x, w_y, w_z [rad/s], a_x, a_y, a_z [m/s^2] per
+// line, lines starting with '#' are comments. return -1 if the file can not be opened, a line has less than 7 values or
+// the timestamps are not increasing, samples is then empty
+GlobalStatus ReadImuCsv(const std::string& file_name, std::vector<ImuSample>& samples);
+
+// read the frame timestamps [s], one per line (KITTI times.txt), return -1 if the file can not be opened
+GlobalStatus ReadFrameTimestamps(const std::string& file_name, std::vector<double>& timestamps);
+
+class ImuPreintegrator{
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    // disable default constructor explicitly
+    ImuPreintegrator() = delete;
+
+    // parameterized constructor:
+    //  - kCamImu: transform from the IMU to the (left) camera frame, X_cam = kCamImu * X_imu (Kalibr: T_cam_imu)
+    //  - kGyroBias, kAccelBias: constant biases subtracted from the readings
+    ImuPreintegrator(const Affine4f& kCamImu, const Eigen::Vector3f& kGyroBias, const Eigen::Vector3f& kAccelBias);
+
+    // preintegrate the readings between the frame timestamps t0 < t1, kSamples sorted by time. the readings at t0 and t1
+    // are interpolated linearly, the mean of two consecutive readings is held over each step. return status:
+    // if -1: [t0, t1] is not covered by kSamples, the previous preintegration is kept
+    // otherwise: success
+    GlobalStatus Integrate(const std::vector<ImuSample>& kSamples, double t0, double t1);
+
+    // transform from the camera frame at t0 to the camera frame at t1 (X_1 = T * X_0, as LevenbergMarquardtOptimizer)
+    // with the preintegrated rotation and the translation of kMotionPrior, e.g. the last frame to frame motion
+    Affine4f PredictCameraMotion(const Affine4f& kMotionPrior) const;
+
+    // as above, the translation is preintegrated, too: kVelocity and kGravity are the velocity [m/s] and the gravity
+    // [m/s^2] in the IMU frame at t0
+    Affine4f PredictCameraMotion(const Eigen::Vector3f& kVelocity, const Eigen::Vector3f& kGravity) const;
+
+    // preintegrated rotation, velocity and position of the IMU frame at t1 in the IMU frame at t0, without gravity and
+    // initial velocity
+    const Sophus::SO3<float>& GetDeltaRotation() const{return delta_rotation_;};
+    const Eigen::Vector3f& GetDeltaVelocity() const{return delta_velocity_;};
+    const Eigen::Vector3f& GetDeltaPosition() const{return delta_position_;};
+    double GetDeltaTime() const{return delta_time_;};
+
+  private:
+    // transform X_1 = T * X_0 of the camera frames from the pose of the IMU frame at t1 in the IMU frame at t0
+    Affine4f CameraMotion(const Sophus::SO3<float>& kRotation, const Eigen::Vector3f& kPosition) const;
+
+    Affine4f cam_imu_;
+    Eigen::Vector3f gyro_bias_;
+    Eigen::Vector3f accel_bias_;
+    Sophus::SO3<float> delta_rotation_;
+    Eigen::Vector3f delta_velocity_;
+    Eigen::Vector3f delta_position_;
+    double delta_time_;
+};
+
+} // namespace odometry
+
+#endif //ODOMETRY_IMU_PREINTEGRATION_H
@@ -17,14 +17,29 @@
 #include <data_types.h>
 #include <image_pyramid.h>
 #include <camera.h>
+#include <pose_initializer.h>
 
 namespace odometry
 {
 
+// residuals of the pose tracking
+enum TrackingResiduals{
+  kDenseResiduals = 0,   // one residual per pixel with a valid inverse depth (default)
+  kPattern8Residuals = 1 // 8 point pattern (kPattern8) residuals around sparse anchor pixels, one warp per anchor
+};
+
 class LevenbergMarquardtOptimizer{
   public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
+    // the state carried from one Solve() to the next, e.g. for checkpoints: SetState() of a saved state continues as
+    // the optimizer it was taken from
+    struct State{
+      Affine4f affine_init;  // initial pose of the next Solve(), see Reset()
+      float lambda;          // damping factor of the next Solve(), see Reset()
+      bool prior_uncertain;  // the next Solve() starts from a seed, see SetPoseInitializer()
+    };
+
     // disable default constructor explicitly
     LevenbergMarquardtOptimizer() = delete;
 
@@ -53,12 +68,32 @@ class LevenbergMarquardtOptimizer{
     // return -1 if reset failed, otherwise success
     OptimizerStatus Reset(const Affine4f& kRelativeInit, const float lambda);
 
+    // get/set the state carried to the next Solve(), see State
+    State GetState() const;
+    void SetState(const State& kState);
+
+    // select the tracking residuals, kPattern8Residuals takes the pixel with the largest gradient among the pixels with
+    // a valid inverse depth in each anchor_cell x anchor_cell cell of every level as anchor: anchor_cell^2 times fewer
+    // warps per iteration than kDenseResiduals. return -1 if anchor_cell < 3 (more residuals than pixels)
+    OptimizerStatus SetTrackingResiduals(TrackingResiduals residuals, int anchor_cell = 3);
+
+    // optional feature based pre-alignment for large motions (nullptr: disabled, default). it only runs when the motion
+    // prior is uncertain, i.e. the optimization ended with a mean cost of the coarsest level above max_coarse_cost (the
+    // optimization from the prior landed in a wrong minimum) or failed: then the optimization is repeated once from the
+    // seed of kInitializer, and the next Solve() starts from a seed, too
+    OptimizerStatus SetPoseInitializer(const std::shared_ptr<PoseInitializer>& kInitializer, float max_coarse_cost = 100.0f);
+
+    // quality of the last Solve(): mean cost and number of residuals of the finest level, i.e. the pixels warped into
+    // the second image. FLT_MAX and 0 if the optimization failed
+    float GetFinalCost() const{return final_cost_;};
+    int GetNumResiduals() const{return final_residuals_;};
+
   private:
     // the function that actually solves the optimization, return status:
     // if -1: failed, throw err, optimization terminate
     // otherwise: success
     OptimizerStatus OptimizeCameraPose(const ImagePyramid& kImagePyr1, const DepthPyramid& kDepthPyr1, const ImagePyramid& kImagePyr2);
-    // sse implementation, highly optimized for speed
+    // sse implementation, highly optimized for speed. the only one supporting compact pyramids (see PyramidStorage)
     OptimizerStatus OptimizeCameraPoseSse(const ImagePyramid& kImagePyr1, const DepthPyramid& kDepthPyr1, const ImagePyramid& kImagePyr2);
 
     // compute jacobians, weights, residuals and number of residuals, return status:
@@ -72,6 +107,9 @@ class LevenbergMarquardtOptimizer{
                                                   int& num_residual,
                                                   int level);
 
+    // compute the weights of the first num_residual residuals according to robust_est_
+    void ComputeWeights(const Eigen::VectorXf& residual, const int num_residual, Eigen::DiagonalMatrix<float, Eigen::Dynamic>& weight);
+
     // compute residual weighting scale naive implementation
     float ComputeScaleNaive(const Eigen::VectorXf& residual, const int num_residual);
 
@@ -79,13 +117,30 @@ class LevenbergMarquardtOptimizer{
     float ComputeScaleSse(const Eigen::VectorXf& residual, const int num_residual);
 
 
-    // SSE impl, highly optimized
+    // SIMD impl, highly optimized: dispatched kernel, vectorized over the pixels of a row.
+    // the outputs are pre-allocated to the size of the image and never resized, only the first num_residual are valid
     OptimizerStatus ComputeResidualJacobianSse(const cv::Mat& kImg1, const cv::Mat& kImg2, const cv::Mat& kDep1, const Affine4f& kTransform,
                                                 Eigen::Matrix<float, Eigen::Dynamic, 6>& jaco,
-                                                Eigen::DiagonalMatrix<float, Eigen::Dynamic, Eigen::Dynamic>& weight,
-                                                Eigen::VectorXf& residual,
-                                                int& num_residual);
+                                                Eigen::DiagonalMatrix<float, Eigen::Dynamic>& weight,
+                                                Eigen::Matrix<float, Eigen::Dynamic, 1>& residual,
+                                                int& num_residual,
+                                                int level);
+
 
+    // kPattern8Residuals impl: dispatched kernel over the anchors selected by SelectPatternAnchors() for the level,
+    // outputs as ComputeResidualJacobianSse()
+    OptimizerStatus ComputeResidualJacobianPattern8(const cv::Mat& kImg1, const cv::Mat& kImg2, const Affine4f& kTransform,
+                                                     Eigen::Matrix<float, Eigen::Dynamic, 6>& jaco,
+                                                     Eigen::DiagonalMatrix<float, Eigen::Dynamic>& weight,
+                                                     Eigen::Matrix<float, Eigen::Dynamic, 1>& residual,
+                                                     int& num_residual,
+                                                     int level);
+
+    // replace affine_init_ by the seed of pose_initializer_, return false if it was rejected
+    bool SeedInitialAffine(const ImagePyramid& kImagePyr1, const DepthPyramid& kDepthPyr1, const ImagePyramid& kImagePyr2);
+
+    // fill anchor_xs_, anchor_ys_, anchor_inv_depth_ for one pyramid level
+    void SelectPatternAnchors(const cv::Mat& kImg1, const cv::Mat& kDep1);
 
     void SetIdentityTransform(Affine4f& in_mat);
 
@@ -109,6 +164,22 @@ class LevenbergMarquardtOptimizer{
     int robust_est_; // 0: no robust, 1: huber, 2: t-dist
     float huber_delta_;
 
+    /************************************** TRACKING RESIDUALS ********************************************/
+    TrackingResiduals tracking_residuals_;
+    int anchor_cell_; // cell size of the anchor selection in pixels, kPattern8Residuals only
+    std::vector<int> anchor_xs_; // anchors of the current pyramid level
+    std::vector<int> anchor_ys_;
+    std::vector<float> anchor_inv_depth_;
+
+    /************************************** POSE INITIALIZATION ********************************************/
+    std::shared_ptr<PoseInitializer> pose_initializer_;
+    float max_coarse_cost_;
+    float coarse_cost_; // mean cost of the coarsest level at the end of the last optimization
+    bool prior_uncertain_; // the next prior is uncertain, see SetPoseInitializer()
+
+    float final_cost_; // see GetFinalCost()
+    int final_residuals_;
+
     // shared pointer to the left camera. note that the pointer MUST point to one global camera instance
     // during the entire lifetime of the program
     std::shared_ptr<CameraPyramid> camera_ptr_;
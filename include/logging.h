@@ -0,0 +1,194 @@
+// The header file contains a low overhead asynchronous logging facility for the hot paths (per frame/per stage messages).
+// A log call only encodes its arguments as a binary record into a lock-free single-producer/single-consumer ring buffer
+// owned by the calling thread, no formatting, no lock and no syscall. A background thread drains all rings, formats
+// the records and writes them in batches to stdout.
+//  * levels below ODOMETRY_LOG_LEVEL are removed at compile time, e.g. -DODOMETRY_LOG_LEVEL=2 keeps INFO and above
+//  * the format string must be a string literal, "{}" is replaced by the next argument
+//  * arguments: integers, floating points, bool, const char* and std::string (strings are copied, up to 127 bytes in total)
+//  * if a ring is full the record is dropped and counted, the logging thread never blocks the caller
+//  * a ring is returned to the logger when its thread exits and reused by the next new thread, records logged by
+//    thread_local destructors after that are dropped
+// Usage:
+//   LOG_INFO("valid depth at level {}: {}", l, num_valid);
+//   logging::Flush(); // e.g. before exit(), the remaining records are also flushed at normal program termination
+
+#ifndef ODOMETRY_LOGGING_H
+#define ODOMETRY_LOGGING_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#ifndef ODOMETRY_LOG_LEVEL
+#define ODOMETRY_LOG_LEVEL 1 // debug
+#endif
+
+namespace odometry
+{
+namespace logging
+{
+
+enum LogLevel{
+  kLogTrace = 0,
+  kLogDebug = 1,
+  kLogInfo = 2,
+  kLogWarn = 3,
+  kLogError = 4
+};
+
+const int kMaxLogArgs = 8;
+const int kLogTextBytes = 128;
+
+// one argument of a record, the type tag tells the formatter how to print it
+struct LogArg{
+  enum Type : uint8_t { kInt, kUInt, kDouble, kBool, kText } type;
+  union {
+    int64_t i;
+    uint64_t u;
+    double d;
+    uint32_t text_offset; // into LogRecord::text, zero terminated
+  };
+};
+
+// binary record, fixed size, written by the producer thread only
+struct LogRecord{
+  uint64_t time_ns; // since the logger started
+  const char* format; // string literal, never copied
+  const char* file;
+  int line;
+  uint8_t level;
+  uint8_t num_args;
+  uint16_t text_used;
+  LogArg args[kMaxLogArgs];
+  char text[kLogTextBytes];
+};
+
+// per thread ring buffer, power of two capacity: 256 records (72 KB), drained every 2 ms
+class LogRing{
+  public:
+    static const uint64_t kCapacity = 256;
+
+    // producer side: reserve the next slot, nullptr if the ring is full
+    LogRecord* Reserve(){
+      uint64_t head = head_.load(std::memory_order_relaxed);
+      if (head - tail_.load(std::memory_order_acquire) >= kCapacity){
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      }
+      return &records_[head & (kCapacity - 1)];
+    }
+    // producer side: publish the slot returned by Reserve()
+    void Commit(){ head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    // consumer side: the oldest unread record, nullptr if empty
+    const LogRecord* Front(){
+      uint64_t tail = tail_.load(std::memory_order_relaxed);
+      if (tail == head_.load(std::memory_order_acquire)) return nullptr;
+      return &records_[tail & (kCapacity - 1)];
+    }
+    void Pop(){ tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+    uint64_t TakeDropped(){ return dropped_.exchange(0, std::memory_order_relaxed); }
+    uint64_t Dropped() const{ return dropped_.load(std::memory_order_relaxed); }
+
+    int thread_id_ = 0;
+
+  private:
+    // producer and consumer indices on separate cache lines (padding instead of alignas: no aligned new in C++14)
+    std::atomic<uint64_t> head_{0};
+    char pad0_[64];
+    std::atomic<uint64_t> tail_{0};
+    char pad1_[64];
+    std::atomic<uint64_t> dropped_{0};
+    char pad2_[64];
+    LogRecord records_[kCapacity];
+};
+
+// the ring of the calling thread, registered with the background thread on the first call; nullptr once the thread
+// exits and its ring is returned
+LogRing* ThreadRing();
+// nano seconds since the logger started, steady clock
+uint64_t NowNs();
+// block until every record committed before the call is written (or dropped)
+void Flush();
+// name of a level, e.g. "INFO"
+const char* LevelName(int level);
+
+/********************************************* Argument encoding ***************************************************/
+inline void CopyText(LogRecord& record, LogArg& arg, const char* text, size_t length){
+  size_t room = kLogTextBytes - record.text_used;
+  if (room == 0){ // no room left: point to the terminating zero of the previous text
+    arg.text_offset = kLogTextBytes - 1;
+    return;
+  }
+  if (length >= room) length = room - 1;
+  memcpy(record.text + record.text_used, text, length);
+  record.text[record.text_used + length] = '\0';
+  arg.text_offset = record.text_used;
+  record.text_used = uint16_t(record.text_used + length + 1);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+EncodeArg(LogRecord&, LogArg& arg, T value){ arg.type = LogArg::kInt; arg.i = value; }
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+EncodeArg(LogRecord&, LogArg& arg, T value){ arg.type = LogArg::kUInt; arg.u = value; }
+
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value>::type
+EncodeArg(LogRecord&, LogArg& arg, T value){ arg.type = LogArg::kDouble; arg.d = value; }
+
+inline void EncodeArg(LogRecord&, LogArg& arg, bool value){ arg.type = LogArg::kBool; arg.u = value ? 1 : 0; }
+
+inline void EncodeArg(LogRecord& record, LogArg& arg, const char* value){
+  arg.type = LogArg::kText;
+  CopyText(record, arg, value != nullptr ? value : "(null)", value != nullptr ? strlen(value) : 6);
+}
+
+inline void EncodeArg(LogRecord& record, LogArg& arg, const std::string& value){
+  arg.type = LogArg::kText;
+  CopyText(record, arg, value.data(), value.size());
+}
+
+inline void EncodeArgs(LogRecord&, int){}
+
+template <typename T, typename... Rest>
+inline void EncodeArgs(LogRecord& record, int idx, const T& value, const Rest&... rest){
+  EncodeArg(record, record.args[idx], value);
+  EncodeArgs(record, idx + 1, rest...);
+}
+
+template <typename... Args>
+inline void Log(int level, const char* file, int line, const char* format, const Args&... args){
+  static_assert(sizeof...(Args) <= kMaxLogArgs, "too many log arguments");
+  LogRing* ring = ThreadRing();
+  if (ring == nullptr) return;
+  LogRecord* record = ring->Reserve();
+  if (record == nullptr) return;
+  record->time_ns = NowNs();
+  record->format = format;
+  record->file = file;
+  record->line = line;
+  record->level = uint8_t(level);
+  record->num_args = uint8_t(sizeof...(Args));
+  record->text_used = 0;
+  EncodeArgs(*record, 0, args...);
+  ring->Commit();
+}
+
+} // namespace logging
+} // namespace odometry
+
+// compile-time filtered logging macros, the arguments are not evaluated if the level is filtered
+#define ODOMETRY_LOG(level, ...) \
+  do { if ((level) >= ODOMETRY_LOG_LEVEL) ::odometry::logging::Log((level), __FILE__, __LINE__, __VA_ARGS__); } while (0)
+#define LOG_TRACE(...) ODOMETRY_LOG(::odometry::logging::kLogTrace, __VA_ARGS__)
+#define LOG_DEBUG(...) ODOMETRY_LOG(::odometry::logging::kLogDebug, __VA_ARGS__)
+#define LOG_INFO(...) ODOMETRY_LOG(::odometry::logging::kLogInfo, __VA_ARGS__)
+#define LOG_WARN(...) ODOMETRY_LOG(::odometry::logging::kLogWarn, __VA_ARGS__)
+#define LOG_ERROR(...) ODOMETRY_LOG(::odometry::logging::kLogError, __VA_ARGS__)
+
+#endif //ODOMETRY_LOGGING_H
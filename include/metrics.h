@@ -0,0 +1,139 @@
+// The header file contains an in-process metrics registry for production monitoring, exported in the Prometheus text
+// format (version 0.0.4). Hot paths only touch relaxed atomics, registration and rendering take a mutex that the hot
+// paths never see, so a slow scraper can not block the pipeline.
+//  * Counter: monotonic, e.g. frames processed
+//  * Gauge: last value, e.g. number of valid depth points of the current frame
+//  * Histogram: cumulative buckets + sum + count, e.g. per stage latency in seconds
+// Register once and keep the reference (registration is NOT meant for the hot path):
+//   static metrics::Counter& frames = metrics::Registry().GetCounter("odometry_frames_total", "Frames processed.");
+//   frames.Inc();
+// Export with one of StartHttpExporter / StartUnixSocketExporter / StartFileExporter, or StartExporterFromEnv().
+
+#ifndef ODOMETRY_METRICS_H
+#define ODOMETRY_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <map>
+
+namespace odometry
+{
+namespace metrics
+{
+
+class Counter{
+  public:
+    void Inc(uint64_t n = 1){ value_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t Value() const{ return value_.load(std::memory_order_relaxed); }
+  private:
+    std::atomic<uint64_t> value_{0};
+};
+
+class Gauge{
+  public:
+    void Set(double value){ value_.store(value, std::memory_order_relaxed); }
+    void Add(double delta){
+      double old_value = value_.load(std::memory_order_relaxed);
+      while (!value_.compare_exchange_weak(old_value, old_value + delta, std::memory_order_relaxed)){}
+    }
+    double Value() const{ return value_.load(std::memory_order_relaxed); }
+  private:
+    std::atomic<double> value_{0.0};
+};
+
+class Histogram{
+  public:
+    // bounds: upper bounds of the buckets in increasing order, the +Inf bucket is added implicitly
+    explicit Histogram(const std::vector<double>& bounds);
+
+    void Observe(double value){
+      size_t idx = 0;
+      while (idx < bounds_.size() && value > bounds_[idx]) idx++; // few buckets: linear scan beats binary search
+      buckets_[idx].fetch_add(1, std::memory_order_relaxed);
+      double old_sum = sum_.load(std::memory_order_relaxed);
+      while (!sum_.compare_exchange_weak(old_sum, old_sum + value, std::memory_order_relaxed)){}
+    }
+
+    const std::vector<double>& Bounds() const{ return bounds_; }
+    // non-cumulative count of bucket idx, idx == Bounds().size() is the +Inf bucket
+    uint64_t BucketCount(size_t idx) const{ return buckets_[idx].load(std::memory_order_relaxed); }
+    double Sum() const{ return sum_.load(std::memory_order_relaxed); }
+
+  private:
+    std::vector<double> bounds_;
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+    std::atomic<double> sum_{0.0};
+};
+
+// default latency buckets in seconds, 0.5 ms .. 2 s
+const std::vector<double>& LatencyBuckets();
+
+// observes the elapsed wall time in seconds into a histogram when going out of scope
+class ScopedLatency{
+  public:
+    explicit ScopedLatency(Histogram& histogram): histogram_(histogram), begin_(std::chrono::steady_clock::now()){}
+    ~ScopedLatency(){
+      histogram_.Observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - begin_).count());
+    }
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator= (const ScopedLatency&) = delete;
+  private:
+    Histogram& histogram_;
+    std::chrono::steady_clock::time_point begin_;
+};
+
+class MetricsRegistry{
+  public:
+    // get or create a series, labels are given in Prometheus syntax without braces, e.g. "stage=\"pose\""
+    // the returned references stay valid for the lifetime of the process
+    Counter& GetCounter(const std::string& name, const std::string& help, const std::string& labels = "");
+    Gauge& GetGauge(const std::string& name, const std::string& help, const std::string& labels = "");
+    Histogram& GetHistogram(const std::string& name, const std::string& help, const std::vector<double>& bounds,
+                            const std::string& labels = "");
+
+    // all series in the Prometheus text exposition format, plus the resident memory of the process
+    std::string RenderPrometheus();
+
+  private:
+    enum Type { kCounter, kGauge, kHistogram };
+    struct Series{
+      std::string labels;
+      std::unique_ptr<Counter> counter;
+      std::unique_ptr<Gauge> gauge;
+      std::unique_ptr<Histogram> histogram;
+    };
+    struct Family{
+      Type type;
+      std::string help;
+      std::vector<std::unique_ptr<Series>> series;
+    };
+    Series& GetSeries(const std::string& name, const std::string& help, Type type, const std::string& labels);
+
+    std::mutex mutex_;
+    std::map<std::string, Family> families_; // sorted by name, stable output
+};
+
+// the process wide registry
+MetricsRegistry& Registry();
+
+// exporters, each runs one background thread, at most one exporter per process. return -1 if failed, 0 otherwise
+// plain HTTP on 127.0.0.1:port, any request path returns the metrics
+int StartHttpExporter(int port);
+// HTTP over a Unix domain socket, e.g. curl --unix-socket <path> http://localhost/metrics
+int StartUnixSocketExporter(const std::string& path);
+// re-write the file every period_ms (atomically via rename), e.g. for the node_exporter textfile collector
+int StartFileExporter(const std::string& path, int period_ms);
+// ODOMETRY_METRICS=http:<port> | unix:<path> | file:<path>[:<period_ms>], does nothing if not set
+int StartExporterFromEnv();
+// stop the exporter thread (also done at exit)
+void StopExporter();
+
+} // namespace metrics
+} // namespace odometry
+
+#endif //ODOMETRY_METRICS_H
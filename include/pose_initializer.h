@@ -0,0 +1,81 @@
+// The header file contains the feature based pre-alignment of the pose tracking for large motions, i.e. motions outside
+// the convergence basin of the coarsest pyramid level:
+//  * FAST corners on the keyframe image, the strongest one per cell and with a valid inverse depth
+//  * pyramidal Lucas-Kanade tracking into the current frame (SimdKernels::klt_track), from the coarsest level down to
+//    the level of the corners, starting at the projection by the motion prior
+//  * RANSAC PnP (Gauss-Newton on the reprojection error) of the keyframe points
+// The resulting pose seeds the photometric optimization, see LevenbergMarquardtOptimizer::SetPoseInitializer().
+
+#ifndef ODOMETRY_POSE_INITIALIZER_H
+#define ODOMETRY_POSE_INITIALIZER_H
+
+#include <memory>
+#include <vector>
+#include <Eigen/Core>
+#include <opencv2/core.hpp>
+#include <data_types.h>
+#include <image_pyramid.h>
+#include <camera.h>
+
+namespace odometry
+{
+
+// FAST-9 corners of img (CV_32F), scored by SimdKernels::fast_score_row. only the strongest corner of each cell x cell
+// block is kept, pixels within border (>= 3) of the edges are skipped
+void DetectFastCorners(const cv::Mat& img, float threshold, int cell, int border, std::vector<cv::Point>& corners);
+
+class PoseInitializer{
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    // disable default constructor explicitly
+    PoseInitializer() = delete;
+
+    // parameterized constructor:
+    //  - level: pyramid level of the corners and the PnP, the tracking starts at the coarsest level
+    //  - fast_threshold, cell: see DetectFastCorners()
+    //  - ransac_iterations: largest number of 4 point hypotheses
+    //  - inlier_threshold: reprojection error of the inliers, in pixels of level
+    //  - min_inliers: fewer inliers reject the seed
+    PoseInitializer(int level, float fast_threshold, int cell, int ransac_iterations, float inlier_threshold,
+                    int min_inliers, const std::shared_ptr<CameraPyramid>& kCameraPtr);
+
+    // disable copy constructor
+    PoseInitializer(const PoseInitializer& ) = delete;
+
+    // disable copy assignment
+    PoseInitializer& operator= (const PoseInitializer& ) = delete;
+
+    // estimate the transform from the first (keyframe) to the second camera frame starting from kPrior, return status:
+    // if -1: too few corners, tracked features or inliers, seed is not modified
+    // otherwise: success, seed is written
+    GlobalStatus EstimatePose(const ImagePyramid& kImagePyr1, const DepthPyramid& kDepthPyr1, const ImagePyramid& kImagePyr2,
+                              const Affine4f& kPrior, Affine4f& seed);
+
+    // number of tracked features and inliers of the last EstimatePose()
+    int GetNumTracked() const{return num_tracked_;};
+    int GetNumInliers() const{return num_inliers_;};
+
+  private:
+    int level_;
+    float fast_threshold_;
+    int cell_;
+    int ransac_iterations_;
+    float inlier_threshold_;
+    int min_inliers_;
+    int num_tracked_;
+    int num_inliers_;
+
+    // buffers of the features, kept between the calls
+    std::vector<cv::Point> corners_;
+    std::vector<float> x1_, y1_, x2_, y2_, level_x1_, level_y1_;
+    std::vector<unsigned char> status_;
+
+    // shared pointer to the left camera. note that the pointer MUST point to one global camera instance
+    // during the entire lifetime of the program
+    std::shared_ptr<CameraPyramid> camera_ptr_;
+};
+
+} // namespace odometry
+
+#endif //ODOMETRY_POSE_INITIALIZER_H
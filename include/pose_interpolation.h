@@ -0,0 +1,65 @@
+// The header file contains the pose queries at any time for consumers running faster than the camera, e.g. 100-200 Hz
+// controllers on 10 Hz KITTI poses:
+//  * a ring of the last poses with their timestamps, filled by the tracking (one writer, e.g. a PosePublisher
+//    subscriber)
+//  * PoseAt(t) between two poses: SE3 interpolation (Sophus::interpolate), constant velocity on the geodesic
+//  * PoseAt(t) after the newest pose: extrapolation with the velocity between the two newest poses, up to
+//    max_extrapolation seconds
+//  * the readers never wait for the tracking: the ring is guarded by a sequence number (seqlock) and a query is
+//    retried only if a pose is added during it. a query costs a few hundred nanoseconds
+// Usage:
+//   PoseInterpolator interpolator(64, 0.3);
+//   publisher.Subscribe([&](const PoseSample& sample){ interpolator.Add(sample.timestamp, sample.pose); });
+//   Affine4f pose;
+//   if (interpolator.PoseAt(now, pose) != -1) ...; // any thread
+
+#ifndef ODOMETRY_POSE_INTERPOLATION_H
+#define ODOMETRY_POSE_INTERPOLATION_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <data_types.h>
+
+namespace odometry
+{
+
+class PoseInterpolator{
+  public:
+    // disable default constructor explicitly
+    PoseInterpolator() = delete;
+
+    // parameterized constructor:
+    //  - history: poses kept, queries before the oldest one fail. at least 2
+    //  - max_extrapolation: seconds after the newest pose a query may extrapolate, later queries fail
+    PoseInterpolator(int history, double max_extrapolation);
+
+    // disable copy constructor
+    PoseInterpolator(const PoseInterpolator& ) = delete;
+
+    // disable copy assignment
+    PoseInterpolator& operator= (const PoseInterpolator& ) = delete;
+
+    // add pose (camera to world) at timestamp in seconds, single writer. the rotation block is re-orthonormalized
+    // Return: -1 if timestamp is not after the newest pose; otherwise success
+    GlobalStatus Add(double timestamp, const Affine4f& pose);
+
+    // pose at timestamp, interpolated or extrapolated (extrapolated set to true, if not null)
+    // Return: -1 if no pose was added, timestamp is before the oldest pose or after the extrapolation window;
+    // otherwise success
+    GlobalStatus PoseAt(double timestamp, Affine4f& pose, bool* extrapolated = nullptr) const;
+
+  private:
+    // one pose: timestamp, quaternion (x, y, z, w) and translation as floats
+    static const int kWords = 5;
+
+    int history_;
+    double max_extrapolation_;
+    std::unique_ptr<std::atomic<uint64_t>[]> words_; // [history_][kWords]
+    std::atomic<uint64_t> version_; // odd while a pose is added
+    std::atomic<uint64_t> count_;   // poses added, pose i is in slot i % history_
+};
+
+} // namespace odometry
+
+#endif //ODOMETRY_POSE_INTERPOLATION_H
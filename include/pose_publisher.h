@@ -0,0 +1,90 @@
+// The header file contains the publication of the latest pose to downstream consumers, e.g. planner and controller
+// threads, with minimum latency and without locking against the tracking:
+//  * one writer (the tracking) publishes a PoseSample per frame into a ring of kPoseSlots slots, each guarded by a
+//    sequence number (seqlock). the writer never waits for the readers
+//  * any number of readers copy the latest slot. a copy is retried only if the writer wrapped around all slots during
+//    it (kPoseSlots publications within one copy of ~100 ns), i.e. the readers never wait for the writer in practice
+//  * subscribers: callbacks run on the writer thread right after each publication. they must be short (copy the
+//    sample, wake a thread), the tracking waits for them
+// Usage:
+//   PosePublisher publisher;
+//   publisher.Subscribe([&](const PoseSample& sample){ ... });
+//   publisher.Publish(sample); // tracking thread
+//   PoseSample latest;
+//   if (publisher.Latest(latest) != -1) ...; // any thread
+
+#ifndef ODOMETRY_POSE_PUBLISHER_H
+#define ODOMETRY_POSE_PUBLISHER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <data_types.h>
+
+namespace odometry
+{
+
+// slots of the ring, see above
+const int kPoseSlots = 4;
+
+enum TrackingStatus{
+  kTrackingOk = 0,
+  kTrackingLost = 1 // no residuals, the pose is the motion prior
+};
+
+struct PoseSample{
+  Affine4f pose = Affine4f::Identity();    // camera to world, as the trajectory (X_world = pose * X_cam)
+  double timestamp = 0.0;                   // capture time of the frame in seconds, clock of the sequence
+  uint64_t frame_id = 0;
+  Eigen::Matrix<float, 6, 6> covariance = Eigen::Matrix<float, 6, 6>::Zero(); // TODO: placeholder, zero: unknown
+  TrackingStatus status = kTrackingLost;
+  uint64_t sequence = 0;                    // number of the publication, 1 for the first one, set by Publish()
+};
+
+class PosePublisher{
+  public:
+    PosePublisher();
+
+    // disable copy constructor
+    PosePublisher(const PosePublisher& ) = delete;
+
+    // disable copy assignment
+    PosePublisher& operator= (const PosePublisher& ) = delete;
+
+    // publish sample as the latest pose (single writer), then call the subscribers
+    void Publish(const PoseSample& sample);
+
+    // copy the latest pose, wait-free in practice, see above
+    // Return: -1 if no pose was published yet; otherwise success
+    GlobalStatus Latest(PoseSample& sample) const;
+
+    // number of publications, 0: none
+    uint64_t Sequence() const{ return published_.load(std::memory_order_acquire); }
+
+    // callback for each publication, return its id for Unsubscribe(). not called from within a callback
+    int Subscribe(std::function<void(const PoseSample&)> callback);
+
+    // Return: -1 if id is not subscribed; otherwise success
+    GlobalStatus Unsubscribe(int id);
+
+  private:
+    // the sample as words: pose (16 floats), covariance (36 floats), timestamp, frame_id, status and sequence
+    static const int kWords = 8 + 18 + 4;
+    struct Slot{
+      std::atomic<uint64_t> version; // odd while written
+      std::atomic<uint64_t> words[kWords];
+    };
+
+    Slot slots_[kPoseSlots];
+    std::atomic<uint64_t> published_; // publications, the latest is in slot (published_ - 1) % kPoseSlots
+    std::mutex subscribers_mutex_; // subscribers vs. (un)subscribe, never taken by the readers
+    std::vector<std::pair<int, std::function<void(const PoseSample&)>>> subscribers_;
+    int next_subscriber_ = 0;
+};
+
+} // namespace odometry
+
+#endif //ODOMETRY_POSE_PUBLISHER_H
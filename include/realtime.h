@@ -0,0 +1,51 @@
+// The header file contains the real-time mode of the live pipeline. On shared hosts the latency spikes of the tracking
+// come from thread migrations, page faults and memory of the other socket:
+//  * pinning: the driver thread (capture, task graphs) and each worker of DefaultThreadPool() (tracking, depth, mapping
+//    tasks, see TaskGraph) run on fixed cores. the stages share the workers, their order is set by TaskPriority
+//  * NUMA: a pinned thread allocates from the node of its core (preferred, other nodes when it is full). the frames
+//    are allocated by the threads filling them, i.e. on the node of the pipeline cores
+//  * memory: mlockall() of the current and future pages, freed heap memory is kept (no trim, no mmap), so the frame
+//    buffers of the next frames reuse resident pages instead of faulting
+//  * priority: SCHED_FIFO for the pinned threads, optional
+// Every setting needs privileges (CAP_SYS_NICE, CAP_IPC_LOCK or the rtprio / memlock limits). A setting which fails
+// is reported and skipped, the others still apply, i.e. the pipeline falls back to the normal mode.
+// Linux only; the settings are no-ops elsewhere.
+
+#ifndef ODOMETRY_REALTIME_H
+#define ODOMETRY_REALTIME_H
+
+#include <vector>
+#include <data_types.h>
+
+namespace odometry
+{
+
+struct RealtimeConfig{
+  bool lock_memory = true;       // mlockall() and no heap trimming
+  int fifo_priority = 0;         // SCHED_FIFO priority of the pinned threads (1-99), 0: keep the normal scheduling
+  int driver_core = -1;          // core of the thread calling EnableRealtime(), -1: not pinned
+  std::vector<int> worker_cores; // core of worker i: worker_cores[i % size()], empty: workers not pinned
+  bool numa_local = true;        // allocate from the node of the core, pinned threads only
+};
+
+// lock the current and future pages of the process, then keep the freed heap memory
+// Return: -1 if the pages could not be locked (no privileges or memlock limit), the allocator is left unchanged;
+//         otherwise success
+GlobalStatus LockMemory();
+
+// pin the calling thread to core (-1: keep), allocate from its NUMA node if numa_local, set SCHED_FIFO with
+// fifo_priority (0: keep)
+// Return: -1 if a setting failed, the others are applied; otherwise success
+GlobalStatus SetThreadRealtime(int core, bool numa_local, int fifo_priority);
+
+// the real-time mode: LockMemory(), SetThreadRealtime() of the calling thread and of the workers of DefaultThreadPool(),
+// which must not be used before. num_threads: of the pool, 0: DefaultNumThreads()
+// Return: -1 if a setting failed, the others are applied (the workers report their failures themselves); otherwise success
+GlobalStatus EnableRealtime(const RealtimeConfig& config, int num_threads = 0);
+
+// the NUMA node of core, 0 if unknown (single node systems)
+int NumaNodeOfCore(int core);
+
+} // namespace odometry
+
+#endif //ODOMETRY_REALTIME_H
@@ -0,0 +1,87 @@
+// The header file contains the dense stereo mode: semi-global matching (SGM, Hirschmueller 2008) of census costs.
+// DepthEstimator keeps at most one point per block for the tracking, SgmStereo fills every pixel with a unique match:
+//  * census transform of both images (5x5, kCensusBits) and hamming costs of num_disp disparities, uint8
+//  * 4 (horizontal, vertical) or 8 (plus diagonal) path aggregation, uint16, vectorized across the disparities
+//  * winner takes all with uniqueness check, sub-pixel parabola and left-right consistency check
+// The image is split into horizontal bands processed in parallel on DefaultThreadPool(). The vertical and diagonal
+// paths of a band start kSgmBandOverlap rows outside of it, i.e. they see only part of the image above and below.
+
+#ifndef ODOMETRY_SGM_STEREO_H
+#define ODOMETRY_SGM_STEREO_H
+
+#include <memory>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <data_types.h>
+#include <camera.h>
+
+namespace odometry
+{
+
+// rows aggregated outside of a band, see above
+const int kSgmBandOverlap = 16;
+
+class SgmStereo{
+  public:
+    // disable default constructor explicitly
+    SgmStereo() = delete;
+
+    // parameterized constructor:
+    //  - num_disp: disparities [0, num_disp), multiple of kSgmDisparityStep, e.g. 128 (3 m on KITTI)
+    //  - num_paths: 4 or 8 aggregation paths
+    //  - p1, p2: penalties of disparity changes by 1 and by more than 1 pixel between path neighbours
+    //  - uniqueness: the smallest aggregated cost must be below uniqueness times the second smallest one (0 < u <= 1)
+    //  - min_depth, max_depth: in meters, the other depths are invalid
+    //  - num_bands: horizontal bands processed in parallel, e.g. the number of threads
+    SgmStereo(int num_disp, int num_paths, int p1, int p2, float uniqueness, float min_depth, float max_depth,
+              int num_bands, const std::shared_ptr<CameraPyramid>& left_cam_ptr, float baseline);
+
+    // disable copy constructor
+    SgmStereo(const SgmStereo& ) = delete;
+
+    // disable copy assignment
+    SgmStereo& operator= (const SgmStereo& ) = delete;
+
+    // compute the dense depth of the left image, same inputs and outputs as DepthEstimator::ComputeDepth():
+    //  * left_disp: disparity [pixels], left_dep: inverse depth, left_val: 1 for the valid pixels, 0 otherwise
+    // Return: -1 if the images don't match or are not CV_32F; otherwise success
+    GlobalStatus ComputeDepth(const cv::Mat& left_img, const cv::Mat& right_img, cv::Mat& left_val, cv::Mat& left_disp,
+                              cv::Mat& left_dep);
+
+  private:
+    // buffers of one band, allocated at the first call and reused
+    struct Band{
+      std::vector<unsigned int> census_left;
+      std::vector<unsigned int> census_right;
+      std::vector<unsigned int> scratch;
+      std::vector<unsigned char> cost; // [rows of the band + overlap][cols][num_disp]
+      std::vector<unsigned short> sum; // [rows of the band][cols][num_disp]
+      std::vector<unsigned short> paths; // previous and current row of each path, [cols][num_disp + 2]
+      std::vector<float> disparity;
+      std::vector<float> right_disparity;
+      std::vector<unsigned short> right_sum;
+    };
+
+    // aggregate and select the rows [y_begin, y_end) of band, the outputs are written for these rows only
+    void ComputeBand(const cv::Mat& left_img, const cv::Mat& right_img, int y_begin, int y_end, Band& band,
+                     cv::Mat& left_val, cv::Mat& left_disp, cv::Mat& left_dep);
+
+    int num_disp_;
+    int num_paths_;
+    unsigned short p1_;
+    unsigned short p2_;
+    float uniqueness_;
+    float min_depth_;
+    float max_depth_;
+    int num_bands_;
+    float baseline_;
+    std::vector<Band> bands_;
+
+    // shared pointer to the left camera. note that the pointer MUST point to one global camera instance
+    // during the entire lifetime of the program
+    std::shared_ptr<CameraPyramid> camera_ptr_;
+};
+
+} // namespace odometry
+
+#endif //ODOMETRY_SGM_STEREO_H
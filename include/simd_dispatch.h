@@ -0,0 +1,196 @@
+// The header file contains the runtime CPU dispatch of the hot SIMD kernels.
+// Every kernel is compiled once per instruction set (src/simd_kernels_{scalar,sse42,avx2,avx512}.cpp, see CMakeLists.txt),
+// the best variant supported by the running CPU is chosen by CPUID at the first call of GetSimdKernels().
+// The rest of the library is compiled for the x86-64 baseline only, so one binary runs on every node of the fleet.
+
+#ifndef ODOMETRY_SIMD_DISPATCH_H
+#define ODOMETRY_SIMD_DISPATCH_H
+
+namespace odometry
+{
+
+// supported instruction set levels, ordered: a higher level implies all lower ones
+enum SimdLevel{
+  kSimdScalar = 0,
+  kSimdSse42 = 1,
+  kSimdAvx2 = 2,   // AVX2 + FMA + F16C
+  kSimdAvx512 = 3  // AVX-512 F/BW/DQ/VL
+};
+
+// DSO-style 8 point pattern used by the stereo search and depth refinement: {row offset, col offset}
+const int kPattern8[8][2] = {{-2, 0}, {-1, -1}, {-1, 1}, {0, -2}, {0, 0}, {0, 2}, {1, -1}, {2, 0}};
+
+// output of the whole image warping for pixels without a warped intensity (intensities are >= 0)
+const float kWarpInvalid = -1.0f;
+// a warped point is occluded if it is more than this fraction of its depth behind the nearest point on the same pixel
+const float kWarpOcclusionTolerance = 0.05f;
+
+// IEEE 754 half precision float, stored as its bits (compact image pyramids, see ImagePyramid)
+typedef unsigned short Float16;
+
+// FAST corners (fast_score_row): the 16 pixel Bresenham circle of radius 3, {dx, dy} clockwise from the top
+const int kFastCircle[16][2] = {{0, -3}, {1, -3}, {2, -2}, {3, -1}, {3, 0}, {3, 1}, {2, 2}, {1, 3},
+                                {0, 3}, {-1, 3}, {-2, 2}, {-3, 1}, {-3, 0}, {-3, -1}, {-2, -2}, {-1, -3}};
+
+// pyramidal Lucas-Kanade tracking (klt_track): largest window radius, and the step length below which a feature stops
+const int kKltMaxRadius = 4;
+const float kKltMinStep = 0.01f;
+
+// semi-global matching (census_row, sgm_cost_row, sgm_aggregate_row, sgm_select_row): the census transform compares
+// the 5x5 window without its center, i.e. kCensusBits bits per pixel and matching costs of 0 to kCensusBits. the
+// number of disparities must be a multiple of kSgmDisparityStep, so every instruction set works on full vectors
+const int kCensusBits = 24;
+const int kSgmDisparityStep = 32;
+
+// Table of kernel entry points of one instruction set level.
+// All images are passed as raw row-major float pointers with a stride in floats (NOT bytes), no Eigen or OpenCV types
+// are used on purpose, since the kernel translation units are compiled with different ISA flags. The compact uint8 /
+// Float16 images have a stride in pixels and one padding row behind the last one: the gathers read whole 32 bit words.
+struct SimdKernels{
+  SimdLevel level;
+  const char* name;
+
+  // disparity search along one epipolar line with the 8 point pattern (kPattern8)
+  //  * left_pattern: 8 left intensities ordered as kPattern8
+  //  * right_rows: 5 right row pointers, from row y-2 to row y+2
+  //  * [begin_x, end_x): candidate columns on the right image
+  // Return: the first column with the smallest ssd (-1 if the range is empty), smallest ssd is written to best_ssd
+  int (*ssd_pattern8_search)(const float* left_pattern, const float* const* right_rows, int begin_x, int end_x, float* best_ssd);
+
+  // pyramid down-sampling by keeping the odd rows/cols: dst(y, x) = src(2y+1, 2x+1)
+  void (*pyramid_down)(const float* src, int src_stride, float* dst, int dst_stride, int dst_rows, int dst_cols);
+
+  // accumulate the normal equations of the pose optimization over num residuals:
+  //  * jaco: [num, 6] column-major jacobian, column k starts at jaco + k * jaco_stride
+  //  * hessian: 6x6 output, J^T W J
+  //  * gradient: 6x1 output, J^T W r
+  //  * cost: r^T W r
+  void (*accumulate_normal_equations)(const float* jaco, int jaco_stride, const float* residual, const float* weight, int num,
+                                      float* hessian, float* gradient, float* cost);
+
+  // photometric residuals r = I2(warp(p)) - I1(p) and their [1, 6] jacobians w.r.t. the twist, one per pixel p of image 1
+  // with a valid inverse depth that warps inside image 2, pixels within border of the edges are skipped. intensity and
+  // gradient of image 2 are sampled bilinearly like sample_bilinear
+  //  * img1, img2, inv_depth: [rows, cols] with the same stride
+  //  * camera: fx, fy, cx, cy of the pyramid level
+  //  * transform: 3x4 row-major [R|t] from camera 1 to camera 2
+  //  * jaco: column-major output like accumulate_normal_equations, residual: output, both hold at least rows * cols
+  // Return: number of residuals, stored contiguously in the row-major order of the pixels
+  int (*pose_residual_jacobian)(const float* img1, const float* img2, const float* inv_depth, int stride, int rows, int cols,
+                                int border, const float* camera, const float* transform, float* jaco, int jaco_stride,
+                                float* residual);
+
+  // residuals and diagonal normal equations of the inverse depth refinement (one unknown per point), each point is
+  // evaluated on the 8 point pattern (kPattern8) around it, all pattern pixels share the inverse depth of the point
+  //  * tx_fx: baseline [meters] * fx [pixels]
+  //  * the right image is sampled (linear interpolation along the row) at the continuous warped column x - tx_fx * d
+  //  * per point outputs: jtwj, b = -J^T W r and energy = r^T W r (Huber weights) summed over the pattern,
+  //    residual: mean absolute photometric residual of the pattern
+  //  * points whose pattern is not inside the images get jtwj = b = energy = 0, residual = -1000
+  // Return: number of valid points, the sum of their energies is written to err_sum
+  int (*depth_residual_jacobian)(const float* left_img, const float* right_img, int stride, int rows, int cols,
+                                 const int* xs, const int* ys, const float* inv_depth, int num, float tx_fx, float huber_delta,
+                                 float* jtwj, float* b, float* energy, float* residual, float* err_sum);
+
+  // whole image warping of image 2 into the frame of camera 1 (WarpImageSse), two passes over the rows
+  // [row_begin, row_end) of camera 1 so that each pass can run row-parallel. camera/transform like pose_residual_jacobian,
+  // all images [rows, cols] with the same stride
+  //  * warp_depth_splat: depth of every pixel with a valid inverse depth in camera 2, the nearest one is kept per pixel
+  //    of image 2 (zbuffer, atomic minimum, must be initialised to +inf)
+  //  * warp_image: bilinear sample of img2 at the warped position, kWarpInvalid if the pixel has no depth, warps out of
+  //    image 2 or is occluded: its depth is more than kWarpOcclusionTolerance (relative) behind the zbuffer
+  void (*warp_depth_splat)(const float* inv_depth, int stride, int rows, int cols, int row_begin, int row_end,
+                           const float* camera, const float* transform, float* zbuffer);
+  void (*warp_image)(const float* img2, const float* inv_depth, int stride, int rows, int cols, int row_begin, int row_end,
+                     const float* camera, const float* transform, const float* zbuffer, float* warped);
+
+  // bilinear intensity and gradient of img [rows, cols] at num sub-pixel positions (u[i], v[i]), the gradient is the
+  // bilinear interpolation of the central differences. valid[i] = 0 if the 4x4 neighbourhood of the sample is not
+  // inside the image (1 <= u < cols - 2, 1 <= v < rows - 2), its value and gradient are set to 0
+  void (*sample_bilinear)(const float* img, int stride, int rows, int cols, const float* u, const float* v, int num,
+                          float* value, float* grad_x, float* grad_y, unsigned char* valid);
+
+  // pose_residual_jacobian on compact images, converted to float in registers: same results as on the float image
+  // holding the same values. img1, img2 and inv_depth have the same stride in pixels
+  int (*pose_residual_jacobian_u8)(const unsigned char* img1, const unsigned char* img2, const float* inv_depth, int stride,
+                                   int rows, int cols, int border, const float* camera, const float* transform,
+                                   float* jaco, int jaco_stride, float* residual);
+  int (*pose_residual_jacobian_f16)(const Float16* img1, const Float16* img2, const float* inv_depth, int stride,
+                                    int rows, int cols, int border, const float* camera, const float* transform,
+                                    float* jaco, int jaco_stride, float* residual);
+
+  // float <-> half float of num values, round to nearest even (bit exact on every level)
+  void (*convert_to_half)(const float* src, int num, Float16* dst);
+  void (*convert_from_half)(const Float16* src, int num, float* dst);
+
+  // pose_residual_jacobian on the 8 point pattern (kPattern8) around num sparse anchor pixels (xs[i], ys[i]) of img1
+  // with inverse depth inv_depth[i]: each anchor is warped once, the pattern keeps its shape in img2 and all its points
+  // share the geometric jacobian of the anchor (DSO). an anchor whose pattern warps out of img2 (border 3, i.e. the
+  // pattern and its gradients) or behind the camera is dropped with all 8 residuals. anchors must be at least 2 pixels
+  // inside img1. outputs as pose_residual_jacobian, ordered by groups of 16 anchors, then by pattern point, then by
+  // anchor, i.e. independent of the level. Return: number of residuals, 8 per valid anchor
+  int (*pose_residual_jacobian_pattern8)(const float* img1, const float* img2, int stride, int rows, int cols,
+                                         const int* xs, const int* ys, const float* inv_depth, int num,
+                                         const float* camera, const float* transform, float* jaco, int jaco_stride,
+                                         float* residual);
+
+  // Lucas-Kanade tracking of num features on one pyramid level: the (2 * radius + 1)^2 window (radius <= kKltMaxRadius)
+  // around (x1[i], y1[i]) in img1 is aligned in img2 by inverse compositional Gauss-Newton on the translation, starting
+  // at (x2[i], y2[i]) which is updated in place. a feature stops after iterations steps or a step below kKltMinStep.
+  // status[i] = 0 if a window is not inside its image or the window of img1 has no 2D structure (flat, edge)
+  void (*klt_track)(const float* img1, const float* img2, int stride, int rows, int cols, const float* x1,
+                    const float* y1, int num, int radius, int iterations, float* x2, float* y2, unsigned char* status);
+
+  // FAST-9 corner score of one image row (row points to its first pixel, the 3 rows above and below must exist): at
+  // least 9 contiguous pixels of kFastCircle are all brighter or all darker than the center by more than threshold.
+  // score[x] = sum of the absolute differences beyond threshold of the brighter (darker) circle pixels, the larger one
+  // if both form an arc, 0 for no corner and within 3 pixels of the row ends
+  void (*fast_score_row)(const float* row, int stride, int cols, float threshold, float* score);
+
+  // census transform of one image row (the 2 rows above and below must exist): bit k of census[x] is set if the k-th
+  // pixel of the 5x5 window (row-major, center skipped) is darker than the center. 0 within 2 pixels of the row ends
+  void (*census_row)(const float* row, int stride, int cols, unsigned int* census);
+
+  // matching costs of one row for the disparities [0, num_disp): cost[x * num_disp + d] = hamming distance of left[x]
+  // and right[x - d], kCensusBits if x < d. scratch holds cols + num_disp values
+  void (*sgm_cost_row)(const unsigned int* left, const unsigned int* right, int cols, int num_disp, unsigned int* scratch,
+                       unsigned char* cost);
+
+  // one row of one aggregation path (Hirschmueller 2008): L(x, d) = C(x, d) + min(L'(d), L'(d +- 1) + p1,
+  // min L' + p2) - min L', where L' are the path costs of the previous pixel of the path: pixel x - dx of the row prev,
+  // or of the row cur itself if prev is nullptr (horizontal paths, dx = +-1, the row is traversed in direction dx).
+  // a path starts with L = C where the previous pixel is outside the row, and at every pixel for prev = nullptr and
+  // dx = 0 (first row of the vertical and diagonal paths). the path costs of pixel x are stored at
+  // cur + x * (num_disp + 2) + 1 between two guard values, written by the kernel. L is added to
+  // sum[x * num_disp + d] (saturated)
+  void (*sgm_aggregate_row)(const unsigned char* cost, int cols, int num_disp, int dx, const unsigned short* prev,
+                            unsigned short* cur, unsigned short* sum, unsigned short p1, unsigned short p2);
+
+  // winner takes all over the aggregated costs of one row: disparity[x] = the first disparity of the smallest sum,
+  // refined by the parabola through its neighbours, or -1 if the smallest sum is larger than uniqueness times the
+  // smallest sum of the disparities which are not its neighbours
+  void (*sgm_select_row)(const unsigned short* sum, int cols, int num_disp, float uniqueness, float* disparity);
+
+  // sparse depth codec (SparseDepthCodec), one row of cols pixels:
+  //  * sparse_encode_row: the columns x with mask[x] != 0 in increasing order to xs and their values quantized to
+  //    quantized[i] = round(values[xs[i]] * scale), to nearest even, clamped to [0, 65535] (NaN: 0). xs and quantized
+  //    hold cols values. Return: number of valid pixels
+  //  * sparse_decode_row: values[xs[i]] = quantized[i] * step of num pixels, the other values are not touched
+  int (*sparse_encode_row)(const float* values, const unsigned char* mask, int cols, float scale, int* xs,
+                           unsigned short* quantized);
+  void (*sparse_decode_row)(const unsigned short* quantized, const int* xs, int num, float step, float* values);
+};
+
+// detect the highest level supported by the running CPU (CPUID + XGETBV, i.e. the OS must also save the registers)
+SimdLevel DetectSimdLevel();
+
+// the kernels of the best supported level, selected once and cached.
+// the environment variable ODOMETRY_SIMD=scalar|sse4.2|avx2|avx512 caps the level, e.g. for benchmarks/debugging
+const SimdKernels& GetSimdKernels();
+
+// the kernels of one specific level, nullptr if the running CPU does not support it (used by tests/benchmarks)
+const SimdKernels* GetSimdKernels(SimdLevel level);
+
+} // namespace odometry
+
+#endif //ODOMETRY_SIMD_DISPATCH_H
@@ -0,0 +1,893 @@
+// The header file contains the bodies of the hot kernels, written once against the SIMD abstraction of simd_vector.h.
+// It is included by every per-ISA kernel translation unit (src/simd_kernels_*.cpp) which defines:
+//  * ODOMETRY_SIMD_{SCALAR,SSE42,AVX2,AVX512} and ODOMETRY_SIMD_NS: see simd_vector.h
+//  * ODOMETRY_SIMD_LEVEL, ODOMETRY_SIMD_NAME: level and name reported by the kernel table
+// The lanes of every kernel compute exactly the same sequence of operations as the scalar variant (the kernel TUs are
+// compiled with -ffp-contract=off), only the final lane reductions may differ in rounding.
+
+#ifndef ODOMETRY_SIMD_KERNELS_IMPL_H
+#define ODOMETRY_SIMD_KERNELS_IMPL_H
+
+#include <simd_dispatch.h>
+#include <simd_vector.h>
+
+namespace odometry
+{
+namespace simd
+{
+namespace ODOMETRY_SIMD_NS
+{
+
+/********************************************* Stereo SSD search ***************************************************/
+// ssd of the 8 point pattern for kLanes consecutive right columns starting at x, lanes beyond n are zero
+inline VecF SsdPattern8(const VecF* left, const float* const* right_rows, int x, int n){
+  VecF ssd = Zero();
+  for (int t = 0; t < 8; t++){
+    VecF diff = Sub(left[t], Load(right_rows[kPattern8[t][0] + 2] + x + kPattern8[t][1], n));
+    ssd = Add(ssd, Mul(diff, diff));
+  }
+  return ssd;
+}
+
+int SsdPattern8Search(const float* left_pattern, const float* const* right_rows, int begin_x, int end_x, float* best_ssd){
+  VecF left[8];
+  for (int t = 0; t < 8; t++){
+    left[t] = Set1(left_pattern[t]);
+  }
+  // vectorized over candidate columns: every lane keeps its own best ssd and column
+  VecF lane_best = Set1(1e+10f);
+  VecI lane_best_x = SetI1(-1);
+  VecI lane_x = AddI(IotaI(), SetI1(begin_x));
+  const VecI kStep = SetI1(kLanes);
+  for (int x = begin_x; x < end_x; x += kLanes){
+    int n = end_x - x;
+    VecF ssd = SsdPattern8(left, right_rows, x, n);
+    MaskF better = And(Lt(ssd, lane_best), FirstN(n));
+    lane_best = Select(better, ssd, lane_best);
+    lane_best_x = SelectI(better, lane_x, lane_best_x);
+    lane_x = AddI(lane_x, kStep);
+  }
+  // reduce lanes: smallest ssd, ties go to the smallest column, i.e. the same result as a sequential scan
+  float ssd_lanes[kLanes];
+  int x_lanes[kLanes];
+  StoreU(ssd_lanes, lane_best);
+  StoreUI(x_lanes, lane_best_x);
+  float best = 1e+10f;
+  int best_x = -1;
+  for (int i = 0; i < kLanes; i++){
+    if (x_lanes[i] < 0) continue;
+    if (ssd_lanes[i] < best || (ssd_lanes[i] == best && x_lanes[i] < best_x)){
+      best = ssd_lanes[i];
+      best_x = x_lanes[i];
+    }
+  }
+  *best_ssd = best;
+  return best_x;
+}
+
+/********************************************* Pyramid down-sampling ***********************************************/
+void PyramidDown(const float* src, int src_stride, float* dst, int dst_stride, int dst_rows, int dst_cols){
+  for (int y = 0; y < dst_rows; y++){
+    const float* src_row = src + (2 * y + 1) * src_stride;
+    float* dst_row = dst + y * dst_stride;
+    int x = 0;
+    for (; x + kLanes <= dst_cols; x += kLanes){
+      StoreU(dst_row + x, DeinterleaveOdd(LoadU(src_row + 2 * x), LoadU(src_row + 2 * x + kLanes)));
+    }
+    for (; x < dst_cols; x++){
+      dst_row[x] = src_row[2 * x + 1];
+    }
+  }
+}
+
+/********************************** Normal equations of the pose optimization **************************************/
+void AccumulateNormalEquations(const float* jaco, int jaco_stride, const float* residual, const float* weight, int num,
+                               float* hessian, float* gradient, float* cost){
+  VecF acc_h[21]; // upper triangle of J^T W J, row by row
+  VecF acc_g[6];
+  VecF acc_c = Zero();
+  for (int k = 0; k < 21; k++) acc_h[k] = Zero();
+  for (int k = 0; k < 6; k++) acc_g[k] = Zero();
+  VecF j[6];
+  for (int i = 0; i < num; i += kLanes){
+    int n = num - i;
+    VecF r = Load(residual + i, n);
+    VecF w = Load(weight + i, n); // zero beyond the tail, so the tail lanes add nothing
+    for (int a = 0; a < 6; a++){
+      j[a] = Load(jaco + a * jaco_stride + i, n);
+    }
+    VecF wr = Mul(w, r);
+    acc_c = Add(acc_c, Mul(wr, r));
+    int k = 0;
+    for (int a = 0; a < 6; a++){
+      acc_g[a] = Add(acc_g[a], Mul(j[a], wr));
+      VecF wj = Mul(w, j[a]);
+      for (int b = a; b < 6; b++){
+        acc_h[k] = Add(acc_h[k], Mul(wj, j[b]));
+        k++;
+      }
+    }
+  }
+  int k = 0;
+  for (int a = 0; a < 6; a++){
+    gradient[a] = ReduceAdd(acc_g[a]);
+    for (int b = a; b < 6; b++){
+      hessian[a * 6 + b] = ReduceAdd(acc_h[k]);
+      hessian[b * 6 + a] = hessian[a * 6 + b];
+      k++;
+    }
+  }
+  *cost = ReduceAdd(acc_c);
+}
+
+/********************************************* Bilinear image sampling *********************************************/
+// The sampling shared by the tracking, the depth refinement and the whole image warping. (u, v) are continuous image
+// coordinates, (0, 0) is the center of the top left pixel. The gradient is the bilinear interpolation of the central
+// differences at the 4 neighbours, so unlike the derivative of the bilinear intensity it is continuous in (u, v).
+// Disabled lanes are never gathered, the positions of the enabled lanes must be inside the out of bounds mask.
+
+// out of bounds mask: border <= u < cols - 1 - border and border <= v < rows - 1 - border, NaN is out of bounds.
+// the intensity only needs border 0, intensity and gradient need border 1
+inline MaskF SampleInBounds(VecF u, VecF v, int rows, int cols, int border){
+  const VecF kBorder = Set1(float(border));
+  return And(And(Le(kBorder, u), Lt(u, Set1(float(cols - 1 - border)))),
+             And(Le(kBorder, v), Lt(v, Set1(float(rows - 1 - border)))));
+}
+
+// same along an image row, for the epipolar sampling
+inline MaskF SampleInBoundsRow(VecF u, int cols, int border){
+  return And(Le(Set1(float(border)), u), Lt(u, Set1(float(cols - 1 - border))));
+}
+
+inline VecF Lerp(VecF a, VecF b, VecF t){
+  return Add(Mul(Sub(Set1(1.0f), t), a), Mul(t, b));
+}
+
+// intensity at (u, v): 4 gathers
+inline VecF SampleBilinearValue(const float* img, int stride, VecF u, VecF v, MaskF valid){
+  VecF u0 = Floor(u);
+  VecF v0 = Floor(v);
+  VecF au = Sub(u, u0);
+  VecF av = Sub(v, v0);
+  const VecI kOne = SetI1(1);
+  VecI r0 = AddI(MulI(ToInt(Select(valid, v0, Zero())), SetI1(stride)), ToInt(Select(valid, u0, Zero())));
+  VecI r1 = AddI(r0, SetI1(stride));
+  VecF top = Lerp(Gather(img, r0, valid), Gather(img, AddI(r0, kOne), valid), au);
+  VecF bot = Lerp(Gather(img, r1, valid), Gather(img, AddI(r1, kOne), valid), au);
+  return Lerp(top, bot, av);
+}
+
+// intensity and gradient at (u, v): 12 gathers, the 4x4 neighbourhood without its corners. Pixel: float, unsigned char
+// or unsigned short (half float), see LoadPixels()
+template <typename Pixel>
+inline void SampleBilinear(const Pixel* img, int stride, VecF u, VecF v, MaskF valid, VecF& value, VecF& grad_x,
+                           VecF& grad_y){
+  VecF u0 = Floor(u);
+  VecF v0 = Floor(v);
+  VecF au = Sub(u, u0);
+  VecF av = Sub(v, v0);
+  const VecF kHalf = Set1(0.5f);
+  const VecI kOne = SetI1(1);
+  const VecI kTwo = SetI1(2);
+  const VecI kMinusOne = SetI1(-1);
+  // rows v0 - 1 (rm) to v0 + 2 (r2), at column u0
+  VecI r0 = AddI(MulI(ToInt(Select(valid, v0, Zero())), SetI1(stride)), ToInt(Select(valid, u0, Zero())));
+  VecI r1 = AddI(r0, SetI1(stride));
+  VecI rm = AddI(r0, SetI1(-stride));
+  VecI r2 = AddI(r0, SetI1(2 * stride));
+  VecF i00 = GatherPixels(img, r0, valid);
+  VecF i01 = GatherPixels(img, AddI(r0, kOne), valid);
+  VecF i10 = GatherPixels(img, r1, valid);
+  VecF i11 = GatherPixels(img, AddI(r1, kOne), valid);
+  value = Lerp(Lerp(i00, i01, au), Lerp(i10, i11, au), av);
+  VecF gx00 = Sub(i01, GatherPixels(img, AddI(r0, kMinusOne), valid));
+  VecF gx01 = Sub(GatherPixels(img, AddI(r0, kTwo), valid), i00);
+  VecF gx10 = Sub(i11, GatherPixels(img, AddI(r1, kMinusOne), valid));
+  VecF gx11 = Sub(GatherPixels(img, AddI(r1, kTwo), valid), i10);
+  grad_x = Mul(kHalf, Lerp(Lerp(gx00, gx01, au), Lerp(gx10, gx11, au), av));
+  VecF gy00 = Sub(i10, GatherPixels(img, rm, valid));
+  VecF gy01 = Sub(i11, GatherPixels(img, AddI(rm, kOne), valid));
+  VecF gy10 = Sub(GatherPixels(img, r2, valid), i00);
+  VecF gy11 = Sub(GatherPixels(img, AddI(r2, kOne), valid), i01);
+  grad_y = Mul(kHalf, Lerp(Lerp(gy00, gy01, au), Lerp(gy10, gy11, au), av));
+}
+
+// intensity and x gradient at column u of the rows starting at row (index of the first pixel of the row per lane),
+// i.e. along the epipolar line of rectified stereo images: 4 gathers
+inline void SampleEpipolar(const float* img, VecI row, VecF u, MaskF valid, VecF& value, VecF& grad){
+  VecF u0 = Floor(u);
+  VecF au = Sub(u, u0);
+  VecI idx = AddI(row, ToInt(Select(valid, u0, Zero())));
+  VecF i0 = Gather(img, idx, valid);
+  VecF i1 = Gather(img, AddI(idx, SetI1(1)), valid);
+  value = Lerp(i0, i1, au);
+  VecF g0 = Sub(i1, Gather(img, AddI(idx, SetI1(-1)), valid));
+  VecF g1 = Sub(Gather(img, AddI(idx, SetI1(2)), valid), i0);
+  grad = Mul(Set1(0.5f), Lerp(g0, g1, au));
+}
+
+void SampleBilinearPoints(const float* img, int stride, int rows, int cols, const float* u, const float* v, int num,
+                          float* value, float* grad_x, float* grad_y, unsigned char* valid){
+  for (int i = 0; i < num; i += kLanes){
+    int n = num - i;
+    VecF ui = Load(u + i, n);
+    VecF vi = Load(v + i, n);
+    MaskF in_bounds = And(SampleInBounds(ui, vi, rows, cols, 1), FirstN(n));
+    VecF val, gx, gy;
+    SampleBilinear(img, stride, ui, vi, in_bounds, val, gx, gy);
+    StorePartial(value + i, Select(in_bounds, val, Zero()), n);
+    StorePartial(grad_x + i, Select(in_bounds, gx, Zero()), n);
+    StorePartial(grad_y + i, Select(in_bounds, gy, Zero()), n);
+    unsigned int bits = MaskBits(in_bounds);
+    for (int k = 0; k < kLanes && k < n; k++){
+      valid[i + k] = (unsigned char)((bits >> k) & 1u);
+    }
+  }
+}
+
+/******************************** Residuals and jacobians of the pose optimization **********************************/
+// the images are float, uint8 or half float (Pixel, see LoadPixels()), the inverse depth is float with the same stride
+template <typename Pixel>
+int PoseResidualJacobianT(const Pixel* img1, const Pixel* img2, const float* inv_depth, int stride, int rows, int cols,
+                          int border, const float* camera, const float* transform, float* jaco, int jaco_stride,
+                          float* residual){
+  const VecF kFx = Set1(camera[0]);
+  const VecF kFy = Set1(camera[1]);
+  const VecF kCx = Set1(camera[2]);
+  const VecF kCy = Set1(camera[3]);
+  VecF t[12];
+  for (int k = 0; k < 12; k++) t[k] = Set1(transform[k]);
+  const VecF kOne = Set1(1.0f);
+  const VecF kMinInvDepth = Set1(0.01f);
+  int num = 0;
+  for (int y = border; y < rows - border; y++){
+    const Pixel* img1_row = img1 + y * stride;
+    const float* dep_row = inv_depth + y * stride;
+    const VecF kY = Set1(float(y));
+    for (int x = border; x < cols - border; x += kLanes){
+      int n = cols - border - x;
+      // skip invalid depth
+      VecF d = Load(dep_row + x, n);
+      MaskF valid = And(Le(kMinInvDepth, Abs(d)), FirstN(n));
+      // re-project to the camera frame of image 1
+      VecF px = ToFloat(AddI(IotaI(), SetI1(x)));
+      VecF z = Div(kOne, d);
+      VecF x3 = Div(Mul(z, Sub(px, kCx)), kFx);
+      VecF y3 = Div(Mul(z, Sub(kY, kCy)), kFy);
+      // transform to the camera frame of image 2 and project, must stay in front of the camera and inside the image
+      VecF wx = Add(Add(Add(Mul(t[0], x3), Mul(t[1], y3)), Mul(t[2], z)), t[3]);
+      VecF wy = Add(Add(Add(Mul(t[4], x3), Mul(t[5], y3)), Mul(t[6], z)), t[7]);
+      VecF wz = Add(Add(Add(Mul(t[8], x3), Mul(t[9], y3)), Mul(t[10], z)), t[11]);
+      valid = And(valid, Lt(Zero(), wz));
+      VecF u = Add(Div(Mul(kFx, wx), wz), kCx);
+      VecF v = Add(Div(Mul(kFy, wy), wz), kCy);
+      valid = And(valid, SampleInBounds(u, v, rows, cols, 1));
+      // bilinear intensity and gradient on image 2
+      VecF i2, grad_x, grad_y;
+      SampleBilinear(img2, stride, u, v, valid, i2, grad_x, grad_y);
+      VecF r = Sub(i2, LoadPixels(img1_row + x, n));
+      // jacobian of the projection w.r.t. the twist at the point of image 1, chained with the image gradient
+      VecF fx_z = Div(kFx, z);
+      VecF fy_z = Div(kFy, z);
+      VecF xy = Mul(x3, y3);
+      VecF xx_zz = Div(Mul(x3, x3), Mul(z, z));
+      VecF yy_zz = Div(Mul(y3, y3), Mul(z, z));
+      VecF j[6];
+      j[0] = Mul(grad_x, fx_z);
+      j[1] = Mul(grad_y, fy_z);
+      j[2] = Sub(Zero(), Add(Mul(grad_x, Div(Mul(fx_z, x3), z)), Mul(grad_y, Div(Mul(fy_z, y3), z))));
+      j[3] = Sub(Zero(), Add(Mul(grad_x, Div(Mul(fx_z, xy), z)), Mul(grad_y, Mul(kFy, Add(kOne, yy_zz)))));
+      j[4] = Add(Mul(grad_x, Mul(kFx, Add(kOne, xx_zz))), Mul(grad_y, Div(Mul(fy_z, xy), z)));
+      j[5] = Sub(Mul(grad_y, Mul(fy_z, x3)), Mul(grad_x, Mul(fx_z, y3)));
+      // compact the valid lanes, keeping the row-major order of the pixels
+      for (int k = 0; k < 6; k++){
+        CompressStore(jaco + k * jaco_stride + num, j[k], valid);
+      }
+      num += CompressStore(residual + num, r, valid);
+    }
+  }
+  return num;
+}
+
+int PoseResidualJacobian(const float* img1, const float* img2, const float* inv_depth, int stride, int rows, int cols,
+                         int border, const float* camera, const float* transform, float* jaco, int jaco_stride,
+                         float* residual){
+  return PoseResidualJacobianT(img1, img2, inv_depth, stride, rows, cols, border, camera, transform, jaco, jaco_stride,
+                               residual);
+}
+
+int PoseResidualJacobianU8(const unsigned char* img1, const unsigned char* img2, const float* inv_depth, int stride,
+                           int rows, int cols, int border, const float* camera, const float* transform, float* jaco,
+                           int jaco_stride, float* residual){
+  return PoseResidualJacobianT(img1, img2, inv_depth, stride, rows, cols, border, camera, transform, jaco, jaco_stride,
+                               residual);
+}
+
+int PoseResidualJacobianF16(const unsigned short* img1, const unsigned short* img2, const float* inv_depth, int stride,
+                            int rows, int cols, int border, const float* camera, const float* transform, float* jaco,
+                            int jaco_stride, float* residual){
+  return PoseResidualJacobianT(img1, img2, inv_depth, stride, rows, cols, border, camera, transform, jaco, jaco_stride,
+                               residual);
+}
+
+/********************************* Pattern residuals and jacobians of the pose optimization *******************************/
+// anchors per output group, a multiple of every lane count: the order of the outputs does not depend on the level
+const int kPatternGroup = 16;
+
+int PoseResidualJacobianPattern8(const float* img1, const float* img2, int stride, int rows, int cols, const int* xs,
+                                 const int* ys, const float* inv_depth, int num, const float* camera,
+                                 const float* transform, float* jaco, int jaco_stride, float* residual){
+  const VecF kFx = Set1(camera[0]);
+  const VecF kFy = Set1(camera[1]);
+  const VecF kCx = Set1(camera[2]);
+  const VecF kCy = Set1(camera[3]);
+  VecF t[12];
+  for (int k = 0; k < 12; k++) t[k] = Set1(transform[k]);
+  const VecF kOne = Set1(1.0f);
+  const VecF kMinInvDepth = Set1(0.01f);
+  const int kVecs = kPatternGroup / kLanes;
+  // per vector of anchors: warped position, anchor index in image 1 and the jacobian of the projection w.r.t. the
+  // twist, split by image axis: j = grad_x * jx + grad_y * jy
+  VecF u[kVecs], v[kVecs], jx[kVecs][6], jy[kVecs][6];
+  VecI anchor[kVecs];
+  MaskF valid[kVecs];
+  int out = 0;
+  for (int g = 0; g < num; g += kPatternGroup){
+    int num_vecs = (num - g + kLanes - 1) / kLanes;
+    if (num_vecs > kVecs) num_vecs = kVecs;
+    // warp each anchor once
+    for (int w = 0; w < num_vecs; w++){
+      int i = g + w * kLanes;
+      int n = num - i;
+      VecI xi = LoadPartialI(xs + i, n);
+      VecI yi = LoadPartialI(ys + i, n);
+      VecF d = Load(inv_depth + i, n);
+      valid[w] = And(Le(kMinInvDepth, Abs(d)), FirstN(n));
+      VecF px = ToFloat(xi);
+      VecF py = ToFloat(yi);
+      VecF z = Div(kOne, d);
+      VecF x3 = Div(Mul(z, Sub(px, kCx)), kFx);
+      VecF y3 = Div(Mul(z, Sub(py, kCy)), kFy);
+      VecF wx = Add(Add(Add(Mul(t[0], x3), Mul(t[1], y3)), Mul(t[2], z)), t[3]);
+      VecF wy = Add(Add(Add(Mul(t[4], x3), Mul(t[5], y3)), Mul(t[6], z)), t[7]);
+      VecF wz = Add(Add(Add(Mul(t[8], x3), Mul(t[9], y3)), Mul(t[10], z)), t[11]);
+      valid[w] = And(valid[w], Lt(Zero(), wz));
+      u[w] = Add(Div(Mul(kFx, wx), wz), kCx);
+      v[w] = Add(Div(Mul(kFy, wy), wz), kCy);
+      // the whole pattern (+-2 pixels) and its gradients must be inside image 2
+      valid[w] = And(valid[w], SampleInBounds(u[w], v[w], rows, cols, 3));
+      anchor[w] = AddI(MulI(yi, SetI1(stride)), xi);
+      VecF fx_z = Div(kFx, z);
+      VecF fy_z = Div(kFy, z);
+      VecF xy = Mul(x3, y3);
+      jx[w][0] = fx_z;
+      jy[w][0] = Zero();
+      jx[w][1] = Zero();
+      jy[w][1] = fy_z;
+      jx[w][2] = Sub(Zero(), Div(Mul(fx_z, x3), z));
+      jy[w][2] = Sub(Zero(), Div(Mul(fy_z, y3), z));
+      jx[w][3] = Sub(Zero(), Div(Mul(fx_z, xy), z));
+      jy[w][3] = Sub(Zero(), Mul(kFy, Add(kOne, Div(Mul(y3, y3), Mul(z, z)))));
+      jx[w][4] = Mul(kFx, Add(kOne, Div(Mul(x3, x3), Mul(z, z))));
+      jy[w][4] = Div(Mul(fy_z, xy), z);
+      jx[w][5] = Sub(Zero(), Mul(fx_z, y3));
+      jy[w][5] = Mul(fy_z, x3);
+    }
+    // the pattern keeps its shape in image 2, every point shares the warp and the geometric jacobian of its anchor
+    for (int p = 0; p < 8; p++){
+      const VecF kDu = Set1(float(kPattern8[p][1]));
+      const VecF kDv = Set1(float(kPattern8[p][0]));
+      const VecI kOffset = SetI1(kPattern8[p][0] * stride + kPattern8[p][1]);
+      for (int w = 0; w < num_vecs; w++){
+        VecF i2, grad_x, grad_y;
+        SampleBilinear(img2, stride, Add(u[w], kDu), Add(v[w], kDv), valid[w], i2, grad_x, grad_y);
+        VecF r = Sub(i2, Gather(img1, AddI(anchor[w], kOffset), valid[w]));
+        for (int k = 0; k < 6; k++){
+          CompressStore(jaco + k * jaco_stride + out, Add(Mul(grad_x, jx[w][k]), Mul(grad_y, jy[w][k])), valid[w]);
+        }
+        out += CompressStore(residual + out, r, valid[w]);
+      }
+    }
+  }
+  return out;
+}
+
+/********************************** Residuals of the inverse depth refinement **************************************/
+int DepthResidualJacobian(const float* left_img, const float* right_img, int stride, int rows, int cols,
+                          const int* xs, const int* ys, const float* inv_depth, int num, float tx_fx, float huber_delta,
+                          float* jtwj, float* b, float* energy, float* residual, float* err_sum){
+  const VecF kTxFx = Set1(tx_fx);
+  const VecF kHuber = Set1(huber_delta);
+  const VecF kOne = Set1(1.0f);
+  const VecF kTwo = Set1(2.0f);
+  const VecF kMaxX = Set1(float(cols - 3));
+  const VecF kMaxY = Set1(float(rows - 3));
+  const VecI kStride = SetI1(stride);
+  VecF acc_err = Zero();
+  int num_valid = 0;
+  for (int i = 0; i < num; i += kLanes){
+    int n = num - i;
+    VecI x = LoadPartialI(xs + i, n);
+    VecI y = LoadPartialI(ys + i, n);
+    VecF xf = ToFloat(x);
+    VecF yf = ToFloat(y);
+    VecF warped_x = Sub(xf, Mul(kTxFx, Load(inv_depth + i, n)));
+    // the pattern must stay inside both images, the warped one leaves some space to compute the gradient
+    MaskF valid = And(And(And(Le(kTwo, xf), Le(xf, kMaxX)), And(Le(kTwo, yf), Le(yf, kMaxY))), FirstN(n));
+    valid = And(valid, And(SampleInBoundsRow(Sub(warped_x, kTwo), cols, 1), SampleInBoundsRow(Add(warped_x, kTwo), cols, 1)));
+    VecI row = MulI(y, kStride);
+    VecF h = Zero();
+    VecF g = Zero();
+    VecF e = Zero();
+    VecF abs_sum = Zero();
+    // all pattern pixels share the inverse depth of the point, i.e. the same disparity
+    for (int t = 0; t < 8; t++){
+      VecI pattern_row = AddI(row, SetI1(kPattern8[t][0] * stride));
+      VecF left_val = Gather(left_img, AddI(pattern_row, AddI(x, SetI1(kPattern8[t][1]))), valid);
+      VecF right_val, right_grad;
+      SampleEpipolar(right_img, pattern_row, Add(warped_x, Set1(float(kPattern8[t][1]))), valid, right_val, right_grad);
+      VecF r = Sub(left_val, right_val);
+      VecF abs_r = Abs(r);
+      VecF w = Select(Le(abs_r, kHuber), kOne, Div(kHuber, abs_r));
+      VecF grad = Mul(kTxFx, right_grad);
+      h = Add(h, Mul(Mul(grad, grad), w));
+      g = Add(g, Mul(Mul(Sub(Zero(), grad), w), r));
+      e = Add(e, Mul(Mul(r, r), w));
+      abs_sum = Add(abs_sum, abs_r);
+    }
+    StorePartial(jtwj + i, Select(valid, h, Zero()), n);
+    StorePartial(b + i, Select(valid, g, Zero()), n);
+    StorePartial(energy + i, Select(valid, e, Zero()), n);
+    StorePartial(residual + i, Select(valid, Mul(abs_sum, Set1(0.125f)), Set1(-1000.0f)), n);
+    acc_err = Add(acc_err, Select(valid, e, Zero()));
+    num_valid += __builtin_popcount(MaskBits(valid));
+  }
+  *err_sum = ReduceAdd(acc_err);
+  return num_valid;
+}
+
+/********************************************* Whole image warping *************************************************/
+// camera and transform of the warp broadcast once per call
+struct WarpCamera{
+  VecF fx, fy, cx, cy;
+  VecF t[12];
+};
+
+inline WarpCamera MakeWarpCamera(const float* camera, const float* transform){
+  WarpCamera cam;
+  cam.fx = Set1(camera[0]);
+  cam.fy = Set1(camera[1]);
+  cam.cx = Set1(camera[2]);
+  cam.cy = Set1(camera[3]);
+  for (int k = 0; k < 12; k++) cam.t[k] = Set1(transform[k]);
+  return cam;
+}
+
+// re-project pixels (px, py) with inverse depth d of camera 1 into camera 2: image coordinates (u, v) and depth wz.
+// same operations as PoseResidualJacobian
+inline void WarpToCamera2(const WarpCamera& cam, VecF px, VecF py, VecF d, VecF& u, VecF& v, VecF& wz){
+  VecF z = Div(Set1(1.0f), d);
+  VecF x3 = Div(Mul(z, Sub(px, cam.cx)), cam.fx);
+  VecF y3 = Div(Mul(z, Sub(py, cam.cy)), cam.fy);
+  VecF wx = Add(Add(Add(Mul(cam.t[0], x3), Mul(cam.t[1], y3)), Mul(cam.t[2], z)), cam.t[3]);
+  VecF wy = Add(Add(Add(Mul(cam.t[4], x3), Mul(cam.t[5], y3)), Mul(cam.t[6], z)), cam.t[7]);
+  wz = Add(Add(Add(Mul(cam.t[8], x3), Mul(cam.t[9], y3)), Mul(cam.t[10], z)), cam.t[11]);
+  u = Add(Div(Mul(cam.fx, wx), wz), cam.cx);
+  v = Add(Div(Mul(cam.fy, wy), wz), cam.cy);
+}
+
+// *p = min(*p, value), rows of different threads may warp onto the same pixel
+inline void AtomicMinFloat(float* p, float value){
+  float current;
+  __atomic_load(p, &current, __ATOMIC_RELAXED);
+  while (value < current && !__atomic_compare_exchange(p, &current, &value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){}
+}
+
+void WarpDepthSplat(const float* inv_depth, int stride, int rows, int cols, int row_begin, int row_end,
+                    const float* camera, const float* transform, float* zbuffer){
+  const WarpCamera cam = MakeWarpCamera(camera, transform);
+  const VecF kHalf = Set1(0.5f);
+  const VecF kMaxU = Set1(float(cols - 1));
+  const VecF kMaxV = Set1(float(rows - 1));
+  const VecI kStride = SetI1(stride);
+  float depth_lanes[kLanes];
+  int idx_lanes[kLanes];
+  for (int y = row_begin; y < row_end; y++){
+    const float* dep_row = inv_depth + y * stride;
+    const VecF kY = Set1(float(y));
+    for (int x = 0; x < cols; x += kLanes){
+      int n = cols - x;
+      VecF d = Load(dep_row + x, n);
+      MaskF valid = And(Lt(Zero(), d), FirstN(n));
+      if (MaskBits(valid) == 0) continue;
+      VecF u, v, wz;
+      WarpToCamera2(cam, ToFloat(AddI(IotaI(), SetI1(x))), kY, d, u, v, wz);
+      // nearest pixel of image 2
+      VecF ur = Floor(Add(u, kHalf));
+      VecF vr = Floor(Add(v, kHalf));
+      valid = And(valid, And(Lt(Zero(), wz), And(And(Le(Zero(), ur), Le(ur, kMaxU)), And(Le(Zero(), vr), Le(vr, kMaxV)))));
+      unsigned int bits = MaskBits(valid);
+      if (bits == 0) continue;
+      StoreU(depth_lanes, wz);
+      StoreUI(idx_lanes, AddI(MulI(ToInt(Select(valid, vr, Zero())), kStride), ToInt(Select(valid, ur, Zero()))));
+      for (int i = 0; i < kLanes; i++){
+        if ((bits >> i) & 1u) AtomicMinFloat(zbuffer + idx_lanes[i], depth_lanes[i]);
+      }
+    }
+  }
+}
+
+void WarpImage(const float* img2, const float* inv_depth, int stride, int rows, int cols, int row_begin, int row_end,
+               const float* camera, const float* transform, const float* zbuffer, float* warped){
+  const WarpCamera cam = MakeWarpCamera(camera, transform);
+  const VecF kHalf = Set1(0.5f);
+  const VecF kOcclusion = Set1(1.0f + kWarpOcclusionTolerance);
+  const VecF kInvalid = Set1(kWarpInvalid);
+  const VecI kStride = SetI1(stride);
+  for (int y = row_begin; y < row_end; y++){
+    const float* dep_row = inv_depth + y * stride;
+    float* warped_row = warped + y * stride;
+    const VecF kY = Set1(float(y));
+    for (int x = 0; x < cols; x += kLanes){
+      int n = cols - x;
+      VecF d = Load(dep_row + x, n);
+      MaskF valid = And(Lt(Zero(), d), FirstN(n));
+      if (MaskBits(valid) == 0){
+        StorePartial(warped_row + x, kInvalid, n);
+        continue;
+      }
+      VecF u, v, wz;
+      WarpToCamera2(cam, ToFloat(AddI(IotaI(), SetI1(x))), kY, d, u, v, wz);
+      // the 2x2 neighbourhood of the bilinear sample must be inside image 2
+      valid = And(valid, And(Lt(Zero(), wz), SampleInBounds(u, v, rows, cols, 0)));
+      VecF value = SampleBilinearValue(img2, stride, u, v, valid);
+      // z-test against the nearest point warped onto the same pixel
+      VecI nearest = AddI(MulI(ToInt(Select(valid, Floor(Add(v, kHalf)), Zero())), kStride),
+                          ToInt(Select(valid, Floor(Add(u, kHalf)), Zero())));
+      valid = And(valid, Le(wz, Mul(Gather(zbuffer, nearest, valid), kOcclusion)));
+      StorePartial(warped_row + x, Select(valid, value, kInvalid), n);
+    }
+  }
+}
+
+/************************************** Pyramidal Lucas-Kanade feature tracking ************************************/
+void KltTrack(const float* img1, const float* img2, int stride, int rows, int cols, const float* x1, const float* y1,
+              int num, int radius, int iterations, float* x2, float* y2, unsigned char* status){
+  if (radius > kKltMaxRadius) radius = kKltMaxRadius;
+  const VecF kOne = Set1(1.0f);
+  const VecF kRadius = Set1(float(radius));
+  const VecF kMinStepSqr = Set1(kKltMinStep * kKltMinStep);
+  const VecF kMinConditioning = Set1(1e-3f);
+  // template intensities and gradients of the window, fixed over the iterations (inverse compositional)
+  VecF tmpl[(2 * kKltMaxRadius + 1) * (2 * kKltMaxRadius + 1)];
+  VecF tmpl_gx[(2 * kKltMaxRadius + 1) * (2 * kKltMaxRadius + 1)];
+  VecF tmpl_gy[(2 * kKltMaxRadius + 1) * (2 * kKltMaxRadius + 1)];
+  for (int i = 0; i < num; i += kLanes){
+    int n = num - i;
+    VecF u1 = Load(x1 + i, n);
+    VecF v1 = Load(y1 + i, n);
+    MaskF active = And(And(SampleInBounds(Sub(u1, kRadius), Sub(v1, kRadius), rows, cols, 1),
+                           SampleInBounds(Add(u1, kRadius), Add(v1, kRadius), rows, cols, 1)), FirstN(n));
+    VecF h00 = Zero(), h01 = Zero(), h11 = Zero();
+    int k = 0;
+    for (int dy = -radius; dy <= radius; dy++){
+      for (int dx = -radius; dx <= radius; dx++, k++){
+        SampleBilinear(img1, stride, Add(u1, Set1(float(dx))), Add(v1, Set1(float(dy))), active, tmpl[k], tmpl_gx[k],
+                       tmpl_gy[k]);
+        h00 = Add(h00, Mul(tmpl_gx[k], tmpl_gx[k]));
+        h01 = Add(h01, Mul(tmpl_gx[k], tmpl_gy[k]));
+        h11 = Add(h11, Mul(tmpl_gy[k], tmpl_gy[k]));
+      }
+    }
+    // reject flat and edge-like windows: det / trace^2 is 1/4 for isotropic gradients, 0 along a straight edge
+    VecF det = Sub(Mul(h00, h11), Mul(h01, h01));
+    VecF trace = Add(h00, h11);
+    active = And(active, Lt(Mul(kMinConditioning, Mul(trace, trace)), det));
+    VecF inv_det = Div(kOne, Select(active, det, kOne));
+    VecF u2 = Load(x2 + i, n);
+    VecF v2 = Load(y2 + i, n);
+    MaskF moving = active;
+    for (int it = 0; it < iterations && MaskBits(moving) != 0; it++){
+      // a window leaving image 2 freezes the feature, it fails the final bounds check
+      moving = And(moving, And(SampleInBounds(Sub(u2, kRadius), Sub(v2, kRadius), rows, cols, 0),
+                               SampleInBounds(Add(u2, kRadius), Add(v2, kRadius), rows, cols, 0)));
+      VecF b0 = Zero(), b1 = Zero();
+      k = 0;
+      for (int dy = -radius; dy <= radius; dy++){
+        for (int dx = -radius; dx <= radius; dx++, k++){
+          VecF r = Sub(SampleBilinearValue(img2, stride, Add(u2, Set1(float(dx))), Add(v2, Set1(float(dy))), moving),
+                       tmpl[k]);
+          b0 = Add(b0, Mul(tmpl_gx[k], r));
+          b1 = Add(b1, Mul(tmpl_gy[k], r));
+        }
+      }
+      VecF du = Mul(Sub(Mul(h11, b0), Mul(h01, b1)), inv_det);
+      VecF dv = Mul(Sub(Mul(h00, b1), Mul(h01, b0)), inv_det);
+      u2 = Select(moving, Sub(u2, du), u2);
+      v2 = Select(moving, Sub(v2, dv), v2);
+      moving = And(moving, Le(kMinStepSqr, Add(Mul(du, du), Mul(dv, dv))));
+    }
+    MaskF tracked = And(active, And(SampleInBounds(Sub(u2, kRadius), Sub(v2, kRadius), rows, cols, 0),
+                                    SampleInBounds(Add(u2, kRadius), Add(v2, kRadius), rows, cols, 0)));
+    StorePartial(x2 + i, u2, n);
+    StorePartial(y2 + i, v2, n);
+    unsigned int bits = MaskBits(tracked);
+    for (int l = 0; l < kLanes && l < n; l++){
+      status[i + l] = (unsigned char)((bits >> l) & 1u);
+    }
+  }
+}
+
+/************************************************** FAST corners ***************************************************/
+// 1 where the circular flags (0 or 1) of kFastCircle contain 9 contiguous ones, else 0. products of the flags instead
+// of run lengths: independent operations, and no branches for the scalar variant
+inline VecF FastArc9(const VecF* flags){
+  VecF pairs[16], quads[16];
+  for (int k = 0; k < 16; k++) pairs[k] = Mul(flags[k], flags[(k + 1) & 15]);
+  for (int k = 0; k < 16; k++) quads[k] = Mul(pairs[k], pairs[(k + 2) & 15]);
+  VecF arc = Zero();
+  for (int k = 0; k < 16; k++) arc = Max(arc, Mul(Mul(quads[k], quads[(k + 4) & 15]), flags[(k + 8) & 15]));
+  return arc;
+}
+
+void FastScoreRow(const float* row, int stride, int cols, float threshold, float* score){
+  const VecF kThreshold = Set1(threshold);
+  const VecF kOne = Set1(1.0f);
+  const VecF kTwo = Set1(2.0f);
+  int offsets[16];
+  for (int k = 0; k < 16; k++) offsets[k] = kFastCircle[k][1] * stride + kFastCircle[k][0];
+  for (int x = 0; x < cols && x < 3; x++) score[x] = 0.0f;
+  for (int x = (cols > 6 ? cols - 3 : 3); x < cols; x++) score[x] = 0.0f;
+  for (int x = 3; x < cols - 3; x += kLanes){
+    int n = cols - 3 - x;
+    const float* center = row + x;
+    VecF bright = Add(Load(center, n), kThreshold);
+    VecF dark = Sub(Load(center, n), kThreshold);
+    // quick reject: every arc of 9 contains at least 2 of the pixels 0, 4, 8, 12
+    VecF num_bright = Zero(), num_dark = Zero();
+    for (int k = 0; k < 16; k += 4){
+      VecF value = Load(center + offsets[k], n);
+      num_bright = Add(num_bright, Select(Lt(bright, value), kOne, Zero()));
+      num_dark = Add(num_dark, Select(Lt(value, dark), kOne, Zero()));
+    }
+    VecF num_max = Select(Lt(num_bright, num_dark), num_dark, num_bright);
+    if (MaskBits(And(Le(kTwo, num_max), FirstN(n))) == 0){
+      StorePartial(score + x, Zero(), n);
+      continue;
+    }
+    VecF is_bright[16], is_dark[16]; // 1 for the brighter (darker) pixels, 0 otherwise
+    VecF bright_score = Zero(), dark_score = Zero();
+    for (int k = 0; k < 16; k++){
+      VecF value = Load(center + offsets[k], n);
+      is_bright[k] = Select(Lt(bright, value), kOne, Zero());
+      is_dark[k] = Select(Lt(value, dark), kOne, Zero());
+      bright_score = Add(bright_score, Mul(is_bright[k], Sub(value, bright)));
+      dark_score = Add(dark_score, Mul(is_dark[k], Sub(dark, value)));
+    }
+    StorePartial(score + x, Max(Mul(FastArc9(is_bright), bright_score), Mul(FastArc9(is_dark), dark_score)), n);
+  }
+}
+
+/*********************************************** Half float storage ************************************************/
+void ConvertToHalf(const float* src, int num, unsigned short* dst){
+  for (int i = 0; i < num; i += kLanes){
+    StoreF16(dst + i, Load(src + i, num - i), num - i);
+  }
+}
+
+void ConvertFromHalf(const unsigned short* src, int num, float* dst){
+  for (int i = 0; i < num; i += kLanes){
+    StorePartial(dst + i, LoadF16(src + i, num - i), num - i);
+  }
+}
+
+/********************************************* Semi-global matching ************************************************/
+// bits set in each lane, lanes below 2^31
+inline VecI PopCount(VecI x){
+  x = SubI(x, AndI(ShiftRightI(x, 1), SetI1(0x55555555)));
+  x = AddI(AndI(x, SetI1(0x33333333)), AndI(ShiftRightI(x, 2), SetI1(0x33333333)));
+  x = AndI(AddI(x, ShiftRightI(x, 4)), SetI1(0x0f0f0f0f));
+  x = AddI(x, ShiftRightI(x, 8));
+  x = AddI(x, ShiftRightI(x, 16));
+  return AndI(x, SetI1(0x3f));
+}
+
+void CensusRow(const float* row, int stride, int cols, unsigned int* census){
+  int end = cols - 2;
+  for (int x = 0; x < cols && x < 2; x++) census[x] = 0;
+  for (int x = end > 2 ? end : 2; x < cols; x++) census[x] = 0;
+  for (int x = 2; x < end; x += kLanes){
+    int n = end - x;
+    VecF center = Load(row + x, n);
+    VecI bits = SetI1(0);
+    int bit = 0;
+    for (int dy = -2; dy <= 2; dy++){
+      for (int dx = -2; dx <= 2; dx++){
+        if (dy == 0 && dx == 0) continue;
+        MaskF darker = Lt(Load(row + dy * stride + x + dx, n), center);
+        bits = AddI(bits, SelectI(darker, SetI1(1 << bit), SetI1(0)));
+        bit++;
+      }
+    }
+    int tmp[kLanes];
+    StoreUI(tmp, bits);
+    for (int i = 0; i < kLanes && i < n; i++) census[x + i] = (unsigned int)tmp[i];
+  }
+}
+
+void SgmCostRow(const unsigned int* left, const unsigned int* right, int cols, int num_disp, unsigned int* scratch,
+                unsigned char* cost){
+  // the right row reversed, scratch[cols - 1 - x + d] = right[x - d]: contiguous in d. the tail is never valid
+  for (int i = 0; i < cols; i++) scratch[i] = right[cols - 1 - i];
+  for (int i = cols; i < cols + num_disp; i++) scratch[i] = 0;
+  const VecI kMaxCost = SetI1(kCensusBits);
+  const VecF kIota = ToFloat(IotaI());
+  for (int x = 0; x < cols; x++){
+    VecI census = SetI1(int(left[x]));
+    const int* reversed = (const int*)(scratch + cols - 1 - x);
+    unsigned char* cost_x = cost + x * num_disp;
+    for (int d = 0; d < num_disp; d += kLanes){
+      VecI distance = PopCount(XorI(census, LoadPartialI(reversed + d, kLanes)));
+      MaskF outside = Lt(Set1(float(x)), Add(kIota, Set1(float(d)))); // x < d
+      StoreU8I(cost_x + d, SelectI(outside, kMaxCost, distance));
+    }
+  }
+}
+
+void SgmAggregateRow(const unsigned char* cost, int cols, int num_disp, int dx, const unsigned short* prev,
+                     unsigned short* cur, unsigned short* sum, unsigned short p1, unsigned short p2){
+  const int kPixel = num_disp + 2;
+  const VecW kP1 = SetW1(p1);
+  for (int i = 0; i < cols; i++){
+    int x = dx < 0 ? cols - 1 - i : i;
+    const unsigned char* cost_x = cost + x * num_disp;
+    unsigned short* path = cur + x * kPixel;
+    unsigned short* sum_x = sum + x * num_disp;
+    path[0] = 0xffff;
+    path[num_disp + 1] = 0xffff;
+    int prev_x = x - dx;
+    if (prev_x < 0 || prev_x >= cols || (prev == nullptr && dx == 0)){
+      // start of the path
+      for (int d = 0; d < num_disp; d += kWordLanes){
+        VecW path_cost = LoadU8W(cost_x + d);
+        StoreW(path + 1 + d, path_cost);
+        StoreW(sum_x + d, AddSatW(LoadW(sum_x + d), path_cost));
+      }
+      continue;
+    }
+    const unsigned short* prev_path = (prev != nullptr ? prev : cur) + prev_x * kPixel;
+    VecW prev_min = LoadW(prev_path + 1);
+    for (int d = kWordLanes; d < num_disp; d += kWordLanes) prev_min = MinW(prev_min, LoadW(prev_path + 1 + d));
+    unsigned short min_prev = ReduceMinW(prev_min);
+    const VecW kMinPrev = SetW1(min_prev);
+    const VecW kJump = AddSatW(kMinPrev, SetW1(p2));
+    for (int d = 0; d < num_disp; d += kWordLanes){
+      VecW step = AddSatW(MinW(LoadW(prev_path + d), LoadW(prev_path + 2 + d)), kP1);
+      VecW best = MinW(MinW(LoadW(prev_path + 1 + d), step), kJump);
+      VecW path_cost = AddSatW(LoadU8W(cost_x + d), SubW(best, kMinPrev));
+      StoreW(path + 1 + d, path_cost);
+      StoreW(sum_x + d, AddSatW(LoadW(sum_x + d), path_cost));
+    }
+  }
+}
+
+void SgmSelectRow(const unsigned short* sum, int cols, int num_disp, float uniqueness, float* disparity){
+  const VecF kIota = ToFloat(IotaI());
+  const VecF kLarge = Set1(1e+10f);
+  for (int x = 0; x < cols; x++){
+    const unsigned short* sum_x = sum + x * num_disp;
+    // per lane: smallest sum and its first disparity
+    VecF best = kLarge, best_disp = Zero();
+    for (int d = 0; d < num_disp; d += kLanes){
+      VecF value = LoadU16(sum_x + d);
+      MaskF smaller = Lt(value, best);
+      best = Select(smaller, value, best);
+      best_disp = Select(smaller, Add(kIota, Set1(float(d))), best_disp);
+    }
+    float lane_best[kLanes], lane_disp[kLanes];
+    StoreU(lane_best, best);
+    StoreU(lane_disp, best_disp);
+    float min_sum = lane_best[0], min_disp = lane_disp[0];
+    for (int i = 1; i < kLanes; i++){
+      if (lane_best[i] < min_sum || (lane_best[i] == min_sum && lane_disp[i] < min_disp)){
+        min_sum = lane_best[i];
+        min_disp = lane_disp[i];
+      }
+    }
+    // uniqueness against the disparities which are not neighbours of the best one
+    VecF second = kLarge;
+    const VecF kMinDisp = Set1(min_disp);
+    for (int d = 0; d < num_disp; d += kLanes){
+      MaskF far = Lt(Set1(1.5f), Abs(Sub(Add(kIota, Set1(float(d))), kMinDisp)));
+      second = Min(second, Select(far, LoadU16(sum_x + d), kLarge));
+    }
+    float lane_second[kLanes];
+    StoreU(lane_second, second);
+    float min_second = lane_second[0];
+    for (int i = 1; i < kLanes; i++) min_second = lane_second[i] < min_second ? lane_second[i] : min_second;
+    if (min_sum > uniqueness * min_second){
+      disparity[x] = -1.0f;
+      continue;
+    }
+    int d = int(min_disp);
+    float offset = 0.0f;
+    if (d > 0 && d < num_disp - 1){
+      float prev_sum = float(sum_x[d - 1]), next_sum = float(sum_x[d + 1]);
+      float curvature = prev_sum - 2.0f * min_sum + next_sum;
+      if (curvature > 0.0f) offset = (prev_sum - next_sum) / (2.0f * curvature);
+    }
+    disparity[x] = min_disp + offset;
+  }
+}
+
+/********************************************* Sparse depth codec **************************************************/
+int SparseEncodeRow(const float* values, const unsigned char* mask, int cols, float scale, int* xs,
+                    unsigned short* quantized){
+  // the valid columns, kByteLanes mask bytes per test
+  int num = 0;
+  int x = 0;
+  for (; x + kByteLanes <= cols; x += kByteLanes){
+    unsigned long long bits = NonZeroBytes(mask + x);
+    while (bits != 0){
+      xs[num++] = x + __builtin_ctzll(bits);
+      bits &= bits - 1;
+    }
+  }
+  for (; x < cols; x++){
+    if (mask[x] != 0) xs[num++] = x;
+  }
+  const VecF kScale = Set1(scale);
+  const VecF kMaxValue = Set1(65535.0f);
+  for (int i = 0; i < num; i += kLanes){
+    int n = num - i;
+    VecF value = Gather(values, LoadPartialI(xs + i, n), FirstN(n));
+    // Max returns its second operand for NaN
+    StorePartialU16(quantized + i, ToIntRound(Min(Max(Mul(value, kScale), Zero()), kMaxValue)), n);
+  }
+  return num;
+}
+
+void SparseDecodeRow(const unsigned short* quantized, const int* xs, int num, float step, float* values){
+  const VecF kStep = Set1(step);
+  for (int i = 0; i < num; i += kLanes){
+    int n = num - i;
+    ScatterPartial(values, LoadPartialI(xs + i, n), Mul(LoadPartialU16(quantized + i, n), kStep), n);
+  }
+}
+
+/***************************************************** Table *******************************************************/
+const SimdKernels kKernelTable = {
+  ODOMETRY_SIMD_LEVEL,
+  ODOMETRY_SIMD_NAME,
+  &SsdPattern8Search,
+  &PyramidDown,
+  &AccumulateNormalEquations,
+  &PoseResidualJacobian,
+  &DepthResidualJacobian,
+  &WarpDepthSplat,
+  &WarpImage,
+  &SampleBilinearPoints,
+  &PoseResidualJacobianU8,
+  &PoseResidualJacobianF16,
+  &ConvertToHalf,
+  &ConvertFromHalf,
+  &PoseResidualJacobianPattern8,
+  &KltTrack,
+  &FastScoreRow,
+  &CensusRow,
+  &SgmCostRow,
+  &SgmAggregateRow,
+  &SgmSelectRow,
+  &SparseEncodeRow,
+  &SparseDecodeRow
+};
+
+const SimdKernels& GetKernelTable(){
+  return kKernelTable;
+}
+
+} // namespace ODOMETRY_SIMD_NS
+} // namespace simd
+} // namespace odometry
+
+#endif //ODOMETRY_SIMD_KERNELS_IMPL_H
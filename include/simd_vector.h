@@ -0,0 +1,596 @@
+// The header file contains a small SIMD abstraction for the per-ISA kernel translation units (src/simd_kernels_*.cpp).
+// A kernel TU defines ODOMETRY_SIMD_NS and exactly one of ODOMETRY_SIMD_{SCALAR,SSE42,AVX2,AVX512} before including
+// this file. Every ISA then gets its own VecF (float lanes), VecI (int32 lanes), VecW (uint16 lanes) and MaskF types in
+// its own namespace odometry::simd::ODOMETRY_SIMD_NS, so the kernels in simd_kernels_impl.h are written once for all of
+// them.
+// NOTE:
+//  * only include this header from the kernel TUs, never from code compiled with the baseline flags
+//  * do not use STL/Eigen templates in the kernel TUs: their out-of-line copies would be merged by the linker with the
+//    baseline ones and leak AVX instructions into code that runs on older CPUs
+
+#ifndef ODOMETRY_SIMD_VECTOR_H
+#define ODOMETRY_SIMD_VECTOR_H
+
+#if !defined(ODOMETRY_SIMD_NS)
+#error "ODOMETRY_SIMD_NS must be defined before including simd_vector.h"
+#endif
+
+#include <string.h>
+#if !defined(ODOMETRY_SIMD_SCALAR)
+#include <immintrin.h>
+#endif
+
+namespace odometry
+{
+namespace simd
+{
+namespace ODOMETRY_SIMD_NS
+{
+
+// IEEE half precision <-> float in software, round to nearest even: same results as the F16C instructions, used by the
+// instruction sets without F16C
+inline float HalfToFloat(unsigned short h){
+  unsigned int sign = (unsigned int)(h & 0x8000u) << 16;
+  unsigned int exponent = (h >> 10) & 0x1fu;
+  unsigned int mantissa = h & 0x3ffu;
+  unsigned int bits;
+  if (exponent == 0x1fu){ // inf, nan (quiet)
+    bits = sign | 0x7f800000u | (mantissa != 0 ? 0x400000u | (mantissa << 13) : 0u);
+  } else if (exponent != 0){
+    bits = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+  } else if (mantissa == 0){
+    bits = sign;
+  } else{ // subnormal half, normal float
+    unsigned int float_exponent = 113;
+    while ((mantissa & 0x400u) == 0){
+      mantissa <<= 1;
+      float_exponent--;
+    }
+    bits = sign | (float_exponent << 23) | ((mantissa & 0x3ffu) << 13);
+  }
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+inline unsigned short FloatToHalf(float f){
+  unsigned int bits;
+  memcpy(&bits, &f, sizeof(f));
+  unsigned int sign = (bits >> 16) & 0x8000u;
+  unsigned int abs_bits = bits & 0x7fffffffu;
+  if (abs_bits >= 0x7f800000u){ // inf, nan (quiet)
+    return (unsigned short)(sign | 0x7c00u | (abs_bits > 0x7f800000u ? 0x200u | ((abs_bits >> 13) & 0x3ffu) : 0u));
+  }
+  if (abs_bits >= 0x477ff000u) return (unsigned short)(sign | 0x7c00u); // rounds beyond 65504: inf
+  if (abs_bits < 0x38800000u){ // subnormal half or zero
+    if (abs_bits <= 0x33000000u) return (unsigned short)sign; // <= 2^-25 rounds to zero
+    unsigned int shift = 126u - (abs_bits >> 23);
+    unsigned int mantissa = (abs_bits & 0x7fffffu) | 0x800000u;
+    unsigned int h = mantissa >> shift;
+    unsigned int rest = mantissa & ((1u << shift) - 1u);
+    unsigned int half_way = 1u << (shift - 1u);
+    if (rest > half_way || (rest == half_way && (h & 1u))) h++;
+    return (unsigned short)(sign | h);
+  }
+  unsigned int h = (abs_bits - 0x38000000u) >> 13; // re-bias the exponent from 127 to 15
+  unsigned int rest = abs_bits & 0x1fffu;
+  if (rest > 0x1000u || (rest == 0x1000u && (h & 1u))) h++; // may carry into the exponent
+  return (unsigned short)(sign | h);
+}
+
+#if defined(ODOMETRY_SIMD_AVX512)
+/******************************************* AVX-512: 16 float lanes ***********************************************/
+const int kLanes = 16;
+struct VecF{ __m512 v; };
+struct VecI{ __m512i v; };
+typedef __mmask16 MaskF;
+
+inline VecF Set1(float a){ return VecF{_mm512_set1_ps(a)}; }
+inline VecF LoadU(const float* p){ return VecF{_mm512_loadu_ps(p)}; }
+inline MaskF FirstN(int n){ return n >= 16 ? MaskF(0xffff) : MaskF((1u << (n > 0 ? n : 0)) - 1u); }
+inline VecF LoadPartial(const float* p, int n){ return VecF{_mm512_maskz_loadu_ps(FirstN(n), p)}; }
+inline void StoreU(float* p, VecF a){ _mm512_storeu_ps(p, a.v); }
+inline void StorePartial(float* p, VecF a, int n){ _mm512_mask_storeu_ps(p, FirstN(n), a.v); }
+inline VecF Add(VecF a, VecF b){ return VecF{_mm512_add_ps(a.v, b.v)}; }
+inline VecF Sub(VecF a, VecF b){ return VecF{_mm512_sub_ps(a.v, b.v)}; }
+inline VecF Mul(VecF a, VecF b){ return VecF{_mm512_mul_ps(a.v, b.v)}; }
+inline VecF Div(VecF a, VecF b){ return VecF{_mm512_div_ps(a.v, b.v)}; }
+inline VecF Min(VecF a, VecF b){ return VecF{_mm512_min_ps(a.v, b.v)}; }
+inline VecF Max(VecF a, VecF b){ return VecF{_mm512_max_ps(a.v, b.v)}; }
+inline VecF Abs(VecF a){ return VecF{_mm512_abs_ps(a.v)}; }
+inline VecF Floor(VecF a){ return VecF{_mm512_roundscale_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)}; }
+inline MaskF Lt(VecF a, VecF b){ return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ); }
+inline MaskF Le(VecF a, VecF b){ return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ); }
+inline MaskF And(MaskF a, MaskF b){ return MaskF(a & b); }
+inline VecF Select(MaskF m, VecF a, VecF b){ return VecF{_mm512_mask_blend_ps(m, b.v, a.v)}; }
+inline unsigned int MaskBits(MaskF m){ return (unsigned int)m; }
+inline float ReduceAdd(VecF a){ return _mm512_reduce_add_ps(a.v); }
+
+inline VecI SetI1(int a){ return VecI{_mm512_set1_epi32(a)}; }
+inline VecI IotaI(){ return VecI{_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)}; }
+inline VecI LoadPartialI(const int* p, int n){ return VecI{_mm512_maskz_loadu_epi32(FirstN(n), p)}; }
+inline void StoreUI(int* p, VecI a){ _mm512_storeu_si512(p, a.v); }
+inline VecI AddI(VecI a, VecI b){ return VecI{_mm512_add_epi32(a.v, b.v)}; }
+inline VecI MulI(VecI a, VecI b){ return VecI{_mm512_mullo_epi32(a.v, b.v)}; }
+inline VecI SelectI(MaskF m, VecI a, VecI b){ return VecI{_mm512_mask_blend_epi32(m, b.v, a.v)}; }
+inline VecI MinI(VecI a, VecI b){ return VecI{_mm512_min_epi32(a.v, b.v)}; }
+inline VecI MaxI(VecI a, VecI b){ return VecI{_mm512_max_epi32(a.v, b.v)}; }
+inline VecI ToInt(VecF a){ return VecI{_mm512_cvttps_epi32(a.v)}; }
+inline VecF ToFloat(VecI a){ return VecF{_mm512_cvtepi32_ps(a.v)}; }
+// masked gather, the disabled lanes are set to zero and never touch memory
+inline VecF Gather(const float* base, VecI idx, MaskF m){
+  return VecF{_mm512_mask_i32gather_ps(_mm512_setzero_ps(), m, idx.v, base, 4)};
+}
+// store the enabled lanes contiguously to p, return the number of stored lanes
+inline int CompressStore(float* p, VecF a, MaskF m){
+  _mm512_mask_compressstoreu_ps(p, m, a.v);
+  return __builtin_popcount((unsigned int)m);
+}
+// odd elements of the concatenation [lo, hi]
+inline VecF DeinterleaveOdd(VecF lo, VecF hi){
+  const __m512i kIdx = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+  return VecF{_mm512_permutex2var_ps(lo.v, kIdx, hi.v)};
+}
+// compact pixels (uint8 and half floats, see ImagePyramid) converted to float in registers. the gathers read the 32 bit
+// word at the pixel address and keep its low bits, i.e. up to 3 bytes behind the pixel: the buffers must be padded
+inline VecF LoadU8(const unsigned char* p, int n){
+  return VecF{_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8(FirstN(n), p)))};
+}
+inline VecF LoadF16(const unsigned short* p, int n){ return VecF{_mm512_cvtph_ps(_mm256_maskz_loadu_epi16(FirstN(n), p))}; }
+inline void StoreF16(unsigned short* p, VecF a, int n){
+  _mm256_mask_storeu_epi16(p, FirstN(n), _mm512_cvtps_ph(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+}
+inline VecF GatherU8(const unsigned char* base, VecI idx, MaskF m){
+  __m512i word = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), m, idx.v, base, 1);
+  return VecF{_mm512_cvtepi32_ps(_mm512_and_si512(word, _mm512_set1_epi32(0xff)))};
+}
+inline VecF GatherF16(const unsigned short* base, VecI idx, MaskF m){
+  __m512i word = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), m, idx.v, base, 2);
+  return VecF{_mm512_cvtph_ps(_mm512_cvtepi32_epi16(word))};
+}
+
+// integer lanes of the census costs (semi-global matching): logical shift, bit operations, low byte of each lane
+inline VecI SubI(VecI a, VecI b){ return VecI{_mm512_sub_epi32(a.v, b.v)}; }
+inline VecI AndI(VecI a, VecI b){ return VecI{_mm512_and_si512(a.v, b.v)}; }
+inline VecI XorI(VecI a, VecI b){ return VecI{_mm512_xor_si512(a.v, b.v)}; }
+inline VecI ShiftRightI(VecI a, int n){ return VecI{_mm512_srl_epi32(a.v, _mm_cvtsi32_si128(n))}; }
+inline void StoreU8I(unsigned char* p, VecI a){ _mm_storeu_si128((__m128i*)p, _mm512_cvtepi32_epi8(a.v)); }
+inline VecF LoadU16(const unsigned short* p){
+  return VecF{_mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)p)))};
+}
+
+// sparse depth codec: one bit per mask byte, rounding to the nearest integer (even on ties, MXCSR default), 16 bit
+// quantized values, scatter of the decoded values. values stored as 16 bit must be in [0, 65535]
+const int kByteLanes = 64;
+inline unsigned long long NonZeroBytes(const unsigned char* p){
+  __m512i bytes = _mm512_loadu_si512(p);
+  return (unsigned long long)_mm512_test_epi8_mask(bytes, bytes);
+}
+inline VecI ToIntRound(VecF a){ return VecI{_mm512_cvtps_epi32(a.v)}; }
+inline void StorePartialU16(unsigned short* p, VecI a, int n){ _mm256_mask_storeu_epi16(p, FirstN(n), _mm512_cvtepi32_epi16(a.v)); }
+inline VecF LoadPartialU16(const unsigned short* p, int n){
+  return VecF{_mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(_mm256_maskz_loadu_epi16(FirstN(n), p)))};
+}
+inline void ScatterPartial(float* base, VecI idx, VecF a, int n){ _mm512_mask_i32scatter_ps(base, FirstN(n), idx.v, a.v, 4); }
+
+// unsigned 16 bit lanes of the path costs (semi-global matching), all loads and stores are full vectors
+const int kWordLanes = 32;
+struct VecW{ __m512i v; };
+inline VecW SetW1(unsigned short a){ return VecW{_mm512_set1_epi16((short)a)}; }
+inline VecW LoadW(const unsigned short* p){ return VecW{_mm512_loadu_si512(p)}; }
+inline void StoreW(unsigned short* p, VecW a){ _mm512_storeu_si512(p, a.v); }
+inline VecW LoadU8W(const unsigned char* p){ return VecW{_mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*)p))}; }
+inline VecW AddSatW(VecW a, VecW b){ return VecW{_mm512_adds_epu16(a.v, b.v)}; }
+inline VecW SubW(VecW a, VecW b){ return VecW{_mm512_sub_epi16(a.v, b.v)}; }
+inline VecW MinW(VecW a, VecW b){ return VecW{_mm512_min_epu16(a.v, b.v)}; }
+inline unsigned short ReduceMinW(VecW a){
+  __m256i half = _mm256_min_epu16(_mm512_castsi512_si256(a.v), _mm512_extracti64x4_epi64(a.v, 1));
+  __m128i quarter = _mm_min_epu16(_mm256_castsi256_si128(half), _mm256_extracti128_si256(half, 1));
+  return (unsigned short)_mm_cvtsi128_si32(_mm_minpos_epu16(quarter));
+}
+
+#elif defined(ODOMETRY_SIMD_AVX2)
+/********************************************* AVX2: 8 float lanes *************************************************/
+const int kLanes = 8;
+struct VecF{ __m256 v; };
+struct VecI{ __m256i v; };
+typedef __m256 MaskF; // all ones/zeros per lane
+
+inline VecF Set1(float a){ return VecF{_mm256_set1_ps(a)}; }
+inline VecF LoadU(const float* p){ return VecF{_mm256_loadu_ps(p)}; }
+inline MaskF FirstN(int n){
+  return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(n), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+}
+inline VecF LoadPartial(const float* p, int n){ return VecF{_mm256_maskload_ps(p, _mm256_castps_si256(FirstN(n)))}; }
+inline void StoreU(float* p, VecF a){ _mm256_storeu_ps(p, a.v); }
+inline void StorePartial(float* p, VecF a, int n){ _mm256_maskstore_ps(p, _mm256_castps_si256(FirstN(n)), a.v); }
+inline VecF Add(VecF a, VecF b){ return VecF{_mm256_add_ps(a.v, b.v)}; }
+inline VecF Sub(VecF a, VecF b){ return VecF{_mm256_sub_ps(a.v, b.v)}; }
+inline VecF Mul(VecF a, VecF b){ return VecF{_mm256_mul_ps(a.v, b.v)}; }
+inline VecF Div(VecF a, VecF b){ return VecF{_mm256_div_ps(a.v, b.v)}; }
+inline VecF Min(VecF a, VecF b){ return VecF{_mm256_min_ps(a.v, b.v)}; }
+inline VecF Max(VecF a, VecF b){ return VecF{_mm256_max_ps(a.v, b.v)}; }
+inline VecF Abs(VecF a){ return VecF{_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v)}; }
+inline VecF Floor(VecF a){ return VecF{_mm256_floor_ps(a.v)}; }
+inline MaskF Lt(VecF a, VecF b){ return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline MaskF Le(VecF a, VecF b){ return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+inline MaskF And(MaskF a, MaskF b){ return _mm256_and_ps(a, b); }
+inline VecF Select(MaskF m, VecF a, VecF b){ return VecF{_mm256_blendv_ps(b.v, a.v, m)}; }
+inline unsigned int MaskBits(MaskF m){ return (unsigned int)_mm256_movemask_ps(m); }
+inline float ReduceAdd(VecF a){
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+  return _mm_cvtss_f32(sum);
+}
+
+inline VecI SetI1(int a){ return VecI{_mm256_set1_epi32(a)}; }
+inline VecI IotaI(){ return VecI{_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)}; }
+inline VecI LoadPartialI(const int* p, int n){ return VecI{_mm256_maskload_epi32(p, _mm256_castps_si256(FirstN(n)))}; }
+inline void StoreUI(int* p, VecI a){ _mm256_storeu_si256((__m256i*)p, a.v); }
+inline VecI AddI(VecI a, VecI b){ return VecI{_mm256_add_epi32(a.v, b.v)}; }
+inline VecI MulI(VecI a, VecI b){ return VecI{_mm256_mullo_epi32(a.v, b.v)}; }
+inline VecI SelectI(MaskF m, VecI a, VecI b){ return VecI{_mm256_blendv_epi8(b.v, a.v, _mm256_castps_si256(m))}; }
+inline VecI MinI(VecI a, VecI b){ return VecI{_mm256_min_epi32(a.v, b.v)}; }
+inline VecI MaxI(VecI a, VecI b){ return VecI{_mm256_max_epi32(a.v, b.v)}; }
+inline VecI ToInt(VecF a){ return VecI{_mm256_cvttps_epi32(a.v)}; }
+inline VecF ToFloat(VecI a){ return VecF{_mm256_cvtepi32_ps(a.v)}; }
+inline VecF Gather(const float* base, VecI idx, MaskF m){
+  return VecF{_mm256_mask_i32gather_ps(_mm256_setzero_ps(), base, idx.v, m, 4)};
+}
+inline VecF DeinterleaveOdd(VecF lo, VecF hi){
+  __m256 odd = _mm256_shuffle_ps(lo.v, hi.v, _MM_SHUFFLE(3, 1, 3, 1)); // [l1 l3 h1 h3 | l5 l7 h5 h7]
+  return VecF{_mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(odd), _MM_SHUFFLE(3, 1, 2, 0)))};
+}
+// compact pixels, see AVX-512. the half float conversions need F16C (every AVX2 CPU has it, checked by the dispatch)
+inline VecF LoadU8(const unsigned char* p, int n){
+  long long tmp = 0;
+  memcpy(&tmp, p, n < 8 ? (n > 0 ? n : 0) : 8);
+  return VecF{_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_cvtsi64_si128(tmp)))};
+}
+inline VecF LoadF16(const unsigned short* p, int n){
+  unsigned short tmp[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  memcpy(tmp, p, sizeof(unsigned short) * (n < 8 ? (n > 0 ? n : 0) : 8));
+  return VecF{_mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)tmp))};
+}
+inline void StoreF16(unsigned short* p, VecF a, int n){
+  unsigned short tmp[8];
+  _mm_storeu_si128((__m128i*)tmp, _mm256_cvtps_ph(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+  memcpy(p, tmp, sizeof(unsigned short) * (n < 8 ? (n > 0 ? n : 0) : 8));
+}
+inline VecF GatherU8(const unsigned char* base, VecI idx, MaskF m){
+  __m256i word = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)base, idx.v, _mm256_castps_si256(m), 1);
+  return VecF{_mm256_cvtepi32_ps(_mm256_and_si256(word, _mm256_set1_epi32(0xff)))};
+}
+inline VecF GatherF16(const unsigned short* base, VecI idx, MaskF m){
+  __m256i word = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)base, idx.v, _mm256_castps_si256(m), 2);
+  word = _mm256_and_si256(word, _mm256_set1_epi32(0xffff));
+  // pack the 8 low halves into 128 bits: [w0..w3 w0..w3 | w4..w7 w4..w7] -> w0..w7
+  __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(word, word), _MM_SHUFFLE(3, 1, 2, 0));
+  return VecF{_mm256_cvtph_ps(_mm256_castsi256_si128(packed))};
+}
+
+// integer lanes of the census costs, see AVX-512
+inline VecI SubI(VecI a, VecI b){ return VecI{_mm256_sub_epi32(a.v, b.v)}; }
+inline VecI AndI(VecI a, VecI b){ return VecI{_mm256_and_si256(a.v, b.v)}; }
+inline VecI XorI(VecI a, VecI b){ return VecI{_mm256_xor_si256(a.v, b.v)}; }
+inline VecI ShiftRightI(VecI a, int n){ return VecI{_mm256_srl_epi32(a.v, _mm_cvtsi32_si128(n))}; }
+inline void StoreU8I(unsigned char* p, VecI a){
+  __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(a.v), _mm256_extracti128_si256(a.v, 1));
+  _mm_storel_epi64((__m128i*)p, _mm_packus_epi16(words, words));
+}
+inline VecF LoadU16(const unsigned short* p){
+  return VecF{_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p)))};
+}
+
+// sparse depth codec, see AVX-512. no masked 16 bit loads/stores and no scatter: through the stack
+const int kByteLanes = 32;
+inline unsigned long long NonZeroBytes(const unsigned char* p){
+  __m256i zero = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), _mm256_setzero_si256());
+  return (unsigned long long)(~(unsigned int)_mm256_movemask_epi8(zero));
+}
+inline VecI ToIntRound(VecF a){ return VecI{_mm256_cvtps_epi32(a.v)}; }
+inline void StorePartialU16(unsigned short* p, VecI a, int n){
+  unsigned short tmp[8];
+  _mm_storeu_si128((__m128i*)tmp, _mm_packus_epi32(_mm256_castsi256_si128(a.v), _mm256_extracti128_si256(a.v, 1)));
+  memcpy(p, tmp, sizeof(unsigned short) * (n < 8 ? (n > 0 ? n : 0) : 8));
+}
+inline VecF LoadPartialU16(const unsigned short* p, int n){
+  unsigned short tmp[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  memcpy(tmp, p, sizeof(unsigned short) * (n < 8 ? (n > 0 ? n : 0) : 8));
+  return LoadU16(tmp);
+}
+inline void ScatterPartial(float* base, VecI idx, VecF a, int n){
+  int lane_idx[8];
+  float tmp[8];
+  _mm256_storeu_si256((__m256i*)lane_idx, idx.v);
+  _mm256_storeu_ps(tmp, a.v);
+  for (int i = 0; i < 8 && i < n; i++) base[lane_idx[i]] = tmp[i];
+}
+
+// unsigned 16 bit lanes of the path costs, see AVX-512
+const int kWordLanes = 16;
+struct VecW{ __m256i v; };
+inline VecW SetW1(unsigned short a){ return VecW{_mm256_set1_epi16((short)a)}; }
+inline VecW LoadW(const unsigned short* p){ return VecW{_mm256_loadu_si256((const __m256i*)p)}; }
+inline void StoreW(unsigned short* p, VecW a){ _mm256_storeu_si256((__m256i*)p, a.v); }
+inline VecW LoadU8W(const unsigned char* p){ return VecW{_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)p))}; }
+inline VecW AddSatW(VecW a, VecW b){ return VecW{_mm256_adds_epu16(a.v, b.v)}; }
+inline VecW SubW(VecW a, VecW b){ return VecW{_mm256_sub_epi16(a.v, b.v)}; }
+inline VecW MinW(VecW a, VecW b){ return VecW{_mm256_min_epu16(a.v, b.v)}; }
+inline unsigned short ReduceMinW(VecW a){
+  __m128i half = _mm_min_epu16(_mm256_castsi256_si128(a.v), _mm256_extracti128_si256(a.v, 1));
+  return (unsigned short)_mm_cvtsi128_si32(_mm_minpos_epu16(half));
+}
+
+#elif defined(ODOMETRY_SIMD_SSE42)
+/******************************************** SSE4.2: 4 float lanes *************************************************/
+const int kLanes = 4;
+struct VecF{ __m128 v; };
+struct VecI{ __m128i v; };
+typedef __m128 MaskF;
+
+inline VecF Set1(float a){ return VecF{_mm_set1_ps(a)}; }
+inline VecF LoadU(const float* p){ return VecF{_mm_loadu_ps(p)}; }
+inline MaskF FirstN(int n){ return _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32(n), _mm_setr_epi32(0, 1, 2, 3))); }
+inline VecF LoadPartial(const float* p, int n){
+  float tmp[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  memcpy(tmp, p, sizeof(float) * (n < 4 ? (n > 0 ? n : 0) : 4));
+  return VecF{_mm_loadu_ps(tmp)};
+}
+inline void StoreU(float* p, VecF a){ _mm_storeu_ps(p, a.v); }
+inline void StorePartial(float* p, VecF a, int n){
+  float tmp[4];
+  _mm_storeu_ps(tmp, a.v);
+  memcpy(p, tmp, sizeof(float) * (n < 4 ? (n > 0 ? n : 0) : 4));
+}
+inline VecF Add(VecF a, VecF b){ return VecF{_mm_add_ps(a.v, b.v)}; }
+inline VecF Sub(VecF a, VecF b){ return VecF{_mm_sub_ps(a.v, b.v)}; }
+inline VecF Mul(VecF a, VecF b){ return VecF{_mm_mul_ps(a.v, b.v)}; }
+inline VecF Div(VecF a, VecF b){ return VecF{_mm_div_ps(a.v, b.v)}; }
+inline VecF Min(VecF a, VecF b){ return VecF{_mm_min_ps(a.v, b.v)}; }
+inline VecF Max(VecF a, VecF b){ return VecF{_mm_max_ps(a.v, b.v)}; }
+inline VecF Abs(VecF a){ return VecF{_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)}; }
+inline VecF Floor(VecF a){ return VecF{_mm_floor_ps(a.v)}; }
+inline MaskF Lt(VecF a, VecF b){ return _mm_cmplt_ps(a.v, b.v); }
+inline MaskF Le(VecF a, VecF b){ return _mm_cmple_ps(a.v, b.v); }
+inline MaskF And(MaskF a, MaskF b){ return _mm_and_ps(a, b); }
+inline VecF Select(MaskF m, VecF a, VecF b){ return VecF{_mm_blendv_ps(b.v, a.v, m)}; }
+inline unsigned int MaskBits(MaskF m){ return (unsigned int)_mm_movemask_ps(m); }
+inline float ReduceAdd(VecF a){
+  __m128 sum = _mm_add_ps(a.v, _mm_movehl_ps(a.v, a.v));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+  return _mm_cvtss_f32(sum);
+}
+
+inline VecI SetI1(int a){ return VecI{_mm_set1_epi32(a)}; }
+inline VecI IotaI(){ return VecI{_mm_setr_epi32(0, 1, 2, 3)}; }
+inline VecI LoadPartialI(const int* p, int n){
+  int tmp[4] = {0, 0, 0, 0};
+  memcpy(tmp, p, sizeof(int) * (n < 4 ? (n > 0 ? n : 0) : 4));
+  return VecI{_mm_loadu_si128((const __m128i*)tmp)};
+}
+inline void StoreUI(int* p, VecI a){ _mm_storeu_si128((__m128i*)p, a.v); }
+inline VecI AddI(VecI a, VecI b){ return VecI{_mm_add_epi32(a.v, b.v)}; }
+inline VecI MulI(VecI a, VecI b){ return VecI{_mm_mullo_epi32(a.v, b.v)}; }
+inline VecI SelectI(MaskF m, VecI a, VecI b){ return VecI{_mm_blendv_epi8(b.v, a.v, _mm_castps_si128(m))}; }
+inline VecI MinI(VecI a, VecI b){ return VecI{_mm_min_epi32(a.v, b.v)}; }
+inline VecI MaxI(VecI a, VecI b){ return VecI{_mm_max_epi32(a.v, b.v)}; }
+inline VecI ToInt(VecF a){ return VecI{_mm_cvttps_epi32(a.v)}; }
+inline VecF ToFloat(VecI a){ return VecF{_mm_cvtepi32_ps(a.v)}; }
+// no hardware gather before AVX2: emulated lane by lane
+inline VecF Gather(const float* base, VecI idx, MaskF m){
+  int lane_idx[4];
+  float tmp[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  _mm_storeu_si128((__m128i*)lane_idx, idx.v);
+  unsigned int bits = MaskBits(m);
+  for (int i = 0; i < 4; i++){
+    if (bits & (1u << i)) tmp[i] = base[lane_idx[i]];
+  }
+  return VecF{_mm_loadu_ps(tmp)};
+}
+inline VecF DeinterleaveOdd(VecF lo, VecF hi){ return VecF{_mm_shuffle_ps(lo.v, hi.v, _MM_SHUFFLE(3, 1, 3, 1))}; }
+// compact pixels, see AVX-512. no F16C: the half floats are converted in software
+inline VecF LoadU8(const unsigned char* p, int n){
+  int tmp = 0;
+  memcpy(&tmp, p, n < 4 ? (n > 0 ? n : 0) : 4);
+  return VecF{_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(tmp)))};
+}
+inline VecF LoadF16(const unsigned short* p, int n){
+  float tmp[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  for (int i = 0; i < 4 && i < n; i++) tmp[i] = HalfToFloat(p[i]);
+  return VecF{_mm_loadu_ps(tmp)};
+}
+inline void StoreF16(unsigned short* p, VecF a, int n){
+  float tmp[4];
+  _mm_storeu_ps(tmp, a.v);
+  for (int i = 0; i < 4 && i < n; i++) p[i] = FloatToHalf(tmp[i]);
+}
+inline VecF GatherU8(const unsigned char* base, VecI idx, MaskF m){
+  int lane_idx[4];
+  float tmp[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  _mm_storeu_si128((__m128i*)lane_idx, idx.v);
+  unsigned int bits = MaskBits(m);
+  for (int i = 0; i < 4; i++){
+    if (bits & (1u << i)) tmp[i] = float(base[lane_idx[i]]);
+  }
+  return VecF{_mm_loadu_ps(tmp)};
+}
+inline VecF GatherF16(const unsigned short* base, VecI idx, MaskF m){
+  int lane_idx[4];
+  float tmp[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  _mm_storeu_si128((__m128i*)lane_idx, idx.v);
+  unsigned int bits = MaskBits(m);
+  for (int i = 0; i < 4; i++){
+    if (bits & (1u << i)) tmp[i] = HalfToFloat(base[lane_idx[i]]);
+  }
+  return VecF{_mm_loadu_ps(tmp)};
+}
+
+// integer lanes of the census costs, see AVX-512
+inline VecI SubI(VecI a, VecI b){ return VecI{_mm_sub_epi32(a.v, b.v)}; }
+inline VecI AndI(VecI a, VecI b){ return VecI{_mm_and_si128(a.v, b.v)}; }
+inline VecI XorI(VecI a, VecI b){ return VecI{_mm_xor_si128(a.v, b.v)}; }
+inline VecI ShiftRightI(VecI a, int n){ return VecI{_mm_srl_epi32(a.v, _mm_cvtsi32_si128(n))}; }
+inline void StoreU8I(unsigned char* p, VecI a){
+  __m128i words = _mm_packus_epi32(a.v, a.v);
+  int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+  memcpy(p, &bytes, 4);
+}
+inline VecF LoadU16(const unsigned short* p){
+  return VecF{_mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)p)))};
+}
+
+// sparse depth codec, see AVX-512 and AVX2
+const int kByteLanes = 16;
+inline unsigned long long NonZeroBytes(const unsigned char* p){
+  __m128i zero = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), _mm_setzero_si128());
+  return (unsigned long long)(~(unsigned int)_mm_movemask_epi8(zero) & 0xffffu);
+}
+inline VecI ToIntRound(VecF a){ return VecI{_mm_cvtps_epi32(a.v)}; }
+inline void StorePartialU16(unsigned short* p, VecI a, int n){
+  unsigned short tmp[8];
+  _mm_storeu_si128((__m128i*)tmp, _mm_packus_epi32(a.v, a.v));
+  memcpy(p, tmp, sizeof(unsigned short) * (n < 4 ? (n > 0 ? n : 0) : 4));
+}
+inline VecF LoadPartialU16(const unsigned short* p, int n){
+  unsigned short tmp[4] = {0, 0, 0, 0};
+  memcpy(tmp, p, sizeof(unsigned short) * (n < 4 ? (n > 0 ? n : 0) : 4));
+  return LoadU16(tmp);
+}
+inline void ScatterPartial(float* base, VecI idx, VecF a, int n){
+  int lane_idx[4];
+  float tmp[4];
+  _mm_storeu_si128((__m128i*)lane_idx, idx.v);
+  _mm_storeu_ps(tmp, a.v);
+  for (int i = 0; i < 4 && i < n; i++) base[lane_idx[i]] = tmp[i];
+}
+
+// unsigned 16 bit lanes of the path costs, see AVX-512
+const int kWordLanes = 8;
+struct VecW{ __m128i v; };
+inline VecW SetW1(unsigned short a){ return VecW{_mm_set1_epi16((short)a)}; }
+inline VecW LoadW(const unsigned short* p){ return VecW{_mm_loadu_si128((const __m128i*)p)}; }
+inline void StoreW(unsigned short* p, VecW a){ _mm_storeu_si128((__m128i*)p, a.v); }
+inline VecW LoadU8W(const unsigned char* p){ return VecW{_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)p))}; }
+inline VecW AddSatW(VecW a, VecW b){ return VecW{_mm_adds_epu16(a.v, b.v)}; }
+inline VecW SubW(VecW a, VecW b){ return VecW{_mm_sub_epi16(a.v, b.v)}; }
+inline VecW MinW(VecW a, VecW b){ return VecW{_mm_min_epu16(a.v, b.v)}; }
+inline unsigned short ReduceMinW(VecW a){ return (unsigned short)_mm_cvtsi128_si32(_mm_minpos_epu16(a.v)); }
+
+#elif defined(ODOMETRY_SIMD_SCALAR)
+/************************************** Scalar reference: 1 float lane *********************************************/
+const int kLanes = 1;
+struct VecF{ float v; };
+struct VecI{ int v; };
+typedef bool MaskF;
+
+inline VecF Set1(float a){ return VecF{a}; }
+inline VecF LoadU(const float* p){ return VecF{*p}; }
+inline MaskF FirstN(int n){ return n > 0; }
+inline VecF LoadPartial(const float* p, int n){ return VecF{n > 0 ? *p : 0.0f}; }
+inline void StoreU(float* p, VecF a){ *p = a.v; }
+inline void StorePartial(float* p, VecF a, int n){ if (n > 0) *p = a.v; }
+inline VecF Add(VecF a, VecF b){ return VecF{a.v + b.v}; }
+inline VecF Sub(VecF a, VecF b){ return VecF{a.v - b.v}; }
+inline VecF Mul(VecF a, VecF b){ return VecF{a.v * b.v}; }
+inline VecF Div(VecF a, VecF b){ return VecF{a.v / b.v}; }
+inline VecF Min(VecF a, VecF b){ return VecF{b.v < a.v ? b.v : a.v}; }
+inline VecF Max(VecF a, VecF b){ return VecF{a.v > b.v ? a.v : b.v}; }
+inline VecF Abs(VecF a){ return VecF{__builtin_fabsf(a.v)}; }
+inline VecF Floor(VecF a){ return VecF{__builtin_floorf(a.v)}; }
+inline MaskF Lt(VecF a, VecF b){ return a.v < b.v; }
+inline MaskF Le(VecF a, VecF b){ return a.v <= b.v; }
+inline MaskF And(MaskF a, MaskF b){ return a && b; }
+inline VecF Select(MaskF m, VecF a, VecF b){ return m ? a : b; }
+inline unsigned int MaskBits(MaskF m){ return m ? 1u : 0u; }
+inline float ReduceAdd(VecF a){ return a.v; }
+
+inline VecI SetI1(int a){ return VecI{a}; }
+inline VecI IotaI(){ return VecI{0}; }
+inline VecI LoadPartialI(const int* p, int n){ return VecI{n > 0 ? *p : 0}; }
+inline void StoreUI(int* p, VecI a){ *p = a.v; }
+inline VecI AddI(VecI a, VecI b){ return VecI{a.v + b.v}; }
+inline VecI MulI(VecI a, VecI b){ return VecI{a.v * b.v}; }
+inline VecI SelectI(MaskF m, VecI a, VecI b){ return m ? a : b; }
+inline VecI MinI(VecI a, VecI b){ return VecI{b.v < a.v ? b.v : a.v}; }
+inline VecI MaxI(VecI a, VecI b){ return VecI{a.v < b.v ? b.v : a.v}; }
+inline VecI ToInt(VecF a){ return VecI{int(a.v)}; }
+inline VecF ToFloat(VecI a){ return VecF{float(a.v)}; }
+inline VecF Gather(const float* base, VecI idx, MaskF m){ return VecF{m ? base[idx.v] : 0.0f}; }
+inline int CompressStore(float* p, VecF a, MaskF m){
+  if (m) *p = a.v;
+  return m ? 1 : 0;
+}
+inline VecF DeinterleaveOdd(VecF lo, VecF hi){ (void)lo; return hi; }
+inline VecF LoadU8(const unsigned char* p, int n){ return VecF{n > 0 ? float(*p) : 0.0f}; }
+inline VecF LoadF16(const unsigned short* p, int n){ return VecF{n > 0 ? HalfToFloat(*p) : 0.0f}; }
+inline void StoreF16(unsigned short* p, VecF a, int n){ if (n > 0) *p = FloatToHalf(a.v); }
+inline VecF GatherU8(const unsigned char* base, VecI idx, MaskF m){ return VecF{m ? float(base[idx.v]) : 0.0f}; }
+inline VecF GatherF16(const unsigned short* base, VecI idx, MaskF m){ return VecF{m ? HalfToFloat(base[idx.v]) : 0.0f}; }
+
+inline VecI SubI(VecI a, VecI b){ return VecI{a.v - b.v}; }
+inline VecI AndI(VecI a, VecI b){ return VecI{a.v & b.v}; }
+inline VecI XorI(VecI a, VecI b){ return VecI{a.v ^ b.v}; }
+inline VecI ShiftRightI(VecI a, int n){ return VecI{int((unsigned int)a.v >> n)}; }
+inline void StoreU8I(unsigned char* p, VecI a){ *p = (unsigned char)a.v; }
+inline VecF LoadU16(const unsigned short* p){ return VecF{float(*p)}; }
+
+const int kByteLanes = 1;
+inline unsigned long long NonZeroBytes(const unsigned char* p){ return *p != 0 ? 1ull : 0ull; }
+inline VecI ToIntRound(VecF a){ return VecI{int(__builtin_rintf(a.v))}; }
+inline void StorePartialU16(unsigned short* p, VecI a, int n){ if (n > 0) *p = (unsigned short)a.v; }
+inline VecF LoadPartialU16(const unsigned short* p, int n){ return VecF{n > 0 ? float(*p) : 0.0f}; }
+inline void ScatterPartial(float* base, VecI idx, VecF a, int n){ if (n > 0) base[idx.v] = a.v; }
+
+const int kWordLanes = 1;
+struct VecW{ unsigned short v; };
+inline VecW SetW1(unsigned short a){ return VecW{a}; }
+inline VecW LoadW(const unsigned short* p){ return VecW{*p}; }
+inline void StoreW(unsigned short* p, VecW a){ *p = a.v; }
+inline VecW LoadU8W(const unsigned char* p){ return VecW{*p}; }
+inline VecW AddSatW(VecW a, VecW b){
+  unsigned int sum = (unsigned int)a.v + (unsigned int)b.v;
+  return VecW{(unsigned short)(sum > 0xffffu ? 0xffffu : sum)};
+}
+inline VecW SubW(VecW a, VecW b){ return VecW{(unsigned short)(a.v - b.v)}; }
+inline VecW MinW(VecW a, VecW b){ return VecW{b.v < a.v ? b.v : a.v}; }
+inline unsigned short ReduceMinW(VecW a){ return a.v; }
+
+#else
+#error "one of ODOMETRY_SIMD_{SCALAR,SSE42,AVX2,AVX512} must be defined before including simd_vector.h"
+#endif
+
+inline VecF Zero(){ return Set1(0.0f); }
+
+#if defined(ODOMETRY_SIMD_SSE42) || defined(ODOMETRY_SIMD_AVX2)
+// no compress store before AVX-512: pack the enabled lanes through the stack
+inline int CompressStore(float* p, VecF a, MaskF m){
+  float tmp[kLanes];
+  StoreU(tmp, a);
+  unsigned int bits = MaskBits(m);
+  int count = 0;
+  for (int i = 0; i < kLanes; i++){
+    if (bits & (1u << i)) p[count++] = tmp[i];
+  }
+  return count;
+}
+#endif
+
+// load n (<= kLanes) floats, the remaining lanes are set to zero
+inline VecF Load(const float* p, int n){ return n >= kLanes ? LoadU(p) : LoadPartial(p, n); }
+
+// pixels of any storage type as floats, overloaded by the pixel type so that the kernels can be templates:
+// float, unsigned char (uint8) and unsigned short (IEEE half float bits)
+inline VecF LoadPixels(const float* p, int n){ return Load(p, n); }
+inline VecF LoadPixels(const unsigned char* p, int n){ return LoadU8(p, n); }
+inline VecF LoadPixels(const unsigned short* p, int n){ return LoadF16(p, n); }
+inline VecF GatherPixels(const float* base, VecI idx, MaskF m){ return Gather(base, idx, m); }
+inline VecF GatherPixels(const unsigned char* base, VecI idx, MaskF m){ return GatherU8(base, idx, m); }
+inline VecF GatherPixels(const unsigned short* base, VecI idx, MaskF m){ return GatherF16(base, idx, m); }
+
+} // namespace ODOMETRY_SIMD_NS
+} // namespace simd
+} // namespace odometry
+
+#endif //ODOMETRY_SIMD_VECTOR_H
@@ -0,0 +1,86 @@
+// The header file contains the task graph of one frame: the stages of the pipeline are nodes with explicit
+// dependencies, e.g. the tracking needs the left pyramid and the keyframe decision of the previous frame, the depth
+// needs both images only. Each node runs on the ThreadPool as soon as its dependencies are done, so independent nodes
+// run concurrently and consecutive frames overlap where the dependencies allow:
+//  * AddNode(): a node returns GlobalStatus, the nodes depending on a failed node are skipped and Wait() fails
+//  * After(): dependency on a node of another graph, e.g. the previous frame, which may be running or done already
+//  * the thread calling Wait() runs ready nodes of the graph, too, instead of blocking
+//  * critical path: the chain of nodes which determined the latency of the graph, each node preceded by the dependency
+//    finished last. the time between the end of that dependency and the start of the node is queueing (all threads
+//    busy), or waiting for another graph
+// Usage:
+//   TaskGraph graph;
+//   int load = graph.AddNode("load", [&](){ ...; return 0; });
+//   int depth = graph.AddNode("depth", [&](){ return estimator.ComputeDepth(...); }, {load});
+//   graph.After(depth, previous_graph, previous_depth); // the estimator is shared by the frames
+//   graph.Start(DefaultThreadPool());
+//   graph.Wait();
+//   LOG_INFO("{}", graph.CriticalPathReport());
+
+#ifndef ODOMETRY_TASK_GRAPH_H
+#define ODOMETRY_TASK_GRAPH_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <data_types.h>
+#include <thread_pool.h>
+
+namespace odometry
+{
+
+class TaskGraph{
+  public:
+    TaskGraph();
+
+    // waits for the graph if it was started
+    ~TaskGraph();
+
+    // disable copy constructor
+    TaskGraph(const TaskGraph& ) = delete;
+
+    // disable copy assignment
+    TaskGraph& operator= (const TaskGraph& ) = delete;
+
+    // add a node running fn after the nodes deps (of this graph) are done, before Start() only. name is also the task
+    // type of the scheduler statistics
+    // Return: index of the node, -1 if the graph is started already or a dependency does not exist
+    int AddNode(const char* name, std::function<GlobalStatus()> fn, const std::vector<int>& deps = {},
+                TaskPriority priority = kPriorityNormal);
+
+    // node runs after previous_node of the graph previous, too, before Start() only. previous must not be destroyed
+    // before it is done. a failed or skipped previous_node skips node
+    // Return: -1 if a node does not exist or this graph is started already; otherwise success
+    GlobalStatus After(int node, TaskGraph& previous, int previous_node);
+
+    // queue the nodes without dependencies on pool and return
+    void Start(ThreadPool& pool);
+
+    // run ready nodes on the calling thread until all nodes are done or skipped
+    // Return: -1 if a node failed or was skipped; otherwise success
+    GlobalStatus Wait();
+
+    // after Wait(): seconds from Start() to the end of the last node, i.e. the latency of the graph
+    double LatencySeconds() const;
+
+    // after Wait(): the nodes of the critical path, first to last
+    std::vector<int> CriticalPath() const;
+
+    // after Wait(): e.g. "critical path 41.2 ms: wait 3.2 ms > queue 0.1 ms > depth 30.5 ms > depth_pyramid 7.4 ms",
+    // wait: for the node of another graph, queue: all threads busy
+    std::string CriticalPathReport() const;
+
+    const std::string& NodeName(int node) const;
+
+    // after Wait(): run time of node in seconds, 0 if it was skipped
+    double NodeSeconds(int node) const;
+
+  private:
+    struct State;
+    std::shared_ptr<State> state_; // shared with the queued tasks and the graphs depending on this one
+};
+
+} // namespace odometry
+
+#endif //ODOMETRY_TASK_GRAPH_H
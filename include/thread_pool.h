@@ -0,0 +1,121 @@
+// The header file contains the work-stealing task scheduler shared by all parallel stages of the library, e.g.
+// row-parallel image operations, stereo bands and concurrent optimizations. One pool with a fixed number of threads
+// runs every task, so the stages never oversubscribe the cores:
+//  * every worker owns one deque per priority: it pops its newest task (LIFO, cache warm), idle workers steal the
+//    oldest task of another worker (FIFO). tasks submitted from outside the pool go to a shared queue
+//  * priorities: a worker always takes the highest priority task available, e.g. the tracking (kPriorityHigh) goes
+//    ahead of background mapping (kPriorityLow). running tasks are never preempted
+//  * ParallelFor: fork-join loop. the caller splits [begin, end) into chunks of grain iterations, runs chunks itself and
+//    pushes helper tasks which take chunks from the same counter, then blocks until every chunk is done. nested loops
+//    are parallel, too: the helpers of the inner loop are stolen by the idle workers
+//  * Submit: fire and forget task, e.g. background work
+//  * statistics per task type (a short label): tasks run and busy time, exported as odometry_scheduler_tasks_total and
+//    odometry_scheduler_busy_microseconds_total{type="..."}; utilization = busy time / (wall time * NumThreads())
+//  * the body must not throw
+// Usage:
+//   DefaultThreadPool().ParallelFor(0, rows, 16, [&](int row_begin, int row_end){ ... });
+//   DefaultThreadPool().ParallelFor(0, rows, 16, [&](int row_begin, int row_end){ ... }, kPriorityHigh, "tracking");
+
+#ifndef ODOMETRY_THREAD_POOL_H
+#define ODOMETRY_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace odometry
+{
+
+enum TaskPriority{
+  kPriorityHigh = 0,   // latency critical, e.g. tracking
+  kPriorityNormal = 1, // default
+  kPriorityLow = 2     // background, e.g. mapping, debug output
+};
+const int kNumTaskPriorities = 3;
+
+class ThreadPool{
+  public:
+    // num_threads includes the calling thread, i.e. num_threads - 1 workers are started. at least 1.
+    // worker_init(index) runs on each worker before its first task, e.g. to pin it to a core, see realtime.h
+    explicit ThreadPool(int num_threads, const std::function<void(int)>& worker_init = nullptr);
+
+    // runs the queued tasks, then joins the workers
+    ~ThreadPool();
+
+    // disable copy constructor
+    ThreadPool(const ThreadPool& ) = delete;
+
+    // disable copy assignment
+    ThreadPool& operator= (const ThreadPool& ) = delete;
+
+    // run fn(chunk_begin, chunk_end) over [begin, end) in chunks of at most grain iterations, blocks until all are done.
+    // the helper tasks run with priority and count to the statistics of type
+    void ParallelFor(int begin, int end, int grain, const std::function<void(int, int)>& fn,
+                     TaskPriority priority = kPriorityNormal, const char* type = "default");
+
+    // queue task and return, it runs on a worker (on the calling thread, before returning, if the pool has no workers)
+    void Submit(std::function<void()> task, TaskPriority priority = kPriorityLow, const char* type = "background");
+
+    int NumThreads() const{ return int(workers_.size()) + 1; }
+
+    // statistics of one task type since the start of the pool
+    struct TypeStats{
+      std::string type;
+      unsigned long tasks;
+      double busy_seconds;
+    };
+    std::vector<TypeStats> Stats() const;
+
+  private:
+    struct Task{
+      std::function<void()> fn;
+      int type;
+    };
+    // the deques of one worker, the last one is shared by the threads outside of the pool
+    struct Queues{
+      std::mutex mutex;
+      std::deque<Task> tasks[kNumTaskPriorities];
+    };
+    struct TypeCounters;
+
+    void WorkerLoop(int index, std::function<void(int)> worker_init);
+    // push to the deque of the calling worker, or to the shared queue, and wake a sleeping worker
+    void Push(Task task, TaskPriority priority);
+    // highest priority task: own newest, shared oldest, then the oldest of the other workers
+    bool Take(int index, Task& task);
+    // run task and add its busy time to the statistics
+    void Run(const std::function<void()>& fn, int type);
+    // index of the statistics of type, registered at the first use
+    int TypeIndex(const char* type);
+
+    std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<Queues>> queues_; // one per worker + shared
+    std::atomic<int> queued_{0}; // tasks in the queues
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+    mutable std::mutex types_mutex_;
+    std::vector<std::unique_ptr<TypeCounters>> types_;
+};
+
+// ODOMETRY_THREADS=<n>, or the number of hardware threads
+int DefaultNumThreads();
+
+// the process wide pool, created at the first call with the number of threads of ConfigureDefaultThreadPool(), or
+// DefaultNumThreads()
+ThreadPool& DefaultThreadPool();
+
+// fix the number of threads (and the worker_init of the constructor) of DefaultThreadPool() from the config, before
+// its first use. return -1 if the pool exists already (with another number of threads or a worker_init) or
+// num_threads < 1, otherwise success
+int ConfigureDefaultThreadPool(int num_threads, const std::function<void(int)>& worker_init = nullptr);
+
+} // namespace odometry
+
+#endif //ODOMETRY_THREAD_POOL_H
@@ -0,0 +1,124 @@
+// The header file contains the streaming trajectory sink: every pose is appended as it is produced instead of being
+// kept for a text dump at shutdown:
+//  * formats: KITTI (12 values of the 3x4 pose per line), TUM (timestamp, translation, quaternion x y z w) and a
+//    binary log of fixed size records, any number of files per writer
+//  * Append() only queues the pose (a short critical section, safe in PosePublisher subscribers). a background thread
+//    formats the queued poses without allocations (FormatFixed(), no std::to_string), writes them and syncs the files
+//    to disk every flush_interval seconds
+//  * crash safety: the poses of the last completed flush are on disk. a crash can cut a text line or a binary record
+//    at the end, ReadTrajectoryLog() drops the cut record, Open() in append mode truncates it
+// Usage:
+//   TrajectoryWriter writer(0.5);
+//   writer.Open("00.txt", kTrajectoryKitti);
+//   writer.Open("00.bin", kTrajectoryBinary);
+//   publisher.Subscribe([&](const PoseSample& sample){ writer.Append(sample); });
+//   ...
+//   writer.Close();
+
+#ifndef ODOMETRY_TRAJECTORY_WRITER_H
+#define ODOMETRY_TRAJECTORY_WRITER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <data_types.h>
+#include <pose_publisher.h>
+
+namespace odometry
+{
+
+enum TrajectoryFormat{
+  kTrajectoryKitti = 0,  // r11 r12 r13 tx r21 ... tz, 6 decimals as the devkit results
+  kTrajectoryTum = 1,    // timestamp tx ty tz qx qy qz qw
+  kTrajectoryBinary = 2  // kTrajectoryMagic, then one TrajectoryRecord per pose, see ReadTrajectoryLog()
+};
+
+// first bytes of a binary trajectory log, the version in the last two
+const char kTrajectoryMagic[8] = {'O', 'D', 'O', 'T', 'R', 'J', '0', '1'};
+
+// one pose of the binary log, kTrajectoryRecordBytes in the file (little endian, no padding between the fields)
+struct TrajectoryRecord{
+  uint64_t frame_id = 0;
+  double timestamp = 0.0;
+  Eigen::Matrix<float, 3, 4, Eigen::RowMajor> pose = Eigen::Matrix<float, 3, 4, Eigen::RowMajor>::Identity();
+  TrackingStatus status = kTrackingLost;
+};
+const int kTrajectoryRecordBytes = 8 + 8 + 48 + 4 + 4; // frame_id, timestamp, pose, status, reserved
+
+// write value with decimals (0-9) fraction digits to out (at least 32 chars), as printf("%.*f") up to the rounding of
+// the last digit (near ties). values of 1e15 / 10^decimals and more and non finite values are written as
+// printf("%.17g")
+// Return: the number of chars written, no terminating 0
+int FormatFixed(double value, int decimals, char* out);
+
+// read the poses of a binary log, a cut record at the end (crash while writing) is dropped
+// Return: -1 if the file can not be opened or is no trajectory log; otherwise success
+GlobalStatus ReadTrajectoryLog(const std::string& file_name, std::vector<TrajectoryRecord>& records);
+
+class TrajectoryWriter{
+  public:
+    // flush_interval: seconds between the background writes and disk syncs, i.e. the poses a crash loses at most
+    explicit TrajectoryWriter(double flush_interval);
+
+    // Close()
+    ~TrajectoryWriter();
+
+    // disable copy constructor
+    TrajectoryWriter(const TrajectoryWriter& ) = delete;
+
+    // disable copy assignment
+    TrajectoryWriter& operator= (const TrajectoryWriter& ) = delete;
+
+    // add a file, before the first Append(). truncated unless append, appending to a binary log keeps its complete
+    // records and drops a cut one
+    // Return: -1 if the file can not be opened or an appended binary log is no trajectory log; otherwise success
+    GlobalStatus Open(const std::string& file_name, TrajectoryFormat format, bool append = false);
+
+    // queue a pose for the next background write, any thread
+    void Append(const TrajectoryRecord& record);
+    void Append(const PoseSample& sample);
+
+    // write the queued poses and sync the files, wait for it
+    // Return: -1 if a write failed since the files were opened; otherwise success
+    GlobalStatus Flush();
+
+    // Flush(), stop the background thread and close the files. the writer can not be used afterwards
+    // Return: -1 if a write failed; otherwise success
+    GlobalStatus Close();
+
+    // number of poses written and synced
+    uint64_t Written() const;
+
+  private:
+    struct Sink{
+      int fd;
+      TrajectoryFormat format;
+      std::string file_name;
+    };
+
+    void WriteLoop();
+
+    // format and write records to every sink, sync them. called by the background thread without the lock
+    GlobalStatus WriteRecords(const std::vector<TrajectoryRecord>& records);
+
+    double flush_interval_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable written_;
+    std::vector<Sink> sinks_;
+    std::vector<TrajectoryRecord> queue_; // appended, not yet taken by the background thread
+    uint64_t flush_requested_ = 0;
+    uint64_t flush_done_ = 0;
+    uint64_t written_records_ = 0;
+    bool failed_ = false;
+    bool stopped_ = false;
+    std::string buffer_; // formatted records, background thread only, reused
+    std::thread write_thread_;
+};
+
+} // namespace odometry
+
+#endif //ODOMETRY_TRAJECTORY_WRITER_H
@@ -1,10 +1,14 @@
 // The file runs full pipline of odometry on kitti stereo sequences.
 // No real camera is used, camera parameters are hard-coded.
-// No multi-thread used, only sequential pipeline
+// The stages of a frame run as a task graph on the thread pool, consecutive frames overlap, see TaskGraph
+// Usage: ./run_odometry_kitti [--resume], --resume continues the sequence after the last checkpoint, see
+// OdometryCheckpoint
 // Created by Yu Wang on 2019-01-13.
 
 #include <iostream>
 #include <vector>
+#include <atomic>
+#include <thread>
 #include <Eigen/Core>
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
@@ -12,41 +16,112 @@
 #include <opencv2/highgui.hpp>
 #include <fstream>
 #include "include/camera.h"
+#include "include/checkpoint.h"
+#include "include/concurrent_tracking.h"
+#include "include/debug_writer.h"
 #include "data_types.h"
 #include "include/depth_estimate.h"
 #include "include/image_processing_global.h"
 #include "include/image_pyramid.h"
+#include "include/imu_preintegration.h"
 #include "include/lm_optimizer.h"
+#include "include/logging.h"
+#include "include/metrics.h"
+#include "include/pose_interpolation.h"
+#include "include/pose_publisher.h"
+#include "include/realtime.h"
+#include "include/sgm_stereo.h"
+#include "include/task_graph.h"
+#include "include/thread_pool.h"
+#include "include/trajectory_writer.h"
 #include <se3.hpp>
 #include <typeinfo>
 #include <string>
 #include <tuple>
+#include <chrono>
 
 void load_gt_pose(const std::string& folder_name, std::vector<Eigen::Matrix<float, 3, 4, Eigen::RowMajor>>& gt_poses);
 void load_data(const std::string& folder_name, std::vector<cv::Mat> &gray, int frame_id);
 void eval_pose(const std::vector<Eigen::Matrix<float, 3, 4, Eigen::RowMajor>>& gt_poses, const std::vector<Eigen::Matrix<float, 3, 4, Eigen::RowMajor>>& pred_poses);
-void save_txt(const std::vector<Eigen::Matrix<float, 3, 4, Eigen::RowMajor>>& gt_poses, const std::vector<Eigen::Matrix<float, 3, 4, Eigen::RowMajor>>& pred_poses);
-void save_to_vis(const std::vector<std::tuple<odometry::ImagePyramid, odometry::DepthPyramid, cv::Mat>>& data_vec, const std::vector<int>& keyframe_ids);
+void save_keyframe_ids(const std::string& file_name, const std::vector<int>& keyframe_ids);
 
-int main(){
+int main(int argc, char** argv){
 
-  // TODO: hardcode camera params in depth_estimate, lm_optimizer, WarpPixel, ReprojectToCameraFrame
+  // no camera is passed to the estimators (rectified KITTI images): they use the sequence 00 intrinsics, see GetCameraLevel()
   // Kitti sequence00, calibration
   unsigned int num_frames = 130; // 4000
   unsigned int num_pyramid = 4;
+  // kStorageUint8/kStorageFloat16: 4x/2x less memory traffic for the tracking and keyframe storage, see PyramidStorage
+  odometry::PyramidStorage pyramid_storage = odometry::kStorageFloat32;
+  // feature based pose seeds when the motion prior fails, e.g. large motions (float pyramids only), see PoseInitializer
+  bool pose_seeding = false;
+  // track against the previous frame, too, concurrently with the keyframe, the better result is chained, see
+  // TrackConcurrently(). needs num_threads >= 2 to keep the latency of one solve
+  bool concurrent_tracking = false;
+  // kPatchMatchSearch: near-dense depth, the cost per point does not grow with the disparity range, see DepthEstimator
+  odometry::DisparitySearch disparity_search = odometry::kEpipolarSearch;
+  // rectify (raw inputs only), smooth and match row bands instead of whole images, see ComputeDepthStreaming()
+  bool streaming_stereo = false;
+  // dense depth of every textured pixel by semi-global matching instead of the sparse disparity search, see SgmStereo
+  bool dense_stereo = false;
+  // threads of the task scheduler shared by all parallel stages, see ThreadPool. 0: ODOMETRY_THREADS or all cores
+  int num_threads = 0;
+  // real-time mode of the live pipeline: pinned threads, NUMA-local and locked memory, optional SCHED_FIFO, see
+  // RealtimeConfig. falls back to the normal mode for the settings without privileges
+  bool realtime = false;
+  odometry::RealtimeConfig realtime_config;
+  realtime_config.driver_core = 0;
+  realtime_config.worker_cores = {1, 2, 3};
   std::string data_path = "../dataset/kitti";
+  // trajectories for the KITTI devkit, written while running. the poses of the last flush survive a crash, see
+  // TrajectoryWriter
+  std::string gt_trajectory_file = "../dataset/kitti/devkit/data/odometry/poses/00.txt";
+  std::string pred_trajectory_file = "../dataset/kitti/devkit/results/seq00/data/00.txt";
+  double trajectory_flush_interval = 1.0; // in seconds
+  // checkpoint of the system state every checkpoint_interval frames (0: none), saved in the background. --resume
+  // continues after the frame of the last one with the results of an uninterrupted run, see OdometryCheckpoint
+  int checkpoint_interval = 0;
+  std::string checkpoint_file = "../dataset/kitti/devkit/results/seq00/checkpoint.bin";
+  bool resume = argc > 1 && std::string(argv[1]) == "--resume";
+  // keyframe images, masks and disparities for the visualization, written in the background while running. sampled
+  // (every keyframe_stride-th keyframe), a full queue drops keyframes instead of blocking the tracking, see DebugWriter
+  odometry::DebugWriterConfig debug_config;
+  debug_config.directory = "../data/kitti_result";
+  debug_config.format = odometry::kDebugPng;
+  debug_config.keyframe_stride = 1;
+  // recorded IMU stream of the sequence (EuRoC csv, same clock as times.txt), seeds the rotation of the pose tracking.
+  // empty: constant motion prior only
+  std::string imu_file = "";
   float fx = 718.856f; // in pixels
   float cx = 607.1928; // in pixels
   float cy = 185.2157; // in pixels
   float baseline = 386.1448f / 718.856f; // in meters: 0,53716572
   cv::Scalar init_val(0);
   std::vector<cv::Mat> pre_gray(2); // load for previous frame's stereo img
-  std::vector<cv::Mat> cur_gray(2); // load for current frame's stereo img
   std::vector<Eigen::Matrix<float, 3, 4, Eigen::RowMajor>> gt_poses(num_frames); // store gt pose trajectory
   std::vector<Eigen::Matrix<float, 3, 4, Eigen::RowMajor>> pred_poses(num_frames); // store pred pose trajectory
 
 
   std::cout << "Initializing odometry system ..." << std::endl;
+  if (realtime){
+    if (odometry::EnableRealtime(realtime_config, num_threads) == -1){
+      std::cout << "Real-time mode partly applied, see above." << std::endl;
+    }
+  } else if (num_threads > 0 && odometry::ConfigureDefaultThreadPool(num_threads) == -1){
+    std::cout << "Configure thread pool failed!" << std::endl;
+  }
+  // production monitoring, e.g. ODOMETRY_METRICS=http:9464
+  if (odometry::metrics::StartExporterFromEnv() == -1){
+    std::cout << "Start metrics exporter failed!" << std::endl;
+  }
+  odometry::metrics::MetricsRegistry& registry = odometry::metrics::Registry();
+  odometry::metrics::Counter& frames_total = registry.GetCounter("odometry_frames_total", "Frames processed.");
+  odometry::metrics::Gauge& fps = registry.GetGauge("odometry_fps", "Frame rate of the last frame.");
+  odometry::metrics::Gauge& keyframes_total = registry.GetGauge("odometry_keyframes", "Number of keyframes.");
+  odometry::metrics::Histogram& frame_latency = registry.GetHistogram("odometry_stage_latency_seconds",
+          "Latency of the pipeline stages.", odometry::metrics::LatencyBuckets(), "stage=\"frame\"");
+  odometry::metrics::Histogram& pyramid_latency = registry.GetHistogram("odometry_stage_latency_seconds",
+          "Latency of the pipeline stages.", odometry::metrics::LatencyBuckets(), "stage=\"pyramid\"");
   // initialise stereo cameras (null pointer since we only evaluate on kitti dataset)
   std::shared_ptr<odometry::CameraPyramid> left_cam_ptr = nullptr;
   std::shared_ptr<odometry::CameraPyramid> right_cam_ptr = nullptr;
@@ -68,6 +143,10 @@ int main(){
   odometry::DepthEstimator depth_estimator(disparity_grad_th, disparity_ssd_th, depth_photo_th, search_min, search_max,
                                      depth_lambda, depth_huber_delta, depth_precision, depth_max_iters, 4,
                                      left_cam_ptr, right_cam_ptr, baseline, max_residuals);
+  depth_estimator.SetDisparitySearch(disparity_search);
+  // one band per thread
+  odometry::SgmStereo sgm_stereo(128, 8, 8, 96, 0.95f, search_min, search_max, odometry::DefaultThreadPool().NumThreads(),
+                                 left_cam_ptr, baseline);
   std::cout << "Created depth estimator." << std::endl;
 
 
@@ -86,10 +165,72 @@ int main(){
   int robust_estimator = 1; // robust estimator: 0-no, 1-huber, 2-t_dist;
   float pose_huber_delta = 28.0f; // 4/255
   odometry::LevenbergMarquardtOptimizer pose_estimator(0.01f, 0.995f, pose_max_iters, init_relative_affine, left_cam_ptr, robust_estimator, pose_huber_delta);
+  if (pose_seeding){
+    pose_estimator.SetPoseInitializer(std::make_shared<odometry::PoseInitializer>(1, 20.0f, 16, 100, 2.0f, 20, left_cam_ptr));
+  }
+  // frame to frame tracking of concurrent_tracking
+  odometry::LevenbergMarquardtOptimizer frame_estimator(0.01f, 0.995f, pose_max_iters, init_relative_affine, left_cam_ptr, robust_estimator, pose_huber_delta);
+  // latest pose for the downstream consumers, e.g. planner and controller threads, see PosePublisher
+  odometry::PosePublisher pose_publisher;
+  // poses at any time for consumers faster than the camera, e.g. 100-200 Hz controllers, see PoseInterpolator
+  odometry::PoseInterpolator pose_interpolator(64, 0.3);
+  pose_publisher.Subscribe([&](const odometry::PoseSample& sample){
+    if (sample.status == odometry::kTrackingOk) pose_interpolator.Add(sample.timestamp, sample.pose);
+  });
+  // predicted trajectory: KITTI text and binary log (all fields of the samples, see ReadTrajectoryLog())
+  std::string pred_trajectory_log = pred_trajectory_file.substr(0, pred_trajectory_file.rfind('.')) + ".bin";
+  // resume: the state of the checkpoint and the trajectory up to its frame, the files are written again from it
+  odometry::OdometryCheckpoint checkpoint;
+  std::vector<odometry::TrajectoryRecord> resumed_trajectory;
+  if (resume){
+    if (odometry::LoadCheckpoint(checkpoint_file, checkpoint) == -1 ||
+        odometry::ReadTrajectoryLog(pred_trajectory_log, resumed_trajectory) == -1 ||
+        resumed_trajectory.size() <= size_t(checkpoint.frame_id) ||
+        checkpoint.keyframe_image->GetStorage() != pyramid_storage){
+      std::cout << "Resume failed: no checkpoint, trajectory log or pyramid storage of the checkpoint!" << std::endl;
+      exit(-1);
+    }
+    resumed_trajectory.resize(size_t(checkpoint.frame_id) + 1);
+    std::cout << "Resuming after frame " << checkpoint.frame_id << "." << std::endl;
+  }
+  odometry::TrajectoryWriter trajectory_writer(trajectory_flush_interval);
+  if (trajectory_writer.Open(pred_trajectory_file, odometry::kTrajectoryKitti) == -1 ||
+      trajectory_writer.Open(pred_trajectory_log, odometry::kTrajectoryBinary) == -1){
+    exit(-1);
+  }
+  pose_publisher.Subscribe([&](const odometry::PoseSample& sample){ trajectory_writer.Append(sample); });
   std::cout << "Created pose estimator." << std::endl;
 
-  // load gt poses
+  // initialise IMU prior
+  std::vector<odometry::ImuSample> imu_samples;
+  std::vector<double> frame_times;
+  // TODO: T_cam_imu from the Kalibr camchain, identity for now
+  odometry::ImuPreintegrator imu_preintegrator(odometry::Affine4f::Identity(), Eigen::Vector3f::Zero(), Eigen::Vector3f::Zero());
+  if (!imu_file.empty()){
+    if (odometry::ReadImuCsv(imu_file, imu_samples) == -1 ||
+        odometry::ReadFrameTimestamps(data_path + "/dataset/sequences/00/times.txt", frame_times) == -1){
+      std::cout << "Load IMU data failed, use the constant motion prior!" << std::endl;
+      imu_samples.clear();
+    } else {
+      std::cout << "Loaded " << imu_samples.size() << " IMU samples." << std::endl;
+    }
+  }
+  odometry::Affine4f frame_motion = init_relative_affine; // last frame to frame motion, X_cur = frame_motion * X_pre
+  odometry::Affine4f pre_pose;
+
+  // load gt poses, the devkit evaluates the lines of the predicted trajectory written until the end or a crash
   load_gt_pose(data_path, gt_poses);
+  {
+    odometry::TrajectoryWriter gt_writer(trajectory_flush_interval);
+    if (gt_writer.Open(gt_trajectory_file, odometry::kTrajectoryKitti) == -1) exit(-1);
+    odometry::TrajectoryRecord record;
+    for (unsigned int i = 0; i < num_frames; i++){
+      record.frame_id = i;
+      record.pose = gt_poses[i];
+      gt_writer.Append(record);
+    }
+    if (gt_writer.Close() == -1) exit(-1);
+  }
 
   // initialise 0-th frame: compute left_depth
   load_data(data_path, pre_gray, 0);
@@ -99,12 +240,19 @@ int main(){
   cv::Mat pre_left_val(pre_gray[0].rows, pre_gray[0].cols, CV_8U, init_val);
   cv::Mat pre_left_disp(pre_gray[0].rows, pre_gray[0].cols, PixelType, init_val);
   cv::Mat pre_left_dep(pre_gray[0].rows, pre_gray[0].cols, PixelType, init_val);
-  depth_state = depth_estimator.ComputeDepth(pre_gray[0], pre_gray[1], pre_left_val, pre_left_disp, pre_left_dep);
+  cv::Mat left_rect, right_rect;
+  if (dense_stereo)
+    depth_state = sgm_stereo.ComputeDepth(pre_gray[0], pre_gray[1], pre_left_val, pre_left_disp, pre_left_dep);
+  else if (streaming_stereo)
+    depth_state = depth_estimator.ComputeDepthStreaming(pre_gray[0], pre_gray[1], left_rect, right_rect, pre_left_val,
+                                                        pre_left_disp, pre_left_dep);
+  else
+    depth_state = depth_estimator.ComputeDepth(pre_gray[0], pre_gray[1], pre_left_val, pre_left_disp, pre_left_dep);
   if (depth_state == -1){
     std::cout << "Init 0-th frame failed!" << std::endl;
     exit(-1);
   }
-  depth_estimator.ReportStatus();
+  if (!dense_stereo) depth_estimator.ReportStatus();
   cv::Mat gray_left;
 //  pre_gray[0].convertTo(gray_left, cv::IMREAD_GRAYSCALE);
 //  for (int y=0; y<pre_left_val.rows; y++){
@@ -127,10 +275,45 @@ int main(){
 
 //  odometry::ImagePyramid pre_img_pyramid(4, pre_gray[0], true);
 //  odometry::DepthPyramid pre_dep_pyramid(4, pre_left_dep, false);
-  auto* pre_img_pyramid_ptr = new odometry::ImagePyramid(4, pre_gray[0], true);
-  auto* pre_dep_pyramid_ptr = new odometry::DepthPyramid(4, pre_left_dep, false);
+  // per frame data: frame i in slot i % kFrameSlots, see the task graphs below. a frame reads the slot of the previous
+  // one while the next frame fills its own
+  const unsigned int kFrameSlots = 3;
+  struct FrameData{
+    std::vector<cv::Mat> gray = std::vector<cv::Mat>(2);
+    std::unique_ptr<odometry::ImagePyramid> img_pyramid;
+    std::unique_ptr<odometry::DepthPyramid> dep_pyramid;
+    cv::Mat val;
+    cv::Mat disp;
+    cv::Mat dep;
+    std::unique_ptr<odometry::TaskGraph> graph; // null for the 0-th frame
+    int depth_node = -1;
+    int keyframe_node = -1;
+  };
+  std::vector<FrameData> frames(kFrameSlots);
+  frames[0].gray = pre_gray;
+  frames[0].val = pre_left_val;
+  frames[0].disp = pre_left_disp;
+  frames[0].dep = pre_left_dep;
+  frames[0].img_pyramid.reset(new odometry::ImagePyramid(4, pre_gray[0], true, pyramid_storage));
+  frames[0].dep_pyramid.reset(new odometry::DepthPyramid(4, pre_left_dep, false));
 //  img_pyr_vec.emplace_back(odometry::ImagePyramid(4, pre_gray[0], true));
 //  img_dep_vec.emplace_back(odometry::DepthPyramid(4, pre_left_dep, false));
+  odometry::PoseSample pose_sample;
+  pose_sample.pose = cur_pose;
+  pose_sample.timestamp = frame_times.empty() ? 0.0 : frame_times[0];
+  pose_sample.status = odometry::kTrackingOk;
+  if (resume){
+    // the last pose of the checkpoint is published instead
+    for (size_t i = 0; i < resumed_trajectory.size(); i++){
+      if (i < num_frames) pred_poses[i] = resumed_trajectory[i].pose;
+      if (i + 1 < resumed_trajectory.size()) trajectory_writer.Append(resumed_trajectory[i]);
+    }
+    pose_sample.pose = checkpoint.pose;
+    pose_sample.timestamp = resumed_trajectory.back().timestamp;
+    pose_sample.frame_id = resumed_trajectory.back().frame_id;
+    pose_sample.status = resumed_trajectory.back().status;
+  }
+  pose_publisher.Publish(pose_sample);
   std::cout << "Initialize 0-th frame done." << std::endl << std::endl;
 
   // simulate keyframe
@@ -138,50 +321,38 @@ int main(){
   std::vector<std::tuple<odometry::ImagePyramid, odometry::DepthPyramid, cv::Mat>> keyframes;
   std::vector<odometry::Affine4f> keyframe_poses_abs;
   unsigned int current_kf = 0;
-  keyframes.emplace_back(std::make_tuple(*pre_img_pyramid_ptr, *pre_dep_pyramid_ptr, pre_left_val));
+  keyframes.emplace_back(std::make_tuple(*frames[0].img_pyramid, *frames[0].dep_pyramid, pre_left_val));
   keyframe_id.push_back(current_kf);
   keyframe_poses_abs.emplace_back(cur_pose);
   Eigen::Matrix<float, 6, 1> keyframe_weight;
   keyframe_weight << 0.1f/3.3f, 1.0f/3.3f, 0.1f/3.3f, 1.0f/3.3f, 0.1f/3.3f, 1.0f/3.3f;
-  Eigen::Matrix<float, 1, 6> current_mot;
   std::cout << "****************************************** new keyframe:" << current_kf << " *********************"<< std::endl;
-
-  int sum = 0;
-  gray_left = pre_dep_pyramid_ptr->GetPyramidDepth(0);
-  for (int y= 0; y < gray_left.rows; y++){
-    for (int x = 0; x < gray_left.cols; x++){
-      if (gray_left.at<float>(y,x) != 0)
-        sum++;
-    }
-  }
-  std::cout << "num of valid depth at level 0: " << sum << std::endl;
-  gray_left = pre_dep_pyramid_ptr->GetPyramidDepth(1);
-  sum = 0;
-  for (int y= 0; y < gray_left.rows; y++){
-    for (int x = 0; x < gray_left.cols; x++){
-      if (gray_left.at<float>(y,x) != 0)
-        sum++;
-    }
+  // resume: the 0-th frame is replaced by the state of the checkpoint. keyframes holds the current keyframe only, the
+  // debug writer has the previous ones
+  unsigned int first_frame = 1;
+  if (resume){
+    keyframes.clear();
+    keyframes.emplace_back(std::make_tuple(*checkpoint.keyframe_image, *checkpoint.keyframe_depth, checkpoint.keyframe_valid));
+    keyframe_id = checkpoint.keyframe_ids;
+    keyframe_poses_abs = checkpoint.keyframe_poses;
+    current_kf = keyframe_id.size() - 1;
+    cur_pose = checkpoint.pose;
+    pose_to_keyframe = checkpoint.pose_to_keyframe;
+    frame_motion = checkpoint.frame_motion;
+    pose_estimator.SetState(checkpoint.keyframe_tracking);
+    frame_estimator.SetState(checkpoint.frame_tracking);
+    FrameData& last = frames[checkpoint.frame_id % kFrameSlots];
+    last.img_pyramid.reset(new odometry::ImagePyramid(*checkpoint.frame_image));
+    last.dep_pyramid.reset(new odometry::DepthPyramid(*checkpoint.frame_depth));
+    first_frame = checkpoint.frame_id + 1;
   }
-  std::cout << "num of valid depth at level 1: " << sum << std::endl;
-  gray_left = pre_dep_pyramid_ptr->GetPyramidDepth(2);
-  sum = 0;
-  for (int y= 0; y < gray_left.rows; y++){
-    for (int x = 0; x < gray_left.cols; x++){
-      if (gray_left.at<float>(y,x) != 0)
-        sum++;
-    }
-  }
-  std::cout << "num of valid depth at level 2: " << sum << std::endl;
-  gray_left = pre_dep_pyramid_ptr->GetPyramidDepth(3);
-  sum = 0;
-  for (int y= 0; y < gray_left.rows; y++){
-    for (int x = 0; x < gray_left.cols; x++){
-      if (gray_left.at<float>(y,x) != 0)
-        sum++;
-    }
+  std::atomic<bool> checkpoint_busy(false); // a checkpoint is saved, the next ones are skipped until it is done
+  odometry::DebugWriter debug_writer(debug_config);
+  if (!resume) debug_writer.AddKeyframe(0, *frames[0].img_pyramid, *frames[0].dep_pyramid, pre_left_val);
+
+  for (int l = 0; l < frames[0].dep_pyramid->GetNumberLevels(); l++){
+    LOG_INFO("num of valid depth at level {}: {}", l, cv::countNonZero(frames[0].dep_pyramid->GetPyramidDepth(l)));
   }
-  std::cout << "num of valid depth at level 3: " << sum << std::endl;
 
 //  pre_dep_pyramid.GetPyramidDepth(2).convertTo(gray_left, cv::IMREAD_GRAYSCALE, 255);
 //  cv::imshow("level1", gray_left);
@@ -194,92 +365,176 @@ int main(){
 //  return 0;
 
 
-  // estimate pose from 1-th frame
-  for (unsigned int frame_id = 1; frame_id < num_frames; frame_id++){
-    // load data: gray-imgs, gt_poses(left camera)
-    load_data(data_path, cur_gray, frame_id);
-    std::cout << "read frame done " << std::endl;
-
-    // create image-pyramid for current frame
-    //img_pyr_vec.emplace_back(odometry::ImagePyramid(num_pyramid, cur_gray[0], true));
-    odometry::ImagePyramid cur_img_pyramid(num_pyramid, cur_gray[0], true); // create pyramid for left image
-//    cv::Mat tmp, show_tmp;
-//    tmp = img_pyr_vec[frame_id].GetPyramidImage(3);
-//    tmp.convertTo(show_tmp, cv::IMREAD_GRAYSCALE);
-//    cv::imshow("show_tmp"+std::to_string(frame_id), show_tmp);
-//    cv::waitKey(0);
-
-    // estimate pose and store
-    std::cout << "computing pose " << std::endl;
-    // pose to current keyframe
-    pose_to_keyframe = pose_estimator.Solve(std::get<0>(keyframes[current_kf]), std::get<1>(keyframes[current_kf]), cur_img_pyramid);
-    std::cout << "compute pose done" << std::endl;
-    // pose to world origin: concatenate with current keyframe abs pose
-    cur_pose = keyframe_poses_abs[current_kf] * pose_to_keyframe.inverse();
-    //pose_estimator.Reset(rela_pose, 0.01f);
-    //pose_estimator.Reset(init_relative_affine, 0.01f);
-    //cur_pose = rela_pose.inverse();
-    pred_poses[frame_id] = cur_pose.block<3,4>(0,0);
-
-
-    // estimate depth & create depth-pyramid
-    cv::Mat cur_left_val(cur_gray[0].rows, cur_gray[0].cols, CV_8U, init_val);
-    cv::Mat cur_left_disp(cur_gray[0].rows, cur_gray[0].cols, PixelType);
-    cv::Mat cur_left_dep(cur_gray[0].rows, cur_gray[0].cols, PixelType);
-    depth_state = depth_estimator.ComputeDepth(cur_gray[0], cur_gray[1], cur_left_val, cur_left_disp, cur_left_dep);
-    if (depth_state == -1){
-      std::cout << "    depth failed!" << std::endl;
-      break;
-    } else {
-      std::cout << "    compute depth done." << std::endl;
-      std::cout << "    number of val depth: " << cv::sum(cur_left_val)[0] << std::endl;
-      depth_estimator.ReportStatus();
-//      cur_gray[0].convertTo(gray_left, cv::IMREAD_GRAYSCALE);
-//      for (int y=0; y<cur_left_val.rows; y++){
-//        for (int x=0; x<cur_left_val.cols; x++){
-//          if (cur_left_val.at<uint8_t>(y,x)==1){
-//            cv::circle(gray_left, cv::Point(x,y), 4, cv::Scalar(0));
-//          }
-//        }
-//      }
-//      cv::imshow("keypoints", gray_left);
-//      cv::waitKey(0);
-      //img_dep_vec.emplace_back(odometry::DepthPyramid(4, cur_left_dep, false));
+  // estimate pose from 1-th frame. the stages of a frame run as a task graph on DefaultThreadPool(): the pyramid and the
+  // depth are independent, the tracking needs the pyramid only. the next frame starts while the current one is tracked,
+  // the stages sharing state are chained across the frames: the depth (buffers of the estimators) and the tracking
+  // after the keyframe decision (keyframes, pose estimators)
+  std::chrono::steady_clock::time_point last_frame_done = std::chrono::steady_clock::now();
+  for (unsigned int frame_id = first_frame; frame_id <= num_frames; frame_id++){
+    FrameData* previous = &frames[(frame_id - 1) % kFrameSlots];
+    odometry::TaskGraph* next_graph = nullptr;
+    if (frame_id < num_frames){
+      FrameData* frame = &frames[frame_id % kFrameSlots];
+      frame->graph.reset(new odometry::TaskGraph());
+      odometry::TaskGraph& graph = *frame->graph;
+      // load data: gray-imgs, gt_poses(left camera)
+      int load = graph.AddNode("load", [&, frame, frame_id](){
+        load_data(data_path, frame->gray, frame_id);
+        LOG_DEBUG("read frame done");
+        return 0;
+      });
+      // create image-pyramid for current frame, kept as previous frame and keyframe
+      int pyramid = graph.AddNode("pyramid", [&, frame](){
+        odometry::metrics::ScopedLatency timer(pyramid_latency);
+        frame->img_pyramid.reset(new odometry::ImagePyramid(num_pyramid, frame->gray[0], true, pyramid_storage));
+        return 0;
+      }, {load});
+      // estimate depth & create depth-pyramid. new buffers per frame, the keyframes share them
+      int depth = graph.AddNode("depth", [&, frame](){
+        frame->val = cv::Mat(frame->gray[0].rows, frame->gray[0].cols, CV_8U, init_val);
+        frame->disp = cv::Mat(frame->gray[0].rows, frame->gray[0].cols, PixelType);
+        frame->dep = cv::Mat(frame->gray[0].rows, frame->gray[0].cols, PixelType);
+        odometry::GlobalStatus state;
+        if (dense_stereo)
+          state = sgm_stereo.ComputeDepth(frame->gray[0], frame->gray[1], frame->val, frame->disp, frame->dep);
+        else if (streaming_stereo)
+          state = depth_estimator.ComputeDepthStreaming(frame->gray[0], frame->gray[1], left_rect, right_rect, frame->val,
+                                                        frame->disp, frame->dep);
+        else
+          state = depth_estimator.ComputeDepth(frame->gray[0], frame->gray[1], frame->val, frame->disp, frame->dep);
+        if (state == -1){
+          LOG_ERROR("    depth failed!");
+          return state;
+        }
+        LOG_DEBUG("    compute depth done.");
+        LOG_INFO("    number of val depth: {}", cv::countNonZero(frame->val));
+        if (!dense_stereo) depth_estimator.ReportStatus();
+        return state;
+      }, {load});
+      int depth_pyramid = graph.AddNode("depth_pyramid", [&, frame](){
+        frame->dep_pyramid.reset(new odometry::DepthPyramid(num_pyramid, frame->dep, false));
+        return 0;
+      }, {depth});
+      // estimate pose and store
+      int track = graph.AddNode("track", [&, frame, frame_id](){
+        const FrameData& pre = frames[(frame_id - 1) % kFrameSlots];
+        LOG_DEBUG("computing pose");
+        // IMU prior: preintegrated rotation since the previous frame, translation of the last frame to frame motion
+        pre_pose = cur_pose;
+        odometry::Affine4f frame_prior = frame_motion;
+        if (!imu_samples.empty() && frame_id < frame_times.size() &&
+            imu_preintegrator.Integrate(imu_samples, frame_times[frame_id - 1], frame_times[frame_id]) != -1){
+          frame_prior = imu_preintegrator.PredictCameraMotion(frame_motion);
+          pose_estimator.Reset(frame_prior * pre_pose.inverse() * keyframe_poses_abs[current_kf], 0.01f);
+        }
+        // pose to current keyframe
+        if (concurrent_tracking){
+          frame_estimator.Reset(frame_prior, 0.01f);
+          odometry::TrackingSource source = odometry::TrackConcurrently(pose_estimator, std::get<0>(keyframes.back()), std::get<1>(keyframes.back()),
+                                                                        frame_estimator, *pre.img_pyramid, *pre.dep_pyramid, *frame->img_pyramid,
+                                                                        pre_pose.inverse() * keyframe_poses_abs[current_kf], 0.75f, pose_to_keyframe);
+          LOG_DEBUG("tracking source: {}", source == odometry::kFrameTracking ? "frame" : "keyframe");
+        } else {
+          pose_to_keyframe = pose_estimator.Solve(std::get<0>(keyframes.back()), std::get<1>(keyframes.back()), *frame->img_pyramid);
+        }
+        LOG_DEBUG("compute pose done");
+        // pose to world origin: concatenate with current keyframe abs pose
+        cur_pose = keyframe_poses_abs[current_kf] * pose_to_keyframe.inverse();
+        pred_poses[frame_id] = cur_pose.block<3,4>(0,0);
+        frame_motion = cur_pose.inverse() * pre_pose;
+        odometry::PoseSample sample;
+        sample.pose = cur_pose;
+        sample.timestamp = frame_id < frame_times.size() ? frame_times[frame_id] : 0.1 * frame_id; // KITTI: 10 Hz
+        sample.frame_id = frame_id;
+        bool tracked = pose_estimator.GetNumResiduals() > 0 || (concurrent_tracking && frame_estimator.GetNumResiduals() > 0);
+        sample.status = tracked ? odometry::kTrackingOk : odometry::kTrackingLost;
+        pose_publisher.Publish(sample);
+        return 0;
+      }, {pyramid}, odometry::kPriorityHigh);
+      // TODO: if pose to keyframe is larger than TH, add current image/depth as new keyframe, set init_pose as identity
+      int keyframe = graph.AddNode("keyframe", [&, frame, frame_id](){
+        Sophus::SO3<float> rotation(pose_to_keyframe.block<3,3>(0,0));
+        Eigen::Matrix<float, 1, 6> current_mot;
+        current_mot << std::fabs(rotation.angleX()), std::fabs(rotation.angleY()), std::fabs(rotation.angleZ()),
+                std::fabs(pose_to_keyframe(0,3)), std::fabs(pose_to_keyframe(1,3)), std::fabs(pose_to_keyframe(2,3));
+        float motion_mag = current_mot.dot(keyframe_weight);
+        if ( motion_mag > 1.1f){
+          keyframes.clear(); // the debug writer has the previous one
+          keyframes.emplace_back(*frame->img_pyramid, *frame->dep_pyramid, frame->val);
+          keyframe_poses_abs.emplace_back(cur_pose);
+          pose_estimator.Reset(pose_to_keyframe, 0.01f);
+          //pose_estimator.Reset(init_relative_affine, 0.01f);
+          current_kf++;
+          keyframe_id.push_back(frame_id);
+          debug_writer.AddKeyframe(int(current_kf), *frame->img_pyramid, *frame->dep_pyramid, frame->val);
+          LOG_INFO("****************************************** new keyframe: {} *********************", current_kf);
+        } else {
+          // TODO: else set init_pose as previous pose w.r.t the keyframe
+          pose_estimator.Reset(pose_to_keyframe, 0.01f);
+          LOG_INFO("****************************************** motion: {} *********************", motion_mag);
+        }
+        keyframes_total.Set(double(current_kf + 1));
+        // the state is complete here, the next tracking waits for this node. the pyramids are shared, not copied
+        if (checkpoint_interval > 0 && frame_id % checkpoint_interval == 0 && !checkpoint_busy.exchange(true)){
+          std::shared_ptr<odometry::OdometryCheckpoint> snapshot(new odometry::OdometryCheckpoint());
+          snapshot->frame_id = int(frame_id);
+          snapshot->keyframe_ids = keyframe_id;
+          snapshot->keyframe_poses = keyframe_poses_abs;
+          snapshot->keyframe_image = std::make_shared<odometry::ImagePyramid>(std::get<0>(keyframes.back()));
+          snapshot->keyframe_depth = std::make_shared<odometry::DepthPyramid>(std::get<1>(keyframes.back()));
+          snapshot->keyframe_valid = std::get<2>(keyframes.back());
+          snapshot->frame_image = std::make_shared<odometry::ImagePyramid>(*frame->img_pyramid);
+          snapshot->frame_depth = std::make_shared<odometry::DepthPyramid>(*frame->dep_pyramid);
+          snapshot->pose = cur_pose;
+          snapshot->pose_to_keyframe = pose_to_keyframe;
+          snapshot->frame_motion = frame_motion;
+          snapshot->keyframe_tracking = pose_estimator.GetState();
+          snapshot->frame_tracking = frame_estimator.GetState();
+          odometry::DefaultThreadPool().Submit([&, snapshot](){
+            // the trajectory up to the frame is on disk before the checkpoint refers to it
+            if (trajectory_writer.Flush() == -1 || odometry::SaveCheckpoint(checkpoint_file, *snapshot) == -1)
+              LOG_ERROR("checkpoint of frame {} failed!", snapshot->frame_id);
+            else
+              LOG_INFO("checkpoint of frame {} saved", snapshot->frame_id);
+            checkpoint_busy = false;
+          }, odometry::kPriorityLow, "checkpoint");
+        }
+        return 0;
+      }, {track, depth_pyramid}, odometry::kPriorityHigh);
+      if (previous->graph){
+        graph.After(depth, *previous->graph, previous->depth_node);
+        graph.After(track, *previous->graph, previous->keyframe_node);
+      }
+      frame->depth_node = depth;
+      frame->keyframe_node = keyframe;
+      graph.Start(odometry::DefaultThreadPool());
+      next_graph = &graph;
     }
-    delete pre_img_pyramid_ptr;
-    delete pre_dep_pyramid_ptr;
-    pre_img_pyramid_ptr = new odometry::ImagePyramid(num_pyramid, cur_gray[0], true);
-    pre_dep_pyramid_ptr = new odometry::DepthPyramid(num_pyramid, cur_left_dep, false);
-    // TODO: if pose to keyframe is larger than TH, add current image/depth as new keyframe, set init_pose as identity
-    Sophus::SO3<float> rotation(pose_to_keyframe.block<3,3>(0,0));
-    current_mot << std::fabs(rotation.angleX()), std::fabs(rotation.angleY()), std::fabs(rotation.angleZ()),
-            std::fabs(pose_to_keyframe(0,3)), std::fabs(pose_to_keyframe(1,3)), std::fabs(pose_to_keyframe(2,3));
-    float motion_mag = current_mot.dot(keyframe_weight);
-    if ( motion_mag > 1.1f){
-      keyframes.emplace_back(*pre_img_pyramid_ptr, *pre_dep_pyramid_ptr, cur_left_val);
-      keyframe_poses_abs.emplace_back(cur_pose);
-      pose_estimator.Reset(pose_to_keyframe, 0.01f);
-      //pose_estimator.Reset(init_relative_affine, 0.01f);
-      current_kf++;
-      keyframe_id.push_back(frame_id);
-      std::cout << "****************************************** new keyframe: " << current_kf << " *********************" << std::endl;
-    } else {
-      // TODO: else set init_pose as previous pose w.r.t the keyframe
-      pose_estimator.Reset(pose_to_keyframe, 0.01f);
-      std::cout << "****************************************** motion: " << motion_mag << " *********************" << std::endl;
+    // frame 0 was initialized above
+    if (!previous->graph) continue;
+    if (previous->graph->Wait() == -1){
+      LOG_ERROR("frame {} failed!", frame_id - 1);
+      if (next_graph != nullptr) next_graph->Wait();
+      break;
     }
+    LOG_INFO("frame {} {}", frame_id - 1, previous->graph->CriticalPathReport());
+    std::chrono::steady_clock::time_point frame_done = std::chrono::steady_clock::now();
+    frame_latency.Observe(previous->graph->LatencySeconds());
+    fps.Set(1.0 / std::chrono::duration<double>(frame_done - last_frame_done).count());
+    last_frame_done = frame_done;
+    frames_total.Inc();
   }
-  if (pre_img_pyramid_ptr != nullptr)
-    delete pre_img_pyramid_ptr;
-  if (pre_dep_pyramid_ptr != nullptr)
-    delete pre_dep_pyramid_ptr;
+  while (checkpoint_busy) std::this_thread::sleep_for(std::chrono::milliseconds(1)); // the last checkpoint is saved
+  odometry::logging::Flush();
   std::cout << "Sequence done! Evaluating translation error for the first 50 frames ..." << std::endl;
   eval_pose(gt_poses, pred_poses);
   std::cout << "Total keyframes: " << current_kf << std::endl;
   std::cout << "Saving poses for KITTI plot ..." << std::endl;
-  save_txt(gt_poses, pred_poses);
+  if (trajectory_writer.Close() == 0) std::cout << "save completed." << std::endl;
   std::cout << "Saving data for visualize ..." << std::endl;
-  save_to_vis(keyframes, keyframe_id);
+  if (debug_writer.Close() == -1) std::cout << "Writing the keyframe data failed, see above." << std::endl;
+  std::cout << debug_writer.Written() << " keyframes written, " << debug_writer.Dropped() << " dropped." << std::endl;
+  save_keyframe_ids(debug_config.directory + "/keyframe_ids/keyframe_id.txt", keyframe_id);
 
   return 0;
 }
@@ -338,20 +593,20 @@ void load_data(const std::string& folder_name, std::vector<cv::Mat> &gray, int f
   std::string img_path1 = right_path + std::string(6-std::to_string(frame_id).length(), '0') + std::to_string(frame_id) + ".png";
   cv::Mat gray_8u;
 
-  std::cout << "reading frame: " << img_path0 << std::endl;
+  LOG_INFO("reading frame: {}", img_path0);
   gray_8u = cv::imread(img_path0, cv::IMREAD_GRAYSCALE);
   if (gray_8u.empty()){
-    std::cout << "read img failed." << std::endl;
-    std::exit(-1);
+    LOG_ERROR("read img failed.");
+    std::exit(-1); // pending log records are written at exit
   }
   // cv::imshow("left_img", gray_8u);
   gray_8u.convertTo(gray[0], PixelType);
 
-  std::cout << "reading frame: " << img_path1 << std::endl;
+  LOG_INFO("reading frame: {}", img_path1);
   gray_8u = cv::imread(img_path1, cv::IMREAD_GRAYSCALE);
   if (gray_8u.empty()){
-    std::cout << "read img failed." << std::endl;
-    std::exit(-1);
+    LOG_ERROR("read img failed.");
+    std::exit(-1); // pending log records are written at exit
   }
   // cv::imshow("right_img", gray_8u);
   // cv::waitKey(0);
@@ -371,103 +626,14 @@ void eval_pose(const std::vector<Eigen::Matrix<float, 3, 4, Eigen::RowMajor>>& g
   std::cout << "avg error over " << num_frame << " frames: " << sum_err / float(num_frame) << std::endl;
 }
 
-void save_txt(const std::vector<Eigen::Matrix<float, 3, 4, Eigen::RowMajor>>& gt_poses, const std::vector<Eigen::Matrix<float, 3, 4, Eigen::RowMajor>>& pred_poses){
-
-  // for evaluation script, the size of gt_pose and pred_poses must be the same
-  if (gt_poses.size() != pred_poses.size()){
-    std::cout << "gt_pose.size() != pred_pose.size()" << std::endl;
-    std::cout << "gt_pose size: " << gt_poses.size() << std::endl;
-    std::cout << "pred_pose size: " << pred_poses.size() << std::endl;
-    exit(-1);
-  }
-
-  unsigned int num_frame = gt_poses.size();
-  std::string write_gt_file = "../dataset/kitti/devkit/data/odometry/poses/00.txt";
-  std::string write_pred_file = "../dataset/kitti/devkit/results/seq00/data/00.txt";
-  std::ofstream gt_file;
-  std::ofstream pred_file;
-  float tmp;
-  std::string gt_pose_line;
-  std::string pred_pose_line;
-  Eigen::Matrix<float, 3, 4, Eigen::RowMajor> gt_pose;
-  Eigen::Matrix<float, 3, 4, Eigen::RowMajor> pred_pose;
-
-  // open file & clear all data
-  gt_file.open(write_gt_file, std::ios::out | std::ios::trunc);
-  if (!gt_file.is_open()){
-    std::cout << "open gt write file failed: " << write_gt_file << std::endl;
-    exit(-1);
-  }
-  pred_file.open(write_pred_file, std::ios::out | std::ios::trunc);
-  if (!pred_file.is_open()){
-    std::cout << "open pred write file failed: " << write_pred_file << std::endl;
-    exit(-1);
-  }
-
-  // write poses to txt
-  for (unsigned int i = 0; i < num_frame; i++){
-    gt_pose = gt_poses[i];
-    pred_pose = pred_poses[i];
-    gt_pose_line = "";
-    pred_pose_line = "";
-    for (int param_id = 0; param_id < 12; param_id++){
-      tmp = gt_pose(param_id);
-      gt_pose_line += std::to_string(tmp);
-      tmp = pred_pose(param_id);
-      pred_pose_line += std::to_string(tmp);
-      if (param_id != 11){
-        gt_pose_line += " ";
-        pred_pose_line += " ";
-      }
-    }
-    gt_file << gt_pose_line << std::endl;
-    pred_file << pred_pose_line << std::endl;
-  }
-
-  gt_file.close();
-  pred_file.close();
-  std::cout << "save completed." << std::endl;
-}
-
-void save_to_vis(const std::vector<std::tuple<odometry::ImagePyramid, odometry::DepthPyramid, cv::Mat>>& data_vec, const std::vector<int>& keyframe_ids){
-  unsigned int num = data_vec.size();
-  std::string path_img = "../data/kitti_result/gray_img_left/";
-  std::string path_disp = "../data/kitti_result/disparity_left/";
-  std::string path_mask = "../data/kitti_result/mask_left/";
-  std::string path_keyids = "../data/kitti_result/keyframe_ids/keyframe_id.txt";
-  cv::Mat save_img, save_disp, save_mask, tmp_dep;
-  std::vector<int> compression_params;
-  compression_params.push_back(cv::IMWRITE_PNG_COMPRESSION);
-  compression_params.push_back(9);
-  for (unsigned int id=0; id < num; id++){
-    std::get<0>(data_vec[id]).GetPyramidImage(0).convertTo(save_img, cv::IMREAD_GRAYSCALE);
-    cv::imwrite(path_img+std::to_string(id)+".png", save_img, compression_params);
-    std::get<2>(data_vec[id]).convertTo(save_mask, CV_16U);
-    cv::imwrite(path_mask+std::to_string(id)+".png", save_mask, compression_params);
-    // convert to disparity
-    tmp_dep = std::get<1>(data_vec[id]).GetPyramidDepth(0);
-    save_disp.create(tmp_dep.rows, tmp_dep.cols, CV_16U);
-    for (int y = 0; y < tmp_dep.rows; y++){
-      for (int x = 0; x < tmp_dep.cols; x++){
-        if (std::get<2>(data_vec[id]).at<uint8_t>(y, x) != 0)
-          save_disp.at<uint16_t>(y, x) = uint16_t(386.1448f * tmp_dep.at<float>(y, x));
-        else
-          save_disp.at<uint16_t>(y, x) = 0;
-      }
-    }
-    cv::imwrite(path_disp+std::to_string(id)+".png", save_disp, compression_params);
-  }
-  // save keyframe ids
+void save_keyframe_ids(const std::string& file_name, const std::vector<int>& keyframe_ids){
   std::ofstream keyids;
-  std::string line_data;
-  keyids.open(path_keyids, std::ios::out | std::ios::trunc);
+  keyids.open(file_name, std::ios::out | std::ios::trunc);
   if (!keyids.is_open()){
-    std::cout << "open gt write file failed: " << path_keyids << std::endl;
-    exit(-1);
+    std::cout << "open keyframe ids file failed: " << file_name << std::endl;
+    return;
   }
-  for (int i=0; i<keyframe_ids.size(); i++){
-    line_data = std::to_string(keyframe_ids[i]);
-    keyids << line_data << std::endl;
+  for (int keyframe_id : keyframe_ids){
+    keyids << keyframe_id << "\n";
   }
-  keyids.close();
 }
\ No newline at end of file
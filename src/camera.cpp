@@ -80,6 +80,25 @@ GlobalStatus CameraPyramid::UndistortRectify(const cv::Mat& src_raw, cv::Mat& ds
   return 0;
 }
 
+GlobalStatus CameraPyramid::UndistortRectifyRows(const cv::Mat& src_raw, cv::Mat& dst, int row_begin, int row_end,
+                                                 int interpolation, int borderMode, const cv::Scalar& borderValue){
+  // TODO: check img size
+  if (src_raw.rows != 480 || src_raw.cols != 640){
+    std::cout << "camera raw image is not 480x640!" << std::endl;
+    return -1;
+  }
+  if (dst.rows != rmap_[0].rows || dst.cols != rmap_[0].cols || dst.type() != src_raw.type()
+      || row_begin < 0 || row_end > dst.rows || row_begin >= row_end){
+    std::cout << "invalid row band of the rectified image!" << std::endl;
+    return -1;
+  }
+  // the remap of a row band of the maps writes the same rows of dst in place
+  cv::Mat dst_rows = dst.rowRange(row_begin, row_end);
+  cv::remap(src_raw, dst_rows, rmap_[0].rowRange(row_begin, row_end), rmap_[1].rowRange(row_begin, row_end),
+            interpolation, borderMode, borderValue);
+  return 0;
+}
+
 
 /******************************************** STEREO CAMERA SETUP ***********************************************/
 GlobalStatus SetUpStereoCameraSystem(const std::string& stereo_file, int levels, std::shared_ptr<CameraPyramid>& cam_ptr_left,
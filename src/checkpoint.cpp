@@ -0,0 +1,218 @@
+// The file contains the checkpoint file defined in ODOMETRY_CHECKPOINT_H
+
+#include <checkpoint.h>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+namespace odometry
+{
+
+namespace
+{
+
+// limits of a valid file, a corrupted size must not allocate the memory
+const int kMaxLevels = 16;
+const int kMaxKeyframes = 1 << 24;
+const int kMaxImageSize = 1 << 15;
+
+// the writes of a file, the first failure is kept
+class Writer{
+  public:
+    explicit Writer(FILE* file): file_(file){}
+
+    bool Ok() const{ return ok_; }
+
+    void Bytes(const void* data, size_t size){
+      if (ok_ && size > 0 && std::fwrite(data, 1, size, file_) != size) ok_ = false;
+    }
+
+    template <typename T>
+    void Value(const T& value){ Bytes(&value, sizeof(T)); }
+
+    void Pose(const Affine4f& pose){ Bytes(pose.data(), 16 * sizeof(float)); }
+
+    void Image(const cv::Mat& image){
+      int32_t header[3] = {image.type(), image.rows, image.cols};
+      Bytes(header, sizeof(header));
+      for (int y = 0; y < image.rows; y++) Bytes(image.ptr(y), image.cols * image.elemSize());
+    }
+
+    void Pyramid(const ImagePyramid& pyramid){
+      Value(int32_t(pyramid.GetStorage()));
+      Value(int32_t(pyramid.GetNumberLevels()));
+      for (int l = 0; l < pyramid.GetNumberLevels(); l++) Image(pyramid.GetPyramidData(l));
+    }
+
+    void Pyramid(const DepthPyramid& pyramid){
+      Value(int32_t(pyramid.GetNumberLevels()));
+      for (int l = 0; l < pyramid.GetNumberLevels(); l++) Image(pyramid.GetPyramidDepth(l));
+    }
+
+    void State(const LevenbergMarquardtOptimizer::State& state){
+      Pose(state.affine_init);
+      Value(state.lambda);
+      Value(uint8_t(state.prior_uncertain));
+    }
+
+  private:
+    FILE* file_;
+    bool ok_ = true;
+};
+
+// the reads of a file, the first failure (end of file, invalid size) is kept
+class Reader{
+  public:
+    explicit Reader(FILE* file): file_(file){}
+
+    bool Ok() const{ return ok_; }
+
+    void Bytes(void* data, size_t size){
+      if (!ok_ || size == 0) return;
+      if (std::fread(data, 1, size, file_) != size){
+        ok_ = false;
+        std::memset(data, 0, size);
+      }
+    }
+
+    template <typename T>
+    T Value(){
+      T value{};
+      Bytes(&value, sizeof(T));
+      return value;
+    }
+
+    // a size in [0, max]
+    int Size(int max){
+      int32_t size = Value<int32_t>();
+      if (size < 0 || size > max) ok_ = false;
+      return ok_ ? int(size) : 0;
+    }
+
+    Affine4f Pose(){
+      Affine4f pose = Affine4f::Zero();
+      Bytes(pose.data(), 16 * sizeof(float));
+      return pose;
+    }
+
+    cv::Mat Image(){
+      int32_t type = Value<int32_t>();
+      int rows = Size(kMaxImageSize), cols = Size(kMaxImageSize);
+      if (!ok_ || (type != CV_8U && type != CV_16U && type != CV_32F)){
+        ok_ = false;
+        return cv::Mat();
+      }
+      cv::Mat image(rows, cols, type);
+      for (int y = 0; y < rows; y++) Bytes(image.ptr(y), cols * image.elemSize());
+      return image;
+    }
+
+    std::shared_ptr<ImagePyramid> ImagePyramidData(){
+      int32_t storage = Value<int32_t>();
+      if (storage != kStorageFloat32 && storage != kStorageUint8 && storage != kStorageFloat16) ok_ = false;
+      std::vector<cv::Mat> levels(Size(kMaxLevels));
+      for (cv::Mat& level : levels) level = Image();
+      if (!ok_) return nullptr;
+      return std::make_shared<ImagePyramid>(levels, PyramidStorage(storage));
+    }
+
+    std::shared_ptr<DepthPyramid> DepthPyramidData(){
+      std::vector<cv::Mat> levels(Size(kMaxLevels));
+      for (cv::Mat& level : levels) level = Image();
+      if (!ok_) return nullptr;
+      return std::make_shared<DepthPyramid>(levels);
+    }
+
+    LevenbergMarquardtOptimizer::State State(){
+      LevenbergMarquardtOptimizer::State state;
+      state.affine_init = Pose();
+      state.lambda = Value<float>();
+      state.prior_uncertain = Value<uint8_t>() != 0;
+      return state;
+    }
+
+  private:
+    FILE* file_;
+    bool ok_ = true;
+};
+
+} // namespace
+
+GlobalStatus SaveCheckpoint(const std::string& file_name, const OdometryCheckpoint& checkpoint){
+  if (!checkpoint.keyframe_image || !checkpoint.keyframe_depth || !checkpoint.frame_image || !checkpoint.frame_depth){
+    std::cout << "Checkpoint without pyramids!" << std::endl;
+    return -1;
+  }
+  std::string tmp_name = file_name + ".tmp";
+  FILE* file = std::fopen(tmp_name.c_str(), "wb");
+  if (file == nullptr){
+    std::cout << "open checkpoint file failed: " << tmp_name << std::endl;
+    return -1;
+  }
+  Writer writer(file);
+  writer.Bytes(kCheckpointMagic, sizeof(kCheckpointMagic));
+  writer.Value(int32_t(checkpoint.frame_id));
+  writer.Value(int32_t(checkpoint.keyframe_ids.size()));
+  writer.Bytes(checkpoint.keyframe_ids.data(), checkpoint.keyframe_ids.size() * sizeof(int));
+  writer.Value(int32_t(checkpoint.keyframe_poses.size()));
+  for (const Affine4f& pose : checkpoint.keyframe_poses) writer.Pose(pose);
+  writer.Pyramid(*checkpoint.keyframe_image);
+  writer.Pyramid(*checkpoint.keyframe_depth);
+  writer.Image(checkpoint.keyframe_valid);
+  writer.Pyramid(*checkpoint.frame_image);
+  writer.Pyramid(*checkpoint.frame_depth);
+  writer.Pose(checkpoint.pose);
+  writer.Pose(checkpoint.pose_to_keyframe);
+  writer.Pose(checkpoint.frame_motion);
+  writer.State(checkpoint.keyframe_tracking);
+  writer.State(checkpoint.frame_tracking);
+  // on disk before it replaces the previous checkpoint
+  bool ok = writer.Ok() && std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+  ok = (std::fclose(file) == 0) && ok;
+  if (!ok || std::rename(tmp_name.c_str(), file_name.c_str()) != 0){
+    std::cout << "write checkpoint file failed: " << file_name << std::endl;
+    std::remove(tmp_name.c_str());
+    return -1;
+  }
+  return 0;
+}
+
+GlobalStatus LoadCheckpoint(const std::string& file_name, OdometryCheckpoint& checkpoint){
+  FILE* file = std::fopen(file_name.c_str(), "rb");
+  if (file == nullptr){
+    std::cout << "open checkpoint file failed: " << file_name << std::endl;
+    return -1;
+  }
+  Reader reader(file);
+  char magic[sizeof(kCheckpointMagic)];
+  reader.Bytes(magic, sizeof(magic));
+  if (!reader.Ok() || std::memcmp(magic, kCheckpointMagic, sizeof(magic)) != 0){
+    std::cout << "no checkpoint file: " << file_name << std::endl;
+    std::fclose(file);
+    return -1;
+  }
+  checkpoint.frame_id = reader.Value<int32_t>();
+  checkpoint.keyframe_ids.resize(size_t(reader.Size(kMaxKeyframes)));
+  reader.Bytes(checkpoint.keyframe_ids.data(), checkpoint.keyframe_ids.size() * sizeof(int));
+  checkpoint.keyframe_poses.resize(size_t(reader.Size(kMaxKeyframes)));
+  for (Affine4f& pose : checkpoint.keyframe_poses) pose = reader.Pose();
+  checkpoint.keyframe_image = reader.ImagePyramidData();
+  checkpoint.keyframe_depth = reader.DepthPyramidData();
+  checkpoint.keyframe_valid = reader.Image();
+  checkpoint.frame_image = reader.ImagePyramidData();
+  checkpoint.frame_depth = reader.DepthPyramidData();
+  checkpoint.pose = reader.Pose();
+  checkpoint.pose_to_keyframe = reader.Pose();
+  checkpoint.frame_motion = reader.Pose();
+  checkpoint.keyframe_tracking = reader.State();
+  checkpoint.frame_tracking = reader.State();
+  std::fclose(file);
+  if (!reader.Ok() || checkpoint.keyframe_ids.empty() || checkpoint.keyframe_ids.size() != checkpoint.keyframe_poses.size()){
+    std::cout << "invalid checkpoint file: " << file_name << std::endl;
+    return -1;
+  }
+  return 0;
+}
+
+} // namespace odometry
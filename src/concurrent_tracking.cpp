@@ -0,0 +1,43 @@
+// The file contains the concurrent tracking defined in ODOMETRY_CONCURRENT_TRACKING_H
+
+#include <concurrent_tracking.h>
+#include <metrics.h>
+#include <thread_pool.h>
+
+namespace odometry
+{
+
+TrackingSource TrackConcurrently(LevenbergMarquardtOptimizer& keyframe_optimizer, const ImagePyramid& kImagePyrKeyframe,
+                                 const DepthPyramid& kDepthPyrKeyframe, LevenbergMarquardtOptimizer& frame_optimizer,
+                                 const ImagePyramid& kImagePyrPre, const DepthPyramid& kDepthPyrPre,
+                                 const ImagePyramid& kImagePyrCur, const Affine4f& kPreviousToKeyframe,
+                                 float min_residual_ratio, Affine4f& pose_to_keyframe){
+  static metrics::Counter& keyframe_total = metrics::Registry().GetCounter("odometry_tracking_source_total",
+          "Tracking results chained into the trajectory.", "source=\"keyframe\"");
+  static metrics::Counter& frame_total = metrics::Registry().GetCounter("odometry_tracking_source_total",
+          "Tracking results chained into the trajectory.", "source=\"frame\"");
+  Affine4f keyframe_pose, frame_pose;
+  // one chunk per optimization, the optimizers share no state. ahead of any queued background work
+  DefaultThreadPool().ParallelFor(0, 2, 1, [&](int begin, int end){
+    for (int i = begin; i < end; i++){
+      if (i == 0)
+        keyframe_pose = keyframe_optimizer.Solve(kImagePyrKeyframe, kDepthPyrKeyframe, kImagePyrCur);
+      else
+        frame_pose = frame_optimizer.Solve(kImagePyrPre, kDepthPyrPre, kImagePyrCur);
+    }
+  }, kPriorityHigh, "tracking");
+  bool keyframe_ok = keyframe_optimizer.GetNumResiduals() > 0;
+  bool frame_ok = frame_optimizer.GetNumResiduals() > 0;
+  bool frame_better = frame_optimizer.GetFinalCost() < keyframe_optimizer.GetFinalCost() &&
+                      float(frame_optimizer.GetNumResiduals()) >= min_residual_ratio * float(keyframe_optimizer.GetNumResiduals());
+  if (frame_ok && (!keyframe_ok || frame_better)){
+    pose_to_keyframe = frame_pose * kPreviousToKeyframe;
+    frame_total.Inc();
+    return kFrameTracking;
+  }
+  pose_to_keyframe = keyframe_pose;
+  keyframe_total.Inc();
+  return kKeyframeTracking;
+}
+
+} // namespace odometry
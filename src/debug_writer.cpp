@@ -0,0 +1,159 @@
+// The file contains the background debug output defined in ODOMETRY_DEBUG_WRITER_H
+
+#include <debug_writer.h>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <opencv2/imgcodecs.hpp>
+#include <metrics.h>
+
+namespace odometry
+{
+
+namespace
+{
+
+metrics::Counter& KeyframesCounter(const char* result){
+  return metrics::Registry().GetCounter("odometry_debug_keyframes_total", "Keyframes of the debug output.",
+                                        std::string("result=\"") + result + "\"");
+}
+
+// disparity = scale * inverse depth, truncated, 0 where valid is 0
+void ToDisparity(const cv::Mat& inv_depth, const cv::Mat& valid, float scale, cv::Mat& disparity){
+  disparity.create(inv_depth.rows, inv_depth.cols, CV_16U);
+  for (int y = 0; y < inv_depth.rows; y++){
+    const float* depth_row = inv_depth.ptr<float>(y);
+    const uint8_t* valid_row = valid.ptr<uint8_t>(y);
+    uint16_t* disparity_row = disparity.ptr<uint16_t>(y);
+    for (int x = 0; x < inv_depth.cols; x++){
+      disparity_row[x] = valid_row[x] != 0 ? uint16_t(scale * depth_row[x]) : uint16_t(0);
+    }
+  }
+}
+
+bool WriteRaw(const std::string& file_name, const cv::Mat& image){
+  FILE* file = std::fopen(file_name.c_str(), "wb");
+  if (file == nullptr) return false;
+  int32_t header[3] = {image.type(), image.rows, image.cols};
+  bool ok = std::fwrite(header, sizeof(header), 1, file) == 1;
+  size_t row_bytes = image.cols * image.elemSize();
+  for (int y = 0; ok && y < image.rows; y++) ok = std::fwrite(image.ptr(y), 1, row_bytes, file) == row_bytes;
+  return (std::fclose(file) == 0) && ok;
+}
+
+bool WriteBytes(const std::string& file_name, const std::vector<unsigned char>& data){
+  FILE* file = std::fopen(file_name.c_str(), "wb");
+  if (file == nullptr) return false;
+  bool ok = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+  return (std::fclose(file) == 0) && ok;
+}
+
+bool WritePng(const std::string& file_name, const cv::Mat& image){
+  // level 1: most of the size reduction of level 9 at a fraction of the time
+  return cv::imwrite(file_name, image, {cv::IMWRITE_PNG_COMPRESSION, 1});
+}
+
+} // namespace
+
+DebugWriter::DebugWriter(const DebugWriterConfig& config){
+  config_ = config;
+  write_thread_ = std::thread(&DebugWriter::WriteLoop, this);
+}
+
+DebugWriter::~DebugWriter(){
+  Close();
+}
+
+GlobalStatus DebugWriter::AddKeyframe(int keyframe_index, const ImagePyramid& image, const DepthPyramid& depth,
+                                      const cv::Mat& valid){
+  static metrics::Counter& dropped = KeyframesCounter("dropped");
+  if (config_.keyframe_stride <= 0 || keyframe_index % config_.keyframe_stride != 0) return 0;
+  Keyframe keyframe;
+  keyframe.index = keyframe_index;
+  // the copies share the levels
+  keyframe.image = std::make_shared<ImagePyramid>(image);
+  keyframe.depth = std::make_shared<DepthPyramid>(depth);
+  keyframe.valid = valid;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!stopped_ && int(queue_.size()) < config_.queue_size){
+      queue_.push_back(std::move(keyframe));
+      wake_.notify_one();
+      return 0;
+    }
+    dropped_++;
+  }
+  dropped.Inc();
+  return -1;
+}
+
+GlobalStatus DebugWriter::Close(){
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_) return failed_ ? -1 : 0;
+    stopped_ = true;
+  }
+  wake_.notify_one();
+  write_thread_.join(); // writes the queue left
+  std::lock_guard<std::mutex> lock(mutex_);
+  return failed_ ? -1 : 0;
+}
+
+uint64_t DebugWriter::Written() const{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return written_;
+}
+
+uint64_t DebugWriter::Dropped() const{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return dropped_;
+}
+
+void DebugWriter::WriteLoop(){
+  static metrics::Counter& written = KeyframesCounter("written");
+  static metrics::Counter& failed = KeyframesCounter("failed");
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true){
+    wake_.wait(lock, [&](){ return stopped_ || !queue_.empty(); });
+    if (queue_.empty()) break; // stopped, all written
+    Keyframe keyframe = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    GlobalStatus status = WriteKeyframe(keyframe);
+    (status == -1 ? failed : written).Inc();
+    lock.lock();
+    if (status == -1) failed_ = true;
+    else written_++;
+  }
+}
+
+GlobalStatus DebugWriter::WriteKeyframe(const Keyframe& keyframe){
+  std::string name = std::to_string(keyframe.index);
+  std::string path_img = config_.directory + "/gray_img_left/" + name;
+  std::string path_mask = config_.directory + "/mask_left/" + name;
+  std::string path_disp = config_.directory + "/disparity_left/" + name;
+  cv::Mat gray, image, disparity;
+  keyframe.image->DecodePyramidImage(0, gray);
+  gray.convertTo(image, CV_8U);
+  bool ok;
+  if (config_.format == kDebugSparseDepth){
+    ok = WritePng(path_img + ".png", image) &&
+         codec_.Encode(keyframe.depth->GetPyramidDepth(0), keyframe.valid, encoded_) == 0 &&
+         WriteBytes(path_disp + ".spd", encoded_);
+  } else if (config_.format == kDebugRaw){
+    ToDisparity(keyframe.depth->GetPyramidDepth(0), keyframe.valid, config_.disparity_scale, disparity);
+    ok = WriteRaw(path_img + ".raw", image) && WriteRaw(path_mask + ".raw", keyframe.valid) &&
+         WriteRaw(path_disp + ".raw", disparity);
+  } else {
+    ToDisparity(keyframe.depth->GetPyramidDepth(0), keyframe.valid, config_.disparity_scale, disparity);
+    ok = WritePng(path_img + ".png", image) && WritePng(path_mask + ".png", keyframe.valid) &&
+         WritePng(path_disp + ".png", disparity);
+  }
+  if (!ok){
+    std::cout << "Write debug output of keyframe " << keyframe.index << " failed: " << config_.directory << std::endl;
+    return -1;
+  }
+  return 0;
+}
+
+} // namespace odometry
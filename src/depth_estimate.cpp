@@ -2,10 +2,36 @@
 // Created by Yu Wang on 2019-01-11.
 
 #include <depth_estimate.h>
+#include <image_processing_global.h>
+#include <logging.h>
+#include <metrics.h>
+#include <thread_pool.h>
 
 namespace odometry
 {
 
+namespace
+{
+
+// 3x3 gaussian blur of row y of src into dst: [1 2 1] / 4 in x and y, the borders reflected as cv::BORDER_REFLECT_101.
+// reads the rows y-1, y, y+1 of src only, tmp: cols floats
+void BlurRow(const cv::Mat& src, int y, float* tmp, float* dst){
+  int rows = src.rows, cols = src.cols;
+  const float* p_row_ptr = src.ptr<float>(y > 0 ? y - 1 : 1);
+  const float* row_ptr = src.ptr<float>(y);
+  const float* n_row_ptr = src.ptr<float>(y < rows - 1 ? y + 1 : rows - 2);
+  for (int x = 0; x < cols; x++){
+    tmp[x] = 0.25f * p_row_ptr[x] + 0.5f * row_ptr[x] + 0.25f * n_row_ptr[x];
+  }
+  dst[0] = 0.5f * tmp[1] + 0.5f * tmp[0];
+  for (int x = 1; x < cols - 1; x++){
+    dst[x] = 0.25f * tmp[x-1] + 0.5f * tmp[x] + 0.25f * tmp[x+1];
+  }
+  dst[cols-1] = 0.5f * tmp[cols-2] + 0.5f * tmp[cols-1];
+}
+
+} // namespace
+
 DepthEstimator::DepthEstimator(float grad_th, float ssd_th, float photo_th, float min_depth, float max_depth,
         float lambda, float huber_delta, float precision, int max_iters, int boundary, const std::shared_ptr<CameraPyramid>& left_cam_ptr,
                                const std::shared_ptr<CameraPyramid>& right_cam_ptr, float baseline,  int max_residuals=5000){
@@ -23,6 +49,8 @@ DepthEstimator::DepthEstimator(float grad_th, float ssd_th, float photo_th, floa
   baseline_ = baseline;
   max_residuals_ = max_residuals;
   huber_delta_ = huber_delta;
+  disparity_search_ = kEpipolarSearch;
+  patch_match_iters_ = 3;
 }
 
 DepthEstimator::~DepthEstimator(){
@@ -48,30 +76,142 @@ GlobalStatus DepthEstimator::ComputeDepth(const cv::Mat& left_img, const cv::Mat
     return -1;
   }
 
+  static metrics::Histogram& disparity_latency = metrics::Registry().GetHistogram("odometry_stage_latency_seconds",
+          "Latency of the pipeline stages.", metrics::LatencyBuckets(), "stage=\"disparity\"");
+
   // loop for each pixel, compute gradient and do disparity search
   GlobalStatus disp_stat = -1;
-  GlobalStatus opt_stat = -1;
-  clock_t begin, end;
-  std::cout << "computing disparity ..." << std::endl;
+  clock_t begin;
+  LOG_DEBUG("computing disparity ...");
   begin = clock();
-  disp_stat = DisparityDepthEstimate(left_img, right_img, left_disp, left_dep, left_val);
+  {
+    metrics::ScopedLatency timer(disparity_latency);
+    disp_stat = DisparityDepthEstimate(left_img, right_img, left_disp, left_dep, left_val);
+  }
   if (disp_stat == -1){
-    std::cout << "Disparity search failed!" << std::endl;
+    LOG_ERROR("Disparity search failed!");
     return -1;
   } else {
-    std::cout << "valid disparities: " << cv::sum(left_val)[0] << std::endl;
+    LOG_DEBUG("valid disparities: {}", cv::countNonZero(left_val));
   }
 
+  return RefineDepth(left_img, right_img, left_val, left_dep, begin);
+}
+
+GlobalStatus DepthEstimator::ComputeDepthStreaming(const cv::Mat& left_raw, const cv::Mat& right_raw, cv::Mat& left_rect,
+        cv::Mat& right_rect, cv::Mat& left_val, cv::Mat& left_disp, cv::Mat& left_dep,
+        const std::function<void(int, int)>& rows_done){
+  if ((left_raw.rows != right_raw.rows) || (left_raw.cols != right_raw.cols)){
+    std::cout << "Number of rows/cols do not match for left/right images." << std::endl;
+    return -1;
+  }
+  if ((left_raw.type() != PixelType) || right_raw.type() != PixelType){
+    std::cout << "Pixel type of left/right images not 32-bit float." << std::endl;
+    return -1;
+  }
+  if (disparity_search_ == kPatchMatchSearch){
+    std::cout << "PatchMatch search needs the whole frame, not supported by the row-streaming stereo." << std::endl;
+    return -1;
+  }
+  if (!left_disp.isContinuous() || !left_dep.isContinuous() || !left_val.isContinuous()){
+    std::cout << "The cv::Mat matrix is not continuous in disparity search!" << std::endl;
+    return -1;
+  }
+  static metrics::Histogram& streaming_latency = metrics::Registry().GetHistogram("odometry_stage_latency_seconds",
+          "Latency of the pipeline stages.", metrics::LatencyBuckets(), "stage=\"streaming_disparity\"");
+
+  bool rectify = camera_ptr_left_ != nullptr && camera_ptr_right_ != nullptr;
+  int rows = left_raw.rows, cols = left_raw.cols;
+  if (rectify){
+    left_rect.create(rows, cols, PixelType);
+    right_rect.create(rows, cols, PixelType);
+  } else {
+    left_rect = left_raw;
+    right_rect = right_raw;
+  }
+  // rolling window of the smoothed rows: block row k reads the rows start_y-2 .. start_y+block_h+1
+  int block_h = (rows - boundary_ * 2) / kDepthBlockRows;
+  int window_rows = block_h + 4;
+  cv::Mat left_window(window_rows, cols, PixelType), right_window(window_rows, cols, PixelType);
+  RowFn left_rows = [&left_window, window_rows](int y){ return (const float*)left_window.ptr<float>(y % window_rows); };
+  RowFn right_rows = [&right_window, window_rows](int y){ return (const float*)right_window.ptr<float>(y % window_rows); };
+  std::vector<float> blur_tmp(cols);
+  int rect_end = 0, blur_end = 0;
+  auto rectify_until = [&](int row_end){
+    GlobalStatus status = 0;
+    for (; rect_end < row_end; rect_end = std::min(rect_end + kStreamingBandRows, rows)){
+      if (!rectify) continue;
+      int band_end = std::min(rect_end + kStreamingBandRows, rows);
+      if (camera_ptr_left_->UndistortRectifyRows(left_raw, left_rect, rect_end, band_end, cv::INTER_LINEAR,
+                                                 cv::BORDER_CONSTANT, cv::Scalar()) == -1 ||
+          camera_ptr_right_->UndistortRectifyRows(right_raw, right_rect, rect_end, band_end, cv::INTER_LINEAR,
+                                                  cv::BORDER_CONSTANT, cv::Scalar()) == -1){
+        status = -1;
+      }
+    }
+    return status;
+  };
+
+  GlobalStatus disp_stat = 0;
+  clock_t begin;
+  LOG_DEBUG("computing disparity (row-streaming) ...");
+  begin = clock();
+  {
+    metrics::ScopedLatency timer(streaming_latency);
+    for (int block_row = 0; block_row < kDepthBlockRows && disp_stat != -1; block_row++){
+      int start_y = boundary_ + block_row * block_h;
+      // smoothed row y needs the rectified row y+1
+      int need_blur_end = std::min(start_y + block_h + 2, rows);
+      disp_stat = rectify_until(std::min(need_blur_end + 1, rows));
+      for (; blur_end < need_blur_end; blur_end++){
+        BlurRow(left_rect, blur_end, blur_tmp.data(), left_window.ptr<float>(blur_end % window_rows));
+        BlurRow(right_rect, blur_end, blur_tmp.data(), right_window.ptr<float>(blur_end % window_rows));
+      }
+      SelectBlockRow(left_rows, cols, block_row, left_val);
+      EpipolarSearchRows(left_rows, right_rows, start_y, start_y + block_h, left_disp, left_dep, left_val);
+      if (rows_done){
+        rows_done(block_row == 0 ? 0 : start_y, block_row == kDepthBlockRows - 1 ? rows : start_y + block_h);
+      }
+    }
+    if (disp_stat != -1) disp_stat = rectify_until(rows);
+  }
+  if (disp_stat == -1){
+    LOG_ERROR("Row-streaming rectification failed!");
+    return -1;
+  } else {
+    LOG_DEBUG("valid disparities: {}", cv::countNonZero(left_val));
+  }
+
+  return RefineDepth(left_rect, right_rect, left_val, left_dep, begin);
+}
+
+GlobalStatus DepthEstimator::RefineDepth(const cv::Mat& left_rect, const cv::Mat& right_rect, cv::Mat& left_val,
+                                         cv::Mat& left_dep, clock_t begin){
+  static metrics::Histogram& refine_latency = metrics::Registry().GetHistogram("odometry_stage_latency_seconds",
+          "Latency of the pipeline stages.", metrics::LatencyBuckets(), "stage=\"depth_refinement\"");
+  static metrics::Gauge& valid_points = metrics::Registry().GetGauge("odometry_depth_valid_points",
+          "Valid depth points of the last frame.");
+  static metrics::Gauge& refine_iterations = metrics::Registry().GetGauge("odometry_depth_lm_iterations",
+          "LM iterations of the last depth refinement.");
+
   // depth optimization after initial disparity search
-  std::cout << "optimizing depth ..." << std::endl;
-  opt_stat = DepthOptimization(left_img, right_img, left_dep, left_val);
+  GlobalStatus opt_stat = -1;
+  clock_t end;
+  LOG_DEBUG("optimizing depth ...");
+  {
+    metrics::ScopedLatency timer(refine_latency);
+    opt_stat = DepthOptimization(left_rect, right_rect, left_dep, left_val);
+  }
+  refine_iterations.Set(iters_stat_);
   end = clock();
-  std::cout << "end optimization: " << double(end - begin) / CLOCKS_PER_SEC * 1000.0f << " ms." << std::endl;
+  LOG_INFO("end optimization: {} ms.", double(end - begin) / CLOCKS_PER_SEC * 1000.0f);
   if (opt_stat == -1){
-    std::cout << "Depth optimization failed!" << std::endl;
+    LOG_ERROR("Depth optimization failed!");
     return -1;
   } else {
-    std::cout << "valid depth: " << cv::sum(left_val)[0] << std::endl;
+    int num_valid = cv::countNonZero(left_val);
+    valid_points.Set(num_valid);
+    LOG_INFO("valid depth: {}", num_valid);
   }
 
   return 0;
@@ -89,86 +229,82 @@ GlobalStatus DepthEstimator::DepthOptimization(const cv::Mat& left_rect, const c
 
   // find all valid pixels with inverse depth values and put them into an Eigen::Matrix,
   int num_residuals = 0;
-  float current_lambda = lambda_;
   int iter_count = 0;
-  float err_last = 1e+10;
+  float err_last = 0.0;
   float err_now = 0.0;
-  float err_diff = 1e+10;
   GlobalStatus compute_status;
   Eigen::Matrix<float, Eigen::Dynamic, 1> init_depth; // copied from left_dep, but only valid ones [z0, z1, ...]
-  Eigen::Matrix<float, Eigen::Dynamic, 1> current_depth; // the current best estimate of inverse depth
-  Eigen::Matrix<float, Eigen::Dynamic, 1> pre_depth; // previous best estimate of inverse depth
-  Eigen::Matrix<float, Eigen::Dynamic, 1> tmp_depth; // attempted update
-  Eigen::Matrix<float, Eigen::Dynamic, 1> delta_depth; // delta
-  Eigen::Matrix<float, Eigen::Dynamic, 1> residuals; // keep them to filter pixels with large photometric error
-  std::vector<std::pair<int, int>> coord_valid; // the coordinates of valid pixels on left image [(x0,y0), (x1,y1), ...]
+  std::vector<int> x_valid; // the coordinates of valid pixels on left image [x0, x1, ...]
+  std::vector<int> y_valid; // [y0, y1, ...]
   init_depth.resize(max_residuals_, 1); // resize to [max_residuals_,1], max_residuals_=10000 by default
   for (int y = 0; y < left_rect.rows; y++){
     for (int x = 0; x < left_rect.cols; x++){
       if (left_val.at<uint8_t>(y, x) == 1){
         init_depth.row(num_residuals) << left_dep.at<float>(y, x);
-        coord_valid.emplace_back(std::make_pair(x, y));
+        x_valid.push_back(x);
+        y_valid.push_back(y);
         num_residuals++;
       }
     }
   }
   //std::cout << "number of residuals: " << num_residuals << std::endl;
   init_depth.conservativeResize(num_residuals, 1);
-  Eigen::DiagonalMatrix<float, Eigen::Dynamic> jtwj; // jtwj, diagonal
-  Eigen::DiagonalMatrix<float, Eigen::Dynamic> A; // jtwj + lambda*jtwj, diagonal
-  Eigen::Matrix<float, Eigen::Dynamic, 1> b; // -jtwr
-  current_depth.setZero(num_residuals, 1);
-  current_depth = init_depth; // set current best to initial values
-  residuals.setZero(num_residuals, 1); // [N,1]
-  pre_depth.setZero(num_residuals, 1); // [N,1]
-  delta_depth.setZero(num_residuals, 1); // [N,1]
-  tmp_depth.setZero(num_residuals, 1); // [N,1]
-  jtwj.setIdentity(num_residuals); // set jtwj to identity diagonal of size [N,N]
-  A.setIdentity(num_residuals); // set A to identity diagonal of size [N,N]
-  b.setZero(num_residuals, 1); // set b to zeros of size [N,1]
-
-  // now we have:
-  //  * initial depth, init_depth: [N,1]
-  //  * current best, current_depth: [N,1]
-  //  * previous best, pre_depth: [N,1]
-  //  * delta, delta_depth: [N,1]
-  //  * A: [N,N] diagonal identity
-  //  * b: [N,1] zeros
-  tmp_depth = current_depth;
+  // the points are independent (the normal equations are diagonal), so every point runs its own LM step: it accepts or
+  // rejects its update and keeps its own damping. all [N,1]:
+  //  * current_depth, jtwj, b, energy, residuals: the current best estimate of each point and its normal equations
+  //  * tmp_*: the attempted update
+  Eigen::Matrix<float, Eigen::Dynamic, 1> current_depth = init_depth;
+  Eigen::Matrix<float, Eigen::Dynamic, 1> jtwj(num_residuals), b(num_residuals), energy(num_residuals);
+  Eigen::Matrix<float, Eigen::Dynamic, 1> residuals(num_residuals); // keep them to filter pixels with large photometric error
+  Eigen::Matrix<float, Eigen::Dynamic, 1> tmp_depth(num_residuals), tmp_jtwj(num_residuals), tmp_b(num_residuals);
+  Eigen::Matrix<float, Eigen::Dynamic, 1> tmp_energy(num_residuals), tmp_residuals(num_residuals);
+  Eigen::Matrix<float, Eigen::Dynamic, 1> lambdas = Eigen::Matrix<float, Eigen::Dynamic, 1>::Constant(num_residuals, lambda_);
   iters_stat_ = 0;
   cost_stat_ = 0;
-  //std::cout << "start iterating ..." << std::endl;
+  // a point has converged once its accepted update moves the disparity by less than kMinDisparityStep pixels
+  const float kMinDisparityStep = 0.01f;
+  const float kMaxMovingFraction = 0.02f;
+  float camera[4];
+  GetCameraLevel(camera_ptr_left_, 0, camera);
+  const float kTxFx = baseline_ * camera[0];
+  compute_status = ComputeResidualJacobian(current_depth, x_valid, y_valid, jtwj, b, energy, err_now, num_residuals,
+                                           left_rect, right_rect, residuals);
+  if (compute_status == -1){
+    std::cout << "Evaluate Residual & Jacobian failed " << std::endl;
+    return -1;
+  }
   while(max_iters_ > iter_count){
-    // compute new_err, jtwj, b using tmp_depth
-    //std::cout << "iter# " << iter_count << std::endl;
-    compute_status = ComputeResidualJacobian(tmp_depth, coord_valid, jtwj, b, err_now, num_residuals, left_rect, right_rect, residuals);
+    // damped Gauss-Newton step of every point, points without gradient (or out of the image) stay
+    for (int i = 0; i < num_residuals; i++){
+      tmp_depth(i) = current_depth(i) + (jtwj(i) > 0.0f ? b(i) / (jtwj(i) + lambdas(i) * jtwj(i)) : 0.0f);
+    }
+    compute_status = ComputeResidualJacobian(tmp_depth, x_valid, y_valid, tmp_jtwj, tmp_b, tmp_energy, err_now, num_residuals,
+                                             left_rect, right_rect, tmp_residuals);
     if (compute_status == -1){
       std::cout << "Evaluate Residual & Jacobian failed " << std::endl;
       return -1;
     }
-    // if new_err > last_err: increase lambda, set current_depth to pre_depth
-    if (err_now > err_last){ // bad depth estimate, do not update
-      current_lambda = current_lambda * 10.0f;
-      if (current_lambda > 1e+5) { break; }
-      current_depth = pre_depth;
-    } else{ // good depth estimate -> update, save previous
-      current_depth = tmp_depth;
-      pre_depth = current_depth;
-      err_diff = err_now / err_last;
-      if (err_diff > precision_) { break; }
-      err_last = err_now;
-      current_lambda = std::max(current_lambda / 10.0f, float(1e-7));
+    err_last = energy.sum();
+    int num_moving = 0;
+    for (int i = 0; i < num_residuals; i++){
+      if (tmp_residuals(i) != -1000 && tmp_energy(i) <= energy(i)){ // good depth estimate -> update
+        if (std::fabs(tmp_depth(i) - current_depth(i)) * kTxFx > kMinDisparityStep) num_moving++;
+        current_depth(i) = tmp_depth(i);
+        jtwj(i) = tmp_jtwj(i);
+        b(i) = tmp_b(i);
+        energy(i) = tmp_energy(i);
+        residuals(i) = tmp_residuals(i);
+        lambdas(i) = std::max(lambdas(i) / 10.0f, float(1e-7));
+      } else{ // bad depth estimate, do not update
+        lambdas(i) = std::min(lambdas(i) * 10.0f, float(1e+5));
+      }
     }
-    //std::cout << "solving system ..." << std::endl;
-    // solve system to get delta, set tmp_depth = delta + current_depth
-    A.diagonal() = jtwj.diagonal() + current_lambda * jtwj.diagonal();
-    delta_depth = A.inverse() * b;  // numerically stable since A is diagonal
-    tmp_depth = delta_depth + current_depth;
     iter_count++;
+    // converged: the total error decreases by less than (1 - precision_), or almost all points stopped moving
+    if (energy.sum() >= precision_ * err_last || num_moving < kMaxMovingFraction * num_residuals) { break; }
   }
-  //std::cout << "end iterating." << std::endl;
   iters_stat_ = iter_count;
-  cost_stat_ = err_now;
+  cost_stat_ = energy.sum() / float(std::max(int((residuals.array() != -1000).count()), 1));
 
   // Assign the computed inverse depth to left_dep, and update left_val:
   //  * remove points that have large photometric error after optimization terminates
@@ -176,16 +312,16 @@ GlobalStatus DepthEstimator::DepthOptimization(const cv::Mat& left_rect, const c
   for (int i = 0; i < num_residuals; i++){
     // the residual is either too large or is invalid
     if (residuals(i, 0) > photo_th_ || residuals(i, 0) == -1000){
-      left_val.at<uint8_t>(coord_valid[i].second, coord_valid[i].first) = 0;
-      left_dep.at<float>(coord_valid[i].second, coord_valid[i].first) = 0;
+      left_val.at<uint8_t>(y_valid[i], x_valid[i]) = 0;
+      left_dep.at<float>(y_valid[i], x_valid[i]) = 0;
     } else {
       // if the optimized depth is beyond some interval, set it invalid
       if (1.0f / current_depth(i, 0) > max_depth_ || 1.0f / current_depth(i, 0) < min_depth_){
-        left_val.at<uint8_t>(coord_valid[i].second, coord_valid[i].first) = 0;
-        left_dep.at<float>(coord_valid[i].second, coord_valid[i].first) = 0;
+        left_val.at<uint8_t>(y_valid[i], x_valid[i]) = 0;
+        left_dep.at<float>(y_valid[i], x_valid[i]) = 0;
       } else {
-        left_val.at<uint8_t>(coord_valid[i].second, coord_valid[i].first) = 1;
-        left_dep.at<float>(coord_valid[i].second, coord_valid[i].first) = current_depth(i, 0);
+        left_val.at<uint8_t>(y_valid[i], x_valid[i]) = 1;
+        left_dep.at<float>(y_valid[i], x_valid[i]) = current_depth(i, 0);
       }
     }
   }
@@ -198,46 +334,25 @@ GlobalStatus DepthEstimator::DepthOptimization(const cv::Mat& left_rect, const c
 }
 
 GlobalStatus DepthEstimator::ComputeResidualJacobian(const Eigen::Matrix<float, Eigen::Dynamic, 1>& tmp_depth,
-                                                     const std::vector<std::pair<int, int>>& coord_vec,
-        Eigen::DiagonalMatrix<float, Eigen::Dynamic>& jtwj, Eigen::Matrix<float, Eigen::Dynamic, 1>& b,
-                                     float& err_now, const int num_residuals, const cv::Mat& left_img, const cv::Mat& right_img,
-                                                     Eigen::Matrix<float, Eigen::Dynamic, 1>& residuals){
-  err_now = 0;
-  int warped_x = 0;
-  int num_residual_actual = 0; // used to compute averaged photometric error
-  float r_i = 0;
-  float r_i_diff = 0;
-  float w_i = 0;
+                                                     const std::vector<int>& xs, const std::vector<int>& ys,
+        Eigen::Matrix<float, Eigen::Dynamic, 1>& jtwj, Eigen::Matrix<float, Eigen::Dynamic, 1>& b,
+        Eigen::Matrix<float, Eigen::Dynamic, 1>& energy, float& err_now, const int num_residuals, const cv::Mat& left_img,
+        const cv::Mat& right_img, Eigen::Matrix<float, Eigen::Dynamic, 1>& residuals){
+  if (left_img.step != right_img.step){
+    std::cout << "Row steps of left/right images do not match in depth optimization!" << std::endl;
+    return -1;
+  }
   float tx = baseline_; // in meters
-  // TODO: only for debug now
-  // float fx = camera_ptr_left_->fx_float(0); // in pixels
-  float fx = 718.856f;
-  //std::cout << "computing jacobian..." << std::endl;
-  for (int i = 0; i < num_residuals; i++){
-    warped_x = int(std::floor(coord_vec[i].first - tx * fx * tmp_depth(i)));
-    // if warped out of boundary, leave some space to compute gradient
-    if (warped_x < 2 || warped_x > left_img.cols-2){
-      jtwj.diagonal()(i) = 0;
-      b.row(i) << 0;
-      residuals.row(i) << -1000;
-      continue;
-    }
-    //std::cout << "i: " << i << ", before r_ri" << std::endl;
-    r_i = left_img.at<float>(coord_vec[i].second, coord_vec[i].first) - right_img.at<float>(coord_vec[i].second, warped_x);
-    //std::cout << "i: " << i << ", get r_ri" << std::endl;
-    w_i = (std::fabs(r_i) <= huber_delta_) ? 1.0f : huber_delta_ / std::fabs(r_i);
-    r_i_diff = tx * fx * 0.5f * (right_img.at<float>(coord_vec[i].second, warped_x+1) - right_img.at<float>(coord_vec[i].second, warped_x-1));
-    //std::cout << "get r_i_diff" << std::endl;
-    residuals.row(i) << std::fabs(r_i);
-    num_residual_actual++;
-    err_now += r_i * r_i * w_i;
-    jtwj.diagonal()(i) = r_i_diff * r_i_diff * w_i;
-    b.row(i) << - r_i_diff * w_i * r_i;
-    //std::cout << "done" << std::endl;
-  }
-
-  err_now = (float(1.0) / float(num_residual_actual)) * err_now; // weighted error
-  //std::cout << "err: " << err_now << " over " << num_residual_actual << " residuals." << std::endl;
+  float camera[4];
+  GetCameraLevel(camera_ptr_left_, 0, camera);
+  float fx = camera[0]; // in pixels
+  // warp, pattern residuals, huber weights and diagonal jacobians of all points, see SimdKernels::depth_residual_jacobian
+  float err_sum = 0;
+  int num_residual_actual = GetSimdKernels().depth_residual_jacobian(left_img.ptr<float>(), right_img.ptr<float>(),
+          int(left_img.step / sizeof(float)), left_img.rows, left_img.cols, xs.data(), ys.data(), tmp_depth.data(),
+          num_residuals, tx * fx, huber_delta_, jtwj.data(), b.data(), energy.data(), residuals.data(), &err_sum);
+
+  err_now = (float(1.0) / float(num_residual_actual)) * err_sum; // weighted error
   return 0;
 }
 
@@ -251,153 +366,255 @@ GlobalStatus DepthEstimator::DisparityDepthEstimate(const cv::Mat& kleft_rect, c
   // d) if the smallest SSD error is larger than some TH, return failed match; otherwise, set valid bool, store the value
 
   // check the memory
-  // TODO: smooth left and right images
-  cv::Mat left_rect, right_rect;
-  cv::GaussianBlur(kleft_rect, left_rect, cv::Size(3, 3), 0);
-  cv::GaussianBlur(kright_rect, right_rect, cv::Size(3, 3), 0);
-
-  if (!left_rect.isContinuous() || !right_rect.isContinuous() || !left_disp.isContinuous()
+  if (!kleft_rect.isContinuous() || !kright_rect.isContinuous() || !left_disp.isContinuous()
   || !left_dep.isContinuous() || !left_val.isContinuous()){
     std::cout << "The cv::Mat matrix is not continuous in disparity search!" << std::endl;
     return -1;
   }
-  if ( (unsigned long)left_rect.ptr<float>() % 4 != 0 ||
-       (unsigned long)right_rect.ptr<float>() % 4 != 0){
+  if ( (unsigned long)kleft_rect.ptr<float>() % 4 != 0 ||
+       (unsigned long)kright_rect.ptr<float>() % 4 != 0){
     std::cout << "The cv::Mat matrix is not aligned to 32-bit address in disparity search!" << std::endl;
     return -1;
   }
 
-  // get camera params
-  // TODO: only for debug now
-  //float fx = camera_ptr_left_->fx_float(0); // in pixels
-  float fx = 718.856f;
+  // smooth left and right images
+  cv::Mat left_rect(kleft_rect.rows, kleft_rect.cols, PixelType);
+  cv::Mat right_rect(kright_rect.rows, kright_rect.cols, PixelType);
+  std::vector<float> blur_tmp(kleft_rect.cols);
+  for (int y = 0; y < kleft_rect.rows; y++){
+    BlurRow(kleft_rect, y, blur_tmp.data(), left_rect.ptr<float>(y));
+    BlurRow(kright_rect, y, blur_tmp.data(), right_rect.ptr<float>(y));
+  }
+  RowFn left_rows = [&left_rect](int y){ return (const float*)left_rect.ptr<float>(y); };
+  RowFn right_rows = [&right_rect](int y){ return (const float*)right_rect.ptr<float>(y); };
 
-  float current_ssd = 0;
-  float smallest_ssd = 1e+10; // initial smallest ssd err
-  int match_coord = -1; // the current best match column coord
-  int begin_x = boundary_; // skip the first boundary_ cols of the image
-  int end_x = left_rect.cols - boundary_; // skp the last boundary_ cols of the image, 640-boundary_
-  int begin_y = boundary_; // skip the first boundary_ rows of the image
-  int end_y = left_rect.rows - boundary_; // skp the last boundary_ rows of the image, 480-boundary_
-  const float* left_pp_row_ptr = nullptr;
-  const float* left_p_row_ptr = nullptr;
-  const float* left_row_ptr = nullptr;
-  const float* left_n_row_ptr = nullptr;
-  const float* left_nn_row_ptr = nullptr;
-  const float* right_pp_row_ptr = nullptr;
-  const float* right_p_row_ptr = nullptr;
-  const float* right_row_ptr = nullptr;
-  const float* right_n_row_ptr = nullptr;
-  const float* right_nn_row_ptr = nullptr;
-  uint8_t* left_val_row_ptr = nullptr;
-  float* left_disp_row_ptr = nullptr;
-  float* left_dep_row_ptr = nullptr;
-  float grad_x = 0;
-  float grad_y = 0;
-  float mag_grad = 0;
+  // KITTI size: 376x1241, 16x32 blocks
+  for (int block_row = 0; block_row < kDepthBlockRows; block_row++){
+    SelectBlockRow(left_rows, left_rect.cols, block_row, left_val);
+  }
 
+  if (disparity_search_ == kPatchMatchSearch){
+    PatchMatchSearch(left_rect, right_rect, left_disp, left_dep, left_val);
+    return 0;
+  }
+  EpipolarSearchRows(left_rows, right_rows, boundary_, left_rect.rows - boundary_, left_disp, left_dep, left_val);
+  return 0;
+}
 
-  // KITTI size: 376x1241, 16x32 blocks
-  cv::Mat grad_map(left_rect.rows, left_rect.cols, PixelType);
-  int num_blocks = 16 * 32;
-  int block_w = (left_rect.cols - boundary_ * 2) / 32;
-  int block_h = (left_rect.rows - boundary_ * 2) / 16;
+void DepthEstimator::SelectBlockRow(const RowFn& left_rows, int cols, int block_row, cv::Mat& left_val){
+  int block_w = (cols - boundary_ * 2) / kDepthBlockCols;
+  int block_h = (left_val.rows - boundary_ * 2) / kDepthBlockRows;
+  // kPatchMatchSearch costs the same for every point, fill max_residuals_ instead
+  int max_per_block = (disparity_search_ == kPatchMatchSearch) ? max_residuals_ / (kDepthBlockRows * kDepthBlockCols) : 80;
+  int start_y = boundary_ + block_row * block_h;
+  // gradient magnitudes of the block row
+  std::vector<float> grad_map(block_h * cols);
+  for (int y = start_y; y < start_y + block_h; y++){
+    const float* row_ptr = left_rows(y);
+    const float* p_row_ptr = left_rows(y-1);
+    const float* n_row_ptr = left_rows(y+1);
+    float* grad_row_ptr = grad_map.data() + (y - start_y) * cols;
+    for (int x = boundary_; x < boundary_ + kDepthBlockCols * block_w; x++){
+      float grad_x = 0.5f * (*(row_ptr+x+1) - *(row_ptr+x-1));
+      float grad_y = 0.5f * (*(n_row_ptr+x) - *(p_row_ptr+x));
+      *(grad_row_ptr+x) = std::sqrt(grad_x*grad_x + grad_y*grad_y);
+    }
+  }
   std::vector<float> block_grad(block_w*block_h);
-  int grad_count;
-  int valid_count;
-  float block_th;
-  int start_y, start_x;
-  for (int block_id = 0; block_id < num_blocks; block_id++){
-    //std::cout << "block: " << block_id << std::endl;
-    start_y = boundary_ + (block_id / 32) * block_h;
-    start_x = boundary_ + (block_id % 32) * block_w;
-    grad_count = 0;
-    for (int y = start_y; y < start_y + block_h; y++){
-      //std::cout << "y: " << y << std::endl;
+  for (int block_col = 0; block_col < kDepthBlockCols; block_col++){
+    int start_x = boundary_ + block_col * block_w;
+    int grad_count = 0;
+    for (int y = 0; y < block_h; y++){
       for (int x = start_x; x < start_x + block_w; x++){
-        // compute gradient and store them to grad_map and block_grad vector
-        grad_x = 0.5f * (left_rect.at<float>(y, x+1) - left_rect.at<float>(y, x-1));
-        grad_y = 0.5f * (left_rect.at<float>(y+1, x) - left_rect.at<float>(y-1, x));
-        mag_grad = std::sqrt(grad_x*grad_x + grad_y*grad_y);
-        grad_map.at<float>(y, x) = mag_grad;
-        block_grad[grad_count] = mag_grad;
+        block_grad[grad_count] = grad_map[y * cols + x];
         grad_count++;
       }
     }
     // compute median grad
     std::nth_element(block_grad.begin(), block_grad.begin() + block_grad.size()/2, block_grad.end());
-    block_th = block_grad[block_grad.size()/2] + grad_th_;
+    float block_th = block_grad[block_grad.size()/2] + grad_th_;
     // select all points that have gradient larger than block_th
-    valid_count = 0;
-    for (int y = start_y; y < start_y + block_h; y++){
+    int valid_count = 0;
+    for (int y = 0; y < block_h; y++){
       for (int x = start_x; x < start_x + block_w; x++){
-        if (valid_count >= 80) break;
-        if (grad_map.at<float>(y, x) > block_th){
-          left_val.at<uint8_t>(y, x) = 1;
+        if (valid_count >= max_per_block) break;
+        if (grad_map[y * cols + x] > block_th){
+          left_val.at<uint8_t>(start_y + y, x) = 1;
           valid_count++;
         }
       }
-      if (valid_count >= 80) break;
+      if (valid_count >= max_per_block) break;
     }
   }
+}
 
+void DepthEstimator::EpipolarSearchRows(const RowFn& left_rows, const RowFn& right_rows, int y_begin, int y_end,
+                                        cv::Mat& left_disp, cv::Mat& left_dep, cv::Mat& left_val){
+  // get camera params
+  float camera[4];
+  GetCameraLevel(camera_ptr_left_, 0, camera);
+  float fx = camera[0]; // in pixels
 
-  __m256 left_pattern;
-  for (int y=begin_y; y<end_y; y++){
+  float smallest_ssd = 1e+10; // initial smallest ssd err
+  int match_coord = -1; // the current best match column coord
+  int begin_x = boundary_; // skip the first boundary_ cols of the image
+  int end_x = left_val.cols - boundary_; // skp the last boundary_ cols of the image, 640-boundary_
+  const SimdKernels& kernels = GetSimdKernels();
+  float left_pattern[8]; // ordered as kPattern8
+  const float* right_rows_ptr[5]; // rows y-2 .. y+2 of the right image
+  for (int y=y_begin; y<y_end; y++){
     // get pointers
-    left_p_row_ptr = left_rect.ptr<float>(y-1);
-    left_row_ptr = left_rect.ptr<float>(y);
-    left_n_row_ptr = left_rect.ptr<float>(y+1);
-    left_val_row_ptr = left_val.ptr<uint8_t>(y);
+    const float* left_pp_row_ptr = left_rows(y-2);
+    const float* left_p_row_ptr = left_rows(y-1);
+    const float* left_row_ptr = left_rows(y);
+    const float* left_n_row_ptr = left_rows(y+1);
+    const float* left_nn_row_ptr = left_rows(y+2);
+    uint8_t* left_val_row_ptr = left_val.ptr<uint8_t>(y);
+    float* left_disp_row_ptr = left_disp.ptr<float>(y);
+    float* left_dep_row_ptr = left_dep.ptr<float>(y);
+    for (int k = 0; k < 5; k++){
+      right_rows_ptr[k] = right_rows(y-2+k);
+    }
     for (int x=begin_x; x<end_x; x++){
       // check if a valid point
       if (*(left_val_row_ptr+x) == 0) continue;
+      /***************** Search along epl: SIMD implementation, dispatched at runtime **************/
+      left_pattern[0] = *(left_pp_row_ptr+x);
+      left_pattern[1] = *(left_p_row_ptr+x-1);
+      left_pattern[2] = *(left_p_row_ptr+x+1);
+      left_pattern[3] = *(left_row_ptr+x-2);
+      left_pattern[4] = *(left_row_ptr+x);
+      left_pattern[5] = *(left_row_ptr+x+2);
+      left_pattern[6] = *(left_n_row_ptr+x-1);
+      left_pattern[7] = *(left_nn_row_ptr+x);
+      match_coord = kernels.ssd_pattern8_search(left_pattern, right_rows_ptr, begin_x, x, &smallest_ssd);
+      if (smallest_ssd > ssd_th_)
+        continue;
       else {
-        // get pointers for left_disp, left_dep
-        left_disp_row_ptr = left_disp.ptr<float>(y);
-        left_pp_row_ptr = left_rect.ptr<float>(y-2);
-        left_nn_row_ptr = left_rect.ptr<float>(y+2);
-        left_dep_row_ptr = left_dep.ptr<float>(y);
-        // now we do the actuall disparity match on the right image epl, get the pointers
-        right_row_ptr = right_rect.ptr<float>(y);
-        right_p_row_ptr = right_rect.ptr<float>(y-1);
-        right_pp_row_ptr = right_rect.ptr<float>(y-2);
-        right_n_row_ptr = right_rect.ptr<float>(y+1);
-        right_nn_row_ptr = right_rect.ptr<float>(y+2);
-        smallest_ssd = 1e+10;
-        // loop the search range
-        /***************** Search along epl: Naive implementation **************/
-        /*
-        for (int right_x=begin_x; right_x<x; right_x++){
-          // compute ssd
-          current_ssd = ComputeSsdPattern8(left_pp_row_ptr, left_p_row_ptr, left_row_ptr, left_n_row_ptr, left_nn_row_ptr,
-                                      right_pp_row_ptr, right_p_row_ptr, right_row_ptr, right_n_row_ptr, right_nn_row_ptr, x, right_x);
-          match_coord = (current_ssd < smallest_ssd) ? (right_x) : match_coord;
-          smallest_ssd = (current_ssd < smallest_ssd) ? (current_ssd) : smallest_ssd;
-        } // loop right cols
-        */
-        /***************** Search along epl: SSE/AVX implementation **************/
-        left_pattern = _mm256_set_ps(*(left_pp_row_ptr+x), *(left_p_row_ptr+x-1), *(left_p_row_ptr+x+1), *(left_row_ptr+x-2),
-                                     *(left_row_ptr+x), *(left_row_ptr+x+2), *(left_n_row_ptr+x-1), *(left_nn_row_ptr+x));
-        for (int right_x=begin_x; right_x<x; right_x++){
-          ComputeSsdPattern8Sse(left_pattern, right_pp_row_ptr, right_p_row_ptr, right_row_ptr, right_n_row_ptr,
-                  right_nn_row_ptr, right_x, &current_ssd);
-          match_coord = (current_ssd < smallest_ssd) ? (right_x) : match_coord;
-          smallest_ssd = (current_ssd < smallest_ssd) ? (current_ssd) : smallest_ssd;
-        } // loop right cols
-        if (smallest_ssd > ssd_th_)
-          continue;
-        else {
-          *(left_disp_row_ptr+x) = std::abs(x-match_coord); // left_disp.at<float>(y, x) = std::abs(x-match_coord);
-          // compute left inverse depth value using rectified Camera baseline and Intrinsic:
-          // depth = fx * baseline / disp, fx: [pixels], baseline: [meters], disp: [pixels]
-          *(left_dep_row_ptr+x) = *(left_disp_row_ptr+x) / (fx * baseline_);
-        } // a successful match, store the disparity value, set valid mask
-      } // if left grad is large
+        *(left_disp_row_ptr+x) = std::abs(x-match_coord); // left_disp.at<float>(y, x) = std::abs(x-match_coord);
+        // compute left inverse depth value using rectified Camera baseline and Intrinsic:
+        // depth = fx * baseline / disp, fx: [pixels], baseline: [meters], disp: [pixels]
+        *(left_dep_row_ptr+x) = *(left_disp_row_ptr+x) / (fx * baseline_);
+      } // a successful match, store the disparity value, set valid mask
     } // loop left cols
   } // loop left rows
+}
 
-  return 0;
+void DepthEstimator::PatchMatchSearch(const cv::Mat& left_rect, const cv::Mat& right_rect, cv::Mat& left_disp,
+                                      cv::Mat& left_dep, cv::Mat& left_val){
+  float camera[4];
+  GetCameraLevel(camera_ptr_left_, 0, camera);
+  float fx = camera[0]; // in pixels
+  int begin_x = boundary_, end_x = left_rect.cols - boundary_;
+  int begin_y = boundary_, end_y = left_rect.rows - boundary_;
+  int cols = left_rect.cols;
+  const SimdKernels& kernels = GetSimdKernels();
+  // integer disparities within the depth bounds, at most x - begin_x (right pattern inside the boundary)
+  int min_disp = std::max(int(std::ceil(fx * baseline_ / max_depth_)), 0);
+  float max_disp_depth = fx * baseline_ / min_depth_;
+  auto max_disp = [&](int x){ return int(std::min(max_disp_depth, float(x - begin_x))); };
+  std::vector<int> disp(left_rect.rows * cols, -1);
+  std::vector<float> cost(left_rect.rows * cols, 1e+10f);
+  // candidate disparity d of pixel (x, y), kept if its 8 point pattern ssd is lower
+  auto try_disparity = [&](const float* const* left_rows, const float* const* right_rows, int x, int y, int d){
+    int i = y * cols + x;
+    if (d < min_disp || d > max_disp(x) || d == disp[i]) return;
+    float ssd = ComputeSsdPattern8(left_rows[0], left_rows[1], left_rows[2], left_rows[3], left_rows[4],
+                                   right_rows[0], right_rows[1], right_rows[2], right_rows[3], right_rows[4], x, x - d);
+    if (ssd < cost[i]){
+      cost[i] = ssd;
+      disp[i] = d;
+    }
+  };
+  // one linear congruential generator per row and pass, the result does not depend on the number of threads.
+  // random integer in [lo, hi] from the high bits
+  auto random_int = [](uint32_t& state, int lo, int hi){
+    state = state * 1664525u + 1013904223u;
+    return lo + int((uint64_t(state >> 8) * uint32_t(hi - lo + 1)) >> 24);
+  };
+  auto process_rows = [&](int pass, int parity){
+    int num_rows = (end_y - begin_y - parity + 1) / 2;
+    DefaultThreadPool().ParallelFor(0, num_rows, 4, [&](int row_begin, int row_end){
+      const float* left_rows[5];
+      const float* right_rows[5];
+      float left_pattern[8]; // ordered as kPattern8
+      for (int r = row_begin; r < row_end; r++){
+        int y = begin_y + 2 * r + parity;
+        for (int k = 0; k < 5; k++){
+          left_rows[k] = left_rect.ptr<float>(y - 2 + k);
+          right_rows[k] = right_rect.ptr<float>(y - 2 + k);
+        }
+        const uint8_t* left_val_row_ptr = left_val.ptr<uint8_t>(y);
+        uint32_t rng = uint32_t(pass * left_rect.rows + y) * 2654435761u;
+        if (pass == 0){
+          // random initialization
+          for (int x = begin_x; x < end_x; x++){
+            if (*(left_val_row_ptr+x) == 0 || max_disp(x) < min_disp) continue;
+            try_disparity(left_rows, right_rows, x, y, random_int(rng, min_disp, max_disp(x)));
+          }
+          continue;
+        }
+        // spatial propagation from the previous point of the scan and the rows above and below, random refinement with
+        // a search radius halving from the whole range down to kPatchMatchWindow (first iteration only), then the
+        // dispatched search over the window of +-kPatchMatchWindow pixels. the pixels between the points are not
+        // evaluated, they carry the disparity of the previous point to the next row
+        int step = (pass % 2 == 1) ? 1 : -1;
+        int x_first = (step == 1) ? begin_x : end_x - 1;
+        int carried = -1;
+        for (int x = x_first; x >= begin_x && x < end_x; x += step){
+          int i = y * cols + x;
+          if (*(left_val_row_ptr+x) == 0 || max_disp(x) < min_disp){
+            disp[i] = carried;
+            continue;
+          }
+          try_disparity(left_rows, right_rows, x, y, carried);
+          if (y > begin_y) try_disparity(left_rows, right_rows, x, y, disp[i - cols]);
+          if (y < end_y - 1) try_disparity(left_rows, right_rows, x, y, disp[i + cols]);
+          for (int radius = (pass == 1) ? (max_disp(x) - min_disp) / 2 : 0; radius > kPatchMatchWindow; radius /= 2){
+            try_disparity(left_rows, right_rows, x, y, disp[i] + random_int(rng, -radius, radius));
+          }
+          int lo = std::max(disp[i] - kPatchMatchWindow, min_disp);
+          int hi = std::min(disp[i] + kPatchMatchWindow, max_disp(x));
+          left_pattern[0] = *(left_rows[0]+x);
+          left_pattern[1] = *(left_rows[1]+x-1);
+          left_pattern[2] = *(left_rows[1]+x+1);
+          left_pattern[3] = *(left_rows[2]+x-2);
+          left_pattern[4] = *(left_rows[2]+x);
+          left_pattern[5] = *(left_rows[2]+x+2);
+          left_pattern[6] = *(left_rows[3]+x-1);
+          left_pattern[7] = *(left_rows[4]+x);
+          float ssd;
+          int match_coord = kernels.ssd_pattern8_search(left_pattern, right_rows, x - hi, x - lo + 1, &ssd);
+          if (match_coord >= 0 && ssd < cost[i]){
+            cost[i] = ssd;
+            disp[i] = x - match_coord;
+          }
+          carried = disp[i];
+        }
+      }
+    }, kPriorityNormal, "stereo");
+  };
+  // even rows first, then the odd rows against the updated even rows
+  for (int pass = 0; pass <= patch_match_iters_; pass++){
+    process_rows(pass, 0);
+    process_rows(pass, 1);
+  }
+
+  for (int y = begin_y; y < end_y; y++){
+    uint8_t* left_val_row_ptr = left_val.ptr<uint8_t>(y);
+    float* left_disp_row_ptr = left_disp.ptr<float>(y);
+    float* left_dep_row_ptr = left_dep.ptr<float>(y);
+    for (int x = begin_x; x < end_x; x++){
+      if (*(left_val_row_ptr+x) == 0) continue;
+      int i = y * cols + x;
+      if (disp[i] < 0 || cost[i] > ssd_th_){
+        *(left_val_row_ptr+x) = 0;
+        continue;
+      }
+      *(left_disp_row_ptr+x) = float(disp[i]);
+      *(left_dep_row_ptr+x) = float(disp[i]) / (fx * baseline_);
+    }
+  }
 }
 
 inline float DepthEstimator::ComputeSsd5x5(const float* left_pp_row_ptr, const float* left_p_row_ptr, const float* left_row_ptr, const float* left_n_row_ptr, const float* left_nn_row_ptr,
@@ -432,26 +649,6 @@ inline float DepthEstimator::ComputeSsdPattern8(const float* left_pp_row_ptr, co
   return sum;
 }
 
-inline void DepthEstimator::ComputeSsdPattern8Sse(const __m256& left_pattern, const float* right_pp_row_ptr, const float* right_p_row_ptr,
-        const float* right_row_ptr, const float* right_n_row_ptr, const float* right_nn_row_ptr, int x, float* result){
-  __m256 right_pattern;
-  __m256 sub_pattern;
-  __m256 sq_pattern;
-  __m256 sum_sq;
-  __m128 low_sum, high_sum, sum_low_high, pack_sum, inter_sum;
-  right_pattern = _mm256_set_ps(*(right_pp_row_ptr+x), *(right_p_row_ptr+x-1), *(right_p_row_ptr+x+1), *(right_row_ptr+x-2),
-                               *(right_row_ptr+x), *(right_row_ptr+x+2), *(right_n_row_ptr+x-1), *(right_nn_row_ptr+x));
-  sub_pattern = _mm256_sub_ps(left_pattern, right_pattern);
-  sq_pattern = _mm256_mul_ps(sub_pattern, sub_pattern);
-  sum_sq = _mm256_hadd_ps(sq_pattern, sq_pattern); // [0,1,4,5]
-  low_sum = _mm256_extractf128_ps(sum_sq, 0);
-  high_sum = _mm256_extractf128_ps(sum_sq, 1);
-  sum_low_high = _mm_hadd_ps(low_sum, high_sum);
-  inter_sum = _mm_movehl_ps(sum_low_high, sum_low_high);
-  pack_sum = _mm_add_ps(sum_low_high, inter_sum);
-  _mm_store_ss(result, pack_sum);
-}
-
 inline float DepthEstimator::ComputeSsdLine(const float* left_row_ptr, const float* right_row_ptr, int left_x, int right_x){
   float sum = 0;
   sum += std::pow(*(left_row_ptr+left_x-2) - *(right_row_ptr+right_x-2), 2);
@@ -462,9 +659,19 @@ inline float DepthEstimator::ComputeSsdLine(const float* left_row_ptr, const flo
   return sum;
 }
 
+GlobalStatus DepthEstimator::SetDisparitySearch(DisparitySearch search, int iterations){
+  if (iterations < 1){
+    std::cout << "PatchMatch needs at least 1 iteration in DepthEstimator::SetDisparitySearch()." << std::endl;
+    return -1;
+  }
+  disparity_search_ = search;
+  patch_match_iters_ = iterations;
+  return 0;
+}
+
 void DepthEstimator::ReportStatus(){
-  std::cout << "    Number of iters performed: " << iters_stat_ << "(max allowed: " << max_iters_ << ")" << std::endl;
-  std::cout << "    Final cost: " << cost_stat_ << std::endl;
+  LOG_INFO("    Number of iters performed: {}(max allowed: {})", iters_stat_, max_iters_);
+  LOG_INFO("    Final cost: {}", cost_stat_);
 }
 
 } // namespace odometry
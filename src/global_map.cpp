@@ -2,6 +2,7 @@
 // Created by Yu Wang on 2019-01-13.
 
 #include <global_map.h>
+#include <logging.h>
 
 
 namespace odometry
@@ -56,7 +57,7 @@ void GlobalMap::InsertKeyFrame(std::shared_ptr<KeyFrame>& key_frame){
   key_frames_.push_back(key_frame);
   num_key_frames_ += 1;
   current_keyframe_id_ += 1; // automatically change the current keyframe id
-  std::cout << "Insert new KeyFrame. Current KeyFrame: " << current_keyframe_id_ << ". Total now: " << num_key_frames_ << "." << std::endl;
+  LOG_INFO("Insert new KeyFrame. Current KeyFrame: {}. Total now: {}.", current_keyframe_id_, num_key_frames_);
 }
 
 KeyFrame& GlobalMap::ModifySingleKeyFrame(int key_index){
@@ -2,8 +2,10 @@
 // This is an implementation of functions defined in ODOMETRY_IMAGE_PROCESSING_GLOBAL_H
 
 #include <image_processing_global.h>
+#include <simd_dispatch.h>
+#include <thread_pool.h>
 #include <iostream>
-#include <immintrin.h> // AVX instruction set
+#include <limits>
 
 
 namespace odometry
@@ -112,25 +114,24 @@ GlobalStatus MedianDepthPyramidNaive(int num_levels, const cv::Mat& in_img, std:
   return 0;
 }
 
-// sse implementation of depth pyramid: optimze for down-sampling & memory operations
+// simd implementation of depth pyramid: optimze for down-sampling & memory operations, same result as the naive one
 GlobalStatus MedianDepthPyramidSse(int num_levels, const cv::Mat& in_img, std::vector<cv::Mat>& out_pyramids, bool smooth){
   // Note that input image array and output image array MUST all be contiguous and algined against 32 bits (single precision)
   int rows = in_img.rows;
   int cols = in_img.cols;
   int channels = in_img.channels();
-  // necessary checks
-  if (rows % 2 != 0 || cols % 2 !=0 || channels != 1 || in_img.type() != PixelType){
-    std::cout << "Original depth rows/cols are not even OR channels != 2 OR pixeltype is not CV_32F(float)! Create depth pyramids failed." << std::endl;
+  // necessary checks, odd rows/cols are fine: every level keeps the odd-numbered rows & cols (e.g. 1241 KITTI cols)
+  if (rows < 2 || cols < 2 || channels != 1 || in_img.type() != PixelType){
+    std::cout << "Original depth is smaller than 2x2 OR channels != 1 OR pixeltype is not CV_32F(float)! Create depth pyramids failed." << std::endl;
     std::cout << "Number of rows: " << rows << std::endl;
     std::cout << "Number of cols: " << cols << std::endl;
     std::cout << "Number of channels: " << channels << std::endl;
     std::cout << "Original depth type: " << in_img.type() << std::endl;
-    // TODO: return -1
-    //return -1;
+    return -1;
   }
 
   // smooth the original image using median filter, take care of Invalid depth value(0)
-  out_pyramids.emplace_back(cv::Mat(rows, cols, PixelType));
+  out_pyramids.emplace_back(cv::Mat(rows, cols, PixelType, cv::Scalar(0)));
   if (smooth == true){
     cv::medianBlur(in_img, out_pyramids[0], 3);
   } else{
@@ -139,21 +140,15 @@ GlobalStatus MedianDepthPyramidSse(int num_levels, const cv::Mat& in_img, std::v
   // level-1 pyramid, since we assume level-0 is already smoothed we only do downsampling by ignoring even-numbered rows & cols
   rows = rows / 2;
   cols = cols / 2;
-  out_pyramids.emplace_back(cv::Mat(rows, cols, PixelType));
-  for (int y = 0; y < rows; y++){
-    for (int x = 0; x < cols; x++){
-      PyramidDownSse(out_pyramids[0], out_pyramids[1], rows, cols);
-    }
-  }
+  out_pyramids.emplace_back(cv::Mat(rows, cols, PixelType, cv::Scalar(0)));
+  PyramidDownSse(out_pyramids[0], out_pyramids[1], rows, cols);
 
-  // down sample images: smooth by median filter, then downsample by ignoring even-numbered rows & cols
+  // down sample images: downsample by ignoring even-numbered rows & cols
   rows = rows / 2;
   cols = cols / 2;
   for (int l = 2; l < num_levels; l++){
-    out_pyramids.emplace_back(cv::Mat(rows, cols, PixelType));
-    cv::Mat smooth_out;
-    cv::medianBlur(out_pyramids[l-1], smooth_out, 3);
-    PyramidDownSse(smooth_out, out_pyramids[l], rows, cols);
+    out_pyramids.emplace_back(cv::Mat(rows, cols, PixelType, cv::Scalar(0)));
+    PyramidDownSse(out_pyramids[l-1], out_pyramids[l], rows, cols);
     rows = rows / 2;
     cols = cols / 2;
   }
@@ -167,83 +162,128 @@ GlobalStatus MedianDepthPyramidSse(int num_levels, const cv::Mat& in_img, std::v
 
 void PyramidDownSse(cv::Mat& in_img, cv::Mat& out_img, int rows, int cols){
   // check memeory layout
-  if (!in_img.isContinuous() || !out_img.isContinuous()){
-    std::cout << "Input/Output img not continuous!" << std::endl;
+  if (in_img.type() != PixelType || out_img.type() != PixelType || in_img.rows < rows * 2 || in_img.cols < cols * 2){
+    std::cout << "Input/Output img of pyramid down-sampling do not match!" << std::endl;
     exit(-1);
   }
-  // define pointers and registers
-  float* in_row_ptr;
-  float* out_row_ptr;
-  int num_blocks;
-  __m256 tmp_reg[5]; // use 5 registers as a group, 40 floating data in total
-  for (int row_idx = 0; row_idx < rows; row_idx++){
-    in_row_ptr = in_img.ptr<float>(row_idx*2 + 1);
-    out_row_ptr = out_img.ptr<float>(row_idx);
-    num_blocks = cols / 40;
-    for (int block_id = 0; block_id < num_blocks; block_id++){
-      // load data from input image
-      tmp_reg[0] = _mm256_set_ps (*(in_row_ptr+block_id*40*2+0*16+1),
-                                  *(in_row_ptr+block_id*40*2+0*16+3),
-                                  *(in_row_ptr+block_id*40*2+0*16+5),
-                                  *(in_row_ptr+block_id*40*2+0*16+7),
-                                  *(in_row_ptr+block_id*40*2+0*16+9),
-                                  *(in_row_ptr+block_id*40*2+0*16+11),
-                                  *(in_row_ptr+block_id*40*2+0*16+13),
-                                  *(in_row_ptr+block_id*40*2+0*16+15));
-      tmp_reg[1] = _mm256_set_ps (*(in_row_ptr+block_id*40*2+1*16+1),
-                                  *(in_row_ptr+block_id*40*2+1*16+3),
-                                  *(in_row_ptr+block_id*40*2+1*16+5),
-                                  *(in_row_ptr+block_id*40*2+1*16+7),
-                                  *(in_row_ptr+block_id*40*2+1*16+9),
-                                  *(in_row_ptr+block_id*40*2+1*16+11),
-                                  *(in_row_ptr+block_id*40*2+1*16+13),
-                                  *(in_row_ptr+block_id*40*2+1*16+15));
-      tmp_reg[2] = _mm256_set_ps (*(in_row_ptr+block_id*40*2+2*16+1),
-                                  *(in_row_ptr+block_id*40*2+2*16+3),
-                                  *(in_row_ptr+block_id*40*2+2*16+5),
-                                  *(in_row_ptr+block_id*40*2+2*16+7),
-                                  *(in_row_ptr+block_id*40*2+2*16+9),
-                                  *(in_row_ptr+block_id*40*2+2*16+11),
-                                  *(in_row_ptr+block_id*40*2+2*16+13),
-                                  *(in_row_ptr+block_id*40*2+2*16+15));
-      tmp_reg[3] = _mm256_set_ps (*(in_row_ptr+block_id*40*2+3*16+1),
-                                  *(in_row_ptr+block_id*40*2+3*16+3),
-                                  *(in_row_ptr+block_id*40*2+3*16+5),
-                                  *(in_row_ptr+block_id*40*2+3*16+7),
-                                  *(in_row_ptr+block_id*40*2+3*16+9),
-                                  *(in_row_ptr+block_id*40*2+3*16+11),
-                                  *(in_row_ptr+block_id*40*2+3*16+13),
-                                  *(in_row_ptr+block_id*40*2+3*16+15));
-      tmp_reg[4] = _mm256_set_ps (*(in_row_ptr+block_id*40*2+4*16+1),
-                                  *(in_row_ptr+block_id*40*2+4*16+3),
-                                  *(in_row_ptr+block_id*40*2+4*16+5),
-                                  *(in_row_ptr+block_id*40*2+4*16+7),
-                                  *(in_row_ptr+block_id*40*2+4*16+9),
-                                  *(in_row_ptr+block_id*40*2+4*16+11),
-                                  *(in_row_ptr+block_id*40*2+4*16+13),
-                                  *(in_row_ptr+block_id*40*2+4*16+15));
-      // store data to output image
-      _mm256_store_ps (out_row_ptr+block_id*40+0*8, tmp_reg[0]);
-      _mm256_store_ps (out_row_ptr+block_id*40+1*8, tmp_reg[1]);
-      _mm256_store_ps (out_row_ptr+block_id*40+2*8, tmp_reg[2]);
-      _mm256_store_ps (out_row_ptr+block_id*40+3*8, tmp_reg[3]);
-      _mm256_store_ps (out_row_ptr+block_id*40+4*8, tmp_reg[4]);
-    }
-  }
+  // keep the odd-numbered rows & cols, vectorized by the dispatched kernel (strides in floats)
+  GetSimdKernels().pyramid_down(in_img.ptr<float>(), int(in_img.step / sizeof(float)),
+                                out_img.ptr<float>(), int(out_img.step / sizeof(float)), rows, cols);
 }
 
 
-// TODO, using native c++ for loop combined with openmp to warp entire image
-void WarpImageNative(const cv::Mat& img_in, const Affine4f& kTransMat, cv::Mat& warped_img){
-
+// check the inputs of the whole image warping and allocate the output and the zbuffer (+inf)
+static GlobalStatus PrepareWarp(const cv::Mat& img2, const cv::Mat& inv_depth1, cv::Mat& warped_img, cv::Mat& zbuffer){
+  if (img2.type() != PixelType || inv_depth1.type() != PixelType || img2.rows != inv_depth1.rows || img2.cols != inv_depth1.cols){
+    std::cout << "Input image/inverse depth of warping do not match!" << std::endl;
+    return -1;
+  }
+  if (!img2.isContinuous() || !inv_depth1.isContinuous()){
+    std::cout << "Input image/inverse depth of warping are not continuous!" << std::endl;
+    return -1;
+  }
+  warped_img.create(img2.rows, img2.cols, PixelType);
+  zbuffer.create(img2.rows, img2.cols, PixelType);
+  zbuffer.setTo(cv::Scalar(std::numeric_limits<float>::infinity()));
+  return 0;
 }
 
-// TODO, using sse to warp entire image
-void WarpImageSse(const cv::Mat& img_in, const Affine4f& kTransMat, cv::Mat& warped_img){
+// *p = min(*p, value), rows of different threads may warp onto the same pixel
+static inline void AtomicMinDepth(float* p, float value){
+  float current;
+  __atomic_load(p, &current, __ATOMIC_RELAXED);
+  while (value < current && !__atomic_compare_exchange(p, &current, &value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){}
+}
 
+// re-project pixel (x, y) with inverse depth d into camera 2, same operations as the SIMD kernels
+static inline void WarpToCamera2(const float* camera, const float* t, float x, float y, float d, float& u, float& v, float& wz){
+  float z = 1.0f / d;
+  float x3 = z * (x - camera[2]) / camera[0];
+  float y3 = z * (y - camera[3]) / camera[1];
+  float wx = t[0] * x3 + t[1] * y3 + t[2] * z + t[3];
+  float wy = t[4] * x3 + t[5] * y3 + t[6] * z + t[7];
+  wz = t[8] * x3 + t[9] * y3 + t[10] * z + t[11];
+  u = camera[0] * wx / wz + camera[2];
+  v = camera[1] * wy / wz + camera[3];
 }
 
+GlobalStatus WarpImageNative(const cv::Mat& img2, const cv::Mat& inv_depth1, const Affine4f& kTransMat,
+                             const std::shared_ptr<CameraPyramid>& kCameraPtr, int level, cv::Mat& warped_img){
+  cv::Mat zbuffer;
+  if (PrepareWarp(img2, inv_depth1, warped_img, zbuffer) == -1) return -1;
+  float camera[4];
+  GetCameraLevel(kCameraPtr, level, camera);
+  Eigen::Matrix<float, 3, 4, Eigen::RowMajor> transform = kTransMat.block<3, 4>(0, 0);
+  const float* t = transform.data();
+  int rows = img2.rows;
+  int cols = img2.cols;
+  // pass 1: nearest depth per pixel of image 2
+  DefaultThreadPool().ParallelFor(0, rows, 16, [&](int row_begin, int row_end){
+    for (int y = row_begin; y < row_end; y++){
+      for (int x = 0; x < cols; x++){
+        float d = inv_depth1.at<float>(y, x);
+        if (!(d > 0.0f)) continue;
+        float u, v, wz;
+        WarpToCamera2(camera, t, float(x), float(y), d, u, v, wz);
+        float ur = std::floor(u + 0.5f);
+        float vr = std::floor(v + 0.5f);
+        if (!(wz > 0.0f) || !(ur >= 0.0f && ur <= float(cols - 1) && vr >= 0.0f && vr <= float(rows - 1))) continue;
+        AtomicMinDepth(&zbuffer.at<float>(int(vr), int(ur)), wz);
+      }
+    }
+  }, kPriorityNormal, "warp");
+  // pass 2: bilinear sample of the visible points
+  DefaultThreadPool().ParallelFor(0, rows, 16, [&](int row_begin, int row_end){
+    for (int y = row_begin; y < row_end; y++){
+      for (int x = 0; x < cols; x++){
+        float d = inv_depth1.at<float>(y, x);
+        warped_img.at<float>(y, x) = kWarpInvalid;
+        if (!(d > 0.0f)) continue;
+        float u, v, wz;
+        WarpToCamera2(camera, t, float(x), float(y), d, u, v, wz);
+        if (!(wz > 0.0f) || !(u >= 0.0f && u < float(cols - 1) && v >= 0.0f && v < float(rows - 1))) continue;
+        int u0 = int(std::floor(u));
+        int v0 = int(std::floor(v));
+        float au = u - float(u0);
+        float av = v - float(v0);
+        float top = (1.0f - au) * img2.at<float>(v0, u0) + au * img2.at<float>(v0, u0 + 1);
+        float bot = (1.0f - au) * img2.at<float>(v0 + 1, u0) + au * img2.at<float>(v0 + 1, u0 + 1);
+        // z-test against the nearest point warped onto the same pixel
+        float nearest = zbuffer.at<float>(int(std::floor(v + 0.5f)), int(std::floor(u + 0.5f)));
+        if (wz <= nearest * (1.0f + kWarpOcclusionTolerance)){
+          warped_img.at<float>(y, x) = (1.0f - av) * top + av * bot;
+        }
+      }
+    }
+  }, kPriorityNormal, "warp");
+  return 0;
+}
 
+GlobalStatus WarpImageSse(const cv::Mat& img2, const cv::Mat& inv_depth1, const Affine4f& kTransMat,
+                          const std::shared_ptr<CameraPyramid>& kCameraPtr, int level, cv::Mat& warped_img){
+  cv::Mat zbuffer;
+  if (PrepareWarp(img2, inv_depth1, warped_img, zbuffer) == -1) return -1;
+  if (img2.step != inv_depth1.step || img2.step != warped_img.step){
+    std::cout << "Row steps of warping images do not match!" << std::endl;
+    return -1;
+  }
+  float camera[4];
+  GetCameraLevel(kCameraPtr, level, camera);
+  Eigen::Matrix<float, 3, 4, Eigen::RowMajor> transform = kTransMat.block<3, 4>(0, 0);
+  const SimdKernels& kernels = GetSimdKernels();
+  int stride = int(img2.step / sizeof(float));
+  int rows = img2.rows;
+  int cols = img2.cols;
+  DefaultThreadPool().ParallelFor(0, rows, 16, [&](int row_begin, int row_end){
+    kernels.warp_depth_splat(inv_depth1.ptr<float>(), stride, rows, cols, row_begin, row_end, camera, transform.data(),
+                             zbuffer.ptr<float>());
+  }, kPriorityNormal, "warp");
+  DefaultThreadPool().ParallelFor(0, rows, 16, [&](int row_begin, int row_end){
+    kernels.warp_image(img2.ptr<float>(), inv_depth1.ptr<float>(), stride, rows, cols, row_begin, row_end, camera,
+                       transform.data(), zbuffer.ptr<float>(), warped_img.ptr<float>());
+  }, kPriorityNormal, "warp");
+  return 0;
+}
 
 } // namespace odometry
 
@@ -3,6 +3,7 @@
 
 #include <image_pyramid.h>
 #include <image_processing_global.h>
+#include <simd_dispatch.h>
 #include <iostream>
 
 namespace odometry
@@ -10,15 +11,58 @@ namespace odometry
 
 //*************************** Image Pyramid *****************************//
 
-ImagePyramid::ImagePyramid(int num_levels, const cv::Mat& in_img, bool smooth=true){
+ImagePyramid::ImagePyramid(int num_levels, const cv::Mat& in_img, bool smooth=true, PyramidStorage storage){
   num_levels_ = num_levels;
+  storage_ = storage;
   GlobalStatus status = GaussianImagePyramidNaive(num_levels_, in_img, pyramid_imgs_, smooth);
   if (status == -1){
     std::cout << "Compute Gaussian Image Pyramid failed!" << std::endl;
+    return;
+  }
+  if (storage_ == kStorageFloat32) return;
+  // compact storage: the kernels gather 32 bit words, allocate one padding row behind the level
+  for (cv::Mat& level : pyramid_imgs_){
+    cv::Mat padded(level.rows + 1, level.cols, storage_ == kStorageUint8 ? CV_8U : CV_16U, cv::Scalar(0));
+    cv::Mat compact = padded.rowRange(0, level.rows);
+    if (storage_ == kStorageUint8){
+      level.convertTo(compact, CV_8U); // rounds to nearest and saturates
+    } else{
+      for (int y = 0; y < level.rows; y++){
+        GetSimdKernels().convert_to_half(level.ptr<float>(y), level.cols, compact.ptr<Float16>(y));
+      }
+    }
+    level = compact;
+  }
+}
+
+ImagePyramid::ImagePyramid(const std::vector<cv::Mat>& levels, PyramidStorage storage){
+  num_levels_ = int(levels.size());
+  storage_ = storage;
+  for (const cv::Mat& level : levels){
+    if (storage_ == kStorageFloat32){
+      pyramid_imgs_.push_back(level.clone());
+      continue;
+    }
+    cv::Mat padded(level.rows + 1, level.cols, level.type(), cv::Scalar(0));
+    cv::Mat compact = padded.rowRange(0, level.rows);
+    level.copyTo(compact);
+    pyramid_imgs_.push_back(compact);
   }
 }
 
 const cv::Mat& ImagePyramid::GetPyramidImage(int level_idx) const{
+  if (level_idx >= num_levels_){
+    std::cout << "Requested image pyramid does not exist! Max pyramid id: " << num_levels_ - 1 << std::endl;
+    exit(1);
+  }
+  if (storage_ != kStorageFloat32){
+    std::cout << "Requested float image of a compact image pyramid! Use GetPyramidData() or DecodePyramidImage()." << std::endl;
+    exit(1);
+  }
+  return pyramid_imgs_[level_idx];
+}
+
+const cv::Mat& ImagePyramid::GetPyramidData(int level_idx) const{
   if (level_idx >= num_levels_){
     std::cout << "Requested image pyramid does not exist! Max pyramid id: " << num_levels_ - 1 << std::endl;
     exit(1);
@@ -26,16 +70,35 @@ const cv::Mat& ImagePyramid::GetPyramidImage(int level_idx) const{
   return pyramid_imgs_[level_idx];
 }
 
+void ImagePyramid::DecodePyramidImage(int level_idx, cv::Mat& out_img) const{
+  const cv::Mat& kData = GetPyramidData(level_idx);
+  if (storage_ != kStorageFloat16){
+    kData.convertTo(out_img, PixelType);
+    return;
+  }
+  out_img.create(kData.rows, kData.cols, PixelType);
+  for (int y = 0; y < kData.rows; y++){
+    GetSimdKernels().convert_from_half(kData.ptr<Float16>(y), kData.cols, out_img.ptr<float>(y));
+  }
+}
+
 //*************************** Depth Map Pyramid *****************************//
 DepthPyramid::DepthPyramid(int num_levels, const cv::Mat& in_depth, bool smooth=true){
   num_levels_ = num_levels;
-  GlobalStatus status = MedianDepthPyramidNaive(num_levels_, in_depth, pyramid_depths_, smooth);
-  //GlobalStatus status = MedianDepthPyramidSse(num_levels_, in_depth, pyramid_depths_, smooth);
+  //GlobalStatus status = MedianDepthPyramidNaive(num_levels_, in_depth, pyramid_depths_, smooth);
+  GlobalStatus status = MedianDepthPyramidSse(num_levels_, in_depth, pyramid_depths_, smooth);
   if (status == -1){
     std::cout << "Compute Gaussian Depth Pyramid failed!" << std::endl;
   }
 }
 
+DepthPyramid::DepthPyramid(const std::vector<cv::Mat>& levels){
+  num_levels_ = int(levels.size());
+  for (const cv::Mat& level : levels){
+    pyramid_depths_.push_back(level.clone());
+  }
+}
+
 const cv::Mat& DepthPyramid::GetPyramidDepth(int level_idx) const{
   return pyramid_depths_[level_idx];
 }
@@ -0,0 +1,134 @@
+// The file contains the IMU preintegration defined in ODOMETRY_IMU_PREINTEGRATION_H
+
+#include <imu_preintegration.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace odometry
+{
+
+namespace
+{
+
+// reading at time t between the samples first and second
+ImuSample Interpolate(const ImuSample& kFirst, const ImuSample& kSecond, double t){
+  float alpha = float((t - kFirst.timestamp) / (kSecond.timestamp - kFirst.timestamp));
+  ImuSample sample;
+  sample.timestamp = t;
+  sample.gyro = (1.0f - alpha) * kFirst.gyro + alpha * kSecond.gyro;
+  sample.accel = (1.0f - alpha) * kFirst.accel + alpha * kSecond.accel;
+  return sample;
+}
+
+} // namespace
+
+GlobalStatus ReadImuCsv(const std::string& file_name, std::vector<ImuSample>& samples){
+  samples.clear();
+  std::ifstream file(file_name, std::ios::in);
+  if (!file.is_open()){
+    std::cout << "open IMU file failed: " << file_name << std::endl;
+    return -1;
+  }
+  std::string line;
+  while (std::getline(file, line)){
+    if (line.empty() || line[0] == '#' || line[0] == '\r') continue;
+    std::replace(line.begin(), line.end(), ',', ' ');
+    std::istringstream values(line);
+    double timestamp_ns;
+    ImuSample sample;
+    if (!(values >> timestamp_ns >> sample.gyro(0) >> sample.gyro(1) >> sample.gyro(2)
+                 >> sample.accel(0) >> sample.accel(1) >> sample.accel(2))){
+      std::cout << "read IMU line failed: " << line << std::endl;
+      samples.clear();
+      return -1;
+    }
+    sample.timestamp = timestamp_ns * 1e-9;
+    if (!samples.empty() && sample.timestamp <= samples.back().timestamp){
+      std::cout << "IMU timestamps are not increasing: " << line << std::endl;
+      samples.clear();
+      return -1;
+    }
+    samples.push_back(sample);
+  }
+  return 0;
+}
+
+GlobalStatus ReadFrameTimestamps(const std::string& file_name, std::vector<double>& timestamps){
+  timestamps.clear();
+  std::ifstream file(file_name, std::ios::in);
+  if (!file.is_open()){
+    std::cout << "open timestamp file failed: " << file_name << std::endl;
+    return -1;
+  }
+  double timestamp;
+  while (file >> timestamp){
+    timestamps.push_back(timestamp);
+  }
+  return 0;
+}
+
+ImuPreintegrator::ImuPreintegrator(const Affine4f& kCamImu, const Eigen::Vector3f& kGyroBias,
+                                   const Eigen::Vector3f& kAccelBias){
+  cam_imu_ = kCamImu;
+  gyro_bias_ = kGyroBias;
+  accel_bias_ = kAccelBias;
+  delta_velocity_.setZero();
+  delta_position_.setZero();
+  delta_time_ = 0.0;
+}
+
+GlobalStatus ImuPreintegrator::Integrate(const std::vector<ImuSample>& kSamples, double t0, double t1){
+  if (kSamples.size() < 2 || t1 <= t0 || t0 < kSamples.front().timestamp || t1 > kSamples.back().timestamp){
+    std::cout << "IMU samples don't cover the frame interval in ImuPreintegrator::Integrate()." << std::endl;
+    return -1;
+  }
+  auto not_after = [](const ImuSample& kSample, double t){ return kSample.timestamp <= t; };
+  // first sample after t0 and t1
+  auto begin = std::lower_bound(kSamples.begin(), kSamples.end(), t0, not_after);
+  auto end = std::lower_bound(kSamples.begin(), kSamples.end(), t1, not_after);
+  ImuSample previous = (begin == kSamples.begin()) ? kSamples.front() : Interpolate(*(begin - 1), *begin, t0);
+  ImuSample last = (end == kSamples.end()) ? kSamples.back() : Interpolate(*(end - 1), *end, t1);
+  Sophus::SO3<float> rotation;
+  Eigen::Vector3f velocity = Eigen::Vector3f::Zero();
+  Eigen::Vector3f position = Eigen::Vector3f::Zero();
+  for (auto it = begin; ; ++it){
+    const ImuSample& kNext = (it == end) ? last : *it;
+    float dt = float(kNext.timestamp - previous.timestamp);
+    Eigen::Vector3f gyro = 0.5f * (previous.gyro + kNext.gyro) - gyro_bias_;
+    Eigen::Vector3f accel = rotation * (0.5f * (previous.accel + kNext.accel) - accel_bias_);
+    position += velocity * dt + 0.5f * dt * dt * accel;
+    velocity += accel * dt;
+    rotation = rotation * Sophus::SO3<float>::exp(gyro * dt);
+    previous = kNext;
+    if (it == end) break;
+  }
+  delta_rotation_ = rotation;
+  delta_velocity_ = velocity;
+  delta_position_ = position;
+  delta_time_ = t1 - t0;
+  return 0;
+}
+
+Affine4f ImuPreintegrator::CameraMotion(const Sophus::SO3<float>& kRotation, const Eigen::Vector3f& kPosition) const{
+  // pose of the IMU frame at t1 in the IMU frame at t0, X_0 = imu_motion * X_1
+  Affine4f imu_motion = Affine4f::Identity();
+  imu_motion.block<3, 3>(0, 0) = kRotation.matrix();
+  imu_motion.block<3, 1>(0, 3) = kPosition;
+  return cam_imu_ * imu_motion.inverse() * cam_imu_.inverse();
+}
+
+Affine4f ImuPreintegrator::PredictCameraMotion(const Affine4f& kMotionPrior) const{
+  Affine4f motion = CameraMotion(delta_rotation_, Eigen::Vector3f::Zero());
+  motion.block<3, 1>(0, 3) = kMotionPrior.block<3, 1>(0, 3);
+  return motion;
+}
+
+Affine4f ImuPreintegrator::PredictCameraMotion(const Eigen::Vector3f& kVelocity, const Eigen::Vector3f& kGravity) const{
+  float dt = float(delta_time_);
+  Eigen::Vector3f position = kVelocity * dt + 0.5f * dt * dt * kGravity + delta_position_;
+  return CameraMotion(delta_rotation_, position);
+}
+
+} // namespace odometry
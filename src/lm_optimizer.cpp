@@ -10,12 +10,36 @@
 #include <se3.hpp>
 #include <camera.h>
 #include <algorithm>
+#include <limits>
 #include <opencv2/highgui.hpp>
 #include <math.h>
+#include <simd_dispatch.h>
+#include <metrics.h>
 
 namespace odometry
 {
 
+// per pyramid level monitoring of the pose optimization, registered once
+static void RecordLevelMetrics(int level, int iterations, int num_residuals){
+  static const int kMaxLevels = 8;
+  static metrics::Counter* iterations_total[kMaxLevels];
+  static metrics::Gauge* residuals_last[kMaxLevels];
+  static bool registered = [](){
+    for (int l = 0; l < kMaxLevels; l++){
+      std::string labels = "level=\"" + std::to_string(l) + "\"";
+      iterations_total[l] = &metrics::Registry().GetCounter("odometry_pose_lm_iterations_total",
+                                                             "LM iterations of the pose optimization per pyramid level.", labels);
+      residuals_last[l] = &metrics::Registry().GetGauge("odometry_pose_residuals",
+                                                         "Tracking residuals of the last pose optimization per pyramid level.", labels);
+    }
+    return true;
+  }();
+  (void)registered;
+  if (level < 0 || level >= kMaxLevels) return;
+  iterations_total[level]->Inc(uint64_t(iterations));
+  residuals_last[level]->Set(double(num_residuals));
+}
+
 LevenbergMarquardtOptimizer::LevenbergMarquardtOptimizer(float lambda,
                                                          float precision,
                                                          const std::vector<int> kMaxIterations,
@@ -38,6 +62,13 @@ LevenbergMarquardtOptimizer::LevenbergMarquardtOptimizer(float lambda,
     camera_ptr_ = kCameraPtr;
   robust_est_ = robust_est;
   huber_delta_ = huber_delta;
+  tracking_residuals_ = kDenseResiduals;
+  anchor_cell_ = 3;
+  max_coarse_cost_ = 100.0f;
+  coarse_cost_ = 0.0f;
+  prior_uncertain_ = false;
+  final_cost_ = 0.0f;
+  final_residuals_ = 0;
 }
 
 LevenbergMarquardtOptimizer::~LevenbergMarquardtOptimizer(){
@@ -54,11 +85,28 @@ void LevenbergMarquardtOptimizer::SetIdentityTransform(Affine4f& in_mat){
 Affine4f LevenbergMarquardtOptimizer::Solve(const ImagePyramid& kImagePyr1,
                                             const DepthPyramid& kDepthPyr1,
                                             const ImagePyramid& kImagePyr2){
+  static metrics::Histogram& latency = metrics::Registry().GetHistogram("odometry_stage_latency_seconds",
+          "Latency of the pipeline stages.", metrics::LatencyBuckets(), "stage=\"pose\"");
+  metrics::ScopedLatency timer(latency);
   OptimizerStatus status;
-  status = OptimizeCameraPose(kImagePyr1, kDepthPyr1, kImagePyr2);
-  //status = OptimizeCameraPoseSse(kImagePyr1, kDepthPyr1, kImagePyr2);
+  bool seeded = false;
+  if (pose_initializer_ != nullptr && prior_uncertain_){
+    seeded = SeedInitialAffine(kImagePyr1, kDepthPyr1, kImagePyr2);
+  }
+  //status = OptimizeCameraPose(kImagePyr1, kDepthPyr1, kImagePyr2);
+  status = OptimizeCameraPoseSse(kImagePyr1, kDepthPyr1, kImagePyr2);
+  if (pose_initializer_ != nullptr && !seeded && (status == -1 || coarse_cost_ > max_coarse_cost_)){
+    // the prior was outside the convergence basin of the coarsest level
+    if (SeedInitialAffine(kImagePyr1, kDepthPyr1, kImagePyr2)){
+      ResetStatistics();
+      status = OptimizeCameraPoseSse(kImagePyr1, kDepthPyr1, kImagePyr2);
+    }
+  }
+  prior_uncertain_ = (status == -1 || coarse_cost_ > max_coarse_cost_);
   if (status == -1) {
     std::cout << "Optimize failed! " << std::endl;
+    final_cost_ = std::numeric_limits<float>::max();
+    final_residuals_ = 0;
     Affine4f tmp;
     SetIdentityTransform(tmp);
     return tmp;
@@ -79,11 +127,17 @@ OptimizerStatus LevenbergMarquardtOptimizer::OptimizeCameraPose(const ImagePyram
   Sophus::SE3<float> delta; // the incremented pose
   int pyr_levels = kImagePyr1.GetNumberLevels();
   int l = pyr_levels-1;
-  Eigen::Matrix<float, 6, Eigen::Dynamic> jtw;
-  Eigen::Matrix<float, 6, 6> jtwj;
+  Eigen::Matrix<float, 6, 6> jtwj; // symmetric
+  Eigen::Matrix<float, 6, 1> jtwr;
+  float cost = 0.0f;
   Eigen::Matrix<float, 6, 6> linear_a;
   Eigen::Matrix<float, 6, 1> linear_b;
-  Eigen::Matrix<float, Eigen::Dynamic, 6> jaco;
+  Eigen::Matrix<float, Eigen::Dynamic, 6> jaco; // column-major: column k starts at jaco.data() + k * jaco.rows()
+  const SimdKernels& kernels = GetSimdKernels();
+  if (kImagePyr1.GetStorage() != kStorageFloat32 || kImagePyr2.GetStorage() != kStorageFloat32){
+    std::cout << "Compact image pyramids are only supported by LevenbergMarquardtOptimizer::OptimizeCameraPoseSse()." << std::endl;
+    return -1;
+  }
   Eigen::DiagonalMatrix<float, Eigen::Dynamic> weights;
   Eigen::Matrix<float, Eigen::Dynamic, 1> residuals;
   int num_residuals = 0;
@@ -125,8 +179,10 @@ OptimizerStatus LevenbergMarquardtOptimizer::OptimizeCameraPose(const ImagePyram
         return -1;
       }
       //std::cout << "eval res/jaco: " << double(end - begin) / CLOCKS_PER_SEC * 1000.0f << " ms" << std::endl;
-      // compute jacobian succeed, proceed
-      err_now = (float(1.0) / float(num_residuals)) * residuals.transpose() * weights * residuals;
+      // compute jacobian succeed, proceed: accumulate jtwj, jtwr and the weighted cost in one pass over the residuals
+      kernels.accumulate_normal_equations(jaco.data(), int(jaco.rows()), residuals.data(), weights.diagonal().data(),
+                                          num_residuals, jtwj.data(), jtwr.data(), &cost);
+      err_now = (float(1.0) / float(num_residuals)) * cost;
       //std::cout << "pose err: " << err_now << std::endl;
       if (err_now > err_last){ // bad pose estimate, do not update pose
         // std::cout << "bad pose" << std::endl;
@@ -142,17 +198,17 @@ OptimizerStatus LevenbergMarquardtOptimizer::OptimizeCameraPose(const ImagePyram
         current_lambda = std::max(current_lambda / 5.0f, float(1e-5));
       }
       // solve the system
-      jtw = jaco.transpose() * weights;
-      jtwj = jtw * jaco;
       Eigen::Matrix<float, 6, 6> H = Eigen::Matrix<float, 6, 6>::Zero(); // zero 6x6 matrix
       H.diagonal() = jtwj.diagonal();
-      linear_b = - jtw * residuals;
+      linear_b = - jtwr;
       linear_a = jtwj + current_lambda * H;
       Vector6f delta_vec = linear_a.colPivHouseholderQr().solve(linear_b);
       delta = Sophus::SE3<float>::exp(delta_vec);
       inc_estimate = Sophus::SE3<float>(delta.matrix() * current_estimate.matrix());
       iter_count++;
     } // end optimize criteria loop
+    if (l < int(iters_stat_.size())) iters_stat_[l] = iter_count;
+    RecordLevelMetrics(l, iter_count, num_residuals);
     l--;
   } // end pyramid loop
   affine_ = current_estimate.matrix(); // assign the optimised pose
@@ -172,20 +228,17 @@ OptimizerStatus LevenbergMarquardtOptimizer::ComputeResidualJacobianNaive(const
   // declare local vars
   int kRows = kImg1.rows;
   int kCols = kImg1.cols;
-  float grad_x, grad_y, mag_grad;
   int num_invalid_dep = 0;
   int num_out_bound = 0;
-  float scale = 0.0f;
-  float scale_sqr = 0.0f;
   RowVector2f grad(0.0, 0.0);
   Vector4f left_coord, left_3d, right_3d, warped_coordf;
-  Vector2i warped_coordi;
   GlobalStatus warp_flag;
-  GlobalStatus grad_flag;
   Matrix2ff jw;
   float fx_z, fy_z, xx, yy, zz, xy;
-  residual.resize(kRows*kCols, 1);
-  jaco.resize(kRows*kCols, 6);
+  // warped points: 3d point in camera 1, intensity of image 1 and sub-pixel position on image 2
+  Eigen::Matrix<float, 3, Eigen::Dynamic> points_3d(3, kRows*kCols);
+  std::vector<float> intensities_1, warped_u, warped_v;
+  int num_warped = 0;
   // loop over all pixels
   for (int y = 4; y < kRows - 4; y++){ // ignore boundary by 4 pixels
     for (int x = 4; x < kCols - 4; x++){ // ignore boundary by 4 pixels
@@ -194,49 +247,51 @@ OptimizerStatus LevenbergMarquardtOptimizer::ComputeResidualJacobianNaive(const
         num_invalid_dep++;
         continue;
       } else{
-        //std::cout << y << " " << x << std::endl;
         left_coord << x, y, 1.0f / kDep1.at<float>(y, x), 1.0f;
-        //std::cout << "Sec0" << std::endl;
         ReprojectToCameraFrame(left_coord, camera_ptr_, left_3d, level);
-        //std::cout << "Sec1" << std::endl;
         warp_flag = WarpPixel(left_3d, kTransform, kRows, kCols, camera_ptr_, warped_coordf, right_3d, level);
-        //std::cout << "Sec2" << std::endl;
         if (warp_flag == -1) { // out of image boundary
           num_out_bound++;
           continue;
         }
-        warped_coordi(0) = int(std::floor(warped_coordf(0)));
-        warped_coordi(1) = int(std::floor(warped_coordf(1)));
-        //std::cout << "Sec3" << std::endl;
-//        std::cout << "left_coord: " << left_coord << std::endl;
-//        std::cout << "left_3d: " << left_3d << std::endl;
-//        std::cout << "warped_coordf: " << warped_coordf(1) << " " <<  warped_coordf(0) << std::endl;
-//        std::cout << "warped_coordi: " << warped_coordi(1) << " " <<  warped_coordi(0) << std::endl;
-        ComputePixelGradient(kImg2, kRows, kCols, warped_coordi(1), warped_coordi(0), grad); //BUG!!!
-        //std::cout << "Sec4" << std::endl;
-        residual.row(num_residual) << kImg2.at<float>(warped_coordi(1), warped_coordi(0)) - kImg1.at<float>(y, x);
-        //std::cout << "Sec5" << std::endl;
-        // compute partial jacobian with left_3d
-        // TODO: only for debug now
-        // fx_z = camera_ptr_->fx(level) / left_3d(2);
-        // fy_z = camera_ptr_->fy(level) / left_3d(2);
-        fx_z = (718.856f / std::pow(2.0f, level)) / left_3d(2);
-        fy_z = (718.856f / std::pow(2.0f, level)) / left_3d(2);
-        xy = left_3d(0) * left_3d(1);
-        xx = left_3d(0) * left_3d(0);
-        yy = left_3d(1) * left_3d(1);
-        zz = left_3d(2) * left_3d(2);
-        // TODO: only for debug now
-        //jw << fx_z, 0.0, -fx_z * left_3d(0) / left_3d(2), -fx_z * xy / left_3d(2), camera_ptr_->fx(level) * (1.0 + xx / zz), -fx_z * left_3d(1),
-        //        0.0, fy_z, -fy_z * left_3d(1) / left_3d(2), -camera_ptr_->fy(level) * (1.0 + yy / zz),  fy_z * xy / left_3d(2), fy_z * left_3d(0);
-        jw << fx_z, 0.0, -fx_z * left_3d(0) / left_3d(2), -fx_z * xy / left_3d(2), (718.856f / std::pow(2.0f, level)) * (1.0 + xx / zz), -fx_z * left_3d(1),
-                0.0, fy_z, -fy_z * left_3d(1) / left_3d(2), -(718.856f / std::pow(2.0f, level)) * (1.0 + yy / zz),  fy_z * xy / left_3d(2), fy_z * left_3d(0);
-        jaco.row(num_residual) = grad * jw;
-        //std::cout << "Sec6" << std::endl;
-        num_residual++;
+        points_3d.col(num_warped) = left_3d.head<3>();
+        intensities_1.push_back(kImg1.at<float>(y, x));
+        warped_u.push_back(warped_coordf(0));
+        warped_v.push_back(warped_coordf(1));
+        num_warped++;
       }
     }
   }
+  // bilinear intensities and gradients of all warped points on image 2 at once, see SimdKernels::sample_bilinear
+  std::vector<float> intensities_2(num_warped), grads_x(num_warped), grads_y(num_warped);
+  std::vector<unsigned char> in_bounds(num_warped);
+  GetSimdKernels().sample_bilinear(kImg2.ptr<float>(), int(kImg2.step / sizeof(float)), kRows, kCols, warped_u.data(),
+                                   warped_v.data(), num_warped, intensities_2.data(), grads_x.data(), grads_y.data(),
+                                   in_bounds.data());
+  residual.resize(num_warped, 1);
+  jaco.resize(num_warped, 6);
+  float camera[4];
+  GetCameraLevel(camera_ptr_, level, camera);
+  for (int i = 0; i < num_warped; i++){
+    if (in_bounds[i] == 0){ // the neighbourhood of the sample is out of image boundary
+      num_out_bound++;
+      continue;
+    }
+    left_3d.head<3>() = points_3d.col(i);
+    grad << grads_x[i], grads_y[i];
+    residual.row(num_residual) << intensities_2[i] - intensities_1[i];
+    // compute partial jacobian with left_3d
+    fx_z = camera[0] / left_3d(2);
+    fy_z = camera[1] / left_3d(2);
+    xy = left_3d(0) * left_3d(1);
+    xx = left_3d(0) * left_3d(0);
+    yy = left_3d(1) * left_3d(1);
+    zz = left_3d(2) * left_3d(2);
+    jw << fx_z, 0.0, -fx_z * left_3d(0) / left_3d(2), -fx_z * xy / left_3d(2), camera[0] * (1.0 + xx / zz), -fx_z * left_3d(1),
+            0.0, fy_z, -fy_z * left_3d(1) / left_3d(2), -camera[1] * (1.0 + yy / zz),  fy_z * xy / left_3d(2), fy_z * left_3d(0);
+    jaco.row(num_residual) = grad * jw;
+    num_residual++;
+  }
   //std::cout << "num of valid depth in pose_opt: " << num_residual  << " over total: " << kRows*kCols << std::endl;
   //std::cout << "num out of bound: " << num_out_bound << std::endl;
   residual.conservativeResize(num_residual, 1);
@@ -246,20 +301,8 @@ OptimizerStatus LevenbergMarquardtOptimizer::ComputeResidualJacobianNaive(const
     std::cout << "jaco rows: " << jaco.rows() << std::endl;
     return -1;
   }
-  weight.setIdentity(num_residual);
-  if (robust_est_ == 0){
-    return 0;
-  } else if (robust_est_ == 1){
-    for (int i = 0; i < num_residual; i++){
-      weight.diagonal()(i) = std::fabs(residual(i)) <= huber_delta_ ? 1.0f : huber_delta_ / std::fabs(residual(i));
-    }
-  } else{
-    scale = ComputeScaleNaive(residual, num_residual);
-    scale_sqr = scale * scale;
-    for (int i = 0; i < num_residual; i++){
-      weight.diagonal()(i) = (200.0f + 1.0f) / (200.0f + residual(i) * residual(i) / scale_sqr);
-    }
-  }
+  weight.resize(num_residual);
+  ComputeWeights(residual, num_residual, weight);
   return 0;
 }
 
@@ -268,38 +311,47 @@ OptimizerStatus LevenbergMarquardtOptimizer::OptimizeCameraPoseSse(const ImagePy
                                                                    const ImagePyramid& kImagePyr2){
   Sophus::SE3<float> current_estimate(affine_init_); // current pose estimate, always the best current pose
   Sophus::SE3<float> inc_estimate(affine_init_); // tempted pose estimate used to update the current_estimate
-  Sophus::SE3<float> last_estimate; // used to save previous best pose
+  Sophus::SE3<float> last_estimate = current_estimate; // used to save previous best pose
   Sophus::SE3<float> delta; // the incremented pose
   int pyr_levels = kImagePyr1.GetNumberLevels();
   int l = pyr_levels-1;
-  Eigen::Matrix<float, 6, 640*480> jtw; // the max possible size
-  Eigen::Matrix<float, 6, 6> jtwj;
+  Eigen::Matrix<float, 6, 6> jtwj; // symmetric
+  Eigen::Matrix<float, 6, 1> jtwr;
+  float cost = 0.0f;
   Eigen::Matrix<float, 6, 6> linear_a;
   Eigen::Matrix<float, 6, 1> linear_b;
-  Eigen::Matrix<float, 640*480, 6> jaco;
-  Eigen::Matrix<float, 640*480, 1> weights;
-  Eigen::Matrix<float, 640*480, 1> residuals;
+  // the max possible size, allocated once for all levels and iterations: one residual per pixel, or 8 per anchor
+  const cv::Mat& kImg0 = kImagePyr1.GetPyramidData(0);
+  int capacity = std::max(kImg0.rows * kImg0.cols,
+                          8 * ((kImg0.rows + anchor_cell_ - 1) / anchor_cell_) * ((kImg0.cols + anchor_cell_ - 1) / anchor_cell_));
+  Eigen::Matrix<float, Eigen::Dynamic, 6> jaco(capacity, 6);
+  Eigen::DiagonalMatrix<float, Eigen::Dynamic> weights(capacity);
+  Eigen::Matrix<float, Eigen::Dynamic, 1> residuals(capacity, 1);
   int num_residuals = 0;
   float current_lambda = 0.0f;
+  const SimdKernels& kernels = GetSimdKernels();
   // loop for each pyramid level
   while (l >= 0) {
     // get respective images/depth map from current pyramid level as const reference
-    const cv::Mat& kImg1 = kImagePyr1.GetPyramidImage(l); // CV_32F
-    const cv::Mat& kImg2 = kImagePyr2.GetPyramidImage(l); // CV_32F
+    const cv::Mat& kImg1 = kImagePyr1.GetPyramidData(l); // CV_32F, CV_8U or CV_16U (Float16), see PyramidStorage
+    const cv::Mat& kImg2 = kImagePyr2.GetPyramidData(l); // same storage as kImg1
     const cv::Mat& kDep1 = kDepthPyr1.GetPyramidDepth(l); // CV_32F
     // check data types and matrix size
     if ((kImg1.rows != kImg2.rows) || (kImg1.rows != kDep1.rows)){
-      std::cout << "Image rows don't match in LevenbergMarquardtOptimizer::OptimizeCameraPose()." << std::endl;
+      std::cout << "Image rows don't match in LevenbergMarquardtOptimizer::OptimizeCameraPoseSse()." << std::endl;
       return -1;
     }
     if ((kImg1.cols != kImg2.cols) || (kImg1.cols != kDep1.cols)){
-      std::cout << "Image cols don't match in LevenbergMarquardtOptimizer::OptimizeCameraPose()." << std::endl;
+      std::cout << "Image cols don't match in LevenbergMarquardtOptimizer::OptimizeCameraPoseSse()." << std::endl;
       return -1;
     }
-    if ((kImg1.type() != PixelType) || (kImg2.type() != PixelType) || (kDep1.type() != PixelType)){
-      std::cout << "Image types don't match in LevenbergMarquardtOptimizer::OptimizeCameraPose()." << std::endl;
+    if ((kImg1.type() != kImg2.type()) || (kDep1.type() != PixelType)){
+      std::cout << "Image types don't match in LevenbergMarquardtOptimizer::OptimizeCameraPoseSse()." << std::endl;
       return -1;
     }
+    if (tracking_residuals_ == kPattern8Residuals){
+      SelectPatternAnchors(kImg1, kDep1);
+    }
     int iter_count = 0;
     float err_last = 1e+10;
     float err_now = 0.0;
@@ -308,32 +360,219 @@ OptimizerStatus LevenbergMarquardtOptimizer::OptimizeCameraPoseSse(const ImagePy
     inc_estimate = current_estimate;
     // initial increment twist, default constructed as identity. re-define for each pyramid
     while (max_iterations_[l]> iter_count){
-      std::cout << "level: " << l << ", iter: " << iter_count << std::endl;
       num_residuals = 0;
-      clock_t begin = clock();
-      // OptimizerStatus compute_status = ComputeResidualJacobianSse(kImg1, kImg2, kDep1, inc_estimate.matrix(), jaco, weights, residuals, num_residuals, l);
-      clock_t end = clock();
-//      if (compute_status == -1){
-//        std::cout << "Evaluate Residual & Jacobian failed " << std::endl;
-//        return -1;
-//      }
-      std::cout << "eval res/jaco: " << double(end - begin) / CLOCKS_PER_SEC * 1000.0f << " ms" << std::endl;
+      OptimizerStatus compute_status = -1;
+      if (tracking_residuals_ == kPattern8Residuals){
+        compute_status = ComputeResidualJacobianPattern8(kImg1, kImg2, inc_estimate.matrix(), jaco, weights, residuals, num_residuals, l);
+      } else{
+        compute_status = ComputeResidualJacobianSse(kImg1, kImg2, kDep1, inc_estimate.matrix(), jaco, weights, residuals, num_residuals, l);
+      }
+      if (compute_status == -1){
+        std::cout << "Evaluate Residual & Jacobian failed " << std::endl;
+        return -1;
+      }
+      // compute jacobian succeed, proceed: only the first num_residuals rows are valid
+      kernels.accumulate_normal_equations(jaco.data(), int(jaco.rows()), residuals.data(), weights.diagonal().data(),
+                                          num_residuals, jtwj.data(), jtwr.data(), &cost);
+      err_now = (float(1.0) / float(num_residuals)) * cost;
+      if (err_now > err_last){ // bad pose estimate, do not update pose
+        current_lambda = current_lambda * 5.0f;
+        if (current_lambda > 1e+5) { break; }
+        current_estimate = last_estimate;
+      } else{ // good pose estimate -> update pose, save previous pose
+        current_estimate = inc_estimate;
+        last_estimate = current_estimate;
+        err_diff = err_now / err_last;
+        if (err_diff > precision_) { break; }
+        err_last = err_now;
+        current_lambda = std::max(current_lambda / 5.0f, float(1e-5));
+      }
+      // solve the system
+      Eigen::Matrix<float, 6, 6> H = Eigen::Matrix<float, 6, 6>::Zero(); // zero 6x6 matrix
+      H.diagonal() = jtwj.diagonal();
+      linear_b = - jtwr;
+      linear_a = jtwj + current_lambda * H;
+      Vector6f delta_vec = linear_a.colPivHouseholderQr().solve(linear_b);
+      delta = Sophus::SE3<float>::exp(delta_vec);
+      inc_estimate = Sophus::SE3<float>(delta.matrix() * current_estimate.matrix());
+      iter_count++;
+    } // end optimize criteria loop
+    if (l < int(iters_stat_.size())) iters_stat_[l] = iter_count;
+    if (l == pyr_levels-1) coarse_cost_ = std::min(err_now, err_last); // cost of current_estimate
+    if (l == 0){
+      final_cost_ = std::min(err_now, err_last);
+      final_residuals_ = num_residuals;
     }
-  }
+    RecordLevelMetrics(l, iter_count, num_residuals);
+    l--;
+  } // end pyramid loop
+  affine_ = current_estimate.matrix(); // assign the optimised pose
   return 0;
 }
 
-// TODO, SSE impl, highly optimized
+// SIMD impl: warp, residuals and jacobians are computed by the dispatched kernel, see SimdKernels::pose_residual_jacobian
+// the outputs are NOT resized, they must hold at least kImg1.rows * kImg1.cols residuals, only the first num_residual are valid
 OptimizerStatus LevenbergMarquardtOptimizer::ComputeResidualJacobianSse(const cv::Mat& kImg1, const cv::Mat& kImg2, const cv::Mat& kDep1, const Affine4f& kTransform,
                                            Eigen::Matrix<float, Eigen::Dynamic, 6>& jaco,
-                                           Eigen::DiagonalMatrix<float, Eigen::Dynamic, Eigen::Dynamic>& weight,
-                                           Eigen::VectorXf& residual,
-                                           int& num_residual){
+                                           Eigen::DiagonalMatrix<float, Eigen::Dynamic>& weight,
+                                           Eigen::Matrix<float, Eigen::Dynamic, 1>& residual,
+                                           int& num_residual,
+                                           int level){
   int kRows = kImg1.rows;
   int kCols = kImg1.cols;
+  if (jaco.rows() < kRows * kCols || residual.rows() < kRows * kCols || weight.rows() < kRows * kCols){
+    std::cout << "Residual buffers too small in LevenbergMarquardtOptimizer::ComputeResidualJacobianSse()." << std::endl;
+    return -1;
+  }
+  // the kernels take one stride in pixels for the images and the depth
+  if (kImg1.step != kImg2.step || kImg1.step1() != kDep1.step1()){
+    std::cout << "Image steps don't match in LevenbergMarquardtOptimizer::ComputeResidualJacobianSse()." << std::endl;
+    return -1;
+  }
+  float camera[4];
+  GetCameraLevel(camera_ptr_, level, camera);
+  Eigen::Matrix<float, 3, 4, Eigen::RowMajor> transform = kTransform.block<3, 4>(0, 0);
+  // ignore boundary by 4 pixels
+  const SimdKernels& kernels = GetSimdKernels();
+  int stride = int(kDep1.step1());
+  if (kImg1.type() == PixelType){
+    num_residual = kernels.pose_residual_jacobian(kImg1.ptr<float>(), kImg2.ptr<float>(), kDep1.ptr<float>(), stride,
+            kRows, kCols, 4, camera, transform.data(), jaco.data(), int(jaco.rows()), residual.data());
+  } else if (kImg1.type() == CV_8U){
+    num_residual = kernels.pose_residual_jacobian_u8(kImg1.ptr<unsigned char>(), kImg2.ptr<unsigned char>(),
+            kDep1.ptr<float>(), stride, kRows, kCols, 4, camera, transform.data(), jaco.data(), int(jaco.rows()),
+            residual.data());
+  } else if (kImg1.type() == CV_16U){
+    num_residual = kernels.pose_residual_jacobian_f16(kImg1.ptr<Float16>(), kImg2.ptr<Float16>(), kDep1.ptr<float>(),
+            stride, kRows, kCols, 4, camera, transform.data(), jaco.data(), int(jaco.rows()), residual.data());
+  } else{
+    std::cout << "Image type not supported in LevenbergMarquardtOptimizer::ComputeResidualJacobianSse()." << std::endl;
+    return -1;
+  }
+  if (num_residual == 0){
+    std::cout << "Num residual: " <<  num_residual << std::endl;
+    return -1;
+  }
+  ComputeWeights(residual, num_residual, weight);
   return 0;
 }
 
+OptimizerStatus LevenbergMarquardtOptimizer::ComputeResidualJacobianPattern8(const cv::Mat& kImg1, const cv::Mat& kImg2, const Affine4f& kTransform,
+                                           Eigen::Matrix<float, Eigen::Dynamic, 6>& jaco,
+                                           Eigen::DiagonalMatrix<float, Eigen::Dynamic>& weight,
+                                           Eigen::Matrix<float, Eigen::Dynamic, 1>& residual,
+                                           int& num_residual,
+                                           int level){
+  int num_anchors = int(anchor_xs_.size());
+  if (jaco.rows() < 8 * num_anchors || residual.rows() < 8 * num_anchors || weight.rows() < 8 * num_anchors){
+    std::cout << "Residual buffers too small in LevenbergMarquardtOptimizer::ComputeResidualJacobianPattern8()." << std::endl;
+    return -1;
+  }
+  if (kImg1.type() != PixelType || kImg1.step != kImg2.step){
+    std::cout << "Only float images of the same step supported in LevenbergMarquardtOptimizer::ComputeResidualJacobianPattern8()." << std::endl;
+    return -1;
+  }
+  float camera[4];
+  GetCameraLevel(camera_ptr_, level, camera);
+  Eigen::Matrix<float, 3, 4, Eigen::RowMajor> transform = kTransform.block<3, 4>(0, 0);
+  num_residual = GetSimdKernels().pose_residual_jacobian_pattern8(kImg1.ptr<float>(), kImg2.ptr<float>(),
+          int(kImg1.step / sizeof(float)), kImg1.rows, kImg1.cols, anchor_xs_.data(), anchor_ys_.data(),
+          anchor_inv_depth_.data(), num_anchors, camera, transform.data(), jaco.data(), int(jaco.rows()), residual.data());
+  if (num_residual == 0){
+    std::cout << "Num residual: " <<  num_residual << std::endl;
+    return -1;
+  }
+  ComputeWeights(residual, num_residual, weight);
+  return 0;
+}
+
+void LevenbergMarquardtOptimizer::SelectPatternAnchors(const cv::Mat& kImg1, const cv::Mat& kDep1){
+  anchor_xs_.clear();
+  anchor_ys_.clear();
+  anchor_inv_depth_.clear();
+  // ignore boundary by 4 pixels, as the dense residuals
+  const int kBorder = 4;
+  for (int cell_y = kBorder; cell_y < kImg1.rows - kBorder; cell_y += anchor_cell_){
+    for (int cell_x = kBorder; cell_x < kImg1.cols - kBorder; cell_x += anchor_cell_){
+      float best_grad = 0.0f;
+      int best_x = -1, best_y = -1;
+      for (int y = cell_y; y < std::min(cell_y + anchor_cell_, kImg1.rows - kBorder); y++){
+        const float* img_row = kImg1.ptr<float>(y);
+        const float* dep_row = kDep1.ptr<float>(y);
+        for (int x = cell_x; x < std::min(cell_x + anchor_cell_, kImg1.cols - kBorder); x++){
+          if (std::fabs(dep_row[x]) < 0.01f) continue; // same invalid depth as the kernels
+          float grad_x = img_row[x + 1] - img_row[x - 1];
+          float grad_y = kImg1.ptr<float>(y + 1)[x] - kImg1.ptr<float>(y - 1)[x];
+          float grad = grad_x * grad_x + grad_y * grad_y;
+          if (grad > best_grad){
+            best_grad = grad;
+            best_x = x;
+            best_y = y;
+          }
+        }
+      }
+      if (best_x >= 0){
+        anchor_xs_.push_back(best_x);
+        anchor_ys_.push_back(best_y);
+        anchor_inv_depth_.push_back(kDep1.ptr<float>(best_y)[best_x]);
+      }
+    }
+  }
+}
+
+bool LevenbergMarquardtOptimizer::SeedInitialAffine(const ImagePyramid& kImagePyr1, const DepthPyramid& kDepthPyr1,
+                                                    const ImagePyramid& kImagePyr2){
+  static metrics::Counter& accepted = metrics::Registry().GetCounter("odometry_pose_seeds_total",
+          "Feature based pose seeds of the tracking.", "result=\"accepted\"");
+  static metrics::Counter& rejected = metrics::Registry().GetCounter("odometry_pose_seeds_total",
+          "Feature based pose seeds of the tracking.", "result=\"rejected\"");
+  Affine4f seed;
+  if (pose_initializer_->EstimatePose(kImagePyr1, kDepthPyr1, kImagePyr2, affine_init_, seed) == -1){
+    rejected.Inc();
+    return false;
+  }
+  accepted.Inc();
+  affine_init_ = seed;
+  return true;
+}
+
+OptimizerStatus LevenbergMarquardtOptimizer::SetPoseInitializer(const std::shared_ptr<PoseInitializer>& kInitializer,
+                                                                float max_coarse_cost){
+  pose_initializer_ = kInitializer;
+  max_coarse_cost_ = max_coarse_cost;
+  prior_uncertain_ = false;
+  return 0;
+}
+
+OptimizerStatus LevenbergMarquardtOptimizer::SetTrackingResiduals(TrackingResiduals residuals, int anchor_cell){
+  if (anchor_cell < 3){
+    std::cout << "Anchor cell must be at least 3 pixels in LevenbergMarquardtOptimizer::SetTrackingResiduals()." << std::endl;
+    return -1;
+  }
+  tracking_residuals_ = residuals;
+  anchor_cell_ = anchor_cell;
+  return 0;
+}
+
+void LevenbergMarquardtOptimizer::ComputeWeights(const Eigen::VectorXf& residual, const int num_residual,
+                                                 Eigen::DiagonalMatrix<float, Eigen::Dynamic>& weight){
+  float scale = 0.0f;
+  float scale_sqr = 0.0f;
+  if (robust_est_ == 0){
+    weight.diagonal().head(num_residual).setOnes();
+  } else if (robust_est_ == 1){
+    for (int i = 0; i < num_residual; i++){
+      weight.diagonal()(i) = std::fabs(residual(i)) <= huber_delta_ ? 1.0f : huber_delta_ / std::fabs(residual(i));
+    }
+  } else{
+    scale = ComputeScaleNaive(residual, num_residual);
+    scale_sqr = scale * scale;
+    for (int i = 0; i < num_residual; i++){
+      weight.diagonal()(i) = (200.0f + 1.0f) / (200.0f + residual(i) * residual(i) / scale_sqr);
+    }
+  }
+}
+
 
 float LevenbergMarquardtOptimizer::ComputeScaleNaive(const Eigen::VectorXf& residual, const int num_residual){
   float init_sigma = 5.0f;
@@ -351,7 +590,7 @@ float LevenbergMarquardtOptimizer::ComputeScaleNaive(const Eigen::VectorXf& resi
       err_sqr = residual(i) * residual(i);
       sum +=  err_sqr * (1.0f + vee) / (vee + err_sqr / sigma_sqr);
     }
-    current_sigma = std::sqrtf(sum / float(num_residual));
+    current_sigma = std::sqrt(sum / float(num_residual));
   }while (std::fabs(current_sigma - init_sigma) >= float(1e-3));
 
   return current_sigma;
@@ -381,6 +620,21 @@ OptimizerStatus LevenbergMarquardtOptimizer::Reset(const Affine4f& kRelativeInit
   return 0;
 }
 
+LevenbergMarquardtOptimizer::State LevenbergMarquardtOptimizer::GetState() const{
+  State state;
+  state.affine_init = affine_init_;
+  state.lambda = lambda_;
+  state.prior_uncertain = prior_uncertain_;
+  return state;
+}
+
+void LevenbergMarquardtOptimizer::SetState(const State& kState){
+  affine_init_ = kState.affine_init;
+  lambda_ = kState.lambda;
+  prior_uncertain_ = kState.prior_uncertain;
+  ResetStatistics();
+}
+
 
 OptimizerStatus LevenbergMarquardtOptimizer::SetInitialAffine(const Affine4f& kAffineInit){
   affine_init_ = kAffineInit;
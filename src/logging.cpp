@@ -0,0 +1,260 @@
+// The file contains the background part of the asynchronous logging defined in ODOMETRY_LOGGING_H:
+// ring registry and recycling, drain thread and formatting.
+
+#include <logging.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace odometry
+{
+namespace logging
+{
+
+namespace
+{
+
+class Logger{
+  public:
+    Logger(): start_(std::chrono::steady_clock::now()){
+      drain_thread_ = std::thread(&Logger::DrainLoop, this);
+    }
+
+    // a ring returned by an exited thread is reused once drained, otherwise a new one
+    LogRing* Register(){
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!free_rings_.empty()){
+        rings_.push_back(std::move(free_rings_.back()));
+        free_rings_.pop_back();
+      } else {
+        rings_.emplace_back(new LogRing());
+      }
+      rings_.back()->thread_id_ = next_thread_id_++;
+      return rings_.back().get();
+    }
+
+    // the thread of ring exits: reused right away if drained, otherwise after its unread records are drained
+    void Release(LogRing* ring){
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (ring->Front() == nullptr && ring->Dropped() == 0){
+        Recycle(ring);
+        return;
+      }
+      released_.push_back(ring);
+      wake_.notify_one();
+    }
+
+    uint64_t NowNs() const{
+      return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count());
+    }
+
+    void Flush(){
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (stopped_){
+        lock.unlock();
+        DrainAll(); // no drain thread anymore, drain on the caller
+        return;
+      }
+      uint64_t request = ++flush_requested_;
+      wake_.notify_one();
+      flushed_.wait(lock, [&](){ return flush_done_ >= request || stopped_; });
+    }
+
+    // stop the drain thread and write everything left, called once at program termination
+    void Stop(){
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopped_) return;
+        stopped_ = true;
+      }
+      wake_.notify_one();
+      drain_thread_.join();
+      DrainAll();
+    }
+
+  private:
+    // a record copied out of its ring, formatted after mutex_ is released
+    struct PendingRecord{
+      LogRecord record;
+      int thread_id;
+    };
+
+    void DrainLoop(){
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!stopped_){
+        uint64_t request = flush_requested_;
+        lock.unlock();
+        DrainAll();
+        lock.lock();
+        flush_done_ = request;
+        flushed_.notify_all();
+        wake_.wait_for(lock, std::chrono::milliseconds(2), [&](){ return stopped_ || flush_requested_ != flush_done_ || !released_.empty(); });
+      }
+      flushed_.notify_all();
+    }
+
+    // copies every pending record of every ring under mutex_, then formats and writes them with one call without it:
+    // threads registering or returning a ring never wait for stdout
+    void DrainAll(){
+      std::lock_guard<std::mutex> drain_lock(drain_mutex_); // Stop() or Flush() after Stop() may drain concurrently
+      pending_.clear();
+      dropped_.clear();
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& ring : rings_){
+          const LogRecord* record;
+          while ((record = ring->Front()) != nullptr){
+            pending_.push_back({*record, ring->thread_id_});
+            ring->Pop();
+          }
+          uint64_t dropped = ring->TakeDropped();
+          if (dropped > 0) dropped_.emplace_back(ring->thread_id_, dropped);
+        }
+        // the released rings are empty now and their threads gone
+        for (LogRing* ring : released_) Recycle(ring);
+        released_.clear();
+      }
+      buffer_.clear();
+      for (const PendingRecord& pending : pending_) Format(pending.record, pending.thread_id);
+      for (const auto& dropped : dropped_){
+        buffer_ += "[logging] thread " + std::to_string(dropped.first) + " dropped " + std::to_string(dropped.second)
+                   + " records (ring full)\n";
+      }
+      if (!buffer_.empty()){
+        fwrite(buffer_.data(), 1, buffer_.size(), stdout);
+        fflush(stdout);
+      }
+    }
+
+    // must hold mutex_: moves an empty ring of an exited thread to the free rings
+    void Recycle(LogRing* ring){
+      for (size_t i = 0; i < rings_.size(); i++){
+        if (rings_[i].get() != ring) continue;
+        free_rings_.push_back(std::move(rings_[i]));
+        rings_.erase(rings_.begin() + i);
+        return;
+      }
+    }
+
+    void Format(const LogRecord& record, int thread_id){
+      char tmp[64];
+      snprintf(tmp, sizeof(tmp), "[%11.6f %-5s t%d] ", double(record.time_ns) * 1e-9, LevelName(record.level), thread_id);
+      buffer_ += tmp;
+      int next_arg = 0;
+      for (const char* c = record.format; *c != '\0'; c++){
+        if (c[0] == '{' && c[1] == '}' && next_arg < record.num_args){
+          FormatArg(record, record.args[next_arg++]);
+          c++;
+        } else {
+          buffer_ += *c;
+        }
+      }
+      if (record.level >= kLogWarn){
+        buffer_ += " (";
+        buffer_ += record.file;
+        buffer_ += ":" + std::to_string(record.line) + ")";
+      }
+      buffer_ += '\n';
+    }
+
+    void FormatArg(const LogRecord& record, const LogArg& arg){
+      char tmp[32];
+      switch (arg.type){
+        case LogArg::kInt: snprintf(tmp, sizeof(tmp), "%lld", (long long)arg.i); buffer_ += tmp; break;
+        case LogArg::kUInt: snprintf(tmp, sizeof(tmp), "%llu", (unsigned long long)arg.u); buffer_ += tmp; break;
+        case LogArg::kDouble: snprintf(tmp, sizeof(tmp), "%g", arg.d); buffer_ += tmp; break;
+        case LogArg::kBool: buffer_ += arg.u ? "true" : "false"; break;
+        case LogArg::kText: buffer_ += record.text + arg.text_offset; break;
+      }
+    }
+
+    const std::chrono::steady_clock::time_point start_;
+    std::mutex mutex_; // rings (also their consumer side) and flush state
+    std::condition_variable wake_;
+    std::condition_variable flushed_;
+    std::vector<std::unique_ptr<LogRing>> rings_;      // of the running threads and the released ones
+    std::vector<std::unique_ptr<LogRing>> free_rings_; // drained, ready for new threads
+    std::vector<LogRing*> released_;                   // returned by exited threads, not drained yet
+    int next_thread_id_ = 0;
+    std::mutex drain_mutex_; // the buffers below, held while formatting and writing
+    std::vector<PendingRecord> pending_;
+    std::vector<std::pair<int, uint64_t>> dropped_;
+    std::string buffer_;
+    uint64_t flush_requested_ = 0;
+    uint64_t flush_done_ = 0;
+    bool stopped_ = false;
+    std::thread drain_thread_;
+};
+
+void StopLogger();
+
+// leaked on purpose: must outlive every static destructor that may still log
+Logger& Instance(){
+  static Logger* logger = [](){
+    Logger* instance = new Logger();
+    std::atexit(StopLogger);
+    return instance;
+  }();
+  return *logger;
+}
+
+void StopLogger(){
+  Instance().Stop();
+}
+
+} // namespace
+
+namespace
+{
+
+// trivially destructible, valid until the thread is gone, also in thread_local destructors
+thread_local LogRing* thread_ring = nullptr;
+thread_local bool thread_ring_released = false;
+
+// returns the ring of the thread at thread exit
+struct RingReleaser{
+  ~RingReleaser(){
+    Instance().Release(thread_ring);
+    thread_ring = nullptr;
+    thread_ring_released = true;
+  }
+};
+
+} // namespace
+
+LogRing* ThreadRing(){
+  if (thread_ring == nullptr && !thread_ring_released){
+    thread_ring = Instance().Register();
+    thread_local RingReleaser releaser;
+    (void)releaser;
+  }
+  return thread_ring;
+}
+
+uint64_t NowNs(){
+  return Instance().NowNs();
+}
+
+void Flush(){
+  Instance().Flush();
+}
+
+const char* LevelName(int level){
+  switch (level){
+    case kLogTrace: return "TRACE";
+    case kLogDebug: return "DEBUG";
+    case kLogInfo: return "INFO";
+    case kLogWarn: return "WARN";
+    case kLogError: return "ERROR";
+    default: return "?";
+  }
+}
+
+} // namespace logging
+} // namespace odometry
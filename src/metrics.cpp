@@ -0,0 +1,332 @@
+// The file contains the metrics registry and the Prometheus exporters defined in ODOMETRY_METRICS_H
+
+#include <metrics.h>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace odometry
+{
+namespace metrics
+{
+
+/*************************************************** Histogram *****************************************************/
+Histogram::Histogram(const std::vector<double>& bounds): bounds_(bounds), buckets_(new std::atomic<uint64_t>[bounds.size() + 1]){
+  for (size_t i = 0; i <= bounds_.size(); i++){
+    buckets_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+const std::vector<double>& LatencyBuckets(){
+  static const std::vector<double> kBuckets = {0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1.0, 2.0};
+  return kBuckets;
+}
+
+/*************************************************** Registry ******************************************************/
+MetricsRegistry::Series& MetricsRegistry::GetSeries(const std::string& name, const std::string& help, Type type,
+                                                    const std::string& labels){
+  // caller holds mutex_
+  auto found = families_.find(name);
+  if (found == families_.end()){
+    found = families_.emplace(name, Family()).first;
+    found->second.type = type;
+    found->second.help = help;
+  } else if (found->second.type != type){
+    std::cout << "Metric " << name << " registered with different types!" << std::endl;
+    std::abort();
+  }
+  for (auto& series : found->second.series){
+    if (series->labels == labels) return *series;
+  }
+  found->second.series.emplace_back(new Series());
+  found->second.series.back()->labels = labels;
+  return *found->second.series.back();
+}
+
+Counter& MetricsRegistry::GetCounter(const std::string& name, const std::string& help, const std::string& labels){
+  std::lock_guard<std::mutex> lock(mutex_);
+  Series& series = GetSeries(name, help, kCounter, labels);
+  if (!series.counter) series.counter.reset(new Counter());
+  return *series.counter;
+}
+
+Gauge& MetricsRegistry::GetGauge(const std::string& name, const std::string& help, const std::string& labels){
+  std::lock_guard<std::mutex> lock(mutex_);
+  Series& series = GetSeries(name, help, kGauge, labels);
+  if (!series.gauge) series.gauge.reset(new Gauge());
+  return *series.gauge;
+}
+
+Histogram& MetricsRegistry::GetHistogram(const std::string& name, const std::string& help, const std::vector<double>& bounds,
+                                         const std::string& labels){
+  std::lock_guard<std::mutex> lock(mutex_);
+  Series& series = GetSeries(name, help, kHistogram, labels);
+  if (!series.histogram) series.histogram.reset(new Histogram(bounds));
+  return *series.histogram;
+}
+
+// resident set size from /proc, 0 if not available
+static double ResidentMemoryBytes(){
+  long pages_total = 0, pages_resident = 0;
+  FILE* statm = fopen("/proc/self/statm", "r");
+  if (statm == nullptr) return 0.0;
+  int read = fscanf(statm, "%ld %ld", &pages_total, &pages_resident);
+  fclose(statm);
+  return (read == 2) ? double(pages_resident) * double(sysconf(_SC_PAGESIZE)) : 0.0;
+}
+
+static std::string WithLabels(const std::string& labels, const std::string& extra){
+  if (labels.empty() && extra.empty()) return "";
+  if (labels.empty()) return "{" + extra + "}";
+  if (extra.empty()) return "{" + labels + "}";
+  return "{" + labels + "," + extra + "}";
+}
+
+std::string MetricsRegistry::RenderPrometheus(){
+  std::ostringstream out;
+  out.precision(10);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& family : families_){
+      const std::string& name = family.first;
+      const char* type = family.second.type == kCounter ? "counter" : (family.second.type == kGauge ? "gauge" : "histogram");
+      out << "# HELP " << name << " " << family.second.help << "\n";
+      out << "# TYPE " << name << " " << type << "\n";
+      for (const auto& series : family.second.series){
+        if (series->counter){
+          out << name << WithLabels(series->labels, "") << " " << series->counter->Value() << "\n";
+        } else if (series->gauge){
+          out << name << WithLabels(series->labels, "") << " " << series->gauge->Value() << "\n";
+        } else if (series->histogram){
+          const Histogram& histogram = *series->histogram;
+          // read every bucket once, the count is their sum so the output is self-consistent
+          uint64_t cumulative = 0;
+          for (size_t i = 0; i < histogram.Bounds().size(); i++){
+            cumulative += histogram.BucketCount(i);
+            std::ostringstream le;
+            le << "le=\"" << histogram.Bounds()[i] << "\"";
+            out << name << "_bucket" << WithLabels(series->labels, le.str()) << " " << cumulative << "\n";
+          }
+          cumulative += histogram.BucketCount(histogram.Bounds().size());
+          out << name << "_bucket" << WithLabels(series->labels, "le=\"+Inf\"") << " " << cumulative << "\n";
+          out << name << "_sum" << WithLabels(series->labels, "") << " " << histogram.Sum() << "\n";
+          out << name << "_count" << WithLabels(series->labels, "") << " " << cumulative << "\n";
+        }
+      }
+    }
+  }
+  out << "# HELP odometry_process_resident_memory_bytes Resident memory size in bytes.\n";
+  out << "# TYPE odometry_process_resident_memory_bytes gauge\n";
+  out << "odometry_process_resident_memory_bytes " << ResidentMemoryBytes() << "\n";
+  return out.str();
+}
+
+MetricsRegistry& Registry(){
+  static MetricsRegistry* registry = new MetricsRegistry(); // leaked on purpose, used until the very end
+  return *registry;
+}
+
+/*************************************************** Exporters *****************************************************/
+namespace
+{
+
+class Exporter{
+  public:
+    int StartSocket(int listen_fd){
+      if (!Claim()) {
+        close(listen_fd);
+        return -1;
+      }
+      thread_ = std::thread(&Exporter::ServeLoop, this, listen_fd);
+      return 0;
+    }
+
+    int StartFile(const std::string& path, int period_ms){
+      if (!Claim()) return -1;
+      thread_ = std::thread(&Exporter::FileLoop, this, path, period_ms);
+      return 0;
+    }
+
+    void Stop(){
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      wake_.notify_all();
+      if (thread_.joinable()) thread_.join();
+      std::lock_guard<std::mutex> lock(mutex_);
+      running_ = false;
+    }
+
+  private:
+    // only one exporter per process
+    bool Claim(){
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (running_){
+        std::cout << "Metrics exporter already running." << std::endl;
+        return false;
+      }
+      running_ = true;
+      stop_ = false;
+      return true;
+    }
+
+    bool Stopped(){
+      std::lock_guard<std::mutex> lock(mutex_);
+      return stop_;
+    }
+
+    // one request per connection, the metrics are rendered on this thread only
+    void ServeLoop(int listen_fd){
+      pollfd poll_fd;
+      poll_fd.fd = listen_fd;
+      poll_fd.events = POLLIN;
+      while (!Stopped()){
+        if (poll(&poll_fd, 1, 200) <= 0) continue;
+        int client = accept(listen_fd, nullptr, nullptr);
+        if (client < 0) continue;
+        timeval timeout = {0, 200000};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        char request[2048];
+        if (recv(client, request, sizeof(request), 0) > 0){
+          std::string body = Registry().RenderPrometheus();
+          std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                                 + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+          size_t sent = 0;
+          while (sent < response.size()){
+            ssize_t n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            sent += size_t(n);
+          }
+        }
+        close(client);
+      }
+      close(listen_fd);
+    }
+
+    void FileLoop(const std::string& path, int period_ms){
+      std::string tmp_path = path + ".tmp";
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!stop_){
+        lock.unlock();
+        std::string body = Registry().RenderPrometheus();
+        FILE* file = fopen(tmp_path.c_str(), "w");
+        if (file != nullptr){
+          fwrite(body.data(), 1, body.size(), file);
+          fclose(file);
+          rename(tmp_path.c_str(), path.c_str()); // readers never see a partial file
+        }
+        lock.lock();
+        wake_.wait_for(lock, std::chrono::milliseconds(period_ms), [&](){ return stop_; });
+      }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::thread thread_;
+    bool running_ = false;
+    bool stop_ = false;
+};
+
+Exporter& GetExporter(){
+  static Exporter* exporter = [](){
+    Exporter* instance = new Exporter();
+    std::atexit(StopExporter);
+    return instance;
+  }();
+  return *exporter;
+}
+
+} // namespace
+
+int StartHttpExporter(int port){
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0){
+    std::cout << "Create metrics socket failed." << std::endl;
+    return -1;
+  }
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(uint16_t(port));
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 4) != 0){
+    std::cout << "Bind metrics endpoint 127.0.0.1:" << port << " failed." << std::endl;
+    close(fd);
+    return -1;
+  }
+  return GetExporter().StartSocket(fd);
+}
+
+int StartUnixSocketExporter(const std::string& path){
+  sockaddr_un addr;
+  if (path.size() >= sizeof(addr.sun_path)){
+    std::cout << "Metrics socket path too long: " << path << std::endl;
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0){
+    std::cout << "Create metrics socket failed." << std::endl;
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  unlink(path.c_str()); // stale socket of a previous run
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 4) != 0){
+    std::cout << "Bind metrics endpoint " << path << " failed." << std::endl;
+    close(fd);
+    return -1;
+  }
+  return GetExporter().StartSocket(fd);
+}
+
+int StartFileExporter(const std::string& path, int period_ms){
+  if (period_ms <= 0){
+    std::cout << "Invalid metrics file period: " << period_ms << std::endl;
+    return -1;
+  }
+  return GetExporter().StartFile(path, period_ms);
+}
+
+int StartExporterFromEnv(){
+  const char* config = std::getenv("ODOMETRY_METRICS");
+  if (config == nullptr || config[0] == '\0') return 0;
+  std::string value(config);
+  if (value.compare(0, 5, "http:") == 0){
+    return StartHttpExporter(std::atoi(value.c_str() + 5));
+  } else if (value.compare(0, 5, "unix:") == 0){
+    return StartUnixSocketExporter(value.substr(5));
+  } else if (value.compare(0, 5, "file:") == 0){
+    std::string path = value.substr(5);
+    int period_ms = 1000;
+    size_t colon = path.rfind(':');
+    if (colon != std::string::npos){
+      period_ms = std::atoi(path.c_str() + colon + 1);
+      path = path.substr(0, colon);
+    }
+    return StartFileExporter(path, period_ms);
+  }
+  std::cout << "Unknown ODOMETRY_METRICS=" << value << ", expected http:<port>, unix:<path> or file:<path>[:<ms>]" << std::endl;
+  return -1;
+}
+
+void StopExporter(){
+  GetExporter().Stop();
+}
+
+} // namespace metrics
+} // namespace odometry
@@ -0,0 +1,227 @@
+// The file contains the feature based pose initialization defined in ODOMETRY_POSE_INITIALIZER_H
+
+#include <pose_initializer.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <Eigen/Dense>
+#include <se3.hpp>
+#include <image_processing_global.h>
+#include <simd_dispatch.h>
+
+namespace odometry
+{
+
+namespace
+{
+
+// KLT window radius and Gauss-Newton steps per pyramid level
+const int kKltRadius = 3;
+const int kKltIterations = 10;
+
+// project the point p (camera frame) with camera {fx, fy, cx, cy}
+Eigen::Vector2f Project(const Eigen::Vector3f& p, const float* camera){
+  return Eigen::Vector2f(camera[0] * p(0) / p(2) + camera[2], camera[1] * p(1) / p(2) + camera[3]);
+}
+
+// Gauss-Newton on the reprojection error of the points (camera 1) observed at obs (pixels of camera 2), left increments
+// of the twist as the photometric optimization. only the points listed in ids are used
+void RefinePose(const std::vector<Eigen::Vector3f>& points, const std::vector<Eigen::Vector2f>& obs,
+                const std::vector<int>& ids, const float* camera, int iterations, Sophus::SE3<float>& pose){
+  for (int it = 0; it < iterations; it++){
+    Eigen::Matrix<float, 6, 6> jtj = Eigen::Matrix<float, 6, 6>::Zero();
+    Eigen::Matrix<float, 6, 1> jtr = Eigen::Matrix<float, 6, 1>::Zero();
+    for (int id : ids){
+      Eigen::Vector3f p = pose * points[id];
+      if (p(2) <= 0.0f) continue;
+      float inv_z = 1.0f / p(2);
+      Eigen::Vector2f r = Project(p, camera) - obs[id];
+      Eigen::Matrix<float, 2, 6> jaco;
+      jaco << camera[0] * inv_z, 0.0f, -camera[0] * p(0) * inv_z * inv_z,
+              -camera[0] * p(0) * p(1) * inv_z * inv_z, camera[0] * (1.0f + p(0) * p(0) * inv_z * inv_z), -camera[0] * p(1) * inv_z,
+              0.0f, camera[1] * inv_z, -camera[1] * p(1) * inv_z * inv_z,
+              -camera[1] * (1.0f + p(1) * p(1) * inv_z * inv_z), camera[1] * p(0) * p(1) * inv_z * inv_z, camera[1] * p(0) * inv_z;
+      jtj += jaco.transpose() * jaco;
+      jtr += jaco.transpose() * r;
+    }
+    Eigen::Matrix<float, 6, 1> delta = jtj.ldlt().solve(-jtr);
+    if (!delta.allFinite()) return;
+    pose = Sophus::SE3<float>::exp(delta) * pose;
+    if (delta.squaredNorm() < 1e-12f) return;
+  }
+}
+
+// ids of the points with a reprojection error below threshold
+void FindInliers(const std::vector<Eigen::Vector3f>& points, const std::vector<Eigen::Vector2f>& obs,
+                 const float* camera, float threshold, const Sophus::SE3<float>& pose, std::vector<int>& inliers){
+  inliers.clear();
+  for (int i = 0; i < int(points.size()); i++){
+    Eigen::Vector3f p = pose * points[i];
+    if (p(2) > 0.0f && (Project(p, camera) - obs[i]).squaredNorm() < threshold * threshold) inliers.push_back(i);
+  }
+}
+
+} // namespace
+
+void DetectFastCorners(const cv::Mat& img, float threshold, int cell, int border, std::vector<cv::Point>& corners){
+  corners.clear();
+  border = std::max(border, 3);
+  cell = std::max(cell, 1);
+  const SimdKernels& kernels = GetSimdKernels();
+  int stride = int(img.step / sizeof(float));
+  int num_cells = (img.cols - 2 * border + cell - 1) / cell;
+  std::vector<float> scores(img.cols), best_scores(std::max(num_cells, 0));
+  std::vector<cv::Point> best(best_scores.size());
+  for (int cell_y = border; cell_y < img.rows - border; cell_y += cell){
+    std::fill(best_scores.begin(), best_scores.end(), 0.0f);
+    for (int y = cell_y; y < std::min(cell_y + cell, img.rows - border); y++){
+      kernels.fast_score_row(img.ptr<float>(y), stride, img.cols, threshold, scores.data());
+      for (int c = 0; c < num_cells; c++){
+        int cell_x = border + c * cell;
+        for (int x = cell_x; x < std::min(cell_x + cell, img.cols - border); x++){
+          if (scores[x] > best_scores[c]){
+            best_scores[c] = scores[x];
+            best[c] = cv::Point(x, y);
+          }
+        }
+      }
+    }
+    for (int c = 0; c < num_cells; c++){
+      if (best_scores[c] > 0.0f) corners.push_back(best[c]);
+    }
+  }
+}
+
+PoseInitializer::PoseInitializer(int level, float fast_threshold, int cell, int ransac_iterations,
+                                 float inlier_threshold, int min_inliers,
+                                 const std::shared_ptr<CameraPyramid>& kCameraPtr){
+  level_ = level;
+  fast_threshold_ = fast_threshold;
+  cell_ = cell;
+  ransac_iterations_ = ransac_iterations;
+  inlier_threshold_ = inlier_threshold;
+  min_inliers_ = std::max(min_inliers, 4);
+  num_tracked_ = 0;
+  num_inliers_ = 0;
+  if (kCameraPtr == NULL)
+    std::cout << "Pose initializer failed! Invalid camera pointer!" << std::endl;
+  else
+    camera_ptr_ = kCameraPtr;
+}
+
+GlobalStatus PoseInitializer::EstimatePose(const ImagePyramid& kImagePyr1, const DepthPyramid& kDepthPyr1,
+                                           const ImagePyramid& kImagePyr2, const Affine4f& kPrior, Affine4f& seed){
+  num_tracked_ = 0;
+  num_inliers_ = 0;
+  int num_levels = kImagePyr1.GetNumberLevels();
+  if (level_ >= num_levels || kImagePyr2.GetNumberLevels() != num_levels){
+    std::cout << "Pyramid levels don't match in PoseInitializer::EstimatePose()." << std::endl;
+    return -1;
+  }
+  if (kImagePyr1.GetStorage() != kStorageFloat32 || kImagePyr2.GetStorage() != kStorageFloat32){
+    std::cout << "Compact image pyramids are not supported in PoseInitializer::EstimatePose()." << std::endl;
+    return -1;
+  }
+  float camera[4];
+  GetCameraLevel(camera_ptr_, level_, camera);
+
+  // corners with a valid inverse depth, their points in camera 1 and the projections by the prior as initial guess
+  const cv::Mat& kImg1 = kImagePyr1.GetPyramidImage(level_);
+  const cv::Mat& kDep1 = kDepthPyr1.GetPyramidDepth(level_);
+  DetectFastCorners(kImg1, fast_threshold_, cell_, kKltMaxRadius + 2, corners_);
+  Sophus::SE3<float> prior(kPrior);
+  std::vector<Eigen::Vector3f> points;
+  x1_.clear();
+  y1_.clear();
+  x2_.clear();
+  y2_.clear();
+  for (const cv::Point& corner : corners_){
+    float inv_depth = kDep1.at<float>(corner.y, corner.x);
+    if (std::fabs(inv_depth) < 0.01f) continue; // same invalid depth as the tracking
+    float z = 1.0f / inv_depth;
+    Eigen::Vector3f point(z * (float(corner.x) - camera[2]) / camera[0], z * (float(corner.y) - camera[3]) / camera[1], z);
+    Eigen::Vector3f warped = prior * point;
+    if (warped(2) <= 0.0f) continue;
+    Eigen::Vector2f guess = Project(warped, camera);
+    points.push_back(point);
+    x1_.push_back(float(corner.x));
+    y1_.push_back(float(corner.y));
+    x2_.push_back(guess(0));
+    y2_.push_back(guess(1));
+  }
+  int num = int(points.size());
+  if (num < min_inliers_) return -1;
+
+  // coarse to fine tracking, the coordinates of level l + 1 are half the ones of level l (pyrDown)
+  const SimdKernels& kernels = GetSimdKernels();
+  status_.resize(num);
+  level_x1_.resize(num);
+  level_y1_.resize(num);
+  float scale = 1.0f / float(1 << (num_levels - 1 - level_));
+  for (int i = 0; i < num; i++){
+    x2_[i] *= scale;
+    y2_[i] *= scale;
+  }
+  for (int l = num_levels - 1; l >= level_; l--){
+    const cv::Mat& kLevelImg1 = kImagePyr1.GetPyramidImage(l);
+    const cv::Mat& kLevelImg2 = kImagePyr2.GetPyramidImage(l);
+    for (int i = 0; i < num; i++){
+      level_x1_[i] = x1_[i] * scale;
+      level_y1_[i] = y1_[i] * scale;
+    }
+    kernels.klt_track(kLevelImg1.ptr<float>(), kLevelImg2.ptr<float>(), int(kLevelImg1.step / sizeof(float)),
+                      kLevelImg1.rows, kLevelImg1.cols, level_x1_.data(), level_y1_.data(), num, kKltRadius,
+                      kKltIterations, x2_.data(), y2_.data(), status_.data());
+    if (l > level_){
+      for (int i = 0; i < num; i++){
+        x2_[i] *= 2.0f;
+        y2_[i] *= 2.0f;
+      }
+      scale *= 2.0f;
+    }
+  }
+  std::vector<Eigen::Vector3f> tracked_points;
+  std::vector<Eigen::Vector2f> obs;
+  for (int i = 0; i < num; i++){
+    if (status_[i] == 0) continue;
+    tracked_points.push_back(points[i]);
+    obs.emplace_back(x2_[i], y2_[i]);
+  }
+  num_tracked_ = int(obs.size());
+  if (num_tracked_ < min_inliers_) return -1;
+
+  // RANSAC: 4 point hypotheses refined from the prior, deterministic for reproducible tracking. stops early once an
+  // all-inlier sample was drawn with 99% probability for the best inlier ratio so far
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<int> dist(0, num_tracked_ - 1);
+  std::vector<int> sample(4), inliers, best_inliers;
+  Sophus::SE3<float> best_pose = prior;
+  int num_hypotheses = ransac_iterations_;
+  for (int it = 0; it < num_hypotheses; it++){
+    for (int k = 0; k < 4; k++){
+      do{
+        sample[k] = dist(rng);
+      } while (std::find(sample.begin(), sample.begin() + k, sample[k]) != sample.begin() + k);
+    }
+    Sophus::SE3<float> pose = prior;
+    RefinePose(tracked_points, obs, sample, camera, 5, pose);
+    FindInliers(tracked_points, obs, camera, inlier_threshold_, pose, inliers);
+    if (inliers.size() > best_inliers.size()){
+      best_inliers.swap(inliers);
+      best_pose = pose;
+      double ratio = double(best_inliers.size()) / double(num_tracked_);
+      double needed = std::log(0.01) / std::log(1.0 - ratio * ratio * ratio * ratio);
+      if (needed < double(num_hypotheses)) num_hypotheses = int(std::ceil(needed));
+    }
+  }
+  if (int(best_inliers.size()) < min_inliers_) return -1;
+  RefinePose(tracked_points, obs, best_inliers, camera, 10, best_pose);
+  FindInliers(tracked_points, obs, camera, inlier_threshold_, best_pose, inliers);
+  num_inliers_ = int(inliers.size());
+  if (num_inliers_ < min_inliers_) return -1;
+  seed = best_pose.matrix();
+  return 0;
+}
+
+} // namespace odometry
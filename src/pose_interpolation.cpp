@@ -0,0 +1,127 @@
+// The file contains the pose queries defined in ODOMETRY_POSE_INTERPOLATION_H
+
+#include <pose_interpolation.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <Eigen/Geometry>
+#include <se3.hpp>
+#include <interpolate.hpp>
+
+namespace odometry
+{
+
+namespace
+{
+
+struct StampedPose{
+  double timestamp;
+  float data[8]; // quaternion x, y, z, w, translation, padding
+};
+
+void Pack(const StampedPose& pose, uint64_t* words){
+  std::memcpy(words, &pose.timestamp, sizeof(double));
+  std::memcpy(words + 1, pose.data, sizeof(pose.data));
+}
+
+void Unpack(const uint64_t* words, StampedPose& pose){
+  std::memcpy(&pose.timestamp, words, sizeof(double));
+  std::memcpy(pose.data, words + 1, sizeof(pose.data));
+}
+
+double Timestamp(uint64_t word){
+  double timestamp;
+  std::memcpy(&timestamp, &word, sizeof(double));
+  return timestamp;
+}
+
+Sophus::SE3<float> ToSE3(const StampedPose& pose){
+  Eigen::Quaternionf rotation(pose.data[3], pose.data[0], pose.data[1], pose.data[2]);
+  return Sophus::SE3<float>(rotation, Eigen::Vector3f(pose.data[4], pose.data[5], pose.data[6]));
+}
+
+} // namespace
+
+PoseInterpolator::PoseInterpolator(int history, double max_extrapolation){
+  history_ = std::max(history, 2);
+  max_extrapolation_ = max_extrapolation;
+  words_.reset(new std::atomic<uint64_t>[size_t(history_) * kWords]);
+  for (int i = 0; i < history_ * kWords; i++) words_[i].store(0, std::memory_order_relaxed);
+  version_.store(0, std::memory_order_relaxed);
+  count_.store(0, std::memory_order_relaxed);
+}
+
+GlobalStatus PoseInterpolator::Add(double timestamp, const Affine4f& pose){
+  uint64_t count = count_.load(std::memory_order_relaxed); // single writer
+  if (count > 0 && !(timestamp > Timestamp(words_[size_t((count - 1) % history_) * kWords].load(std::memory_order_relaxed)))){
+    std::cout << "Pose timestamps must increase in PoseInterpolator." << std::endl;
+    return -1;
+  }
+  StampedPose stamped;
+  stamped.timestamp = timestamp;
+  Eigen::Quaternionf rotation(Eigen::Matrix3f(pose.block<3,3>(0,0)));
+  rotation.normalize();
+  stamped.data[0] = rotation.x();
+  stamped.data[1] = rotation.y();
+  stamped.data[2] = rotation.z();
+  stamped.data[3] = rotation.w();
+  stamped.data[4] = pose(0,3);
+  stamped.data[5] = pose(1,3);
+  stamped.data[6] = pose(2,3);
+  stamped.data[7] = 0.0f;
+  uint64_t words[kWords];
+  Pack(stamped, words);
+  uint64_t version = version_.load(std::memory_order_relaxed);
+  version_.store(version + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release); // the odd version is visible before the slot changes
+  std::atomic<uint64_t>* slot = words_.get() + size_t(count % history_) * kWords;
+  for (int i = 0; i < kWords; i++) slot[i].store(words[i], std::memory_order_relaxed);
+  count_.store(count + 1, std::memory_order_relaxed);
+  version_.store(version + 2, std::memory_order_release);
+  return 0;
+}
+
+GlobalStatus PoseInterpolator::PoseAt(double timestamp, Affine4f& pose, bool* extrapolated) const{
+  StampedPose at, other; // at: the newest pose at or before timestamp, other: the next one, or the one before at
+  bool interpolate, has_other;
+  while (true){
+    uint64_t version = version_.load(std::memory_order_acquire);
+    if (version & 1) continue; // a pose is added
+    uint64_t count = count_.load(std::memory_order_relaxed);
+    if (count == 0) return -1;
+    uint64_t oldest = count > uint64_t(history_) ? count - history_ : 0;
+    // usually one of the newest poses
+    uint64_t i = count - 1;
+    while (i > oldest && Timestamp(words_[size_t(i % history_) * kWords].load(std::memory_order_relaxed)) > timestamp) i--;
+    interpolate = i + 1 < count;
+    has_other = interpolate || i > oldest;
+    uint64_t other_index = interpolate ? i + 1 : i - 1;
+    uint64_t words[kWords];
+    for (int k = 0; k < kWords; k++) words[k] = words_[size_t(i % history_) * kWords + k].load(std::memory_order_relaxed);
+    Unpack(words, at);
+    if (has_other){
+      for (int k = 0; k < kWords; k++){
+        words[k] = words_[size_t(other_index % history_) * kWords + k].load(std::memory_order_relaxed);
+      }
+      Unpack(words, other);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire); // the slots are read before the version is checked
+    if (version_.load(std::memory_order_relaxed) == version) break;
+  }
+  if (timestamp < at.timestamp) return -1; // before the oldest pose
+  if (!interpolate && timestamp - at.timestamp > max_extrapolation_) return -1;
+  Sophus::SE3<float> result = ToSE3(at);
+  if (interpolate){
+    float ratio = float((timestamp - at.timestamp) / (other.timestamp - at.timestamp));
+    result = Sophus::interpolate(result, ToSE3(other), ratio);
+  } else if (has_other && timestamp > at.timestamp){
+    // constant velocity of the last motion
+    float ratio = float((timestamp - at.timestamp) / (at.timestamp - other.timestamp));
+    result = result * Sophus::SE3<float>::exp(ratio * (ToSE3(other).inverse() * result).log());
+  }
+  if (extrapolated != nullptr) *extrapolated = !interpolate && timestamp > at.timestamp;
+  pose = result.matrix();
+  return 0;
+}
+
+} // namespace odometry
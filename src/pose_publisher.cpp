@@ -0,0 +1,85 @@
+// The file contains the latest pose publication defined in ODOMETRY_POSE_PUBLISHER_H
+
+#include <pose_publisher.h>
+#include <algorithm>
+#include <cstring>
+
+namespace odometry
+{
+
+PosePublisher::PosePublisher(){
+  for (Slot& slot : slots_){
+    slot.version.store(0, std::memory_order_relaxed);
+    for (auto& word : slot.words) word.store(0, std::memory_order_relaxed);
+  }
+  published_.store(0, std::memory_order_relaxed);
+}
+
+void PosePublisher::Publish(const PoseSample& sample){
+  uint64_t words[kWords];
+  uint64_t sequence = published_.load(std::memory_order_relaxed) + 1; // single writer
+  uint64_t status = uint64_t(sample.status);
+  std::memcpy(words, sample.pose.data(), 16 * sizeof(float));
+  std::memcpy(words + 8, sample.covariance.data(), 36 * sizeof(float));
+  std::memcpy(words + 26, &sample.timestamp, sizeof(double));
+  words[27] = sample.frame_id;
+  words[28] = status;
+  words[29] = sequence;
+  Slot& slot = slots_[(sequence - 1) % kPoseSlots];
+  uint64_t version = slot.version.load(std::memory_order_relaxed);
+  slot.version.store(version + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release); // the odd version is visible before the words change
+  for (int i = 0; i < kWords; i++){
+    slot.words[i].store(words[i], std::memory_order_relaxed);
+  }
+  slot.version.store(version + 2, std::memory_order_release);
+  published_.store(sequence, std::memory_order_release);
+
+  std::lock_guard<std::mutex> lock(subscribers_mutex_);
+  if (subscribers_.empty()) return;
+  PoseSample published = sample;
+  published.sequence = sequence;
+  for (auto& subscriber : subscribers_){
+    subscriber.second(published);
+  }
+}
+
+GlobalStatus PosePublisher::Latest(PoseSample& sample) const{
+  uint64_t words[kWords];
+  while (true){
+    uint64_t sequence = published_.load(std::memory_order_acquire);
+    if (sequence == 0) return -1;
+    const Slot& slot = slots_[(sequence - 1) % kPoseSlots];
+    uint64_t version = slot.version.load(std::memory_order_acquire);
+    if (version & 1) continue; // the writer wrapped around, the slot is written again
+    for (int i = 0; i < kWords; i++){
+      words[i] = slot.words[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire); // the words are read before the version is checked
+    if (slot.version.load(std::memory_order_relaxed) == version) break;
+  }
+  std::memcpy(sample.pose.data(), words, 16 * sizeof(float));
+  std::memcpy(sample.covariance.data(), words + 8, 36 * sizeof(float));
+  std::memcpy(&sample.timestamp, words + 26, sizeof(double));
+  sample.frame_id = words[27];
+  sample.status = TrackingStatus(words[28]);
+  sample.sequence = words[29];
+  return 0;
+}
+
+int PosePublisher::Subscribe(std::function<void(const PoseSample&)> callback){
+  std::lock_guard<std::mutex> lock(subscribers_mutex_);
+  subscribers_.emplace_back(next_subscriber_, std::move(callback));
+  return next_subscriber_++;
+}
+
+GlobalStatus PosePublisher::Unsubscribe(int id){
+  std::lock_guard<std::mutex> lock(subscribers_mutex_);
+  auto it = std::find_if(subscribers_.begin(), subscribers_.end(),
+                         [&](const std::pair<int, std::function<void(const PoseSample&)>>& s){ return s.first == id; });
+  if (it == subscribers_.end()) return -1;
+  subscribers_.erase(it);
+  return 0;
+}
+
+} // namespace odometry
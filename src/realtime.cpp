@@ -0,0 +1,130 @@
+// The file contains the real-time mode defined in ODOMETRY_REALTIME_H
+
+#include <realtime.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread_pool.h>
+#ifdef __linux__
+#include <dirent.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace odometry
+{
+
+namespace
+{
+
+#ifdef __linux__
+// see set_mempolicy(2), numaif.h is part of libnuma
+const int kMpolPreferred = 1;
+#endif
+
+} // namespace
+
+GlobalStatus LockMemory(){
+#ifdef __linux__
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0){
+    std::cout << "Lock memory failed: " << std::strerror(errno) << " (needs CAP_IPC_LOCK or memlock limit)." << std::endl;
+    return -1;
+  }
+#ifdef __GLIBC__
+  // only with locked memory: keep the freed memory in the heap, no trimming, no mmap() per large block, which are
+  // unmapped on free() and faulted in again
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+#endif
+  return 0;
+#else
+  std::cout << "Lock memory not supported on this platform." << std::endl;
+  return -1;
+#endif
+}
+
+int NumaNodeOfCore(int core){
+#ifdef __linux__
+  std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(core);
+  DIR* dir = opendir(path.c_str());
+  if (dir == nullptr) return 0;
+  int node = 0;
+  while (dirent* entry = readdir(dir)){
+    if (std::strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9'){
+      node = std::atoi(entry->d_name + 4);
+      break;
+    }
+  }
+  closedir(dir);
+  return node;
+#else
+  return 0;
+#endif
+}
+
+GlobalStatus SetThreadRealtime(int core, bool numa_local, int fifo_priority){
+  GlobalStatus status = 0;
+#ifdef __linux__
+  if (core >= 0){
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (error != 0){
+      std::cout << "Pin thread to core " << core << " failed: " << std::strerror(error) << "." << std::endl;
+      status = -1;
+    } else if (numa_local){
+      int node = NumaNodeOfCore(core);
+      unsigned long mask = 1ul << node;
+      // maxnode counts one bit more than the kernel reads
+      if (node >= int(8 * sizeof(mask)) - 1 ||
+          syscall(SYS_set_mempolicy, kMpolPreferred, &mask, 8 * sizeof(mask)) != 0){
+        std::cout << "Set memory of core " << core << " to NUMA node " << node << " failed: " << std::strerror(errno)
+                  << "." << std::endl;
+        status = -1;
+      }
+    }
+  }
+  if (fifo_priority > 0){
+    sched_param param;
+    param.sched_priority = fifo_priority;
+    int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (error != 0){
+      std::cout << "Set SCHED_FIFO priority " << fifo_priority << " failed: " << std::strerror(error)
+                << " (needs CAP_SYS_NICE or rtprio limit)." << std::endl;
+      status = -1;
+    }
+  }
+#else
+  if (core >= 0 || fifo_priority > 0){
+    std::cout << "Real-time thread settings not supported on this platform." << std::endl;
+    status = -1;
+  }
+#endif
+  return status;
+}
+
+GlobalStatus EnableRealtime(const RealtimeConfig& config, int num_threads){
+  GlobalStatus status = 0;
+  if (config.lock_memory && LockMemory() == -1) status = -1;
+  if (SetThreadRealtime(config.driver_core, config.numa_local, config.fifo_priority) == -1) status = -1;
+  RealtimeConfig worker_config = config;
+  auto worker_init = [worker_config](int index){
+    int core = worker_config.worker_cores.empty() ? -1 :
+               worker_config.worker_cores[index % worker_config.worker_cores.size()];
+    SetThreadRealtime(core, worker_config.numa_local, worker_config.fifo_priority);
+  };
+  if (ConfigureDefaultThreadPool(num_threads > 0 ? num_threads : DefaultNumThreads(), worker_init) == -1){
+    std::cout << "Real-time workers failed: the thread pool is running already." << std::endl;
+    status = -1;
+  }
+  return status;
+}
+
+} // namespace odometry
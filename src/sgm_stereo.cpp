@@ -0,0 +1,163 @@
+// The file contains the dense stereo mode defined in ODOMETRY_SGM_STEREO_H
+
+#include <sgm_stereo.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <image_processing_global.h>
+#include <logging.h>
+#include <metrics.h>
+#include <simd_dispatch.h>
+#include <thread_pool.h>
+
+namespace odometry
+{
+
+SgmStereo::SgmStereo(int num_disp, int num_paths, int p1, int p2, float uniqueness, float min_depth, float max_depth,
+                     int num_bands, const std::shared_ptr<CameraPyramid>& left_cam_ptr, float baseline){
+  if (num_disp <= 0 || num_disp % kSgmDisparityStep != 0){
+    std::cout << "Number of disparities must be a multiple of " << kSgmDisparityStep << " in SgmStereo." << std::endl;
+    num_disp = std::max(kSgmDisparityStep, (num_disp + kSgmDisparityStep - 1) / kSgmDisparityStep * kSgmDisparityStep);
+  }
+  num_disp_ = num_disp;
+  num_paths_ = num_paths == 4 ? 4 : 8;
+  p1_ = (unsigned short)p1;
+  p2_ = (unsigned short)p2;
+  uniqueness_ = uniqueness;
+  min_depth_ = min_depth;
+  max_depth_ = max_depth;
+  num_bands_ = std::max(num_bands, 1);
+  baseline_ = baseline;
+  bands_.resize(num_bands_);
+  if (left_cam_ptr == NULL)
+    std::cout << "SGM stereo failed! Invalid camera pointer!" << std::endl;
+  else
+    camera_ptr_ = left_cam_ptr;
+}
+
+GlobalStatus SgmStereo::ComputeDepth(const cv::Mat& left_img, const cv::Mat& right_img, cv::Mat& left_val,
+                                     cv::Mat& left_disp, cv::Mat& left_dep){
+  if ((left_img.rows != right_img.rows) || (left_img.cols != right_img.cols) || left_img.step != right_img.step){
+    std::cout << "Number of rows/cols do not match for left/right images." << std::endl;
+    return -1;
+  }
+  if ((left_img.type() != PixelType) || right_img.type() != PixelType){
+    std::cout << "Pixel type of left/right images not 32-bit float." << std::endl;
+    return -1;
+  }
+  static metrics::Histogram& latency = metrics::Registry().GetHistogram("odometry_stage_latency_seconds",
+          "Latency of the pipeline stages.", metrics::LatencyBuckets(), "stage=\"dense_stereo\"");
+  static metrics::Gauge& valid_points = metrics::Registry().GetGauge("odometry_depth_valid_points",
+          "Valid depth points of the last frame.");
+  metrics::ScopedLatency timer(latency);
+  left_val.create(left_img.rows, left_img.cols, CV_8U);
+  left_disp.create(left_img.rows, left_img.cols, PixelType);
+  left_dep.create(left_img.rows, left_img.cols, PixelType);
+  int rows = left_img.rows;
+  DefaultThreadPool().ParallelFor(0, num_bands_, 1, [&](int band_begin, int band_end){
+    for (int b = band_begin; b < band_end; b++){
+      ComputeBand(left_img, right_img, rows * b / num_bands_, rows * (b + 1) / num_bands_, bands_[b],
+                  left_val, left_disp, left_dep);
+    }
+  }, kPriorityNormal, "stereo");
+  int num_valid = cv::countNonZero(left_val);
+  valid_points.Set(num_valid);
+  LOG_INFO("dense stereo valid depth: {}", num_valid);
+  return 0;
+}
+
+void SgmStereo::ComputeBand(const cv::Mat& left_img, const cv::Mat& right_img, int y_begin, int y_end, Band& band,
+                            cv::Mat& left_val, cv::Mat& left_disp, cv::Mat& left_dep){
+  const SimdKernels& kernels = GetSimdKernels();
+  int rows = left_img.rows, cols = left_img.cols;
+  int stride = int(left_img.step / sizeof(float));
+  // the census needs 2 rows above and below
+  int out_begin = std::max(y_begin, 2), out_end = std::min(y_end, rows - 2);
+  for (int y = y_begin; y < y_end; y++){
+    if (y >= out_begin && y < out_end) continue;
+    std::fill(left_val.ptr<uint8_t>(y), left_val.ptr<uint8_t>(y) + cols, 0);
+    std::fill(left_disp.ptr<float>(y), left_disp.ptr<float>(y) + cols, 0.0f);
+    std::fill(left_dep.ptr<float>(y), left_dep.ptr<float>(y) + cols, 0.0f);
+  }
+  if (out_begin >= out_end) return;
+  int ext_begin = std::max(out_begin - kSgmBandOverlap, 2), ext_end = std::min(out_end + kSgmBandOverlap, rows - 2);
+  int num_ext = ext_end - ext_begin;
+  const int kRowCosts = cols * num_disp_;
+  const int kRowPaths = cols * (num_disp_ + 2);
+
+  // census and matching costs of all rows of the band
+  band.census_left.resize(cols);
+  band.census_right.resize(cols);
+  band.scratch.resize(cols + num_disp_);
+  band.cost.resize(size_t(num_ext) * kRowCosts);
+  for (int y = ext_begin; y < ext_end; y++){
+    kernels.census_row(left_img.ptr<float>(y), stride, cols, band.census_left.data());
+    kernels.census_row(right_img.ptr<float>(y), stride, cols, band.census_right.data());
+    kernels.sgm_cost_row(band.census_left.data(), band.census_right.data(), cols, num_disp_, band.scratch.data(),
+                         band.cost.data() + size_t(y - ext_begin) * kRowCosts);
+  }
+
+  // aggregation: downwards (left to right, vertical, diagonals), then upwards (right to left, ...). the rows outside
+  // of [out_begin, out_end) only propagate the paths, their sums go to the last row of sum which is cleared afterwards
+  int num_out = out_end - out_begin;
+  band.sum.assign(size_t(num_out + 1) * kRowCosts, 0);
+  int num_row_paths = num_paths_ == 8 ? 3 : 1; // vertical (and diagonal) paths
+  const int kDx[3] = {0, 1, -1};
+  band.paths.resize(size_t(1 + 2 * num_row_paths) * kRowPaths);
+  for (int direction = 0; direction < 2; direction++){
+    for (int i = 0; i < num_ext; i++){
+      int y = direction == 0 ? ext_begin + i : ext_end - 1 - i;
+      const unsigned char* cost = band.cost.data() + size_t(y - ext_begin) * kRowCosts;
+      bool output = y >= out_begin && y < out_end;
+      unsigned short* sum = band.sum.data() + size_t(output ? y - out_begin : num_out) * kRowCosts;
+      kernels.sgm_aggregate_row(cost, cols, num_disp_, direction == 0 ? 1 : -1, nullptr, band.paths.data(), sum,
+                                p1_, p2_);
+      for (int k = 0; k < num_row_paths; k++){
+        unsigned short* cur = band.paths.data() + size_t(1 + 2 * k + (i & 1)) * kRowPaths;
+        const unsigned short* prev = band.paths.data() + size_t(1 + 2 * k + ((i + 1) & 1)) * kRowPaths;
+        int dx = direction == 0 ? kDx[k] : -kDx[k];
+        kernels.sgm_aggregate_row(cost, cols, num_disp_, i == 0 ? 0 : dx, i == 0 ? nullptr : prev, cur, sum, p1_, p2_);
+      }
+    }
+  }
+
+  // winner takes all and left-right consistency: a left match is kept if the best left match of its right pixel
+  // (smallest aggregated cost) has the same disparity within 1 pixel
+  float camera[4];
+  GetCameraLevel(camera_ptr_, 0, camera);
+  float fx = camera[0]; // in pixels
+  float min_disp = fx * baseline_ / max_depth_, max_disp = fx * baseline_ / min_depth_;
+  band.disparity.resize(cols);
+  band.right_disparity.resize(cols);
+  band.right_sum.resize(cols);
+  for (int y = out_begin; y < out_end; y++){
+    const unsigned short* sum = band.sum.data() + size_t(y - out_begin) * kRowCosts;
+    kernels.sgm_select_row(sum, cols, num_disp_, uniqueness_, band.disparity.data());
+    std::fill(band.right_disparity.begin(), band.right_disparity.end(), -1.0f);
+    std::fill(band.right_sum.begin(), band.right_sum.end(), (unsigned short)0xffff);
+    for (int x = 0; x < cols; x++){
+      float disp = band.disparity[x];
+      int right_x = x - int(disp + 0.5f);
+      if (disp < 0.0f || right_x < 0) continue;
+      unsigned short cost = sum[x * num_disp_ + std::min(int(disp + 0.5f), num_disp_ - 1)];
+      if (cost < band.right_sum[right_x]){
+        band.right_sum[right_x] = cost;
+        band.right_disparity[right_x] = disp;
+      }
+    }
+    uint8_t* val_row = left_val.ptr<uint8_t>(y);
+    float* disp_row = left_disp.ptr<float>(y);
+    float* dep_row = left_dep.ptr<float>(y);
+    for (int x = 0; x < cols; x++){
+      float disp = band.disparity[x];
+      int right_x = x - int(disp + 0.5f);
+      bool valid = x >= 2 && x < cols - 2 && disp >= min_disp && disp <= max_disp && disp > 0.0f && right_x >= 0 &&
+                   std::fabs(band.right_disparity[right_x] - disp) <= 1.0f;
+      val_row[x] = valid ? 1 : 0;
+      disp_row[x] = valid ? disp : 0.0f;
+      dep_row[x] = valid ? disp / (fx * baseline_) : 0.0f;
+    }
+  }
+}
+
+} // namespace odometry
@@ -0,0 +1,90 @@
+// The file contains the CPUID based selection of the SIMD kernel variants declared in ODOMETRY_SIMD_DISPATCH_H
+
+#include <simd_dispatch.h>
+#include <cpuid.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace odometry
+{
+// kernel tables defined by the per-ISA translation units
+namespace simd
+{
+namespace scalar { const SimdKernels& GetKernelTable(); }
+namespace sse42 { const SimdKernels& GetKernelTable(); }
+namespace avx2 { const SimdKernels& GetKernelTable(); }
+namespace avx512 { const SimdKernels& GetKernelTable(); }
+} // namespace simd
+
+// extended control register 0, tells which register states the OS saves on context switches
+static unsigned long long ReadXcr0(){
+  unsigned int eax, edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (static_cast<unsigned long long>(edx) << 32) | eax;
+}
+
+SimdLevel DetectSimdLevel(){
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return kSimdScalar;
+  bool has_sse42 = (ecx & bit_SSE4_2) != 0;
+  bool has_fma = (ecx & bit_FMA) != 0;
+  bool has_f16c = (ecx & bit_F16C) != 0;
+  bool has_avx = (ecx & bit_AVX) != 0;
+  bool has_osxsave = (ecx & bit_OSXSAVE) != 0;
+  unsigned long long xcr0 = has_osxsave ? ReadXcr0() : 0;
+  bool os_ymm = (xcr0 & 0x6) == 0x6;     // xmm + ymm state
+  bool os_zmm = (xcr0 & 0xe6) == 0xe6;   // xmm + ymm + opmask + zmm state
+
+  bool has_avx2 = false;
+  bool has_avx512 = false;
+  if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)){
+    has_avx2 = (ebx & bit_AVX2) != 0;
+    has_avx512 = (ebx & bit_AVX512F) && (ebx & bit_AVX512BW) && (ebx & bit_AVX512DQ) && (ebx & bit_AVX512VL);
+  }
+
+  if (has_avx512 && has_avx2 && has_fma && has_f16c && os_zmm)
+    return kSimdAvx512;
+  if (has_avx2 && has_avx && has_fma && has_f16c && os_ymm)
+    return kSimdAvx2;
+  if (has_sse42)
+    return kSimdSse42;
+  return kSimdScalar;
+}
+
+const SimdKernels* GetSimdKernels(SimdLevel level){
+  if (level > DetectSimdLevel())
+    return nullptr;
+  switch (level){
+    case kSimdAvx512: return &simd::avx512::GetKernelTable();
+    case kSimdAvx2: return &simd::avx2::GetKernelTable();
+    case kSimdSse42: return &simd::sse42::GetKernelTable();
+    default: return &simd::scalar::GetKernelTable();
+  }
+}
+
+// select the kernels once: detected level, capped by ODOMETRY_SIMD if set
+static const SimdKernels& SelectSimdKernels(){
+  SimdLevel level = DetectSimdLevel();
+  const char* request = std::getenv("ODOMETRY_SIMD");
+  if (request != nullptr){
+    SimdLevel cap = level;
+    if (std::strcmp(request, "scalar") == 0) cap = kSimdScalar;
+    else if (std::strcmp(request, "sse4.2") == 0) cap = kSimdSse42;
+    else if (std::strcmp(request, "avx2") == 0) cap = kSimdAvx2;
+    else if (std::strcmp(request, "avx512") == 0) cap = kSimdAvx512;
+    else std::cout << "Unknown ODOMETRY_SIMD=" << request << ", ignored." << std::endl;
+    level = (cap < level) ? cap : level;
+  }
+  const SimdKernels* kernels = GetSimdKernels(level);
+  std::cout << "SIMD kernels: " << kernels->name << std::endl;
+  return *kernels;
+}
+
+const SimdKernels& GetSimdKernels(){
+  static const SimdKernels& kernels = SelectSimdKernels();
+  return kernels;
+}
+
+} // namespace odometry
@@ -0,0 +1,8 @@
+// The file contains the AVX2 variants of the hot kernels, the only file compiled with -mavx2 -mfma.
+// The kernel bodies are shared by all instruction sets, see simd_kernels_impl.h.
+
+#define ODOMETRY_SIMD_AVX2
+#define ODOMETRY_SIMD_NS avx2
+#define ODOMETRY_SIMD_LEVEL kSimdAvx2
+#define ODOMETRY_SIMD_NAME "avx2"
+#include <simd_kernels_impl.h>
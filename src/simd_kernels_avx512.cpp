@@ -0,0 +1,8 @@
+// The file contains the AVX-512 variants of the hot kernels, the only file compiled with -mavx512f -mavx512bw -mavx512dq -mavx512vl.
+// The kernel bodies are shared by all instruction sets, see simd_kernels_impl.h.
+
+#define ODOMETRY_SIMD_AVX512
+#define ODOMETRY_SIMD_NS avx512
+#define ODOMETRY_SIMD_LEVEL kSimdAvx512
+#define ODOMETRY_SIMD_NAME "avx512"
+#include <simd_kernels_impl.h>
@@ -0,0 +1,8 @@
+// The file contains the scalar reference variants of the hot kernels, compiled for the x86-64 baseline. Always available.
+// The kernel bodies are shared by all instruction sets, see simd_kernels_impl.h.
+
+#define ODOMETRY_SIMD_SCALAR
+#define ODOMETRY_SIMD_NS scalar
+#define ODOMETRY_SIMD_LEVEL kSimdScalar
+#define ODOMETRY_SIMD_NAME "scalar"
+#include <simd_kernels_impl.h>
@@ -0,0 +1,8 @@
+// The file contains the SSE4.2 variants of the hot kernels, the only file compiled with -msse4.2.
+// The kernel bodies are shared by all instruction sets, see simd_kernels_impl.h.
+
+#define ODOMETRY_SIMD_SSE42
+#define ODOMETRY_SIMD_NS sse42
+#define ODOMETRY_SIMD_LEVEL kSimdSse42
+#define ODOMETRY_SIMD_NAME "sse4.2"
+#include <simd_kernels_impl.h>
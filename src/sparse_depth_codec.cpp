@@ -0,0 +1,127 @@
+// The file contains the sparse depth encoding defined in ODOMETRY_SPARSE_DEPTH_CODEC_H
+
+#include <sparse_depth_codec.h>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+namespace odometry
+{
+
+namespace
+{
+
+// magic, rows, cols, number of valid pixels, step
+const size_t kHeaderBytes = sizeof(kSparseDepthMagic) + 3 * sizeof(int32_t) + sizeof(float);
+// limit of a valid map, a corrupted size must not allocate the memory
+const int kMaxImageSize = 1 << 15;
+
+} // namespace
+
+SparseDepthCodec::SparseDepthCodec(float step, const SimdKernels* kernels){
+  step_ = step;
+  kernels_ = (kernels != nullptr) ? kernels : &GetSimdKernels();
+}
+
+GlobalStatus SparseDepthCodec::Encode(const cv::Mat& inv_depth, const cv::Mat& valid, std::vector<unsigned char>& data){
+  if (inv_depth.type() != CV_32F || valid.type() != CV_8U || inv_depth.rows != valid.rows || inv_depth.cols != valid.cols){
+    std::cout << "Sparse depth encoding needs a CV_32F inverse depth and a CV_8U mask of the same size!" << std::endl;
+    return -1;
+  }
+  if (!(step_ > 0.0f)){
+    std::cout << "Sparse depth step must be positive: " << step_ << std::endl;
+    return -1;
+  }
+  const int rows = inv_depth.rows, cols = inv_depth.cols;
+  xs_.resize(size_t(cols));
+  positions_.clear();
+  // the values are written behind the header in place, the positions appended at the end
+  data.resize(kHeaderBytes + 2 * size_t(cols));
+  const float scale = 1.0f / step_;
+  size_t count = 0;
+  long long previous = -1; // row major index of the previous valid pixel
+  for (int y = 0; y < rows; y++){
+    if (data.size() < kHeaderBytes + 2 * (count + size_t(cols))) data.resize(2 * data.size() + 2 * size_t(cols));
+    unsigned short* quantized = reinterpret_cast<unsigned short*>(data.data() + kHeaderBytes) + count;
+    int num = kernels_->sparse_encode_row(inv_depth.ptr<float>(y), valid.ptr<uint8_t>(y), cols, scale, xs_.data(),
+                                          quantized);
+    for (int i = 0; i < num; i++){
+      long long index = (long long)y * cols + xs_[i];
+      long long run = index - previous - 1;
+      for (; run >= 255; run -= 255) positions_.push_back(255);
+      positions_.push_back((unsigned char)run);
+      previous = index;
+    }
+    count += size_t(num);
+  }
+  data.resize(kHeaderBytes + 2 * count);
+  data.insert(data.end(), positions_.begin(), positions_.end());
+  int32_t header[3] = {rows, cols, int32_t(count)};
+  std::memcpy(data.data(), kSparseDepthMagic, sizeof(kSparseDepthMagic));
+  std::memcpy(data.data() + sizeof(kSparseDepthMagic), header, sizeof(header));
+  std::memcpy(data.data() + sizeof(kSparseDepthMagic) + sizeof(header), &step_, sizeof(float));
+  return 0;
+}
+
+GlobalStatus SparseDepthCodec::Decode(const unsigned char* data, size_t size, cv::Mat& inv_depth, cv::Mat& valid){
+  if (size < kHeaderBytes || std::memcmp(data, kSparseDepthMagic, sizeof(kSparseDepthMagic)) != 0){
+    std::cout << "no sparse depth data!" << std::endl;
+    return -1;
+  }
+  int32_t header[3];
+  float step;
+  std::memcpy(header, data + sizeof(kSparseDepthMagic), sizeof(header));
+  std::memcpy(&step, data + sizeof(kSparseDepthMagic) + sizeof(header), sizeof(float));
+  const int rows = header[0], cols = header[1];
+  const long long count = header[2];
+  if (rows < 0 || cols < 0 || rows > kMaxImageSize || cols > kMaxImageSize || count < 0 ||
+      count > (long long)rows * cols || !(step > 0.0f) || size < kHeaderBytes + 2 * size_t(count)){
+    std::cout << "invalid sparse depth data!" << std::endl;
+    return -1;
+  }
+  inv_depth.create(rows, cols, CV_32F);
+  valid.create(rows, cols, CV_8U);
+  for (int y = 0; y < rows; y++){
+    std::memset(inv_depth.ptr<float>(y), 0, sizeof(float) * size_t(cols));
+    std::memset(valid.ptr<uint8_t>(y), 0, size_t(cols));
+  }
+  xs_.resize(size_t(cols));
+  const unsigned short* quantized = reinterpret_cast<const unsigned short*>(data + kHeaderBytes);
+  const unsigned char* position = data + kHeaderBytes + 2 * size_t(count);
+  const unsigned char* end = data + size;
+  const long long num_pixels = (long long)rows * cols;
+  long long previous = -1;
+  int y = 0, num = 0; // row and valid pixels of the row decoded so far
+  for (long long i = 0; i < count; i++){
+    long long run = 0;
+    unsigned char byte = 255;
+    while (byte == 255 && position < end){
+      byte = *position++;
+      run += byte;
+    }
+    long long index = previous + run + 1;
+    if (byte == 255 || index >= num_pixels){
+      std::cout << "invalid sparse depth data: position " << i << " cut or out of the map!" << std::endl;
+      return -1;
+    }
+    int row = int(index / cols);
+    if (row != y){
+      kernels_->sparse_decode_row(quantized, xs_.data(), num, step, inv_depth.ptr<float>(y));
+      quantized += num;
+      num = 0;
+      y = row;
+    }
+    int x = int(index - (long long)row * cols);
+    xs_[num++] = x;
+    valid.ptr<uint8_t>(y)[x] = 1;
+    previous = index;
+  }
+  if (num > 0) kernels_->sparse_decode_row(quantized, xs_.data(), num, step, inv_depth.ptr<float>(y));
+  if (position != end){
+    std::cout << "invalid sparse depth data: " << (end - position) << " bytes behind the positions!" << std::endl;
+    return -1;
+  }
+  return 0;
+}
+
+} // namespace odometry
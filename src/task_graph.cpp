@@ -0,0 +1,314 @@
+// The file contains the task graph defined in ODOMETRY_TASK_GRAPH_H
+
+#include <task_graph.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+
+namespace odometry
+{
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+double Seconds(Clock::time_point begin, Clock::time_point end){
+  return std::max(std::chrono::duration<double>(end - begin).count(), 0.0);
+}
+
+// dependency of a node on a node of another graph, see TaskGraph::After()
+const int kExternalDependency = -2;
+
+} // namespace
+
+struct TaskGraph::State{
+  struct Node{
+    std::string name;
+    std::function<GlobalStatus()> fn;
+    TaskPriority priority;
+    std::vector<int> successors;
+    std::vector<std::pair<std::shared_ptr<State>, int>> external_successors;
+    int pending = 0; // dependencies not done
+    bool skip = false; // a dependency failed
+    bool done = false;
+    bool ok = false;
+    int last_dependency = -1; // finished last, -1: none, kExternalDependency: another graph
+    Clock::time_point dependency_end; // end of last_dependency
+    Clock::time_point begin;
+    Clock::time_point end;
+  };
+
+  std::mutex mutex;
+  std::condition_variable changed; // a node got ready or all nodes are done
+  std::vector<Node> nodes;
+  std::vector<int> ready; // ready nodes not claimed by a thread yet
+  ThreadPool* pool = nullptr;
+  bool started = false;
+  bool failed = false;
+  int num_done = 0;
+  Clock::time_point start;
+
+  // queue a helper task running node, unless a waiting thread claims it first
+  void Queue(const std::shared_ptr<State>& self, int node){
+    TaskPriority priority;
+    const char* type;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      priority = nodes[node].priority;
+      type = nodes[node].name.c_str();
+    }
+    pool->Submit([self, node](){ self->RunNode(self, node); }, priority, type);
+  }
+
+  // run node if it is still ready and unclaimed
+  void RunNode(const std::shared_ptr<State>& self, int node){
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto it = std::find(ready.begin(), ready.end(), node);
+      if (it == ready.end()) return;
+      ready.erase(it);
+    }
+    Execute(self, node);
+  }
+
+  void Execute(const std::shared_ptr<State>& self, int node){
+    Node& n = nodes[node]; // fn, skip and the times of a claimed node are touched by this thread only
+    n.begin = Clock::now();
+    n.ok = !n.skip && n.fn() != -1;
+    n.end = Clock::now();
+    if (!n.ok && !n.skip) std::cout << "Task graph node " << n.name << " failed." << std::endl;
+    Finish(self, node);
+  }
+
+  void Finish(const std::shared_ptr<State>& self, int node){
+    std::vector<int> now_ready;
+    std::vector<std::pair<std::shared_ptr<State>, int>> external;
+    bool ok;
+    Clock::time_point end;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      Node& n = nodes[node];
+      n.done = true;
+      ok = n.ok;
+      end = n.end;
+      failed = failed || !ok;
+      num_done++;
+      for (int successor : n.successors){
+        Release(successor, node, ok, end, now_ready);
+      }
+      external.swap(n.external_successors);
+      ready.insert(ready.end(), now_ready.begin(), now_ready.end());
+    }
+    changed.notify_all();
+    for (int successor : now_ready){
+      Queue(self, successor);
+    }
+    for (auto& successor : external){
+      successor.first->ReleaseExternal(successor.first, successor.second, ok, end);
+    }
+  }
+
+  // under mutex: dependency of node done
+  void Release(int node, int dependency, bool ok, Clock::time_point end, std::vector<int>& now_ready){
+    Node& n = nodes[node];
+    n.skip = n.skip || !ok;
+    if (n.last_dependency == -1 || end > n.dependency_end){
+      n.last_dependency = dependency;
+      n.dependency_end = end;
+    }
+    if (--n.pending == 0 && started) now_ready.push_back(node);
+  }
+
+  void ReleaseExternal(const std::shared_ptr<State>& self, int node, bool ok, Clock::time_point end){
+    std::vector<int> now_ready;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      Release(node, kExternalDependency, ok, end, now_ready);
+      ready.insert(ready.end(), now_ready.begin(), now_ready.end());
+    }
+    if (now_ready.empty()) return;
+    changed.notify_all();
+    Queue(self, node);
+  }
+};
+
+TaskGraph::TaskGraph(): state_(std::make_shared<State>()){}
+
+TaskGraph::~TaskGraph(){
+  bool running;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    running = state_->started && state_->num_done < int(state_->nodes.size());
+  }
+  if (running) Wait();
+}
+
+int TaskGraph::AddNode(const char* name, std::function<GlobalStatus()> fn, const std::vector<int>& deps,
+                       TaskPriority priority){
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  int node = int(state_->nodes.size());
+  if (state_->started){
+    std::cout << "Add node " << name << " to a started task graph failed!" << std::endl;
+    return -1;
+  }
+  for (int dep : deps){
+    if (dep < 0 || dep >= node){
+      std::cout << "Invalid dependency of task graph node " << name << "!" << std::endl;
+      return -1;
+    }
+  }
+  state_->nodes.emplace_back();
+  State::Node& n = state_->nodes.back();
+  n.name = name;
+  n.fn = std::move(fn);
+  n.priority = priority;
+  n.pending = int(deps.size());
+  for (int dep : deps){
+    state_->nodes[dep].successors.push_back(node);
+  }
+  return node;
+}
+
+GlobalStatus TaskGraph::After(int node, TaskGraph& previous, int previous_node){
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (state_->started || node < 0 || node >= int(state_->nodes.size())){
+      std::cout << "Invalid task graph dependency!" << std::endl;
+      return -1;
+    }
+    state_->nodes[node].pending++;
+  }
+  bool valid = true, done = false, ok = false;
+  Clock::time_point end;
+  {
+    std::lock_guard<std::mutex> lock(previous.state_->mutex);
+    if (previous_node >= 0 && previous_node < int(previous.state_->nodes.size())){
+      State::Node& n = previous.state_->nodes[previous_node];
+      done = n.done;
+      ok = n.ok;
+      end = n.end;
+      if (!done) n.external_successors.emplace_back(state_, node);
+    } else {
+      // an invalid node of the previous graph never finishes: treat it as failed
+      valid = false;
+      done = true;
+      end = Clock::now();
+    }
+  }
+  if (done) state_->ReleaseExternal(state_, node, ok, end);
+  if (!valid){
+    std::cout << "Invalid task graph dependency!" << std::endl;
+    return -1;
+  }
+  return 0;
+}
+
+void TaskGraph::Start(ThreadPool& pool){
+  std::vector<int> now_ready;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (state_->started) return;
+    state_->started = true;
+    state_->pool = &pool;
+    state_->start = Clock::now();
+    for (int i = 0; i < int(state_->nodes.size()); i++){
+      if (state_->nodes[i].pending == 0) now_ready.push_back(i);
+    }
+    state_->ready = now_ready;
+  }
+  for (int node : now_ready){
+    state_->Queue(state_, node);
+  }
+}
+
+GlobalStatus TaskGraph::Wait(){
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  if (!state_->started){
+    std::cout << "Wait for a task graph not started!" << std::endl;
+    return -1;
+  }
+  while (state_->num_done < int(state_->nodes.size())){
+    if (state_->ready.empty()){
+      state_->changed.wait(lock);
+      continue;
+    }
+    // highest priority first, as the scheduler would
+    auto it = std::min_element(state_->ready.begin(), state_->ready.end(), [&](int a, int b){
+      return state_->nodes[a].priority < state_->nodes[b].priority;
+    });
+    int node = *it;
+    state_->ready.erase(it);
+    lock.unlock();
+    state_->Execute(state_, node);
+    lock.lock();
+  }
+  return state_->failed ? -1 : 0;
+}
+
+double TaskGraph::LatencySeconds() const{
+  double latency = 0.0;
+  for (const auto& n : state_->nodes){
+    latency = std::max(latency, Seconds(state_->start, n.end));
+  }
+  return latency;
+}
+
+std::vector<int> TaskGraph::CriticalPath() const{
+  std::vector<int> path;
+  int node = -1;
+  for (int i = 0; i < int(state_->nodes.size()); i++){
+    if (node == -1 || state_->nodes[i].end > state_->nodes[node].end) node = i;
+  }
+  while (node >= 0){
+    path.push_back(node);
+    node = state_->nodes[node].last_dependency;
+  }
+  std::reverse(path.begin(), path.end());
+  return path;
+}
+
+std::string TaskGraph::CriticalPathReport() const{
+  const double kMinGapSeconds = 1e-4; // gaps below are not reported
+  std::vector<int> path = CriticalPath();
+  char buffer[64];
+  std::snprintf(buffer, sizeof(buffer), "critical path %.1f ms:", LatencySeconds() * 1e3);
+  std::string report(buffer);
+  Clock::time_point previous_end = state_->start;
+  for (size_t i = 0; i < path.size(); i++){
+    const State::Node& n = state_->nodes[path[i]];
+    if (i == 0 && n.last_dependency == kExternalDependency){
+      double wait = Seconds(state_->start, n.dependency_end);
+      if (wait >= kMinGapSeconds){
+        std::snprintf(buffer, sizeof(buffer), " wait %.1f ms >", wait * 1e3);
+        report += buffer;
+      }
+      previous_end = std::max(previous_end, n.dependency_end);
+    }
+    double queue = Seconds(previous_end, n.begin);
+    if (queue >= kMinGapSeconds){
+      std::snprintf(buffer, sizeof(buffer), " queue %.1f ms >", queue * 1e3);
+      report += buffer;
+    }
+    std::snprintf(buffer, sizeof(buffer), " %s %.1f ms%s", n.name.c_str(), Seconds(n.begin, n.end) * 1e3,
+                  n.skip ? " (skipped)" : "");
+    report += buffer;
+    if (i + 1 < path.size()) report += " >";
+    previous_end = n.end;
+  }
+  return report;
+}
+
+const std::string& TaskGraph::NodeName(int node) const{
+  return state_->nodes[node].name;
+}
+
+double TaskGraph::NodeSeconds(int node) const{
+  const State::Node& n = state_->nodes[node];
+  return n.skip ? 0.0 : Seconds(n.begin, n.end);
+}
+
+} // namespace odometry
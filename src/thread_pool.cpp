@@ -0,0 +1,235 @@
+// The file contains the task scheduler defined in ODOMETRY_THREAD_POOL_H
+
+#include <thread_pool.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <metrics.h>
+
+namespace odometry
+{
+
+namespace
+{
+
+// the pool and the index of the worker running on this thread, -1 outside of any pool
+thread_local const ThreadPool* tls_pool = nullptr;
+thread_local int tls_worker = -1;
+
+// state of one ParallelFor, shared with its helper tasks: a helper that starts after the last chunk was taken returns
+// without touching fn, which may be gone by then
+struct Loop{
+  const std::function<void(int, int)>* fn;
+  int begin;
+  int end;
+  int grain;
+  int num_chunks;
+  std::atomic<int> next_chunk{0};
+  std::mutex mutex;
+  std::condition_variable done;
+  int chunks_done = 0; // under mutex
+
+  void RunChunks(){
+    int chunk, num_run = 0;
+    while ((chunk = next_chunk.fetch_add(1, std::memory_order_relaxed)) < num_chunks){
+      int chunk_begin = begin + chunk * grain;
+      (*fn)(chunk_begin, std::min(chunk_begin + grain, end));
+      num_run++;
+    }
+    if (num_run == 0) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    chunks_done += num_run;
+    if (chunks_done == num_chunks) done.notify_all();
+  }
+};
+
+std::mutex default_pool_mutex;
+int default_pool_threads = 0; // set by ConfigureDefaultThreadPool()
+std::function<void(int)> default_pool_init;
+ThreadPool* default_pool = nullptr;
+
+} // namespace
+
+struct ThreadPool::TypeCounters{
+  std::string type;
+  metrics::Counter* tasks;
+  metrics::Counter* busy_us;
+};
+
+ThreadPool::ThreadPool(int num_threads, const std::function<void(int)>& worker_init){
+  int num_workers = std::max(num_threads, 1) - 1;
+  for (int i = 0; i <= num_workers; i++){
+    queues_.emplace_back(new Queues());
+  }
+  for (int i = 0; i < num_workers; i++){
+    workers_.emplace_back(&ThreadPool::WorkerLoop, this, i, worker_init);
+  }
+}
+
+ThreadPool::~ThreadPool(){
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (auto& worker : workers_){
+    worker.join();
+  }
+}
+
+void ThreadPool::ParallelFor(int begin, int end, int grain, const std::function<void(int, int)>& fn,
+                             TaskPriority priority, const char* type){
+  if (end <= begin) return;
+  grain = std::max(grain, 1);
+  int num_chunks = (end - begin + grain - 1) / grain;
+  int type_index = TypeIndex(type);
+  // serial: nothing to share
+  if (workers_.empty() || num_chunks == 1){
+    Run([&](){ fn(begin, end); }, type_index);
+    return;
+  }
+  std::shared_ptr<Loop> loop = std::make_shared<Loop>();
+  loop->fn = &fn;
+  loop->begin = begin;
+  loop->end = end;
+  loop->grain = grain;
+  loop->num_chunks = num_chunks;
+  int num_helpers = std::min(num_chunks, NumThreads()) - 1;
+  for (int i = 0; i < num_helpers; i++){
+    Push(Task{[loop](){ loop->RunChunks(); }, type_index}, priority);
+  }
+  Run([&](){ loop->RunChunks(); }, type_index);
+  // the chunks taken by the helpers are running already, they never wait for this thread
+  std::unique_lock<std::mutex> lock(loop->mutex);
+  loop->done.wait(lock, [&](){ return loop->chunks_done == num_chunks; });
+}
+
+void ThreadPool::Submit(std::function<void()> task, TaskPriority priority, const char* type){
+  int type_index = TypeIndex(type);
+  if (workers_.empty()){
+    Run(task, type_index);
+    return;
+  }
+  Push(Task{std::move(task), type_index}, priority);
+}
+
+void ThreadPool::Push(Task task, TaskPriority priority){
+  int index = (tls_pool == this) ? tls_worker : int(workers_.size());
+  {
+    std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+    queues_[index]->tasks[priority].push_back(std::move(task));
+  }
+  {
+    // under sleep_mutex_: a worker between its last Take() and its wait sees the task
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    queued_.fetch_add(1, std::memory_order_relaxed);
+  }
+  wake_.notify_one();
+}
+
+bool ThreadPool::Take(int index, Task& task){
+  int num_queues = int(queues_.size());
+  for (int priority = 0; priority < kNumTaskPriorities; priority++){
+    for (int i = 0; i < num_queues; i++){
+      // own deque, shared queue, then the other workers
+      int victim = (i == 0) ? index : (i == 1) ? num_queues - 1 : (index + i - 1) % (num_queues - 1);
+      if (i > 0 && victim == index) continue;
+      Queues& queues = *queues_[victim];
+      std::lock_guard<std::mutex> lock(queues.mutex);
+      std::deque<Task>& tasks = queues.tasks[priority];
+      if (tasks.empty()) continue;
+      if (victim == index){
+        task = std::move(tasks.back());
+        tasks.pop_back();
+      } else {
+        task = std::move(tasks.front());
+        tasks.pop_front();
+      }
+      queued_.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::Run(const std::function<void()>& fn, int type){
+  auto begin = std::chrono::steady_clock::now();
+  fn();
+  auto end = std::chrono::steady_clock::now();
+  TypeCounters* counters;
+  {
+    std::lock_guard<std::mutex> lock(types_mutex_);
+    counters = types_[type].get();
+  }
+  counters->tasks->Inc();
+  counters->busy_us->Inc(uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()));
+}
+
+int ThreadPool::TypeIndex(const char* type){
+  std::lock_guard<std::mutex> lock(types_mutex_);
+  for (int i = 0; i < int(types_.size()); i++){
+    if (types_[i]->type == type) return i;
+  }
+  std::string labels = std::string("type=\"") + type + "\"";
+  TypeCounters* counters = new TypeCounters();
+  counters->type = type;
+  counters->tasks = &metrics::Registry().GetCounter("odometry_scheduler_tasks_total",
+                                                    "Tasks and loops run by the scheduler.", labels);
+  counters->busy_us = &metrics::Registry().GetCounter("odometry_scheduler_busy_microseconds_total",
+                                                      "Busy time of the scheduler threads.", labels);
+  types_.emplace_back(counters);
+  return int(types_.size()) - 1;
+}
+
+std::vector<ThreadPool::TypeStats> ThreadPool::Stats() const{
+  std::lock_guard<std::mutex> lock(types_mutex_);
+  std::vector<TypeStats> stats;
+  for (const auto& counters : types_){
+    stats.push_back(TypeStats{counters->type, (unsigned long)counters->tasks->Value(), counters->busy_us->Value() * 1e-6});
+  }
+  return stats;
+}
+
+void ThreadPool::WorkerLoop(int index, std::function<void(int)> worker_init){
+  tls_pool = this;
+  tls_worker = index;
+  if (worker_init) worker_init(index);
+  Task task;
+  while (true){
+    if (Take(index, task)){
+      Run(task.fn, task.type);
+      task.fn = nullptr;
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    wake_.wait(lock, [&](){ return stop_ || queued_.load(std::memory_order_relaxed) > 0; });
+    if (stop_ && queued_.load(std::memory_order_relaxed) == 0) return;
+  }
+}
+
+int DefaultNumThreads(){
+  const char* env = std::getenv("ODOMETRY_THREADS");
+  if (env != nullptr && std::atoi(env) > 0) return std::atoi(env);
+  return std::max(int(std::thread::hardware_concurrency()), 1);
+}
+
+ThreadPool& DefaultThreadPool(){
+  std::lock_guard<std::mutex> lock(default_pool_mutex);
+  if (default_pool == nullptr){
+    int num_threads = default_pool_threads > 0 ? default_pool_threads : DefaultNumThreads();
+    // leaked on purpose: workers must not be joined during static destruction
+    default_pool = new ThreadPool(num_threads, default_pool_init);
+  }
+  return *default_pool;
+}
+
+int ConfigureDefaultThreadPool(int num_threads, const std::function<void(int)>& worker_init){
+  if (num_threads < 1) return -1;
+  std::lock_guard<std::mutex> lock(default_pool_mutex);
+  if (default_pool != nullptr) return default_pool->NumThreads() == num_threads && !worker_init ? 0 : -1;
+  default_pool_threads = num_threads;
+  default_pool_init = worker_init;
+  return 0;
+}
+
+} // namespace odometry
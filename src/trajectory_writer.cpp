@@ -0,0 +1,264 @@
+// The file contains the streaming trajectory sink defined in ODOMETRY_TRAJECTORY_WRITER_H
+
+#include <trajectory_writer.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <Eigen/Geometry>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace odometry
+{
+
+namespace
+{
+
+const uint64_t kPow10[10] = {1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull,
+                             1000000000ull};
+
+void PackRecord(const TrajectoryRecord& record, char* bytes){
+  uint32_t status = uint32_t(record.status), reserved = 0;
+  std::memcpy(bytes, &record.frame_id, 8);
+  std::memcpy(bytes + 8, &record.timestamp, 8);
+  std::memcpy(bytes + 16, record.pose.data(), 48);
+  std::memcpy(bytes + 64, &status, 4);
+  std::memcpy(bytes + 68, &reserved, 4);
+}
+
+void UnpackRecord(const char* bytes, TrajectoryRecord& record){
+  uint32_t status;
+  std::memcpy(&record.frame_id, bytes, 8);
+  std::memcpy(&record.timestamp, bytes + 8, 8);
+  std::memcpy(record.pose.data(), bytes + 16, 48);
+  std::memcpy(&status, bytes + 64, 4);
+  record.status = TrackingStatus(status);
+}
+
+// write all of data, retry on partial writes and signals
+GlobalStatus WriteAll(int fd, const char* data, size_t size){
+  while (size > 0){
+    ssize_t n = write(fd, data, size);
+    if (n < 0){
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    data += n;
+    size -= size_t(n);
+  }
+  return 0;
+}
+
+void AppendLine(const TrajectoryRecord& record, TrajectoryFormat format, std::string& buffer){
+  char tmp[32];
+  if (format == kTrajectoryKitti){
+    for (int i = 0; i < 12; i++){
+      buffer.append(tmp, size_t(FormatFixed(record.pose(i), 6, tmp)));
+      buffer += (i != 11) ? ' ' : '\n';
+    }
+  } else {
+    Eigen::Quaternionf rotation(Eigen::Matrix3f(record.pose.block<3,3>(0,0)));
+    rotation.normalize();
+    const float values[7] = {record.pose(0,3), record.pose(1,3), record.pose(2,3), rotation.x(), rotation.y(),
+                             rotation.z(), rotation.w()};
+    buffer.append(tmp, size_t(FormatFixed(record.timestamp, 6, tmp)));
+    for (int i = 0; i < 7; i++){
+      buffer += ' ';
+      buffer.append(tmp, size_t(FormatFixed(values[i], i < 3 ? 6 : 9, tmp)));
+    }
+    buffer += '\n';
+  }
+}
+
+} // namespace
+
+int FormatFixed(double value, int decimals, char* out){
+  decimals = std::min(std::max(decimals, 0), 9);
+  double scaled = std::fabs(value) * double(kPow10[decimals]) + 0.5;
+  if (!(scaled < 1e15)) return std::snprintf(out, 32, "%.17g", value); // also nan
+  uint64_t fixed = uint64_t(scaled);
+  uint64_t integer = fixed / kPow10[decimals], fraction = fixed % kPow10[decimals];
+  char digits[32];
+  int n = 0;
+  // digits in reverse: fraction, point, integer part
+  for (int i = 0; i < decimals; i++){
+    digits[n++] = char('0' + fraction % 10);
+    fraction /= 10;
+  }
+  if (decimals > 0) digits[n++] = '.';
+  do {
+    digits[n++] = char('0' + integer % 10);
+    integer /= 10;
+  } while (integer > 0);
+  int length = 0;
+  if (value < 0.0 && fixed > 0) out[length++] = '-';
+  while (n > 0) out[length++] = digits[--n];
+  return length;
+}
+
+GlobalStatus ReadTrajectoryLog(const std::string& file_name, std::vector<TrajectoryRecord>& records){
+  records.clear();
+  FILE* file = std::fopen(file_name.c_str(), "rb");
+  if (file == nullptr){
+    std::cout << "open trajectory log failed: " << file_name << std::endl;
+    return -1;
+  }
+  char magic[sizeof(kTrajectoryMagic)];
+  if (std::fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+      std::memcmp(magic, kTrajectoryMagic, sizeof(magic)) != 0){
+    std::cout << "no trajectory log: " << file_name << std::endl;
+    std::fclose(file);
+    return -1;
+  }
+  char bytes[kTrajectoryRecordBytes];
+  TrajectoryRecord record;
+  // a cut record at the end is not read completely
+  while (std::fread(bytes, 1, sizeof(bytes), file) == sizeof(bytes)){
+    UnpackRecord(bytes, record);
+    records.push_back(record);
+  }
+  std::fclose(file);
+  return 0;
+}
+
+TrajectoryWriter::TrajectoryWriter(double flush_interval){
+  flush_interval_ = flush_interval;
+  write_thread_ = std::thread(&TrajectoryWriter::WriteLoop, this);
+}
+
+TrajectoryWriter::~TrajectoryWriter(){
+  Close();
+}
+
+GlobalStatus TrajectoryWriter::Open(const std::string& file_name, TrajectoryFormat format, bool append){
+  int fd = open(file_name.c_str(), O_RDWR | O_CREAT | (append ? 0 : O_TRUNC), 0644);
+  if (fd < 0){
+    std::cout << "open trajectory file failed: " << file_name << std::endl;
+    return -1;
+  }
+  off_t size = lseek(fd, 0, SEEK_END);
+  const char* error = size < 0 ? "seek trajectory file failed: " : nullptr;
+  if (format == kTrajectoryBinary && size == 0){
+    if (WriteAll(fd, kTrajectoryMagic, sizeof(kTrajectoryMagic)) == -1) error = "write trajectory file failed: ";
+  } else if (format == kTrajectoryBinary && size > 0){
+    const off_t kHeader = off_t(sizeof(kTrajectoryMagic));
+    char magic[sizeof(kTrajectoryMagic)];
+    // drop a cut record of a crash, the next ones start at a record boundary
+    off_t complete = kHeader + (size - kHeader) / kTrajectoryRecordBytes * kTrajectoryRecordBytes;
+    if (pread(fd, magic, sizeof(magic), 0) != ssize_t(sizeof(magic)) ||
+        std::memcmp(magic, kTrajectoryMagic, sizeof(magic)) != 0){
+      error = "no trajectory log: ";
+    } else if (complete != size && (ftruncate(fd, complete) != 0 || lseek(fd, complete, SEEK_SET) != complete)){
+      error = "truncate trajectory log failed: ";
+    }
+  }
+  if (error != nullptr){
+    std::cout << error << file_name << std::endl;
+    close(fd);
+    return -1;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  sinks_.push_back(Sink{fd, format, file_name});
+  return 0;
+}
+
+void TrajectoryWriter::Append(const TrajectoryRecord& record){
+  std::lock_guard<std::mutex> lock(mutex_);
+  queue_.push_back(record);
+}
+
+void TrajectoryWriter::Append(const PoseSample& sample){
+  TrajectoryRecord record;
+  record.frame_id = sample.frame_id;
+  record.timestamp = sample.timestamp;
+  record.pose = sample.pose.block<3,4>(0,0);
+  record.status = sample.status;
+  Append(record);
+}
+
+GlobalStatus TrajectoryWriter::Flush(){
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!stopped_){
+    uint64_t request = ++flush_requested_;
+    wake_.notify_one();
+    written_.wait(lock, [&](){ return flush_done_ >= request || stopped_; });
+  }
+  return failed_ ? -1 : 0;
+}
+
+GlobalStatus TrajectoryWriter::Close(){
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_) return failed_ ? -1 : 0;
+    stopped_ = true;
+  }
+  wake_.notify_one();
+  write_thread_.join(); // writes the queue left
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const Sink& sink : sinks_){
+    if (close(sink.fd) != 0){
+      std::cout << "close trajectory file failed: " << sink.file_name << std::endl;
+      failed_ = true;
+    }
+  }
+  sinks_.clear();
+  return failed_ ? -1 : 0;
+}
+
+uint64_t TrajectoryWriter::Written() const{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return written_records_;
+}
+
+void TrajectoryWriter::WriteLoop(){
+  std::vector<TrajectoryRecord> records;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true){
+    wake_.wait_for(lock, std::chrono::duration<double>(flush_interval_),
+                   [&](){ return stopped_ || flush_requested_ != flush_done_; });
+    bool stop = stopped_;
+    uint64_t request = flush_requested_;
+    records.swap(queue_);
+    lock.unlock();
+    // Open() only adds sinks, the ones written here stay valid
+    GlobalStatus status = records.empty() ? 0 : WriteRecords(records);
+    lock.lock();
+    if (status == -1) failed_ = true;
+    else written_records_ += records.size();
+    records.clear();
+    flush_done_ = request;
+    written_.notify_all();
+    if (stop) break;
+  }
+}
+
+GlobalStatus TrajectoryWriter::WriteRecords(const std::vector<TrajectoryRecord>& records){
+  std::vector<Sink> sinks;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sinks = sinks_;
+  }
+  GlobalStatus status = 0;
+  for (const Sink& sink : sinks){
+    buffer_.clear();
+    if (sink.format == kTrajectoryBinary){
+      buffer_.resize(records.size() * kTrajectoryRecordBytes);
+      for (size_t i = 0; i < records.size(); i++) PackRecord(records[i], &buffer_[i * kTrajectoryRecordBytes]);
+    } else {
+      for (const TrajectoryRecord& record : records) AppendLine(record, sink.format, buffer_);
+    }
+    // data only sync: the size is synced with the data, the times are not needed
+    if (WriteAll(sink.fd, buffer_.data(), buffer_.size()) == -1 || fdatasync(sink.fd) != 0){
+      std::cout << "write trajectory file failed: " << sink.file_name << std::endl;
+      status = -1;
+    }
+  }
+  return status;
+}
+
+} // namespace odometry
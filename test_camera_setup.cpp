@@ -1,63 +1,69 @@
-// The file tests camera related operations
+// The file tests camera related operations on the bundled calibration file (calibration_file/camchain.yaml):
+//  * accuracy: raw intrinsics as calibrated, rectified stereo baseline, pyramid intrinsics, valid region
+//  * timing: stereo setup and undistort & rectify of one camera frame against the baseline, see test_utils.h
 // Created by Yu Wang on 2019-01-24.
 
 #include <iostream>
 #include <opencv2/core.hpp>
 #include "data_types.h"
 #include "camera.h"
-#include <typeinfo>
+#include "test_utils.h"
+
+namespace
+{
+
+// values of calibration_file/camchain.yaml
+const double kRawFxLeft = 427.32814323885566;
+const double kRawCxLeft = 367.1148716890002;
+const double kRawBaseline = 0.0604; // norm of T_cn_cnm1 translation, in meters
+
+} // namespace
 
 int main(){
-  // setup camera
-  std::string stereo_file = "../calibration_file/camchain.yaml";
+  std::cout << "test_camera_setup" << std::endl;
+  std::string stereo_file = HOME_DIR "/calibration_file/camchain.yaml";
   std::shared_ptr<odometry::CameraPyramid> cam_ptr_left, cam_ptr_right;
   cv::Rect valid_region;
-  double baseline, left_right_translate; // units are in [meter]
+  double baseline; // units are in [meter]
   const int levels = 4;
 
-  odometry::GlobalStatus setup_camera_status=-1;
+  odometry::GlobalStatus setup_camera_status = -1;
   setup_camera_status = odometry::SetUpStereoCameraSystem(stereo_file, levels, cam_ptr_left, cam_ptr_right, valid_region, baseline);
-  left_right_translate = - baseline;
-  if (setup_camera_status == -1){
-    std::cout << "Configure stereo camera system failed!" << std::endl;
-    exit(-1);
+  if (!odometry::test::Expect(setup_camera_status != -1, "configure stereo camera system")){
+    return odometry::test::Finish("test_camera_setup");
   }
-  std::cout << "******************** Before rectification *******************" << std::endl;
-  std::cout << "Cam left:" << std::endl;
-  std::cout << cam_ptr_left->get_intrinsic_raw() << std::endl;
-  std::cout << "distortion coeff: " << std::endl << cam_ptr_left->get_distortion_coeff() << std::endl;
-  std::cout << std::endl;
-
-  std::cout << "Cam right:" << std::endl;
-  std::cout << cam_ptr_right->get_intrinsic_raw() << std::endl;
-  std::cout << "distortion coeff: " << std::endl << cam_ptr_right->get_distortion_coeff() << std::endl;
-  std::cout << std::endl;
-
-  std::cout << "******************** After rectification *******************" << std::endl;
-  std::cout << "Cam left: " << std::endl;
-  std::cout << cam_ptr_left->get_intrinsic_rectified(0) << std::endl;
-  std::cout << "sensor_w: " << cam_ptr_left->sensor_w_double() << std::endl;
-  std::cout << "sensor_h: " << cam_ptr_left->sensor_h_double() << std::endl;
-  std::cout << "pixels_per_mm_x: " << cam_ptr_left->pixels_per_mm_x_double() << std::endl;
-  std::cout << "pixels_per_mm_y: " << cam_ptr_left->pixels_per_mm_y_double() << std::endl;
-  std::cout << "resolution_raw_w: " << cam_ptr_left->resolution_raw_w() << std::endl;
-  std::cout << "resolution_raw_h: " << cam_ptr_left->resolution_raw_h() << std::endl;
-  std::cout << std::endl;
-
-  std::cout << "Cam right: " << std::endl << cam_ptr_right->get_intrinsic_rectified(0) << std::endl;
-  std::cout << "sensor_w: " << cam_ptr_right->sensor_w_double() << std::endl;
-  std::cout << "sensor_h: " << cam_ptr_right->sensor_h_double() << std::endl;
-  std::cout << "pixels_per_mm_x: " << cam_ptr_right->pixels_per_mm_x_double() << std::endl;
-  std::cout << "pixels_per_mm_y: " << cam_ptr_right->pixels_per_mm_y_double() << std::endl;
-  std::cout << "resolution_raw_w: " << cam_ptr_right->resolution_raw_w() << std::endl;
-  std::cout << "resolution_raw_h: " << cam_ptr_right->resolution_raw_h() << std::endl;
-  std::cout << std::endl;
-
-  std::cout << "******************** Rectified Stereo *******************" << std::endl;
-  std::cout << "New baseline: " << baseline << std::endl;
-  std::cout << "Valid image region: " << valid_region << std::endl;
-
-  return 0;
 
-}
+  /******************************* ACCURACY ***********************************/
+  odometry::test::ExpectLessEqual(std::fabs(cam_ptr_left->get_intrinsic_raw().at<double>(0, 0) - kRawFxLeft), 1e-6, "raw fx error");
+  odometry::test::ExpectLessEqual(std::fabs(cam_ptr_left->get_intrinsic_raw().at<double>(0, 2) - kRawCxLeft), 1e-6, "raw cx error");
+  odometry::test::ExpectLessEqual(std::fabs(baseline - kRawBaseline), 1e-3, "rectified baseline error [m]");
+  // rectified cameras share one intrinsic matrix, each pyramid level halves the focal length
+  odometry::test::ExpectLessEqual(std::fabs(cam_ptr_left->fx_double(0) - cam_ptr_right->fx_double(0)), 1e-9, "left/right rectified fx difference");
+  odometry::test::ExpectLessEqual(std::fabs(cam_ptr_left->fx_double(0) - cam_ptr_left->fy_double(0)), 1e-9, "rectified fx - fy");
+  for (int l = 1; l < levels; l++){
+    odometry::test::ExpectLessEqual(std::fabs(cam_ptr_left->fx_double(l) * 2.0 - cam_ptr_left->fx_double(l - 1)), 1e-9,
+                                    "pyramid fx level " + std::to_string(l));
+  }
+  odometry::test::Expect(valid_region.x >= 0 && valid_region.y >= 0 && valid_region.width > 320 && valid_region.height > 240
+                         && valid_region.x + valid_region.width <= 640 && valid_region.y + valid_region.height <= 480,
+                         "valid region inside the image and covers most of it");
 
+  /******************************* TIMING ***********************************/
+  odometry::test::PerfGate gate;
+  gate.Check("camera.stereo_setup", odometry::test::MedianMs([&](){
+    std::shared_ptr<odometry::CameraPyramid> left, right;
+    cv::Rect region;
+    double b;
+    odometry::SetUpStereoCameraSystem(stereo_file, levels, left, right, region, b);
+  }, 5));
+  odometry::test::SyntheticTexture texture(3);
+  cv::Mat raw(480, 640, PixelType), rectified;
+  for (int y = 0; y < raw.rows; y++){
+    for (int x = 0; x < raw.cols; x++) raw.at<float>(y, x) = texture.At(float(x), float(y));
+  }
+  gate.Check("camera.undistort_rectify", odometry::test::MedianMs([&](){
+    cam_ptr_left->UndistortRectify(raw, rectified, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar());
+  }, 9));
+  gate.Save();
+  return odometry::test::Finish("test_camera_setup");
+}
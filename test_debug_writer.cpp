@@ -0,0 +1,169 @@
+// The file tests the background keyframe output of debug_writer.h: the raw and sparse files against the keyframe data,
+// the keyframe sampling and the dropping of keyframes that do not fit into the queue.
+// The files are written to test_debug/ in the working directory and removed at the end.
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <debug_writer.h>
+
+namespace
+{
+
+int num_failures = 0;
+
+void Check(bool ok, const std::string& test, const std::string& what){
+  if (!ok){
+    std::cout << "  [FAILED] " << test << ": " << what << std::endl;
+    num_failures++;
+  }
+}
+
+const char* kSubDirectories[] = {"gray_img_left", "mask_left", "disparity_left"};
+
+bool Exists(const std::string& file_name){
+  struct stat info;
+  return stat(file_name.c_str(), &info) == 0;
+}
+
+std::vector<char> ReadFile(const std::string& file_name){
+  std::vector<char> data;
+  FILE* file = std::fopen(file_name.c_str(), "rb");
+  if (file == nullptr) return data;
+  char buffer[4096];
+  size_t size;
+  while ((size = std::fread(buffer, 1, sizeof(buffer), file)) > 0) data.insert(data.end(), buffer, buffer + size);
+  std::fclose(file);
+  return data;
+}
+
+// a keyframe with a gradient image, every third pixel valid
+struct TestKeyframe{
+  cv::Mat gray, depth, valid;
+};
+
+TestKeyframe MakeKeyframe(int rows, int cols){
+  TestKeyframe keyframe;
+  keyframe.gray.create(rows, cols, CV_32F);
+  keyframe.depth.create(rows, cols, CV_32F);
+  keyframe.valid.create(rows, cols, CV_8U);
+  for (int y = 0; y < rows; y++){
+    for (int x = 0; x < cols; x++){
+      keyframe.gray.at<float>(y, x) = float((3 * x + 5 * y) % 256);
+      keyframe.depth.at<float>(y, x) = 0.01f * float(1 + (x + y) % 97);
+      keyframe.valid.at<uint8_t>(y, x) = uint8_t((x + 2 * y) % 3 == 0 ? 1 : 0);
+    }
+  }
+  return keyframe;
+}
+
+void RemoveFiles(int num_keyframes){
+  for (int i = 0; i < num_keyframes; i++){
+    for (const char* sub : kSubDirectories){
+      for (const char* ext : {".raw", ".png", ".spd"})
+        std::remove((std::string("test_debug/") + sub + "/" + std::to_string(i) + ext).c_str());
+    }
+  }
+}
+
+void TestRawAndSparse(){
+  TestKeyframe data = MakeKeyframe(48, 64);
+  odometry::ImagePyramid image({data.gray}, odometry::kStorageFloat32);
+  odometry::DepthPyramid depth(std::vector<cv::Mat>{data.depth});
+  odometry::DebugWriterConfig config;
+  config.directory = "test_debug";
+  config.format = odometry::kDebugRaw;
+  {
+    odometry::DebugWriter writer(config);
+    Check(writer.AddKeyframe(0, image, depth, data.valid) == 0, "raw", "keyframe dropped");
+    Check(writer.Close() == 0 && writer.Written() == 1, "raw", "close");
+  }
+  std::vector<char> disparity = ReadFile("test_debug/disparity_left/0.raw");
+  std::vector<char> mask = ReadFile("test_debug/mask_left/0.raw");
+  bool ok = disparity.size() == 12 + 48 * 64 * 2 && mask.size() == 12 + 48 * 64;
+  for (int y = 0; ok && y < 48; y++){
+    for (int x = 0; ok && x < 64; x++){
+      uint16_t value;
+      std::memcpy(&value, disparity.data() + 12 + 2 * (y * 64 + x), 2);
+      uint16_t expected = data.valid.at<uint8_t>(y, x) ? uint16_t(config.disparity_scale * data.depth.at<float>(y, x)) : 0;
+      ok = value == expected && uint8_t(mask[12 + y * 64 + x]) == data.valid.at<uint8_t>(y, x);
+    }
+  }
+  Check(ok, "raw", "disparities or mask differ");
+
+  config.format = odometry::kDebugSparseDepth;
+  {
+    odometry::DebugWriter writer(config);
+    writer.AddKeyframe(1, image, depth, data.valid);
+    Check(writer.Close() == 0, "sparse", "close");
+  }
+  std::vector<char> sparse = ReadFile("test_debug/disparity_left/1.spd");
+  cv::Mat sparse_depth, sparse_valid;
+  odometry::SparseDepthCodec codec;
+  ok = codec.Decode(reinterpret_cast<const unsigned char*>(sparse.data()), sparse.size(), sparse_depth, sparse_valid) == 0;
+  for (int y = 0; ok && y < 48; y++){
+    for (int x = 0; ok && x < 64; x++){
+      ok = sparse_valid.at<uint8_t>(y, x) == data.valid.at<uint8_t>(y, x) &&
+           (data.valid.at<uint8_t>(y, x) == 0 ||
+            std::fabs(sparse_depth.at<float>(y, x) - data.depth.at<float>(y, x)) <= codec.GetStep());
+    }
+  }
+  Check(ok, "sparse", "pixels differ");
+}
+
+void TestSamplingAndDropping(){
+  TestKeyframe data = MakeKeyframe(16, 16);
+  odometry::ImagePyramid image({data.gray}, odometry::kStorageFloat32);
+  odometry::DepthPyramid depth(std::vector<cv::Mat>{data.depth});
+  odometry::DebugWriterConfig config;
+  config.directory = "test_debug";
+  config.format = odometry::kDebugRaw;
+  config.keyframe_stride = 3;
+  {
+    odometry::DebugWriter writer(config);
+    for (int i = 0; i < 10; i++) writer.AddKeyframe(i, image, depth, data.valid);
+    Check(writer.Close() == 0 && writer.Written() == 4 && writer.Dropped() == 0, "sampling",
+          std::to_string(writer.Written()) + " keyframes written");
+  }
+  bool ok = true;
+  for (int i = 0; i < 10; i++) ok = ok && Exists("test_debug/mask_left/" + std::to_string(i) + ".raw") == (i % 3 == 0);
+  Check(ok, "sampling", "wrong keyframes written");
+
+  config.keyframe_stride = 1;
+  config.queue_size = 0; // nothing fits
+  odometry::DebugWriter writer(config);
+  Check(writer.AddKeyframe(0, image, depth, data.valid) == -1, "dropping", "keyframe queued");
+  writer.Close();
+  Check(writer.AddKeyframe(1, image, depth, data.valid) == -1, "dropping", "keyframe queued after Close()");
+  Check(writer.Written() == 0 && writer.Dropped() == 2, "dropping", std::to_string(writer.Dropped()) + " dropped");
+
+  config.directory = "test_debug/missing";
+  config.queue_size = 8;
+  odometry::DebugWriter failing(config);
+  failing.AddKeyframe(0, image, depth, data.valid);
+  Check(failing.Close() == -1 && failing.Written() == 0, "failure", "write to a missing directory succeeded");
+}
+
+} // namespace
+
+int main(){
+  std::cout << "testing DebugWriter ..." << std::endl;
+  mkdir("test_debug", 0755);
+  for (const char* sub : kSubDirectories) mkdir((std::string("test_debug/") + sub).c_str(), 0755);
+  TestRawAndSparse();
+  TestSamplingAndDropping();
+  RemoveFiles(10);
+  for (const char* sub : kSubDirectories) rmdir((std::string("test_debug/") + sub).c_str());
+  rmdir("test_debug");
+  if (num_failures > 0){
+    std::cout << num_failures << " check(s) failed." << std::endl;
+    return 1;
+  }
+  std::cout << "all debug writer checks passed." << std::endl;
+  return 0;
+}
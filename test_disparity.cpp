@@ -1,249 +1,241 @@
-// The file is used to test disparity search and depth estimation assuming given undistorted & rectified image pair
+// The file tests disparity search and depth estimation on a generated KITTI sized, undistorted & rectified image pair.
+// The scene is a textured surface with a known (sub-pixel) disparity everywhere, so the test needs no dataset:
+//  * accuracy: disparities of the search, inverse depth after the refinement, iterations of the refinement
+//  * row-streaming: same output as ComputeDepth(), rows reported in order with their final disparities
+//  * PatchMatch search: more points than the epipolar search at the same accuracy
+//  * dense stereo: density and accuracy of the semi-global matching
+//  * timing: disparity search, PatchMatch search, depth refinement and semi-global matching against the baseline, see test_utils.h
 // Created by Yu Wang on 2019-01-14.
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <Eigen/Core>
 #include <opencv2/core.hpp>
-#include <opencv2/imgproc.hpp>
-#include "opencv2/imgcodecs.hpp"
-#include <opencv2/highgui.hpp>
-#include <fstream>
 #include "data_types.h"
 #include <depth_estimate.h>
-#include <typeinfo>
-#include <se3.hpp>
+#include <metrics.h>
+#include <sgm_stereo.h>
+#include "test_utils.h"
 
-const std::string kDataPath = "../dataset/disparity_bowling2_full";
+namespace
+{
 
-void load_data(const std::string& folder_name, std::vector<cv::Mat> &gray, std::vector<cv::Mat> &disp);
-void report_disp_error(const cv::Mat& pred_disp, const cv::Mat& gt_disp, const cv::Mat& valid_map, const cv::Mat& gt_valid_map);
-void report_depth_error(const cv::Mat& pred_depth, const cv::Mat& gt_depth, const cv::Mat& valid_map, const cv::Mat& gt_valid_map);
+using odometry::test::kKittiRows;
+using odometry::test::kKittiCols;
+using odometry::test::kKittiFx;
+using odometry::test::kKittiBaseline;
 
-int main() {
+// surface slanted in x: disparity grows linearly from left to right, between 12 and ~37 pixels
+const float kDispOffset = 12.0f;
+const float kDispSlope = 0.02f;
 
+// disparity of the scene point seen by the left camera at column x
+float GtDisparity(float x){
+  return kDispOffset + kDispSlope * x;
+}
 
-  // Dataset calibration
-  /*
-  fx = fy = 3740 [pixels for full resolution],
-  doffs = 240 [pixels for full resolution],
-  baseline = 0.16 [meters for full resolution],
-  */
-  float fx = 3740.0f; // since downsample by 3
-  float doffs = 0.0f; // need to be added to disparity when convert to 3d depth， 240
-  float baseline = 0.16f; // in meters
-  float tmp;
-  cv::Scalar init_val(0);
-
-  // load data & create depth map
-  std::vector<cv::Mat> gray(2); // float intensity
-  std::vector<cv::Mat> gt_disp(2); // float disp, exact value
-  load_data(kDataPath, gray, gt_disp);
-  cv::Mat gt_depth(gray[0].rows, gray[0].cols, PixelType, init_val);
-  cv::Mat gt_valid_map(gray[0].rows, gray[0].cols, CV_8U, init_val);
-  float min_depth=100000, max_depth=0;
-  for (int y = 0; y < gray[0].rows; y++){
-    for (int x = 0; x < gray[0].cols; x++){
-      tmp = gt_disp[0].at<float>(y, x);
-      if (tmp != 0){
-        gt_valid_map.at<uint8_t>(y, x) = 1;
-        // depth = fx * baseline / disp
-        gt_depth.at<float>(y, x) = (tmp + doffs) / (fx * baseline);
-        min_depth = (1.0f / gt_depth.at<float>(y, x) < min_depth)? 1.0f / gt_depth.at<float>(y, x) : min_depth;
-        max_depth = (1.0f / gt_depth.at<float>(y, x) > max_depth)? 1.0f / gt_depth.at<float>(y, x) : max_depth;
-      }
+// a scene point at texture coordinate u is seen at x_left = u and at x_right = u - d(u) = u * (1 - slope) - offset
+void RenderStereoPair(const odometry::test::SyntheticTexture& texture, cv::Mat& left, cv::Mat& right){
+  left.create(kKittiRows, kKittiCols, PixelType);
+  right.create(kKittiRows, kKittiCols, PixelType);
+  for (int y = 0; y < kKittiRows; y++){
+    for (int x = 0; x < kKittiCols; x++){
+      left.at<float>(y, x) = texture.At(float(x), float(y));
+      right.at<float>(y, x) = texture.At((float(x) + kDispOffset) / (1.0f - kDispSlope), float(y));
     }
   }
-  std::cout << "created gt inverse depth. min: " << min_depth << " meters, " << "max: " << max_depth << " meters." << std::endl;
-
-  // estimate depth
-  //   DepthEstimator(float grad_th, float ssd_th, float photo_th, float min_depth, float max_depth, float lambda, float huber_delta,
-  //          float precision, int max_iters, int boundary, const std::shared_ptr<CameraPyramid>& left_cam_ptr,
-  //          const std::shared_ptr<CameraPyramid>& right_cam_ptr, float baseline, int max_residuals);
-  //  GlobalStatus ComputeDepth(const cv::Mat& left_img, const cv::Mat& right_img, cv::Mat& left_val, cv::Mat& left_disp, cv::Mat& left_dep);
-
-  odometry::GlobalStatus depth_state;
-  // float search_min = (min_depth - 0.5f < 0.01f)? 0.01f : min_depth - 0.5f;
-  // float search_max = (max_depth + 0.5f > 10.0f)? 10.0f : max_depth + 0.5f;
-  float search_min = 3.0f;
-  float search_max = 17.0f;
-  std::cout << "constraint depth estimate range: " << search_min << " ~ " << search_max << std::endl;
-  std::shared_ptr<odometry::CameraPyramid> left_cam_ptr = nullptr;
-  std::shared_ptr<odometry::CameraPyramid> right_cam_ptr = nullptr;
-  int max_residuals = 5000;
-  odometry::DepthEstimator depth_est(35.0f, 1000.0f, 10.0f, search_min, search_max, 0.01f, 28.0f, 0.995f, 100, 4,
-                                    left_cam_ptr, right_cam_ptr, baseline, max_residuals);
-  cv::Mat left_val(gray[0].rows, gray[0].cols, CV_8U, init_val);
-  cv::Mat left_disp(gray[0].rows, gray[0].cols, PixelType);
-  cv::Mat left_dep(gray[0].rows, gray[0].cols, PixelType);
-  std::cout << "start disparity & depth estimation..." << std::endl;
-  depth_state = depth_est.ComputeDepth(gray[0], gray[1], left_val, left_disp, left_dep);
-
-
-  if (depth_state != -1){
-    std::cout << "compute succeed." << std::endl;
-    std::cout << "number of val depth: " << cv::sum(left_val)[0] << std::endl;
-    std::cout << std::endl << "Report Statistics:" << std::endl;
-    depth_est.ReportStatus();
-    // report error
-    report_disp_error(left_disp, gt_disp[0], left_val, gt_valid_map);
-    report_depth_error(left_dep, gt_depth, left_val, gt_valid_map);
-    cv::Mat gray_left;
-    gray[0].convertTo(gray_left, cv::IMREAD_GRAYSCALE);
-    for (int y=0; y<left_val.rows; y++){
-      for (int x=0; x<left_val.cols; x++){
-        if (left_val.at<uint8_t>(y,x)==1 && gt_disp[0].at<float>(y,x) != 0){
-          cv::circle(gray_left, cv::Point(x,y), 4, cv::Scalar(0));
-        }
-      }
+}
+
+// sum and count of a stage latency histogram, to time the stages inside DepthEstimator::ComputeDepth()
+double StageSeconds(const char* stage){
+  std::string labels = std::string("stage=\"") + stage + "\"";
+  return odometry::metrics::Registry().GetHistogram("odometry_stage_latency_seconds", "Latency of the pipeline stages.",
+                                                    odometry::metrics::LatencyBuckets(), labels).Sum();
+}
+
+// number of pixels that differ between two maps of the same size
+template <typename T>
+int CountDifferent(const cv::Mat& kA, const cv::Mat& kB){
+  int num = 0;
+  for (int y = 0; y < kA.rows; y++){
+    for (int x = 0; x < kA.cols; x++){
+      if (kA.at<T>(y, x) != kB.at<T>(y, x)) num++;
     }
-    cv::namedWindow("keypoints", cv::WINDOW_NORMAL);
-    cv::imshow("keypoints", gray_left);
-    cv::waitKey(0);
-  } else {
-    std::cout << "compute failed." << std::endl;
   }
-
-  return 0;
+  return num;
 }
 
-void load_data(const std::string& folder_name, std::vector<cv::Mat> &gray, std::vector<cv::Mat> &disp){
-  std::string left_img_file = folder_name + "/view1.png";
-  std::string right_img_file = folder_name + "/view5.png";
-  std::string left_disp_file = folder_name + "/disp1.png";
-  std::string right_disp_file = folder_name + "/disp5.png";
-  cv::Mat gray_8u;
-
-  // read left image
-  gray_8u = cv::imread(left_img_file, cv::IMREAD_GRAYSCALE);
-  if (gray_8u.empty()){
-    std::cout << "read left img failed." << std::endl;
-    std::exit(-1);
+} // namespace
+
+int main(){
+  std::cout << "test_disparity: synthetic " << kKittiRows << "x" << kKittiCols << " stereo pair" << std::endl;
+  odometry::test::SyntheticTexture texture(11);
+  cv::Mat left, right;
+  RenderStereoPair(texture, left, right);
+
+  // same parameters as run_odometry_kitti
+  std::shared_ptr<odometry::CameraPyramid> left_cam_ptr = nullptr;
+  std::shared_ptr<odometry::CameraPyramid> right_cam_ptr = nullptr;
+  odometry::DepthEstimator depth_est(8.0f, 900.0f, 15.0f, 0.1f, 30.0f, 0.01f, 28.0f, 0.995f, 50, 4,
+                                     left_cam_ptr, right_cam_ptr, kKittiBaseline, 80000);
+  cv::Scalar init_val(0);
+  cv::Mat left_val(kKittiRows, kKittiCols, CV_8U, init_val);
+  cv::Mat left_disp(kKittiRows, kKittiCols, PixelType, init_val);
+  cv::Mat left_dep(kKittiRows, kKittiCols, PixelType, init_val);
+  odometry::GlobalStatus depth_state = depth_est.ComputeDepth(left, right, left_val, left_disp, left_dep);
+  odometry::test::Expect(depth_state != -1, "ComputeDepth succeeds");
+  // the sub-pixel refinement starts within half a pixel of the solution
+  double refine_iterations = odometry::metrics::Registry().GetGauge("odometry_depth_lm_iterations",
+                                                                    "LM iterations of the last depth refinement.").Value();
+  odometry::test::ExpectLessEqual(refine_iterations, 8, "depth refinement LM iterations");
+
+  /******************************* ACCURACY ***********************************/
+  // the disparity map holds the (integer) search result, the inverse depth the refined one
+  int num_valid = 0, num_disp_within_1px = 0;
+  std::vector<float> refined_errs;
+  for (int y = 0; y < kKittiRows; y++){
+    for (int x = 0; x < kKittiCols; x++){
+      if (left_val.at<uint8_t>(y, x) == 0) continue;
+      float gt_disp = GtDisparity(float(x));
+      if (std::fabs(left_disp.at<float>(y, x) - gt_disp) <= 1.0f) num_disp_within_1px++;
+      float refined_disp = left_dep.at<float>(y, x) * kKittiFx * kKittiBaseline; // inverse depth = disp / (fx * baseline)
+      refined_errs.push_back(std::fabs(refined_disp - gt_disp));
+      num_valid++;
+    }
   }
-  //cv::imshow("left_img", gray_8u);
-  gray_8u.convertTo(gray[0], PixelType);
-  //std::cout << "left size: " << gray[0].size << std::endl;
-
-  // read right image
-  gray_8u = cv::imread(right_img_file, cv::IMREAD_GRAYSCALE);
-  if (gray_8u.empty()){
-    std::cout << "read right img failed." << std::endl;
-    std::exit(-1);
+  odometry::test::ExpectGreaterEqual(num_valid, 5000, "valid depth points");
+  if (num_valid > 0){
+    std::nth_element(refined_errs.begin(), refined_errs.begin() + refined_errs.size() / 2, refined_errs.end());
+    odometry::test::ExpectGreaterEqual(double(num_disp_within_1px) / num_valid, 0.9, "fraction of disparities within 1 px");
+    // the pattern pixels share the disparity of their point: on the slanted surface the columns left and right of the
+    // point are foreshortened in the right image, which biases the refinement to ~0.03 px (center pixel only: < 0.001)
+    odometry::test::ExpectLessEqual(refined_errs[refined_errs.size() / 2], 0.035, "median refined disparity error [px]");
   }
-  //cv::imshow("right_img", gray_8u);
-  gray_8u.convertTo(gray[1], PixelType);
-  //std::cout << "right size: " << gray[1].size << std::endl;
-
-  // read left disp
-  gray_8u = cv::imread(left_disp_file, cv::IMREAD_GRAYSCALE);
-  if (gray_8u.empty()){
-    std::cout << "read left disp failed." << std::endl;
-    std::exit(-1);
+
+  /******************************* ROW-STREAMING ***********************************/
+  // the inputs are rectified already (null cameras), the smoothing and matching run in the rolling window
+  cv::Mat stream_val(kKittiRows, kKittiCols, CV_8U, init_val);
+  cv::Mat stream_disp(kKittiRows, kKittiCols, PixelType, init_val);
+  cv::Mat stream_dep(kKittiRows, kKittiCols, PixelType, init_val);
+  cv::Mat stream_disp_at_done(kKittiRows, kKittiCols, PixelType, init_val);
+  cv::Mat left_rect, right_rect;
+  int rows_done_end = 0;
+  bool rows_in_order = true;
+  auto rows_done = [&](int row_begin, int row_end){
+    rows_in_order = rows_in_order && row_begin == rows_done_end && row_end > row_begin;
+    rows_done_end = row_end;
+    for (int y = row_begin; y < row_end; y++){
+      std::copy(stream_disp.ptr<float>(y), stream_disp.ptr<float>(y) + kKittiCols, stream_disp_at_done.ptr<float>(y));
+    }
+  };
+  odometry::GlobalStatus stream_state = depth_est.ComputeDepthStreaming(left, right, left_rect, right_rect, stream_val,
+                                                                        stream_disp, stream_dep, rows_done);
+  odometry::test::Expect(stream_state != -1, "ComputeDepthStreaming succeeds");
+  odometry::test::Expect(rows_in_order && rows_done_end == kKittiRows, "streamed rows cover the image in order");
+  odometry::test::Expect(CountDifferent<uint8_t>(stream_val, left_val) == 0, "streamed valid map equals ComputeDepth");
+  odometry::test::Expect(CountDifferent<float>(stream_disp, left_disp) == 0, "streamed disparities equal ComputeDepth");
+  odometry::test::Expect(CountDifferent<float>(stream_dep, left_dep) == 0, "streamed inverse depths equal ComputeDepth");
+  odometry::test::Expect(CountDifferent<float>(stream_disp_at_done, stream_disp) == 0,
+                         "streamed disparities are final when their rows are reported");
+
+  /******************************* PATCHMATCH ***********************************/
+  odometry::DepthEstimator patch_match_est(8.0f, 900.0f, 15.0f, 0.1f, 30.0f, 0.01f, 28.0f, 0.995f, 50, 4,
+                                           left_cam_ptr, right_cam_ptr, kKittiBaseline, 80000);
+  odometry::test::Expect(patch_match_est.SetDisparitySearch(odometry::kPatchMatchSearch, 0) == -1,
+                         "SetDisparitySearch rejects 0 iterations");
+  patch_match_est.SetDisparitySearch(odometry::kPatchMatchSearch);
+  cv::Mat pm_val(kKittiRows, kKittiCols, CV_8U, init_val);
+  cv::Mat pm_disp(kKittiRows, kKittiCols, PixelType, init_val);
+  cv::Mat pm_dep(kKittiRows, kKittiCols, PixelType, init_val);
+  odometry::GlobalStatus pm_state = patch_match_est.ComputeDepth(left, right, pm_val, pm_disp, pm_dep);
+  odometry::test::Expect(pm_state != -1, "ComputeDepth with PatchMatch succeeds");
+  int num_pm_valid = 0, num_pm_within_1px = 0;
+  std::vector<float> pm_errs;
+  for (int y = 0; y < kKittiRows; y++){
+    for (int x = 0; x < kKittiCols; x++){
+      if (pm_val.at<uint8_t>(y, x) == 0) continue;
+      float gt_disp = GtDisparity(float(x));
+      if (std::fabs(pm_disp.at<float>(y, x) - gt_disp) <= 1.0f) num_pm_within_1px++;
+      pm_errs.push_back(std::fabs(pm_dep.at<float>(y, x) * kKittiFx * kKittiBaseline - gt_disp));
+      num_pm_valid++;
+    }
   }
-  //cv::imshow("left_disp", gray_8u);
-  gray_8u.convertTo(disp[0], PixelType, 1.0f);
-  //std::cout << "left disp: " << disp[0].size << std::endl;
-
-  // read right disp
-  gray_8u = cv::imread(right_disp_file, cv::IMREAD_GRAYSCALE);
-  if (gray_8u.empty()){
-    std::cout << "read left disp failed." << std::endl;
-    std::exit(-1);
+  odometry::test::ExpectGreaterEqual(num_pm_valid, num_valid, "PatchMatch valid depth points");
+  if (num_pm_valid > 0){
+    std::nth_element(pm_errs.begin(), pm_errs.begin() + pm_errs.size() / 2, pm_errs.end());
+    odometry::test::ExpectGreaterEqual(double(num_pm_within_1px) / num_pm_valid, 0.9,
+                                       "fraction of PatchMatch disparities within 1 px");
+    odometry::test::ExpectLessEqual(pm_errs[pm_errs.size() / 2], 0.035, "median PatchMatch refined disparity error [px]");
   }
-  //cv::imshow("right_disp", gray_8u);
-  gray_8u.convertTo(disp[1], PixelType, 1.0f);
-  //std::cout << "right disp: " << disp[1].size << std::endl;
-  //std::cout << "rows: " << disp[1].rows << std::endl;
-  //cv::waitKey(0);
-}
 
-void report_disp_error(const cv::Mat& pred_disp, const cv::Mat& gt_disp, const cv::Mat& valid_map, const cv::Mat& gt_valid_map){
-  std::vector<int> statistic{0,0,0,0,0,0,0,0,0,0,0};
-  std::vector<int> accmulate_stat{0,0,0,0,0,0,0,0,0,0,0};
-  float err_sum = 0;
-  float abs_err = 0;
-  float sum_val = float(cv::sum(valid_map.mul(gt_valid_map))[0]);
-  std::cout << "number of valid for comparing against gt disparity: " << sum_val << std::endl;
-  for (int y=0; y<1110; y++){
-    for (int x=0; x<1330; x++){
-      if (valid_map.at<uint8_t>(y,x) == 1 && gt_valid_map.at<uint8_t>(y,x) == 1){
-        abs_err = std::abs(gt_disp.at<float>(y,x) - pred_disp.at<float>(y,x));
-        if (abs_err <= 0.5) statistic[0] += 1;
-        else if (abs_err <= 1.0 && abs_err > 0.5) statistic[1] += 1;
-        else if (abs_err <= 2.0 && abs_err > 1.0) statistic[2] += 1;
-        else if (abs_err <= 3.0 && abs_err > 2.0) statistic[3] += 1;
-        else if (abs_err <= 4.0 && abs_err > 3.0) statistic[4] += 1;
-        else if (abs_err <= 5.0 && abs_err > 4.0) statistic[5] += 1;
-        else if (abs_err <= 6.0 && abs_err > 5.0) statistic[6] += 1;
-        else if (abs_err <= 7.0 && abs_err > 6.0) statistic[7] += 1;
-        else if (abs_err <= 10.0 && abs_err > 7.0) statistic[8] += 1;
-        else if (abs_err <= 20.0 && abs_err > 10) statistic[9] += 1;
-        else statistic[10] += 1;
-        err_sum += abs_err;
-      } else
-        continue;
+  /******************************* DENSE STEREO ***********************************/
+  // every textured pixel gets a depth, except for the columns without the full disparity range in the right image
+  odometry::SgmStereo sgm(64, 8, 8, 96, 0.95f, 0.1f, 30.0f, 4, left_cam_ptr, kKittiBaseline);
+  cv::Mat sgm_val, sgm_disp, sgm_dep;
+  odometry::GlobalStatus sgm_state = sgm.ComputeDepth(left, right, sgm_val, sgm_disp, sgm_dep);
+  odometry::test::Expect(sgm_state != -1, "SgmStereo::ComputeDepth succeeds");
+  int num_sgm_pixels = 0, num_sgm_valid = 0, num_sgm_within_1px = 0;
+  std::vector<float> sgm_errs;
+  for (int y = 2; y < kKittiRows - 2; y++){
+    for (int x = 64; x < kKittiCols - 2; x++){
+      num_sgm_pixels++;
+      if (sgm_val.at<uint8_t>(y, x) == 0) continue;
+      float gt_disp = GtDisparity(float(x));
+      float sgm_disp_from_dep = sgm_dep.at<float>(y, x) * kKittiFx * kKittiBaseline;
+      if (std::fabs(sgm_disp.at<float>(y, x) - gt_disp) <= 1.0f) num_sgm_within_1px++;
+      sgm_errs.push_back(std::fabs(sgm_disp_from_dep - gt_disp));
+      num_sgm_valid++;
     }
   }
-  accmulate_stat[0] = statistic[0]; // pixel error <= 0.5
-  for (int i=1; i<11; i++){
-    accmulate_stat[i] = statistic[i] + accmulate_stat[i-1];
+  odometry::test::ExpectGreaterEqual(double(num_sgm_valid) / num_sgm_pixels, 0.9, "fraction of dense depth points");
+  if (num_sgm_valid > 0){
+    std::nth_element(sgm_errs.begin(), sgm_errs.begin() + sgm_errs.size() / 2, sgm_errs.end());
+    odometry::test::ExpectGreaterEqual(double(num_sgm_within_1px) / num_sgm_valid, 0.95,
+                                       "fraction of dense disparities within 1 px");
+    odometry::test::ExpectLessEqual(sgm_errs[sgm_errs.size() / 2], 0.2, "median dense disparity error [px]");
   }
-  std::cout << "Disparity errors in [pixels]:" << std::endl;
-  std::cout << "Error <= 0.5 : " << accmulate_stat[0] << ", percentage: " << float(accmulate_stat[0])/sum_val*100.0f << std::endl;
-  std::cout << "Error <= 1 : " << accmulate_stat[1] << ", percentage: " << float(accmulate_stat[1])/sum_val*100.0f << std::endl;
-  std::cout << "Error <= 2 : " << accmulate_stat[2] << ", percentage: " << float(accmulate_stat[2])/sum_val*100.0f << std::endl;
-  std::cout << "Error <= 3 : " << accmulate_stat[3] << ", percentage: " << float(accmulate_stat[3])/sum_val*100.0f << std::endl;
-  std::cout << "Error <= 4 : " << accmulate_stat[4] << ", percentage: " << float(accmulate_stat[4])/sum_val*100.0f << std::endl;
-  std::cout << "Error <= 5 : " << accmulate_stat[5] << ", percentage: " << float(accmulate_stat[5])/sum_val*100.0f << std::endl;
-  std::cout << "Error <= 6 : " << accmulate_stat[6] << ", percentage: " << float(accmulate_stat[6])/sum_val*100.0f << std::endl;
-  std::cout << "Error <= 7 : " << accmulate_stat[7] << ", percentage: " << float(accmulate_stat[7])/sum_val*100.0f << std::endl;
-  std::cout << "Error <= 10 : " << accmulate_stat[8] << ", percentage: " << float(accmulate_stat[8])/sum_val*100.0f << std::endl;
-  std::cout << "Error <= 20 : " << accmulate_stat[9] << ", percentage: " << float(accmulate_stat[9])/sum_val*100.0f << std::endl;
-  std::cout << "Error > 20 : " << statistic[9] << ", percentage: " << float(statistic[9])/sum_val*100.0f << std::endl;
-  std::cout << "average disparity error [pixels]: " << err_sum / sum_val << std::endl;
-}
 
-void report_depth_error(const cv::Mat& pred_depth, const cv::Mat& gt_depth, const cv::Mat& valid_map, const cv::Mat& gt_valid_map){
-  std::vector<int> statistic{0,0,0,0,0,0,0,0,0,0,0};
-  std::vector<int> accmulate_stat{0,0,0,0,0,0,0,0,0,0,0};
-  float sum_val = float(cv::sum(valid_map.mul(gt_valid_map))[0]);
-  float abs_err; // in meters
-  float err_sum = 0;
-  for (int y=0; y<1110; y++){
-    for (int x=0; x<1330; x++){
-      if (valid_map.at<uint8_t>(y,x) == 1 && gt_valid_map.at<uint8_t>(y,x) == 1){
-        abs_err = std::abs(1.0f/pred_depth.at<float>(y,x) - 1.0f/gt_depth.at<float>(y,x));
-        if (abs_err <= 0.01) statistic[0] += 1;
-        else if (abs_err <= 0.02 && abs_err > 0.01) statistic[1] += 1;
-        else if (abs_err <= 0.03 && abs_err > 0.02) statistic[2] += 1;
-        else if (abs_err <= 0.04 && abs_err > 0.03) statistic[3] += 1;
-        else if (abs_err <= 0.05 && abs_err > 0.04) statistic[4] += 1;
-        else if (abs_err <= 0.06 && abs_err > 0.05) statistic[5] += 1;
-        else if (abs_err <= 0.07 && abs_err > 0.06) statistic[6] += 1;
-        else if (abs_err <= 0.08 && abs_err > 0.07) statistic[7] += 1;
-        else if (abs_err <= 0.1 && abs_err > 0.08) statistic[8] += 1;
-        else if (abs_err <= 0.5 && abs_err > 0.1) statistic[9] += 1;
-        else statistic[10] += 1;
-        err_sum += abs_err;
-      } else
-        continue;
-    }
+  /******************************* TIMING ***********************************/
+  // ComputeDepth observes both stages into the stage latency histograms, the medians are taken over the runs
+  const int kReps = 5;
+  std::vector<double> disparity_ms, refinement_ms;
+  for (int i = 0; i < kReps; i++){
+    left_val.setTo(init_val);
+    left_disp.setTo(init_val);
+    left_dep.setTo(init_val);
+    double disparity_before = StageSeconds("disparity");
+    double refinement_before = StageSeconds("depth_refinement");
+    depth_est.ComputeDepth(left, right, left_val, left_disp, left_dep);
+    disparity_ms.push_back((StageSeconds("disparity") - disparity_before) * 1000.0);
+    refinement_ms.push_back((StageSeconds("depth_refinement") - refinement_before) * 1000.0);
+  }
+  std::vector<double> streaming_ms;
+  for (int i = 0; i < kReps; i++){
+    stream_val.setTo(init_val);
+    double streaming_before = StageSeconds("streaming_disparity");
+    depth_est.ComputeDepthStreaming(left, right, left_rect, right_rect, stream_val, stream_disp, stream_dep);
+    streaming_ms.push_back((StageSeconds("streaming_disparity") - streaming_before) * 1000.0);
   }
-  accmulate_stat[0] = statistic[0]; // pixel error <= 0.01
-  for (int i=1; i<11; i++){
-    accmulate_stat[i] = statistic[i] + accmulate_stat[i-1];
+  std::vector<double> patch_match_ms;
+  for (int i = 0; i < kReps; i++){
+    pm_val.setTo(init_val);
+    double disparity_before = StageSeconds("disparity");
+    patch_match_est.ComputeDepth(left, right, pm_val, pm_disp, pm_dep);
+    patch_match_ms.push_back((StageSeconds("disparity") - disparity_before) * 1000.0);
   }
-  std::cout << "Depth errors in [meters]:" << std::endl;
-  std::cout << "Error <= 0.01 : " << accmulate_stat[0] << ", percentage: " << float(accmulate_stat[0])/sum_val*100.0f << std::endl;
-  std::cout << "Error <= 0.02 : " << accmulate_stat[1] << ", percentage: " << float(accmulate_stat[1])/sum_val*100.0f << std::endl;
-  std::cout << "Error <= 0.03 : " << accmulate_stat[2] << ", percentage: " << float(accmulate_stat[2])/sum_val*100.0f << std::endl;
-  std::cout << "Error <= 0.04 : " << accmulate_stat[3] << ", percentage: " << float(accmulate_stat[3])/sum_val*100.0f << std::endl;
-  std::cout << "Error <= 0.05 : " << accmulate_stat[4] << ", percentage: " << float(accmulate_stat[4])/sum_val*100.0f << std::endl;
-  std::cout << "Error <= 0.06 : " << accmulate_stat[5] << ", percentage: " << float(accmulate_stat[5])/sum_val*100.0f << std::endl;
-  std::cout << "Error <= 0.07 : " << accmulate_stat[6] << ", percentage: " << float(accmulate_stat[6])/sum_val*100.0f << std::endl;
-  std::cout << "Error <= 0.08 : " << accmulate_stat[7] << ", percentage: " << float(accmulate_stat[7])/sum_val*100.0f << std::endl;
-  std::cout << "Error <= 0.1 : " << accmulate_stat[8] << ", percentage: " << float(accmulate_stat[8])/sum_val*100.0f << std::endl;
-  std::cout << "Error <= 0.5 : " << accmulate_stat[9] << ", percentage: " << float(accmulate_stat[9])/sum_val*100.0f << std::endl;
-  std::cout << "Error > 0.5 : " << statistic[9] << ", percentage: " << float(statistic[9])/sum_val*100.0f << std::endl;
-  std::cout << "average depth error [meters]: " << err_sum / sum_val << std::endl;
-}
\ No newline at end of file
+  std::nth_element(disparity_ms.begin(), disparity_ms.begin() + kReps / 2, disparity_ms.end());
+  std::nth_element(streaming_ms.begin(), streaming_ms.begin() + kReps / 2, streaming_ms.end());
+  std::nth_element(patch_match_ms.begin(), patch_match_ms.begin() + kReps / 2, patch_match_ms.end());
+  std::nth_element(refinement_ms.begin(), refinement_ms.begin() + kReps / 2, refinement_ms.end());
+  odometry::test::PerfGate gate;
+  gate.Check("disparity.search", disparity_ms[kReps / 2]);
+  gate.Check("disparity.depth_refinement", refinement_ms[kReps / 2]);
+  gate.Check("disparity.streaming", streaming_ms[kReps / 2]);
+  gate.Check("disparity.patchmatch", patch_match_ms[kReps / 2]);
+  gate.Check("disparity.sgm", odometry::test::MedianMs([&](){
+    sgm.ComputeDepth(left, right, sgm_val, sgm_disp, sgm_dep);
+  }, kReps));
+  gate.Save();
+  return odometry::test::Finish("test_disparity");
+}
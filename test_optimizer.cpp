@@ -1,157 +1,352 @@
-// Test Camera Tracking over a sequence of pairs of consecutive images
+// Test Camera Tracking on generated KITTI sized frames with a known relative pose.
+// The scene is a textured slanted plane rendered (ray cast) from two camera poses, the first frame comes with its exact
+// inverse depth, so the test needs no dataset:
+//  * accuracy: translation/rotation error of the relative pose of several motions, also with the compact uint8 / half
+//    float pyramids (PyramidStorage): same bounds, and within a small tolerance of the float pose, and with the sparse
+//    8 point pattern residuals (kPattern8Residuals), and a large motion recovered by the feature based pose seed
+//    (PoseInitializer) which only runs when the optimization from the prior fails, and rotation-heavy motions seeded by
+//    the preintegrated rotation of a synthetic IMU stream (ImuPreintegrator, EuRoC csv): fewer coarse LM iterations
+//  * timing: pyramid construction and pose optimization against the baseline, see test_utils.h
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <vector>
 #include <Eigen/Core>
+#include <Eigen/Geometry>
 #include <opencv2/core.hpp>
-#include <opencv2/imgproc.hpp>
-#include <opencv2/imgcodecs.hpp>
-#include <opencv2/highgui.hpp>
-#include <fstream>
 #include "include/camera.h"
+#include "include/checkpoint.h"
+#include "include/concurrent_tracking.h"
 #include "include/data_types.h"
 #include "include/image_processing_global.h"
 #include "include/image_pyramid.h"
+#include "include/imu_preintegration.h"
 #include "include/lm_optimizer.h"
+#include "include/metrics.h"
+#include "include/pose_initializer.h"
 #include <se3.hpp>
-#include <typeinfo>
-
-#ifndef N_FRAMES
-#define N_FRAMES 32 // 200
-#endif
-
-/******************************* CHOOSE DATASET ***********************************/
-//const std::string kDataPath = "../dataset/rgbd_dataset_freiburg3_sitting_static";
-const std::string kDataPath = "../dataset/rgbd_dataset_freiburg3_teddy";
-//const std::string kDataPath = "../dataset/rgbd_dataset_freiburg3_sitting_xyz";
-//const std::string kDataPath = "../dataset/rgbd_dataset_freiburg3_long_office_household";
+#include "test_utils.h"
 
+namespace
+{
 
-void load_data(std::string filename, std::vector<cv::Mat> &gray, std::vector<cv::Mat> &depth, Eigen::MatrixXf &poses, int n_frames);
+using odometry::test::kKittiRows;
+using odometry::test::kKittiCols;
+using odometry::test::kKittiFx;
+using odometry::test::kKittiCx;
+using odometry::test::kKittiCy;
 
-int main() {
+// scene plane n^T X = d in the frame of the first camera: a wall about 12 m ahead, tilted towards the ground
+const Eigen::Vector3f kPlaneNormal = Eigen::Vector3f(0.0f, -0.25f, 1.0f).normalized();
+const float kPlaneDistance = 12.0f;
+const float kTextureScale = 50.0f; // texture units per meter on the plane, about 1.2 pixels at 12 m
 
-  /******************************* CREATE CAMERA INSTANCE ***********************************/
-  // use Freiburg 3 sequence (already undistorted, rgb and depth are already pre-registered)
-  float fx = 535.4, fy = 539.2, f_theta = 0, cx = 320.1, cy = 247.6;
-  std::shared_ptr<odometry::CameraPyramid> camera_ptr = std::make_shared<odometry::CameraPyramid>(4, fx, fy, f_theta, cx, cy);
+// render the view of a camera with pose transform (X_cam = R * X_1 + t): cast the ray of every pixel onto the plane,
+// the texture is attached to the plane coordinates (x, y) of the first camera frame. optionally outputs inverse depth
+void RenderView(const odometry::test::SyntheticTexture& texture, const odometry::Affine4f& transform, cv::Mat& gray,
+                cv::Mat* inv_depth){
+  Eigen::Matrix3f rotation_t = transform.block<3, 3>(0, 0).transpose();
+  Eigen::Vector3f translation = transform.block<3, 1>(0, 3);
+  Eigen::Vector3f normal_cam = transform.block<3, 3>(0, 0) * kPlaneNormal; // the plane in the camera frame
+  float distance_cam = kPlaneDistance + normal_cam.dot(translation);
+  gray.create(kKittiRows, kKittiCols, PixelType);
+  if (inv_depth != nullptr) inv_depth->create(kKittiRows, kKittiCols, PixelType);
+  for (int y = 0; y < kKittiRows; y++){
+    for (int x = 0; x < kKittiCols; x++){
+      Eigen::Vector3f ray((float(x) - kKittiCx) / kKittiFx, (float(y) - kKittiCy) / kKittiFx, 1.0f);
+      float depth = distance_cam / normal_cam.dot(ray); // ray.z == 1: the scale is the depth
+      Eigen::Vector3f point_1 = rotation_t * (depth * ray - translation);
+      gray.at<float>(y, x) = texture.At(kTextureScale * point_1(0), kTextureScale * point_1(1));
+      if (inv_depth != nullptr) inv_depth->at<float>(y, x) = 1.0f / depth;
+    }
+  }
+}
 
+// translation [m] and rotation [deg] of the error transform
+void PoseError(const odometry::Affine4f& error, float& trans_err, float& rot_err_deg){
+  trans_err = error.block<3, 1>(0, 3).norm();
+  rot_err_deg = Eigen::AngleAxisf(Eigen::Matrix3f(error.block<3, 3>(0, 0))).angle() * 180.0f / float(M_PI);
+}
 
-  /******************************* LOAD DATASET ***********************************/
-  Eigen::MatrixXf poses(7, N_FRAMES); // qw, qx, qy, qz, tx, ty, tz; absolute pose of cameras w.r.t. world origin
-  std::vector<cv::Mat> gray(N_FRAMES); // float intensity
-  std::vector<cv::Mat> depth(N_FRAMES); // float depth
-  load_data(kDataPath + "/associated.txt", gray, depth, poses, N_FRAMES);
-  std::cout << "Load data done: " << N_FRAMES << " frames" << std::endl;
+odometry::Affine4f MakeTransform(float rx, float ry, float rz, float tx, float ty, float tz){
+  odometry::Affine4f transform = odometry::Affine4f::Identity();
+  transform.block<3, 3>(0, 0) = (Eigen::AngleAxisf(rz, Eigen::Vector3f::UnitZ()) * Eigen::AngleAxisf(ry, Eigen::Vector3f::UnitY())
+                                 * Eigen::AngleAxisf(rx, Eigen::Vector3f::UnitX())).toRotationMatrix();
+  transform.block<3, 1>(0, 3) << tx, ty, tz;
+  return transform;
+}
 
+// LM iterations of the coarsest level so far
+uint64_t CoarseIterations(){
+  return odometry::metrics::Registry().GetCounter("odometry_pose_lm_iterations_total",
+          "LM iterations of the pose optimization per pyramid level.", "level=\"3\"").Value();
+}
 
-  /******************************* CREATE IMAGE/DEPTH PYRAMIDS ***********************************/
-  // all input rgb must already be converted to grayscale(float), depth must also be float(in meters, invalid = 0)
-  // avoid copying using unique_ptr
-  std::vector<std::unique_ptr<odometry::ImagePyramid>> img_pyramids;
-  std::vector<std::unique_ptr<odometry::DepthPyramid>> dep_pyramids;
-  for (int idx = 0; idx < N_FRAMES; idx++){
-    img_pyramids.emplace_back(std::make_unique<odometry::ImagePyramid>(4, gray[idx], false));
-    dep_pyramids.emplace_back(std::make_unique<odometry::DepthPyramid>(4, depth[idx], false));
+// EuRoC csv of an IMU rotating at the constant rate gyro [rad/s] for duration seconds at 200 Hz from start [s]
+void WriteImuCsv(const std::string& file_name, double start, double duration, const Eigen::Vector3f& gyro,
+                 const Eigen::Vector3f& accel){
+  std::ofstream file(file_name);
+  file << "#timestamp [ns],w_RS_S_x [rad s^-1],w_RS_S_y [rad s^-1],w_RS_S_z [rad s^-1],"
+       << "a_RS_S_x [m s^-2],a_RS_S_y [m s^-2],a_RS_S_z [m s^-2]" << std::endl;
+  for (int i = 0; i <= int(duration * 200.0); i++){
+    file << (long long)(start * 1e9) + 5000000LL * i << "," << gyro(0) << "," << gyro(1) << "," << gyro(2) << ","
+         << accel(0) << "," << accel(1) << "," << accel(2) << std::endl;
   }
+}
 
+} // namespace
+
+int main() {
+  std::cout << "test_optimizer: synthetic " << kKittiRows << "x" << kKittiCols << " frames" << std::endl;
+  odometry::test::SyntheticTexture texture(5);
 
   /******************************* CREATE OPTIMIZER INSTANCE ***********************************/
+  // same parameters as run_odometry_kitti, the optimizer uses the KITTI intrinsics
+  std::shared_ptr<odometry::CameraPyramid> camera_ptr = nullptr;
   std::vector<int> max_iters = {10, 20, 30, 30};
-  odometry::Affine4f init_relative_affine;
-  init_relative_affine.block<3,3>(0,0) = Eigen::Matrix<float, 3, 3>::Identity();
-  init_relative_affine.block<1,4>(3,0) << 0.0f, 0.0f, 0.0f, 1.0f;
-  init_relative_affine.block<3,1>(0,3) << 0.0f, 0.0f, 0.0f;
-  // robust estimator: 0-no, 1-huber, 2-t_dist; t-dist estimator is the better in general
-  int robust_estimator = 2;
-  float huber_delta = 28.0f;
-  odometry::LevenbergMarquardtOptimizer optimizer(0.01f, 0.995f, max_iters, init_relative_affine, camera_ptr, robust_estimator, huber_delta);
-  std::cout << "Created optimizer instance." << std::endl;
-
+  odometry::Affine4f init_relative_affine = odometry::Affine4f::Identity();
+  odometry::LevenbergMarquardtOptimizer optimizer(0.01f, 0.995f, max_iters, init_relative_affine, camera_ptr, 1, 28.0f);
 
   /******************************* ESTIMATE & EVALUATE POSES ***********************************/
-  // optimize relative camera pose of pairs of frames
-  clock_t begin, end;
-  odometry::Affine4f rela_pose;
-  odometry::Affine4f pred_pose;
-  odometry::Affine4f gt_pose;
-  float trans_err = 0.0f;
-  std::vector<float> acc_errs(N_FRAMES);
-  Eigen::AngleAxisf rotation_mat0(Eigen::Quaternionf(poses(0,0), poses(1,0), poses(2,0), poses(3,0)));
-  odometry::Affine4f pose0;
-  pose0.block<3,3>(0,0) = rotation_mat0.toRotationMatrix();
-  pose0.block<4,1>(0,3) << poses(4,0), poses(5,0), poses(6,0), 1.0f;
-  pose0.block<1,3>(3,0) << 0.0f, 0.0f, 0.0f;
-  pred_pose = pose0; // set the 0th pose as the starting point
-  acc_errs[0] = 0.0f;
-  for (int f_id = 1; f_id < N_FRAMES; f_id++){
-    std::cout << "Optimize frame " << f_id << " ..." << std::endl;
-    // compute current relative pose
-    begin = clock();
-    rela_pose = optimizer.Solve(*img_pyramids[f_id-1], *dep_pyramids[f_id-1], *img_pyramids[f_id]);
-    end = clock();
-    std::cout << "run time: " << double(end - begin) / CLOCKS_PER_SEC * 1000.0f << " ms." << std::endl;
-    // compute current absolute pose
-    pred_pose = pred_pose.eval() * rela_pose.inverse();
-    // get current absolute gt pose
-    Eigen::AngleAxisf rotation_mat_gt(Eigen::Quaternionf(poses(0,f_id), poses(1,f_id), poses(2,f_id), poses(3,f_id)));
-    gt_pose.block<3,3>(0,0) = rotation_mat_gt.toRotationMatrix();
-    gt_pose.block<4,1>(0,3) << poses(4,f_id), poses(5,f_id), poses(6,f_id), 1.0f;
-    gt_pose.block<1,3>(3,0) << 0.0f, 0.0f, 0.0f;
-    // compute translation error
-    trans_err = (pred_pose.block<3,1>(0,3) - gt_pose.block<3,1>(0,3)).norm();
-    acc_errs[f_id] = trans_err;
-    // reset optimizer
+  // typical KITTI frame to frame motions at 10 Hz: forward driving, turning, a little sideways/vertical shake
+  std::vector<odometry::Affine4f> gt_motions = {
+    MakeTransform(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, -0.8f),
+    MakeTransform(0.0f, 0.015f, 0.0f, 0.02f, 0.0f, -0.6f),
+    MakeTransform(0.005f, -0.01f, 0.003f, -0.05f, 0.02f, -1.0f),
+  };
+  cv::Mat gray1, inv_depth1, gray2;
+  RenderView(texture, odometry::Affine4f::Identity(), gray1, &inv_depth1);
+  odometry::ImagePyramid img_pyramid1(4, gray1, true);
+  odometry::DepthPyramid dep_pyramid1(4, inv_depth1, false);
+  // the compact storage quantizes the intensities (uint8: 0.5, half float: 0.125 at most), the pose moves slightly
+  const odometry::PyramidStorage kCompact[2] = {odometry::kStorageUint8, odometry::kStorageFloat16};
+  const char* kCompactNames[2] = {"uint8", "float16"};
+  std::vector<odometry::ImagePyramid> compact_pyramids1;
+  for (odometry::PyramidStorage storage : kCompact) compact_pyramids1.emplace_back(4, gray1, true, storage);
+  for (size_t i = 0; i < gt_motions.size(); i++){
+    RenderView(texture, gt_motions[i], gray2, nullptr);
+    odometry::ImagePyramid img_pyramid2(4, gray2, true);
+    optimizer.Reset(init_relative_affine, 0.01f);
+    // the optimizer estimates the transform from the first to the second camera frame
+    odometry::Affine4f rela_pose = optimizer.Solve(img_pyramid1, dep_pyramid1, img_pyramid2);
+    float trans_err, rot_err_deg;
+    PoseError(rela_pose * gt_motions[i].inverse(), trans_err, rot_err_deg);
+    std::string motion = "motion " + std::to_string(i);
+    odometry::test::ExpectLessEqual(trans_err, 0.005, motion + " translation error [m]");
+    odometry::test::ExpectLessEqual(rot_err_deg, 0.01, motion + " rotation error [deg]");
+    for (int k = 0; k < 2; k++){
+      odometry::ImagePyramid compact_pyramid2(4, gray2, true, kCompact[k]);
+      optimizer.Reset(init_relative_affine, 0.01f);
+      odometry::Affine4f compact_pose = optimizer.Solve(compact_pyramids1[k], dep_pyramid1, compact_pyramid2);
+      std::string compact_motion = motion + " " + kCompactNames[k];
+      PoseError(compact_pose * gt_motions[i].inverse(), trans_err, rot_err_deg);
+      odometry::test::ExpectLessEqual(trans_err, 0.005, compact_motion + " translation error [m]");
+      odometry::test::ExpectLessEqual(rot_err_deg, 0.01, compact_motion + " rotation error [deg]");
+      PoseError(compact_pose * rela_pose.inverse(), trans_err, rot_err_deg);
+      odometry::test::ExpectLessEqual(trans_err, 0.0002, compact_motion + " translation difference to float [m]");
+      odometry::test::ExpectLessEqual(rot_err_deg, 0.001, compact_motion + " rotation difference to float [deg]");
+    }
+  }
+  // sparse anchors with pattern residuals: same bounds as the dense residuals
+  odometry::LevenbergMarquardtOptimizer pattern_optimizer(0.01f, 0.995f, max_iters, init_relative_affine, camera_ptr, 1, 28.0f);
+  pattern_optimizer.SetTrackingResiduals(odometry::kPattern8Residuals);
+  for (size_t i = 0; i < gt_motions.size(); i++){
+    RenderView(texture, gt_motions[i], gray2, nullptr);
+    odometry::ImagePyramid img_pyramid2(4, gray2, true);
+    pattern_optimizer.Reset(init_relative_affine, 0.01f);
+    odometry::Affine4f rela_pose = pattern_optimizer.Solve(img_pyramid1, dep_pyramid1, img_pyramid2);
+    float trans_err, rot_err_deg;
+    PoseError(rela_pose * gt_motions[i].inverse(), trans_err, rot_err_deg);
+    std::string motion = "motion " + std::to_string(i) + " pattern8";
+    odometry::test::ExpectLessEqual(trans_err, 0.005, motion + " translation error [m]");
+    odometry::test::ExpectLessEqual(rot_err_deg, 0.01, motion + " rotation error [deg]");
+  }
+  // large motion (2 m forward, 3.4 deg yaw): the optimization from the identity prior lands in a wrong minimum
+  std::shared_ptr<odometry::PoseInitializer> initializer =
+      std::make_shared<odometry::PoseInitializer>(1, 20.0f, 16, 100, 2.0f, 20, camera_ptr);
+  odometry::LevenbergMarquardtOptimizer seeded_optimizer(0.01f, 0.995f, max_iters, init_relative_affine, camera_ptr, 1, 28.0f);
+  seeded_optimizer.SetPoseInitializer(initializer);
+  odometry::metrics::Counter& seeds = odometry::metrics::Registry().GetCounter("odometry_pose_seeds_total",
+          "Feature based pose seeds of the tracking.", "result=\"accepted\"");
+  uint64_t seeds_before = seeds.Value();
+  RenderView(texture, gt_motions[1], gray2, nullptr);
+  odometry::ImagePyramid small_pyramid2(4, gray2, true);
+  seeded_optimizer.Reset(init_relative_affine, 0.01f);
+  seeded_optimizer.Solve(img_pyramid1, dep_pyramid1, small_pyramid2);
+  odometry::test::Expect(seeds.Value() == seeds_before, "no pose seed for a small motion");
+  const odometry::Affine4f kLargeMotion = MakeTransform(0.0f, 0.06f, 0.0f, 0.1f, 0.0f, -2.0f);
+  RenderView(texture, kLargeMotion, gray2, nullptr);
+  odometry::ImagePyramid large_pyramid2(4, gray2, true);
+  seeded_optimizer.Reset(init_relative_affine, 0.01f);
+  odometry::Affine4f large_pose = seeded_optimizer.Solve(img_pyramid1, dep_pyramid1, large_pyramid2);
+  odometry::test::Expect(seeds.Value() == seeds_before + 1, "pose seed for a large motion");
+  odometry::test::ExpectGreaterEqual(initializer->GetNumInliers(), 20, "pose seed inliers");
+  {
+    float trans_err, rot_err_deg;
+    PoseError(large_pose * kLargeMotion.inverse(), trans_err, rot_err_deg);
+    odometry::test::ExpectLessEqual(trans_err, 0.005, "large motion translation error [m]");
+    odometry::test::ExpectLessEqual(rot_err_deg, 0.01, "large motion rotation error [deg]");
+  }
+  // IMU prior: the camera looks along the x axis of the IMU (Kalibr T_cam_imu), frames at 10 Hz
+  odometry::Affine4f cam_imu = odometry::Affine4f::Identity();
+  cam_imu.block<3, 3>(0, 0) << 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f;
+  cam_imu.block<3, 1>(0, 3) << 0.05f, -0.02f, 0.1f;
+  odometry::ImuPreintegrator preintegrator(cam_imu, Eigen::Vector3f::Zero(), Eigen::Vector3f::Zero());
+  const double kImuStart = 1403636579.0, kFrame0 = kImuStart + 0.05, kFrame1 = kImuStart + 0.15;
+  const std::vector<odometry::Affine4f> kRotationMotions = {
+    MakeTransform(0.01f, 0.05f, 0.01f, 0.05f, 0.0f, -0.8f),
+    MakeTransform(0.02f, 0.1f, 0.02f, 0.05f, 0.0f, -0.8f),
+  };
+  for (size_t i = 0; i < kRotationMotions.size(); i++){
+    // rotation of the IMU frame at frame 1 in the IMU frame at frame 0, reached at a constant rate
+    Eigen::Matrix3f imu_rotation = cam_imu.block<3, 3>(0, 0).transpose() * kRotationMotions[i].block<3, 3>(0, 0).transpose()
+                                   * cam_imu.block<3, 3>(0, 0);
+    Eigen::Vector3f gyro = Sophus::SO3<float>(imu_rotation).log() / float(kFrame1 - kFrame0);
+    WriteImuCsv("imu_test.csv", kImuStart, 0.2, gyro, Eigen::Vector3f(0.0f, 0.0f, 9.81f));
+    std::vector<odometry::ImuSample> samples;
+    std::string motion = "rotation motion " + std::to_string(i);
+    odometry::test::Expect(odometry::ReadImuCsv("imu_test.csv", samples) != -1 && samples.size() == 41, motion + " IMU csv");
+    odometry::test::Expect(preintegrator.Integrate(samples, kFrame0, kFrame1) != -1, motion + " IMU preintegration");
+    odometry::Affine4f prior = preintegrator.PredictCameraMotion(init_relative_affine);
+    float trans_err, rot_err_deg;
+    PoseError(prior * kRotationMotions[i].inverse(), trans_err, rot_err_deg);
+    odometry::test::ExpectLessEqual(rot_err_deg, 0.01, motion + " IMU prior rotation error [deg]");
+    RenderView(texture, kRotationMotions[i], gray2, nullptr);
+    odometry::ImagePyramid rotation_pyramid2(4, gray2, true);
     optimizer.Reset(init_relative_affine, 0.01f);
+    uint64_t iterations_before = CoarseIterations();
+    odometry::Affine4f constant_pose = optimizer.Solve(img_pyramid1, dep_pyramid1, rotation_pyramid2);
+    uint64_t constant_iterations = CoarseIterations() - iterations_before;
+    float constant_trans_err, constant_rot_err_deg;
+    PoseError(constant_pose * kRotationMotions[i].inverse(), constant_trans_err, constant_rot_err_deg);
+    optimizer.Reset(prior, 0.01f);
+    iterations_before = CoarseIterations();
+    odometry::Affine4f rela_pose = optimizer.Solve(img_pyramid1, dep_pyramid1, rotation_pyramid2);
+    uint64_t imu_iterations = CoarseIterations() - iterations_before;
+    PoseError(rela_pose * kRotationMotions[i].inverse(), trans_err, rot_err_deg);
+    odometry::test::ExpectLessEqual(trans_err, 0.005, motion + " translation error [m]");
+    odometry::test::ExpectLessEqual(rot_err_deg, 0.01, motion + " rotation error [deg]");
+    if (i == 0){
+      // converges from the constant prior too, but slowly
+      odometry::test::ExpectLessEqual(double(imu_iterations), double(constant_iterations) / 2.0,
+                                      motion + " coarse LM iterations, IMU prior vs. constant prior " + std::to_string(constant_iterations));
+    } else {
+      // the constant prior ends in a wrong minimum
+      odometry::test::Expect(constant_rot_err_deg > 1.0f, motion + " fails from the constant prior, rotation error [deg] "
+                             + std::to_string(constant_rot_err_deg));
+    }
   }
-
-  /******************************* PRINT TRANSLATION ERRORS ***********************************/
-  for (int i = 0; i < N_FRAMES; i++){
-    std::cout << "accumulated errs(translation): " << acc_errs[i] << std::endl;
+  // translation: constant specific force without rotation, dp = 0.5 * a * dt^2
+  WriteImuCsv("imu_test.csv", kImuStart, 0.2, Eigen::Vector3f::Zero(), Eigen::Vector3f(1.0f, 0.5f, 9.81f));
+  std::vector<odometry::ImuSample> samples;
+  odometry::ReadImuCsv("imu_test.csv", samples);
+  preintegrator.Integrate(samples, kFrame0 + 0.0025, kFrame1);
+  Eigen::Vector3f expected_position = 0.5f * 0.0975f * 0.0975f * Eigen::Vector3f(1.0f, 0.5f, 9.81f);
+  odometry::test::ExpectLessEqual((preintegrator.GetDeltaPosition() - expected_position).norm(), 1e-5,
+                                  "IMU preintegrated position [m]");
+  // falling at 1 m/s along the gravity: the specific force cancels the gravity, the IMU keeps its velocity
+  odometry::Affine4f imu_motion = preintegrator.PredictCameraMotion(Eigen::Vector3f(0.0f, 0.0f, -1.0f),
+                                                                    Eigen::Vector3f(-1.0f, -0.5f, -9.81f));
+  Eigen::Vector4f imu_origin = cam_imu.inverse() * imu_motion.inverse() * cam_imu * Eigen::Vector4f(0.0f, 0.0f, 0.0f, 1.0f);
+  odometry::test::ExpectLessEqual((imu_origin.head<3>() - Eigen::Vector3f(0.0f, 0.0f, -0.0975f)).norm(), 1e-5,
+                                  "IMU predicted translation [m]");
+  std::remove("imu_test.csv");
+  // concurrent tracking: the previous frame lies between the keyframe (frame 1) and the current frame, both optimizers
+  // start from the identity prior
+  const odometry::Affine4f kPreviousMotion = MakeTransform(0.0f, 0.05f, 0.0f, 0.1f, 0.0f, -1.7f);
+  cv::Mat gray_pre, inv_depth_pre;
+  RenderView(texture, kPreviousMotion, gray_pre, &inv_depth_pre);
+  odometry::ImagePyramid img_pyramid_pre(4, gray_pre, true);
+  odometry::DepthPyramid dep_pyramid_pre(4, inv_depth_pre, false);
+  odometry::LevenbergMarquardtOptimizer frame_optimizer(0.01f, 0.995f, max_iters, init_relative_affine, camera_ptr, 1, 28.0f);
+  const odometry::ImagePyramid* kCurrentPyramids[2] = {&large_pyramid2, &small_pyramid2};
+  const odometry::Affine4f kCurrentMotions[2] = {kLargeMotion, gt_motions[1]};
+  // the large motion is out of reach from the keyframe, the small one from the previous frame
+  const odometry::TrackingSource kExpectedSources[2] = {odometry::kFrameTracking, odometry::kKeyframeTracking};
+  for (int i = 0; i < 2; i++){
+    std::string motion = "concurrent tracking " + std::to_string(i);
+    optimizer.Reset(init_relative_affine, 0.01f);
+    frame_optimizer.Reset(init_relative_affine, 0.01f);
+    odometry::Affine4f pose_to_keyframe;
+    odometry::TrackingSource source = odometry::TrackConcurrently(optimizer, img_pyramid1, dep_pyramid1, frame_optimizer,
+                                                                  img_pyramid_pre, dep_pyramid_pre, *kCurrentPyramids[i],
+                                                                  kPreviousMotion, 0.75f, pose_to_keyframe);
+    std::cout << "  " << motion << " final cost keyframe/frame: " << optimizer.GetFinalCost() << "/"
+              << frame_optimizer.GetFinalCost() << ", residuals: " << optimizer.GetNumResiduals() << "/"
+              << frame_optimizer.GetNumResiduals() << std::endl;
+    odometry::test::Expect(source == kExpectedSources[i], motion + " source");
+    float trans_err, rot_err_deg;
+    PoseError(pose_to_keyframe * kCurrentMotions[i].inverse(), trans_err, rot_err_deg);
+    odometry::test::ExpectLessEqual(trans_err, 0.005, motion + " translation error [m]");
+    odometry::test::ExpectLessEqual(rot_err_deg, 0.01, motion + " rotation error [deg]");
   }
-  float avg_err = std::accumulate(acc_errs.begin(), acc_errs.end(), 0.0f) / float(N_FRAMES-1);
-  std::cout << "average errs(translation) over " << N_FRAMES << " frames: " << avg_err << std::endl;
-  return 0;
-}
-
-void load_data(std::string filename, std::vector<cv::Mat> &gray, std::vector<cv::Mat> &depth, Eigen::MatrixXf &poses, int n_frames) {
-  std::string line;
-  std::ifstream file(filename);
-  int counter = 0;
-  if (file.is_open()) {
-    while (std::getline(file, line) && counter < n_frames) {
-      std::vector<std::string> items;
-      std::string item;
-      std::stringstream ss(line);
-      while (std::getline(ss, item, ' '))
-        items.push_back(item);
-
-      // -> load gray
-      std::string filename_rgb = std::string(kDataPath + "/") + items[9];
-      cv::Mat gray_8u = cv::imread(filename_rgb, cv::IMREAD_GRAYSCALE);
-      if (gray_8u.empty()){
-        std::cout << "read img failed for: " << counter << std::endl;
-        std::exit(-1);
-      }
-      gray_8u.convertTo(gray[counter], PixelType);
-      // <-
-
-      // -> load depth
-      std::string filename_depth = std::string(kDataPath + "/") + items[11];
-      cv::Mat depth_img = cv::imread(filename_depth, cv::IMREAD_UNCHANGED);
-      if (depth_img.empty()){
-        std::cout << "read depth img failed for: " << counter << std::endl;
-        std::exit(-1);
-      }
-      depth_img.convertTo(depth[counter], PixelType, 1.0f/5000.0f);
+  // checkpoint: an optimizer of the saved state on the loaded pyramids continues with the same pose, bit for bit
+  {
+    odometry::OdometryCheckpoint saved, loaded;
+    saved.frame_id = 7;
+    saved.keyframe_ids = {0, 5};
+    saved.keyframe_poses = {odometry::Affine4f::Identity(), kPreviousMotion};
+    saved.keyframe_image = std::make_shared<odometry::ImagePyramid>(compact_pyramids1[0]);
+    saved.keyframe_depth = std::make_shared<odometry::DepthPyramid>(dep_pyramid1);
+    saved.keyframe_valid = cv::Mat(inv_depth1.rows, inv_depth1.cols, CV_8U, cv::Scalar(1));
+    saved.frame_image = std::make_shared<odometry::ImagePyramid>(img_pyramid_pre);
+    saved.frame_depth = std::make_shared<odometry::DepthPyramid>(dep_pyramid_pre);
+    saved.pose = kPreviousMotion.inverse();
+    optimizer.Reset(gt_motions[2], 0.02f);
+    saved.keyframe_tracking = optimizer.GetState();
+    saved.frame_tracking = seeded_optimizer.GetState();
+    odometry::test::Expect(odometry::SaveCheckpoint("checkpoint_test.bin", saved) != -1 &&
+                           odometry::LoadCheckpoint("checkpoint_test.bin", loaded) != -1, "checkpoint save and load");
+    odometry::test::Expect(loaded.frame_id == 7 && loaded.keyframe_ids == saved.keyframe_ids &&
+                           loaded.keyframe_poses[1] == kPreviousMotion && loaded.pose == saved.pose &&
+                           loaded.keyframe_image->GetStorage() == odometry::kStorageUint8 &&
+                           loaded.frame_tracking.prior_uncertain == saved.frame_tracking.prior_uncertain,
+                           "checkpoint fields");
+    odometry::ImagePyramid compact_pyramid2(4, gray2, true, odometry::kStorageUint8);
+    odometry::Affine4f continued_pose = optimizer.Solve(compact_pyramids1[0], dep_pyramid1, compact_pyramid2);
+    odometry::LevenbergMarquardtOptimizer resumed_optimizer(0.01f, 0.995f, max_iters, init_relative_affine, camera_ptr, 1, 28.0f);
+    resumed_optimizer.SetState(loaded.keyframe_tracking);
+    odometry::Affine4f resumed_pose = resumed_optimizer.Solve(*loaded.keyframe_image, *loaded.keyframe_depth, compact_pyramid2);
+    odometry::test::Expect(resumed_pose == continued_pose, "pose after resuming from the checkpoint");
+    std::ofstream("checkpoint_test.bin", std::ios::binary | std::ios::trunc) << "ODOCKP01";
+    odometry::test::Expect(odometry::LoadCheckpoint("checkpoint_test.bin", loaded) == -1, "cut checkpoint rejected");
+    std::remove("checkpoint_test.bin");
+  }
+  // bytes per pixel of the stored levels
+  odometry::test::Expect(compact_pyramids1[0].GetPyramidData(0).elemSize() == 1
+                         && compact_pyramids1[1].GetPyramidData(0).elemSize() == 2, "compact pyramid storage size");
 
-      // -> pose
-      Eigen::Vector3f t(std::stof(items[1]), std::stof(items[2]), std::stof(items[3])); // <- translation T
-      //Eigen::Quaternionf q(std::stof(items[7]), std::stof(items[4]), std::stof(items[5]), std::stof(items[6])); // <- rotation in Eigen: w,x,y,z
-      //Eigen::Vector3f a = Eigen::AngleAxisf(q).angle()*Eigen::AngleAxisf(q).axis(); // <-- convert to axis angle
-      poses.col(counter) << std::stof(items[7]), std::stof(items[4]), std::stof(items[5]), std::stof(items[6]), t(0), t(1), t(2);
-      counter++;
-    }
-    file.close();
+  /******************************* TIMING ***********************************/
+  odometry::test::PerfGate gate;
+  gate.Check("optimizer.image_pyramid", odometry::test::MedianMs([&](){ odometry::ImagePyramid pyramid(4, gray2, true); }, 9));
+  gate.Check("optimizer.depth_pyramid", odometry::test::MedianMs([&](){ odometry::DepthPyramid pyramid(4, inv_depth1, false); }, 9));
+  odometry::ImagePyramid img_pyramid2(4, gray2, true);
+  gate.Check("optimizer.solve", odometry::test::MedianMs([&](){
+    optimizer.Reset(init_relative_affine, 0.01f);
+    optimizer.Solve(img_pyramid1, dep_pyramid1, img_pyramid2);
+  }, 5));
+  for (int k = 0; k < 2; k++){
+    odometry::ImagePyramid compact_pyramid2(4, gray2, true, kCompact[k]);
+    gate.Check(std::string("optimizer.solve_") + kCompactNames[k], odometry::test::MedianMs([&](){
+      optimizer.Reset(init_relative_affine, 0.01f);
+      optimizer.Solve(compact_pyramids1[k], dep_pyramid1, compact_pyramid2);
+    }, 5));
   }
-  assert(counter == n_frames);
-};
\ No newline at end of file
+  gate.Check("optimizer.solve_pattern8", odometry::test::MedianMs([&](){
+    pattern_optimizer.Reset(init_relative_affine, 0.01f);
+    pattern_optimizer.Solve(img_pyramid1, dep_pyramid1, img_pyramid2);
+  }, 5));
+  gate.Check("optimizer.pose_seed", odometry::test::MedianMs([&](){
+    odometry::Affine4f seed;
+    initializer->EstimatePose(img_pyramid1, dep_pyramid1, large_pyramid2, init_relative_affine, seed);
+  }, 9));
+  gate.Check("optimizer.concurrent_tracking", odometry::test::MedianMs([&](){
+    optimizer.Reset(init_relative_affine, 0.01f);
+    frame_optimizer.Reset(init_relative_affine, 0.01f);
+    odometry::Affine4f pose_to_keyframe;
+    odometry::TrackConcurrently(optimizer, img_pyramid1, dep_pyramid1, frame_optimizer, img_pyramid_pre, dep_pyramid_pre,
+                                img_pyramid2, kPreviousMotion, 0.75f, pose_to_keyframe);
+  }, 5));
+  gate.Save();
+  return odometry::test::Finish("test_optimizer");
+}
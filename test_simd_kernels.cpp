@@ -0,0 +1,531 @@
+// The file tests every SIMD kernel variant supported by the running CPU against the scalar reference, see simd_dispatch.h
+// Per element outputs must be bit-identical, only the lane reductions (sums) may differ by rounding.
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <simd_dispatch.h>
+
+namespace
+{
+
+const int kRows = 96;
+const int kCols = 157; // not a multiple of any lane count, so every tail is exercised
+const int kStride = 160;
+const float kReduceTol = 1e-4f;
+
+int num_failures = 0;
+
+void Check(bool ok, const std::string& kernel, const char* level, const std::string& what){
+  if (!ok){
+    std::cout << "  [FAILED] " << kernel << " (" << level << "): " << what << std::endl;
+    num_failures++;
+  }
+}
+
+bool NearlyEqual(float a, float b){
+  return std::fabs(a - b) <= kReduceTol * std::max(1.0f, std::max(std::fabs(a), std::fabs(b)));
+}
+
+std::vector<float> RandomImage(std::mt19937& rng, float low, float high){
+  std::uniform_real_distribution<float> dist(low, high);
+  std::vector<float> img(kRows * kStride);
+  for (float& p : img) p = dist(rng);
+  return img;
+}
+
+void TestSsdSearch(const odometry::SimdKernels& ref, const odometry::SimdKernels& test, std::mt19937& rng){
+  std::vector<float> right = RandomImage(rng, 0.0f, 1.0f);
+  const float* right_rows[5];
+  for (int i = 0; i < 5; i++) right_rows[i] = right.data() + (10 + i) * kStride;
+  float left_pattern[8];
+  for (int y = 0; y < 50; y++){
+    for (int t = 0; t < 8; t++) left_pattern[t] = right_rows[odometry::kPattern8[t][0] + 2][40 + y + odometry::kPattern8[t][1]];
+    // empty, short and long ranges, including a duplicated best column
+    int begin_x = 2;
+    int end_x = 2 + y * 3;
+    if (y == 7) right_rows[2] = right_rows[1];
+    float ssd_ref = 0, ssd_test = 0;
+    int x_ref = ref.ssd_pattern8_search(left_pattern, right_rows, begin_x, end_x, &ssd_ref);
+    int x_test = test.ssd_pattern8_search(left_pattern, right_rows, begin_x, end_x, &ssd_test);
+    Check(x_ref == x_test && ssd_ref == ssd_test, "ssd_pattern8_search", test.name, "range " + std::to_string(end_x));
+  }
+}
+
+void TestPyramidDown(const odometry::SimdKernels& ref, const odometry::SimdKernels& test, std::mt19937& rng){
+  std::vector<float> src = RandomImage(rng, 0.0f, 1.0f);
+  int dst_rows = kRows / 2, dst_cols = kCols / 2;
+  std::vector<float> dst_ref(dst_rows * kStride, 0.0f), dst_test(dst_rows * kStride, 0.0f);
+  ref.pyramid_down(src.data(), kStride, dst_ref.data(), kStride, dst_rows, dst_cols);
+  test.pyramid_down(src.data(), kStride, dst_test.data(), kStride, dst_rows, dst_cols);
+  Check(dst_ref == dst_test, "pyramid_down", test.name, "output differs");
+}
+
+void TestNormalEquations(const odometry::SimdKernels& ref, const odometry::SimdKernels& test, std::mt19937& rng){
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  const int kNum = 1001;
+  std::vector<float> jaco(6 * kNum), residual(kNum), weight(kNum);
+  for (float& v : jaco) v = dist(rng);
+  for (float& v : residual) v = dist(rng);
+  for (float& v : weight) v = std::fabs(dist(rng));
+  float h_ref[36], g_ref[6], c_ref, h_test[36], g_test[6], c_test;
+  ref.accumulate_normal_equations(jaco.data(), kNum, residual.data(), weight.data(), kNum, h_ref, g_ref, &c_ref);
+  test.accumulate_normal_equations(jaco.data(), kNum, residual.data(), weight.data(), kNum, h_test, g_test, &c_test);
+  bool ok = NearlyEqual(c_ref, c_test);
+  for (int k = 0; k < 36; k++) ok = ok && NearlyEqual(h_ref[k], h_test[k]);
+  for (int k = 0; k < 6; k++) ok = ok && NearlyEqual(g_ref[k], g_test[k]);
+  Check(ok, "accumulate_normal_equations", test.name, "sums differ");
+}
+
+void TestPoseResidual(const odometry::SimdKernels& ref, const odometry::SimdKernels& test, std::mt19937& rng){
+  std::vector<float> img1 = RandomImage(rng, 0.0f, 1.0f);
+  std::vector<float> img2 = RandomImage(rng, 0.0f, 1.0f);
+  std::vector<float> inv_depth = RandomImage(rng, 0.05f, 1.0f);
+  std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+  for (float& d : inv_depth){
+    if (dist(rng) < 0.3f) d = 0.0f; // invalid depth
+  }
+  const float kCamera[4] = {90.0f, 90.0f, 78.5f, 48.0f};
+  // small rotation about y and a translation large enough to push points out of the image
+  const float kTransform[12] = {0.9998f, 0.0f, 0.02f, 0.3f, 0.0f, 1.0f, 0.0f, -0.1f, -0.02f, 0.0f, 0.9998f, 0.05f};
+  int capacity = kRows * kCols;
+  std::vector<float> jaco_ref(6 * capacity, 0.0f), res_ref(capacity, 0.0f);
+  std::vector<float> jaco_test(6 * capacity, 0.0f), res_test(capacity, 0.0f);
+  int num_ref = ref.pose_residual_jacobian(img1.data(), img2.data(), inv_depth.data(), kStride, kRows, kCols, 4, kCamera,
+                                           kTransform, jaco_ref.data(), capacity, res_ref.data());
+  int num_test = test.pose_residual_jacobian(img1.data(), img2.data(), inv_depth.data(), kStride, kRows, kCols, 4, kCamera,
+                                             kTransform, jaco_test.data(), capacity, res_test.data());
+  Check(num_ref > 0 && num_ref == num_test, "pose_residual_jacobian", test.name, "number of residuals differs");
+  Check(res_ref == res_test && jaco_ref == jaco_test, "pose_residual_jacobian", test.name, "output differs");
+}
+
+void TestPosePattern8(const odometry::SimdKernels& ref, const odometry::SimdKernels& test, std::mt19937& rng){
+  std::vector<float> img1 = RandomImage(rng, 0.0f, 1.0f);
+  std::vector<float> img2 = RandomImage(rng, 0.0f, 1.0f);
+  std::uniform_int_distribution<int> dist_x(2, kCols - 3), dist_y(2, kRows - 3);
+  std::uniform_real_distribution<float> dist_d(0.0f, 1.0f);
+  const int kNum = 333; // not a multiple of the anchor group
+  std::vector<int> xs(kNum), ys(kNum);
+  std::vector<float> inv_depth(kNum);
+  for (int i = 0; i < kNum; i++){
+    xs[i] = dist_x(rng);
+    ys[i] = dist_y(rng);
+    inv_depth[i] = dist_d(rng) < 0.2f ? 0.0f : 0.05f + dist_d(rng); // some invalid depth
+  }
+  const float kCamera[4] = {90.0f, 90.0f, 78.5f, 48.0f};
+  const float kTransform[12] = {0.9998f, 0.0f, 0.02f, 0.3f, 0.0f, 1.0f, 0.0f, -0.1f, -0.02f, 0.0f, 0.9998f, 0.05f};
+  int capacity = 8 * kNum;
+  std::vector<float> jaco_ref(6 * capacity, 0.0f), res_ref(capacity, 0.0f);
+  std::vector<float> jaco_test(6 * capacity, 0.0f), res_test(capacity, 0.0f);
+  int num_ref = ref.pose_residual_jacobian_pattern8(img1.data(), img2.data(), kStride, kRows, kCols, xs.data(), ys.data(),
+                                                    inv_depth.data(), kNum, kCamera, kTransform, jaco_ref.data(),
+                                                    capacity, res_ref.data());
+  int num_test = test.pose_residual_jacobian_pattern8(img1.data(), img2.data(), kStride, kRows, kCols, xs.data(), ys.data(),
+                                                      inv_depth.data(), kNum, kCamera, kTransform, jaco_test.data(),
+                                                      capacity, res_test.data());
+  Check(num_ref > 0 && num_ref < capacity && num_ref % 8 == 0 && num_ref == num_test, "pose_residual_jacobian_pattern8",
+        test.name, "number of residuals differs");
+  Check(res_ref == res_test && jaco_ref == jaco_test, "pose_residual_jacobian_pattern8", test.name, "output differs");
+}
+
+void TestDepthResidual(const odometry::SimdKernels& ref, const odometry::SimdKernels& test, std::mt19937& rng){
+  std::vector<float> left = RandomImage(rng, 0.0f, 1.0f);
+  std::vector<float> right = RandomImage(rng, 0.0f, 1.0f);
+  std::uniform_int_distribution<int> dist_x(0, kCols - 1), dist_y(0, kRows - 1);
+  std::uniform_real_distribution<float> dist_d(0.0f, 0.5f);
+  const int kNum = 333;
+  std::vector<int> xs(kNum), ys(kNum);
+  std::vector<float> inv_depth(kNum);
+  for (int i = 0; i < kNum; i++){
+    xs[i] = dist_x(rng);
+    ys[i] = dist_y(rng);
+    inv_depth[i] = dist_d(rng);
+  }
+  std::vector<float> jtwj_ref(kNum), b_ref(kNum), e_ref(kNum), r_ref(kNum);
+  std::vector<float> jtwj_test(kNum), b_test(kNum), e_test(kNum), r_test(kNum);
+  float err_ref = 0, err_test = 0;
+  int valid_ref = ref.depth_residual_jacobian(left.data(), right.data(), kStride, kRows, kCols, xs.data(), ys.data(),
+                                              inv_depth.data(), kNum, 100.0f, 0.1f, jtwj_ref.data(), b_ref.data(),
+                                              e_ref.data(), r_ref.data(), &err_ref);
+  int valid_test = test.depth_residual_jacobian(left.data(), right.data(), kStride, kRows, kCols, xs.data(), ys.data(),
+                                                inv_depth.data(), kNum, 100.0f, 0.1f, jtwj_test.data(), b_test.data(),
+                                                e_test.data(), r_test.data(), &err_test);
+  Check(valid_ref == valid_test && NearlyEqual(err_ref, err_test), "depth_residual_jacobian", test.name, "error sum differs");
+  Check(jtwj_ref == jtwj_test && b_ref == b_test && e_ref == e_test && r_ref == r_test, "depth_residual_jacobian",
+        test.name, "output differs");
+}
+
+void TestWarp(const odometry::SimdKernels& ref, const odometry::SimdKernels& test, std::mt19937& rng){
+  std::vector<float> img2 = RandomImage(rng, 0.0f, 1.0f);
+  std::vector<float> inv_depth = RandomImage(rng, 0.05f, 1.0f);
+  std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+  for (float& d : inv_depth){
+    if (dist(rng) < 0.3f) d = 0.0f; // invalid depth
+  }
+  const float kCamera[4] = {90.0f, 90.0f, 78.5f, 48.0f};
+  // forward motion with rotation: points leave the image and several points warp onto the same pixel (occlusion)
+  const float kTransform[12] = {0.9998f, 0.0f, 0.02f, 0.3f, 0.0f, 1.0f, 0.0f, -0.1f, -0.02f, 0.0f, 0.9998f, -0.4f};
+  const float kInf = std::numeric_limits<float>::infinity();
+  std::vector<float> zbuf_ref(kRows * kStride, kInf), warped_ref(kRows * kStride, 0.0f);
+  std::vector<float> zbuf_test(kRows * kStride, kInf), warped_test(kRows * kStride, 0.0f);
+  // split the rows like the thread pool does, the splat must not depend on the order of the row blocks
+  for (int row = kRows - 16; row >= 0; row -= 16){
+    ref.warp_depth_splat(inv_depth.data(), kStride, kRows, kCols, row, row + 16, kCamera, kTransform, zbuf_ref.data());
+  }
+  for (int row = 0; row < kRows; row += 16){
+    test.warp_depth_splat(inv_depth.data(), kStride, kRows, kCols, row, row + 16, kCamera, kTransform, zbuf_test.data());
+  }
+  ref.warp_image(img2.data(), inv_depth.data(), kStride, kRows, kCols, 0, kRows, kCamera, kTransform, zbuf_ref.data(),
+                 warped_ref.data());
+  test.warp_image(img2.data(), inv_depth.data(), kStride, kRows, kCols, 0, kRows, kCamera, kTransform, zbuf_test.data(),
+                  warped_test.data());
+  int num_valid = 0;
+  for (int y = 0; y < kRows; y++){
+    for (int x = 0; x < kCols; x++) num_valid += warped_ref[y * kStride + x] != odometry::kWarpInvalid;
+  }
+  Check(num_valid > 0 && num_valid < kRows * kCols, "warp_image", test.name, "no valid or no invalid pixel");
+  Check(zbuf_ref == zbuf_test, "warp_depth_splat", test.name, "output differs");
+  Check(warped_ref == warped_test, "warp_image", test.name, "output differs");
+}
+
+void TestSampleBilinear(const odometry::SimdKernels& ref, const odometry::SimdKernels& test, std::mt19937& rng){
+  std::vector<float> img = RandomImage(rng, 0.0f, 1.0f);
+  // positions around and beyond the bounds of the sampling
+  std::uniform_real_distribution<float> dist_u(-2.0f, float(kCols + 1)), dist_v(-2.0f, float(kRows + 1));
+  const int kNum = 1001;
+  std::vector<float> us(kNum), vs(kNum);
+  for (int i = 0; i < kNum; i++){
+    us[i] = dist_u(rng);
+    vs[i] = dist_v(rng);
+  }
+  std::vector<float> val_ref(kNum), gx_ref(kNum), gy_ref(kNum), val_test(kNum), gx_test(kNum), gy_test(kNum);
+  std::vector<unsigned char> valid_ref(kNum), valid_test(kNum);
+  ref.sample_bilinear(img.data(), kStride, kRows, kCols, us.data(), vs.data(), kNum, val_ref.data(), gx_ref.data(),
+                      gy_ref.data(), valid_ref.data());
+  test.sample_bilinear(img.data(), kStride, kRows, kCols, us.data(), vs.data(), kNum, val_test.data(), gx_test.data(),
+                       gy_test.data(), valid_test.data());
+  Check(valid_ref == valid_test, "sample_bilinear", test.name, "out of bounds mask differs");
+  Check(val_ref == val_test && gx_ref == gx_test && gy_ref == gy_test, "sample_bilinear", test.name, "output differs");
+  // the sampling of a linear ramp is exact: intensity at (u, v) and constant gradient
+  std::vector<float> ramp(kRows * kStride);
+  for (int y = 0; y < kRows; y++){
+    for (int x = 0; x < kCols; x++) ramp[y * kStride + x] = 0.5f * float(x) - 0.25f * float(y) + 3.0f;
+  }
+  test.sample_bilinear(ramp.data(), kStride, kRows, kCols, us.data(), vs.data(), kNum, val_test.data(), gx_test.data(),
+                       gy_test.data(), valid_test.data());
+  bool exact = true;
+  for (int i = 0; i < kNum; i++){
+    bool in_bounds = us[i] >= 1.0f && us[i] < float(kCols - 2) && vs[i] >= 1.0f && vs[i] < float(kRows - 2);
+    exact = exact && (valid_test[i] != 0) == in_bounds;
+    if (in_bounds){
+      exact = exact && NearlyEqual(val_test[i], 0.5f * us[i] - 0.25f * vs[i] + 3.0f) && NearlyEqual(gx_test[i], 0.5f)
+              && NearlyEqual(gy_test[i], -0.25f);
+    }
+  }
+  Check(exact, "sample_bilinear", test.name, "linear ramp not reproduced");
+}
+
+void TestKlt(const odometry::SimdKernels& ref, const odometry::SimdKernels& test, std::mt19937& rng){
+  // smooth texture, image 2 is image 1 shifted by (kShiftX, kShiftY)
+  const float kShiftX = 1.3f, kShiftY = -0.7f;
+  auto texture = [](float x, float y){
+    return 100.0f + 40.0f * std::sin(0.45f * x + 0.2f * y) + 30.0f * std::cos(0.3f * y - 0.25f * x) + 20.0f * std::sin(0.7f * y);
+  };
+  std::vector<float> img1(kRows * kStride), img2(kRows * kStride);
+  for (int y = 0; y < kRows; y++){
+    for (int x = 0; x < kCols; x++){
+      img1[y * kStride + x] = texture(float(x), float(y));
+      img2[y * kStride + x] = texture(float(x) - kShiftX, float(y) - kShiftY);
+    }
+  }
+  // features everywhere, some too close to the edges
+  std::uniform_real_distribution<float> dist_x(0.0f, float(kCols)), dist_y(0.0f, float(kRows));
+  const int kNum = 201;
+  std::vector<float> x1(kNum), y1(kNum);
+  for (int i = 0; i < kNum; i++){
+    x1[i] = dist_x(rng);
+    y1[i] = dist_y(rng);
+  }
+  std::vector<float> x2_ref = x1, y2_ref = y1, x2_test = x1, y2_test = y1;
+  std::vector<unsigned char> status_ref(kNum), status_test(kNum);
+  ref.klt_track(img1.data(), img2.data(), kStride, kRows, kCols, x1.data(), y1.data(), kNum, 3, 20, x2_ref.data(),
+                y2_ref.data(), status_ref.data());
+  test.klt_track(img1.data(), img2.data(), kStride, kRows, kCols, x1.data(), y1.data(), kNum, 3, 20, x2_test.data(),
+                 y2_test.data(), status_test.data());
+  Check(status_ref == status_test && x2_ref == x2_test && y2_ref == y2_test, "klt_track", test.name, "output differs");
+  int num_tracked = 0, num_accurate = 0;
+  for (int i = 0; i < kNum; i++){
+    if (status_test[i] == 0) continue;
+    num_tracked++;
+    if (std::fabs(x2_test[i] - x1[i] - kShiftX) < 0.05f && std::fabs(y2_test[i] - y1[i] - kShiftY) < 0.05f) num_accurate++;
+  }
+  Check(num_tracked > kNum / 2 && num_accurate >= num_tracked * 95 / 100, "klt_track", test.name, "shift not recovered");
+}
+
+void TestFastScore(const odometry::SimdKernels& ref, const odometry::SimdKernels& test, std::mt19937& rng){
+  // blocky random image: flat areas, edges and corners of both polarities
+  std::uniform_int_distribution<int> dist(0, 3);
+  std::vector<float> img(kRows * kStride, 0.0f);
+  for (int by = 0; by < kRows; by += 4){
+    for (int bx = 0; bx < kCols; bx += 4){
+      float value = 60.0f * float(dist(rng));
+      for (int y = by; y < std::min(by + 4, kRows); y++){
+        for (int x = bx; x < std::min(bx + 4, kCols); x++) img[y * kStride + x] = value + float(dist(rng));
+      }
+    }
+  }
+  const float kThreshold = 20.0f;
+  bool exact = true, matches_definition = true;
+  int num_corners = 0;
+  std::vector<float> score_ref(kCols), score_test(kCols);
+  for (int y = 3; y < kRows - 3; y++){
+    const float* row = img.data() + y * kStride;
+    ref.fast_score_row(row, kStride, kCols, kThreshold, score_ref.data());
+    test.fast_score_row(row, kStride, kCols, kThreshold, score_test.data());
+    exact = exact && score_ref == score_test;
+    // definition: some start of 9 contiguous circle pixels, all brighter or all darker
+    for (int x = 0; x < kCols; x++){
+      bool corner = false;
+      for (int start = 0; start < 16 && x >= 3 && x < kCols - 3; start++){
+        bool all_bright = true, all_dark = true;
+        for (int k = start; k < start + 9; k++){
+          float value = row[odometry::kFastCircle[k % 16][1] * kStride + x + odometry::kFastCircle[k % 16][0]];
+          all_bright = all_bright && value > row[x] + kThreshold;
+          all_dark = all_dark && value < row[x] - kThreshold;
+        }
+        corner = corner || all_bright || all_dark;
+      }
+      matches_definition = matches_definition && (score_test[x] > 0.0f) == corner;
+      num_corners += corner;
+    }
+  }
+  Check(exact, "fast_score_row", test.name, "output differs");
+  Check(matches_definition && num_corners > 0, "fast_score_row", test.name, "corners differ from the definition");
+}
+
+void TestCompactPixels(const odometry::SimdKernels& ref, const odometry::SimdKernels& test, std::mt19937& rng){
+  // every half float, and floats around the rounding and range limits of the half floats
+  std::vector<odometry::Float16> halfs(1 << 16);
+  for (int i = 0; i < (1 << 16); i++) halfs[i] = odometry::Float16(i);
+  std::vector<float> from_ref(halfs.size()), from_test(halfs.size());
+  ref.convert_from_half(halfs.data(), int(halfs.size()), from_ref.data());
+  test.convert_from_half(halfs.data(), int(halfs.size()), from_test.data());
+  Check(std::memcmp(from_ref.data(), from_test.data(), sizeof(float) * from_ref.size()) == 0, "convert_from_half",
+        test.name, "output differs");
+  std::vector<float> floats = {0.0f, -0.0f, 65504.0f, 65519.99f, 65520.0f, 1e+6f, std::numeric_limits<float>::infinity(),
+                               std::ldexp(1.0f, -25), std::ldexp(1.5f, -25), std::ldexp(1.0f, -24), std::ldexp(1.0f, -14),
+                               std::ldexp(1023.5f, -24), 1.0f + std::ldexp(1.0f, -11), 1.0f + std::ldexp(3.0f, -11)};
+  std::uniform_real_distribution<float> dist_exp(-30.0f, 17.0f);
+  for (int i = 0; i < 5000; i++) floats.push_back((i % 2 ? -1.0f : 1.0f) * std::exp2(dist_exp(rng)));
+  for (float f : from_ref){
+    if (!std::isnan(f)) floats.push_back(std::nextafter(f, 1e+10f)); // just above a half float, or a tie
+  }
+  std::vector<odometry::Float16> to_ref(floats.size()), to_test(floats.size());
+  ref.convert_to_half(floats.data(), int(floats.size()), to_ref.data());
+  test.convert_to_half(floats.data(), int(floats.size()), to_test.data());
+  Check(to_ref == to_test, "convert_to_half", test.name, "output differs");
+
+  // the compact pose residuals equal the float ones on the float image with the same values
+  std::vector<float> img1 = RandomImage(rng, 0.0f, 255.0f);
+  std::vector<float> img2 = RandomImage(rng, 0.0f, 255.0f);
+  std::vector<float> inv_depth = RandomImage(rng, 0.05f, 1.0f);
+  const float kCamera[4] = {90.0f, 90.0f, 78.5f, 48.0f};
+  const float kTransform[12] = {0.9998f, 0.0f, 0.02f, 0.3f, 0.0f, 1.0f, 0.0f, -0.1f, -0.02f, 0.0f, 0.9998f, 0.05f};
+  // one padding row, see SimdKernels
+  std::vector<unsigned char> u8_1((kRows + 1) * kStride, 255), u8_2((kRows + 1) * kStride, 255);
+  std::vector<odometry::Float16> f16_1((kRows + 1) * kStride), f16_2((kRows + 1) * kStride);
+  for (int i = 0; i < kRows * kStride; i++){
+    u8_1[i] = (unsigned char)(img1[i]);
+    u8_2[i] = (unsigned char)(img2[i]);
+  }
+  ref.convert_to_half(img1.data(), kRows * kStride, f16_1.data());
+  ref.convert_to_half(img2.data(), kRows * kStride, f16_2.data());
+  int capacity = kRows * kCols;
+  std::vector<float> jaco_ref(6 * capacity, 0.0f), res_ref(capacity, 0.0f);
+  std::vector<float> jaco_test(6 * capacity, 0.0f), res_test(capacity, 0.0f);
+  for (int i = 0; i < kRows * kStride; i++){
+    img1[i] = float(u8_1[i]);
+    img2[i] = float(u8_2[i]);
+  }
+  int num_ref = ref.pose_residual_jacobian(img1.data(), img2.data(), inv_depth.data(), kStride, kRows, kCols, 4, kCamera,
+                                           kTransform, jaco_ref.data(), capacity, res_ref.data());
+  int num_test = test.pose_residual_jacobian_u8(u8_1.data(), u8_2.data(), inv_depth.data(), kStride, kRows, kCols, 4,
+                                                kCamera, kTransform, jaco_test.data(), capacity, res_test.data());
+  Check(num_ref > 0 && num_ref == num_test, "pose_residual_jacobian_u8", test.name, "number of residuals differs");
+  Check(res_ref == res_test && jaco_ref == jaco_test, "pose_residual_jacobian_u8", test.name, "output differs from float");
+  ref.convert_from_half(f16_1.data(), kRows * kStride, img1.data());
+  ref.convert_from_half(f16_2.data(), kRows * kStride, img2.data());
+  num_ref = ref.pose_residual_jacobian(img1.data(), img2.data(), inv_depth.data(), kStride, kRows, kCols, 4, kCamera,
+                                       kTransform, jaco_ref.data(), capacity, res_ref.data());
+  num_test = test.pose_residual_jacobian_f16(f16_1.data(), f16_2.data(), inv_depth.data(), kStride, kRows, kCols, 4,
+                                             kCamera, kTransform, jaco_test.data(), capacity, res_test.data());
+  Check(num_ref > 0 && num_ref == num_test, "pose_residual_jacobian_f16", test.name, "number of residuals differs");
+  Check(res_ref == res_test && jaco_ref == jaco_test, "pose_residual_jacobian_f16", test.name, "output differs from float");
+}
+
+void TestSgm(const odometry::SimdKernels& ref, const odometry::SimdKernels& test, std::mt19937& rng){
+  // right image: the left one shifted by 9 pixels plus noise, so the costs have a clear minimum
+  const int kNumDisp = 2 * odometry::kSgmDisparityStep;
+  std::vector<float> left = RandomImage(rng, 0.0f, 255.0f), right(kRows * kStride);
+  std::uniform_real_distribution<float> noise(-4.0f, 4.0f);
+  for (int y = 0; y < kRows; y++){
+    for (int x = 0; x < kStride; x++){
+      right[y * kStride + x] = left[y * kStride + std::min(x + 9, kStride - 1)] + noise(rng);
+    }
+  }
+  std::vector<unsigned int> census_left(kRows * kCols), census_right(kRows * kCols), census_test(kCols);
+  bool census_exact = true, census_bits = true;
+  for (int y = 2; y < kRows - 2; y++){
+    ref.census_row(left.data() + y * kStride, kStride, kCols, census_left.data() + y * kCols);
+    ref.census_row(right.data() + y * kStride, kStride, kCols, census_right.data() + y * kCols);
+    test.census_row(left.data() + y * kStride, kStride, kCols, census_test.data());
+    census_exact = census_exact && std::equal(census_test.begin(), census_test.end(), census_left.begin() + y * kCols);
+    // definition at one pixel of the row
+    int x = 2 + y % (kCols - 4);
+    unsigned int bits = 0;
+    int bit = 0;
+    for (int dy = -2; dy <= 2; dy++){
+      for (int dx = -2; dx <= 2; dx++){
+        if (dy == 0 && dx == 0) continue;
+        if (left[(y + dy) * kStride + x + dx] < left[y * kStride + x]) bits |= 1u << bit;
+        bit++;
+      }
+    }
+    census_bits = census_bits && census_test[x] == bits && census_test[0] == 0 && census_test[kCols - 1] == 0;
+  }
+  Check(census_exact, "census_row", test.name, "output differs");
+  Check(census_bits, "census_row", test.name, "census differs from the definition");
+
+  // costs and all 8 paths over the rows [2, kRows - 2), as the dense stereo engine
+  std::vector<unsigned int> scratch(kCols + kNumDisp);
+  std::vector<unsigned char> cost_ref(kRows * kCols * kNumDisp), cost_test(kCols * kNumDisp);
+  bool cost_exact = true, cost_definition = true;
+  for (int y = 2; y < kRows - 2; y++){
+    unsigned char* row_cost = cost_ref.data() + y * kCols * kNumDisp;
+    ref.sgm_cost_row(census_left.data() + y * kCols, census_right.data() + y * kCols, kCols, kNumDisp, scratch.data(),
+                     row_cost);
+    test.sgm_cost_row(census_left.data() + y * kCols, census_right.data() + y * kCols, kCols, kNumDisp, scratch.data(),
+                      cost_test.data());
+    cost_exact = cost_exact && std::equal(cost_test.begin(), cost_test.end(), row_cost);
+    int x = y % kCols, d = (7 * y) % kNumDisp;
+    int expected = x < d ? odometry::kCensusBits
+                         : __builtin_popcount(census_left[y * kCols + x] ^ census_right[y * kCols + x - d]);
+    cost_definition = cost_definition && cost_test[x * kNumDisp + d] == expected;
+  }
+  Check(cost_exact, "sgm_cost_row", test.name, "output differs");
+  Check(cost_definition, "sgm_cost_row", test.name, "cost differs from the definition");
+  const int kPixel = kNumDisp + 2;
+  std::vector<unsigned short> sum_ref(kRows * kCols * kNumDisp, 0), sum_test(kRows * kCols * kNumDisp, 0);
+  std::vector<unsigned short> paths_ref(kRows * kCols * kPixel), paths_test(kRows * kCols * kPixel);
+  const int kDx[4] = {1, 1, 0, -1};
+  for (int path = 0; path < 4; path++){
+    for (int direction = 0; direction < 2; direction++){
+      for (int i = 2; i < kRows - 2; i++){
+        int y = direction == 0 ? i : kRows - 1 - i;
+        int dx = direction == 0 ? kDx[path] : -kDx[path];
+        const unsigned char* row_cost = cost_ref.data() + y * kCols * kNumDisp;
+        // horizontal paths stay in the row, the others start at the first row
+        bool in_row = path == 0 || i == 2;
+        int prev_y = direction == 0 ? y - 1 : y + 1;
+        const unsigned short* prev_ref = in_row ? nullptr : paths_ref.data() + prev_y * kCols * kPixel;
+        const unsigned short* prev_test = in_row ? nullptr : paths_test.data() + prev_y * kCols * kPixel;
+        int row_dx = (path != 0 && i == 2) ? 0 : dx;
+        ref.sgm_aggregate_row(row_cost, kCols, kNumDisp, row_dx, prev_ref, paths_ref.data() + y * kCols * kPixel,
+                              sum_ref.data() + y * kCols * kNumDisp, 3, 40);
+        test.sgm_aggregate_row(row_cost, kCols, kNumDisp, row_dx, prev_test, paths_test.data() + y * kCols * kPixel,
+                               sum_test.data() + y * kCols * kNumDisp, 3, 40);
+      }
+    }
+  }
+  Check(sum_ref == sum_test, "sgm_aggregate_row", test.name, "output differs");
+  std::vector<float> disp_ref(kCols), disp_test(kCols);
+  bool select_exact = true;
+  int num_correct = 0, num_valid = 0;
+  for (int y = 2; y < kRows - 2; y++){
+    ref.sgm_select_row(sum_ref.data() + y * kCols * kNumDisp, kCols, kNumDisp, 0.95f, disp_ref.data());
+    test.sgm_select_row(sum_test.data() + y * kCols * kNumDisp, kCols, kNumDisp, 0.95f, disp_test.data());
+    select_exact = select_exact && disp_ref == disp_test;
+    for (int x = 20; x < kCols - 20; x++){
+      num_valid += disp_test[x] >= 0.0f;
+      num_correct += std::fabs(disp_test[x] - 9.0f) < 0.5f;
+    }
+  }
+  Check(select_exact, "sgm_select_row", test.name, "output differs");
+  Check(num_valid > 0 && num_correct > 0.95 * num_valid, "sgm_select_row", test.name, "wrong disparities");
+}
+
+} // namespace
+
+void TestSparseDepth(const odometry::SimdKernels& ref, const odometry::SimdKernels& test, std::mt19937& rng){
+  // sparse and dense rows, ties, values out of the 16 bit range and NaN
+  std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+  std::vector<float> values(kRows * kStride);
+  std::vector<unsigned char> mask(kRows * kStride);
+  const float kScale = 16384.0f;
+  for (int i = 0; i < kRows * kStride; i++){
+    int row = i / kStride;
+    float density = (row % 4 == 0) ? 0.0f : (row % 4 == 1 ? 0.02f : (row % 4 == 2 ? 0.3f : 1.0f));
+    mask[i] = (unsigned char)(dist(rng) < density ? 1 + (i % 255) : 0);
+    values[i] = dist(rng) * 1.2f;
+    if (i % 7 == 0) values[i] = (float(i % 1000) + 0.5f) / kScale; // tie
+  }
+  values[kStride + 3] = std::numeric_limits<float>::quiet_NaN();
+  values[2 * kStride + 5] = -1.0f;
+  values[3 * kStride + 7] = 10.0f;
+  mask[kStride + 3] = mask[2 * kStride + 5] = mask[3 * kStride + 7] = 1;
+  std::vector<int> xs_ref(kCols), xs_test(kCols);
+  std::vector<unsigned short> q_ref(kCols), q_test(kCols);
+  std::vector<float> dec_ref(kCols, 0.0f), dec_test(kCols, 0.0f);
+  bool same = true, decoded = true;
+  for (int y = 0; y < kRows; y++){
+    const float* row = values.data() + y * kStride;
+    const unsigned char* mask_row = mask.data() + y * kStride;
+    int num_ref = ref.sparse_encode_row(row, mask_row, kCols, kScale, xs_ref.data(), q_ref.data());
+    int num_test = test.sparse_encode_row(row, mask_row, kCols, kScale, xs_test.data(), q_test.data());
+    same = same && num_ref == num_test && std::equal(xs_ref.begin(), xs_ref.begin() + num_ref, xs_test.begin()) &&
+           std::equal(q_ref.begin(), q_ref.begin() + num_ref, q_test.begin());
+    ref.sparse_decode_row(q_ref.data(), xs_ref.data(), num_ref, 1.0f / kScale, dec_ref.data());
+    test.sparse_decode_row(q_ref.data(), xs_ref.data(), num_ref, 1.0f / kScale, dec_test.data());
+    decoded = decoded && std::memcmp(dec_ref.data(), dec_test.data(), sizeof(float) * kCols) == 0;
+  }
+  Check(same, "sparse_encode_row", test.name, "output differs");
+  Check(decoded, "sparse_decode_row", test.name, "output differs");
+}
+
+int main(){
+  const odometry::SimdKernels* ref = odometry::GetSimdKernels(odometry::kSimdScalar);
+  std::cout << "detected SIMD level: " << odometry::DetectSimdLevel() << std::endl;
+  for (int level = odometry::kSimdScalar; level <= odometry::kSimdAvx512; level++){
+    const odometry::SimdKernels* test = odometry::GetSimdKernels(odometry::SimdLevel(level));
+    if (test == nullptr){
+      std::cout << "level " << level << " not supported by this CPU, skipped." << std::endl;
+      continue;
+    }
+    std::cout << "testing " << test->name << " against " << ref->name << " ..." << std::endl;
+    std::mt19937 rng(42);
+    TestSsdSearch(*ref, *test, rng);
+    TestPyramidDown(*ref, *test, rng);
+    TestNormalEquations(*ref, *test, rng);
+    TestPoseResidual(*ref, *test, rng);
+    TestPosePattern8(*ref, *test, rng);
+    TestDepthResidual(*ref, *test, rng);
+    TestWarp(*ref, *test, rng);
+    TestSampleBilinear(*ref, *test, rng);
+    TestCompactPixels(*ref, *test, rng);
+    TestKlt(*ref, *test, rng);
+    TestFastScore(*ref, *test, rng);
+    TestSgm(*ref, *test, rng);
+    TestSparseDepth(*ref, *test, rng);
+  }
+  if (num_failures > 0){
+    std::cout << num_failures << " check(s) failed." << std::endl;
+    return 1;
+  }
+  std::cout << "all SIMD kernels match the scalar reference." << std::endl;
+  return 0;
+}
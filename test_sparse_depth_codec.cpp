@@ -0,0 +1,159 @@
+// The file tests the sparse depth encoding of sparse_depth_codec.h: the round trip of semi-dense maps on every SIMD
+// level supported by the running CPU (same data, exact mask, inverse depth within step / 2), long runs of invalid
+// pixels, and the rejection of cut or corrupted data.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <sparse_depth_codec.h>
+
+namespace
+{
+
+const int kRows = 376;
+const int kCols = 1241;
+
+int num_failures = 0;
+
+void Check(bool ok, const std::string& test, const std::string& what){
+  if (!ok){
+    std::cout << "  [FAILED] " << test << ": " << what << std::endl;
+    num_failures++;
+  }
+}
+
+// valid pixels in short horizontal segments (image edges), about 3 % of the map, mask values other than 1 included
+void MakeSemiDense(std::mt19937& rng, cv::Mat& inv_depth, cv::Mat& valid){
+  std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+  inv_depth.create(kRows, kCols, CV_32F);
+  valid.create(kRows, kCols, CV_8U);
+  for (int y = 0; y < kRows; y++){
+    int segment = 0;
+    for (int x = 0; x < kCols; x++){
+      if (segment == 0 && dist(rng) < 0.006f) segment = 1 + int(8.0f * dist(rng));
+      valid.at<uint8_t>(y, x) = uint8_t(segment > 0 ? (x % 5 == 0 ? 255 : 1) : 0);
+      if (segment > 0) segment--;
+      inv_depth.at<float>(y, x) = 0.0125f + 0.5f * dist(rng); // 2 to 80 meters
+    }
+  }
+}
+
+bool RoundTrip(odometry::SparseDepthCodec& codec, const cv::Mat& inv_depth, const cv::Mat& valid,
+               std::vector<unsigned char>& data, const std::string& test){
+  cv::Mat decoded_depth, decoded_valid;
+  if (codec.Encode(inv_depth, valid, data) == -1 ||
+      codec.Decode(data.data(), data.size(), decoded_depth, decoded_valid) == -1){
+    Check(false, test, "encode or decode failed");
+    return false;
+  }
+  bool ok = decoded_depth.rows == inv_depth.rows && decoded_depth.cols == inv_depth.cols;
+  float max_error = 0.0f;
+  for (int y = 0; ok && y < inv_depth.rows; y++){
+    for (int x = 0; ok && x < inv_depth.cols; x++){
+      bool is_valid = valid.at<uint8_t>(y, x) != 0;
+      ok = decoded_valid.at<uint8_t>(y, x) == (is_valid ? 1 : 0);
+      if (is_valid) max_error = std::max(max_error, std::fabs(decoded_depth.at<float>(y, x) - inv_depth.at<float>(y, x)));
+      else ok = ok && decoded_depth.at<float>(y, x) == 0.0f;
+    }
+  }
+  Check(ok, test, "mask or invalid pixels differ");
+  Check(max_error <= 0.5001f * codec.GetStep(), test, "inverse depth error " + std::to_string(max_error));
+  return ok;
+}
+
+void TestRoundTrip(){
+  std::mt19937 rng(3);
+  cv::Mat inv_depth, valid;
+  MakeSemiDense(rng, inv_depth, valid);
+  std::vector<unsigned char> reference;
+  for (int level = odometry::kSimdScalar; level <= odometry::kSimdAvx512; level++){
+    const odometry::SimdKernels* kernels = odometry::GetSimdKernels(odometry::SimdLevel(level));
+    if (kernels == nullptr) continue;
+    odometry::SparseDepthCodec codec(odometry::kSparseDepthStep, kernels);
+    std::vector<unsigned char> data;
+    if (!RoundTrip(codec, inv_depth, valid, data, std::string("round trip ") + kernels->name)) continue;
+    if (level == odometry::kSimdScalar) reference = data;
+    Check(data == reference, std::string("round trip ") + kernels->name, "encoded data differs from scalar");
+  }
+  size_t dense_bytes = size_t(kRows) * kCols * (sizeof(float) + 1);
+  int count = cv::countNonZero(valid);
+  Check(reference.size() < 3 * size_t(count) + size_t(kRows) * 6 + 64, "size",
+        std::to_string(reference.size()) + " bytes for " + std::to_string(count) + " pixels");
+  std::cout << "  " << count << " valid pixels: " << reference.size() << " bytes, " << dense_bytes / reference.size()
+            << "x smaller than float map and mask" << std::endl;
+
+  // a coarser step, negative and too large inverse depths are clamped
+  odometry::SparseDepthCodec coarse(1.0f / 256.0f);
+  std::vector<unsigned char> data;
+  RoundTrip(coarse, inv_depth, valid, data, "coarse step");
+  cv::Mat clamped_depth = inv_depth.clone(), decoded_depth, decoded_valid;
+  clamped_depth.at<float>(0, 0) = -1.0f;
+  clamped_depth.at<float>(0, 1) = 1e+6f;
+  cv::Mat all_valid(kRows, kCols, CV_8U, cv::Scalar(1));
+  coarse.Encode(clamped_depth, all_valid, data);
+  coarse.Decode(data.data(), data.size(), decoded_depth, decoded_valid);
+  Check(decoded_depth.at<float>(0, 0) == 0.0f && decoded_depth.at<float>(0, 1) == 65535.0f / 256.0f, "clamp",
+        "out of range values not clamped");
+}
+
+void TestRuns(){
+  cv::Mat inv_depth(kRows, kCols, CV_32F, cv::Scalar(0.25f));
+  cv::Mat valid(kRows, kCols, CV_8U, cv::Scalar(0));
+  odometry::SparseDepthCodec codec;
+  std::vector<unsigned char> data;
+  RoundTrip(codec, inv_depth, valid, data, "empty map");
+  valid.at<uint8_t>(kRows - 1, kCols - 1) = 1; // one run over the whole map
+  RoundTrip(codec, inv_depth, valid, data, "last pixel");
+  valid.at<uint8_t>(0, 0) = 1;
+  valid.at<uint8_t>(0, 255) = 1; // a run of exactly 254
+  valid.at<uint8_t>(0, 511) = 1; // 255
+  valid.at<uint8_t>(1, 0) = 1;
+  RoundTrip(codec, inv_depth, valid, data, "runs");
+}
+
+void TestCorrupted(){
+  std::mt19937 rng(5);
+  cv::Mat inv_depth, valid, decoded_depth, decoded_valid;
+  MakeSemiDense(rng, inv_depth, valid);
+  odometry::SparseDepthCodec codec;
+  std::vector<unsigned char> data;
+  codec.Encode(inv_depth, valid, data);
+  Check(codec.Decode(data.data(), data.size() - 1, decoded_depth, decoded_valid) == -1, "corrupted", "cut data decoded");
+  Check(codec.Decode(data.data(), 20, decoded_depth, decoded_valid) == -1, "corrupted", "cut header decoded");
+  std::vector<unsigned char> longer = data;
+  longer.push_back(0);
+  Check(codec.Decode(longer.data(), longer.size(), decoded_depth, decoded_valid) == -1, "corrupted",
+        "trailing bytes decoded");
+  std::vector<unsigned char> wrong = data;
+  wrong[0] = 'X';
+  Check(codec.Decode(wrong.data(), wrong.size(), decoded_depth, decoded_valid) == -1, "corrupted", "wrong magic decoded");
+  wrong = data;
+  int32_t count = kRows * kCols + 1;
+  std::memcpy(wrong.data() + 16, &count, sizeof(count));
+  Check(codec.Decode(wrong.data(), wrong.size(), decoded_depth, decoded_valid) == -1, "corrupted",
+        "count beyond the map decoded");
+  wrong = data;
+  for (size_t i = wrong.size() - 4; i < wrong.size(); i++) wrong[i] = 255; // the last runs leave the map
+  Check(codec.Decode(wrong.data(), wrong.size(), decoded_depth, decoded_valid) == -1, "corrupted",
+        "positions beyond the map decoded");
+  Check(codec.Encode(inv_depth, inv_depth, data) == -1, "corrupted", "float mask encoded");
+}
+
+} // namespace
+
+int main(){
+  std::cout << "testing SparseDepthCodec ..." << std::endl;
+  TestRoundTrip();
+  TestRuns();
+  TestCorrupted();
+  if (num_failures > 0){
+    std::cout << num_failures << " check(s) failed." << std::endl;
+    return 1;
+  }
+  std::cout << "all sparse depth checks passed." << std::endl;
+  return 0;
+}
@@ -0,0 +1,202 @@
+// The file tests the task scheduler of thread_pool.h: loop coverage (also nested and with odd grains), priorities of
+// the queued tasks, Submit() and the per type statistics, and the task graphs of task_graph.h running on it.
+// The pools have 4 threads whatever the CPU.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <task_graph.h>
+#include <thread_pool.h>
+
+namespace
+{
+
+int num_failures = 0;
+
+void Check(bool ok, const std::string& test, const std::string& what){
+  if (!ok){
+    std::cout << "  [FAILED] " << test << ": " << what << std::endl;
+    num_failures++;
+  }
+}
+
+// every iteration runs exactly once, also with grains not dividing the range and more chunks than threads
+void TestCoverage(odometry::ThreadPool& pool){
+  const int kGrains[4] = {1, 3, 16, 1000};
+  for (int grain : kGrains){
+    std::vector<std::atomic<int>> hits(517);
+    for (auto& h : hits) h = 0;
+    pool.ParallelFor(3, 517, grain, [&](int begin, int end){
+      Check(end - begin <= grain && begin < end, "coverage", "chunk [" + std::to_string(begin) + ", " +
+            std::to_string(end) + ") of grain " + std::to_string(grain));
+      for (int i = begin; i < end; i++) hits[i]++;
+    });
+    int wrong = 0;
+    for (int i = 0; i < 517; i++) wrong += hits[i] != (i >= 3 ? 1 : 0);
+    Check(wrong == 0, "coverage", std::to_string(wrong) + " iterations not run once, grain " + std::to_string(grain));
+  }
+  bool called = false;
+  pool.ParallelFor(5, 5, 1, [&](int, int){ called = true; });
+  Check(!called, "coverage", "empty range called the body");
+}
+
+// nested loops complete (no deadlock) and run every inner iteration once
+void TestNested(odometry::ThreadPool& pool){
+  std::atomic<int> sum(0);
+  pool.ParallelFor(0, 8, 1, [&](int begin, int end){
+    for (int i = begin; i < end; i++){
+      pool.ParallelFor(0, 100, 7, [&](int inner_begin, int inner_end){
+        for (int j = inner_begin; j < inner_end; j++) sum += j;
+      }, odometry::kPriorityHigh, "inner");
+    }
+  }, odometry::kPriorityNormal, "outer");
+  Check(sum == 8 * 4950, "nested", "sum " + std::to_string(sum.load()) + ", expected " + std::to_string(8 * 4950));
+}
+
+// tasks queued while every worker is busy start by priority: all high before all low
+void TestPriorities(odometry::ThreadPool& pool){
+  std::mutex mutex;
+  std::condition_variable cv;
+  int blocked = 0;
+  bool release = false;
+  std::atomic<int> done(0);
+  int num_workers = pool.NumThreads() - 1;
+  for (int i = 0; i < num_workers; i++){
+    pool.Submit([&](){
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        blocked++;
+        cv.notify_all();
+        cv.wait(lock, [&](){ return release; });
+      }
+      done++; // last access to the locals of the test
+    }, odometry::kPriorityHigh, "blocker");
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&](){ return blocked == num_workers; });
+  }
+  std::vector<int> order;
+  std::mutex order_mutex;
+  for (int i = 0; i < 6; i++){
+    odometry::TaskPriority priority = (i % 2 == 0) ? odometry::kPriorityLow : odometry::kPriorityHigh;
+    pool.Submit([&, priority](){
+      {
+        std::lock_guard<std::mutex> lock(order_mutex);
+        order.push_back(priority);
+      }
+      done++;
+    }, priority, priority == odometry::kPriorityHigh ? "tracking" : "mapping");
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    release = true;
+  }
+  cv.notify_all();
+  while (done < num_workers + 6) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  // the workers start in any order, but no low task may start before the last high one is taken
+  int last_high = -1, first_low = 6;
+  for (int i = 0; i < 6; i++){
+    if (order[i] == odometry::kPriorityHigh) last_high = i;
+    else if (first_low == 6) first_low = i;
+  }
+  Check(last_high < first_low + num_workers, "priorities", "low priority task ran ahead of the high priority ones");
+}
+
+// Submit() runs inline without workers; the statistics count every loop and task of a type, a loop of a pool
+// without workers is one call of the body
+void TestSubmitAndStats(){
+  odometry::ThreadPool serial(1);
+  bool ran = false;
+  serial.Submit([&](){ ran = true; });
+  Check(ran, "submit", "task of a pool without workers not run before returning");
+  for (int i = 0; i < 3; i++){
+    serial.ParallelFor(0, 10, 2, [&](int, int){ std::this_thread::sleep_for(std::chrono::milliseconds(10)); },
+                       odometry::kPriorityNormal, "stats");
+  }
+  unsigned long tasks = 0;
+  double busy = 0.0;
+  for (const auto& stats : serial.Stats()){
+    if (stats.type != "stats") continue;
+    tasks = stats.tasks;
+    busy = stats.busy_seconds;
+  }
+  Check(tasks == 3, "stats", std::to_string(tasks) + " tasks counted, expected 3");
+  Check(busy >= 0.025, "stats", "busy time " + std::to_string(busy) + " s, expected >= 0.025 s");
+}
+
+// nodes run after their dependencies, also of another graph, failures skip the dependent nodes, the critical path
+// follows the dependency finished last
+void TestTaskGraph(odometry::ThreadPool& pool){
+  std::mutex mutex;
+  std::vector<std::string> order;
+  auto node = [&](const std::string& name, int ms, odometry::GlobalStatus status){
+    return [&, name, ms, status](){
+      std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+      std::lock_guard<std::mutex> lock(mutex);
+      order.push_back(name);
+      return status;
+    };
+  };
+  auto position = [&](const std::string& name){
+    return int(std::find(order.begin(), order.end(), name) - order.begin());
+  };
+  // diamond: load -> (pyramid, depth) -> keyframe; the slow depth is on the critical path
+  odometry::TaskGraph first;
+  int load = first.AddNode("load", node("load", 2, 0));
+  int pyramid = first.AddNode("pyramid", node("pyramid", 2, 0), {load});
+  int depth = first.AddNode("depth", node("depth", 30, 0), {load});
+  int keyframe = first.AddNode("keyframe", node("keyframe", 1, 0), {pyramid, depth}, odometry::kPriorityHigh);
+  Check(first.AddNode("cycle", node("cycle", 0, 0), {5}) == -1, "graph", "dependency on a later node accepted");
+  // the next frame: its depth waits for the depth of the first graph, its track fails and skips its keyframe
+  odometry::TaskGraph second;
+  int second_depth = second.AddNode("second_depth", node("second_depth", 1, 0));
+  int track = second.AddNode("track", node("track", 1, -1));
+  int second_keyframe = second.AddNode("second_keyframe", node("second_keyframe", 0, 0), {track, second_depth});
+  Check(second.After(second_depth, first, depth) == 0, "graph", "dependency on another graph rejected");
+  first.Start(pool);
+  second.Start(pool);
+  Check(first.Wait() == 0, "graph", "graph without failed nodes failed");
+  Check(second.Wait() == -1, "graph", "graph with a failed node succeeded");
+  Check(order.size() == 6, "graph", std::to_string(order.size()) + " nodes run, expected 6");
+  Check(position("load") < position("depth") && position("load") < position("pyramid") &&
+        position("depth") < position("keyframe") && position("pyramid") < position("keyframe"), "graph",
+        "node run before its dependencies");
+  Check(position("depth") < position("second_depth"), "graph", "node run before the node of the other graph");
+  Check(position("second_keyframe") == int(order.size()), "graph", "node depending on a failed node run");
+  Check(second.NodeSeconds(second_keyframe) == 0.0, "graph", "skipped node has a run time");
+  std::vector<int> path = first.CriticalPath();
+  Check(path == std::vector<int>({load, depth, keyframe}), "graph", "critical path " + first.CriticalPathReport());
+  Check(first.LatencySeconds() >= 0.03 && first.NodeSeconds(depth) >= 0.03, "graph", "latency shorter than the depth");
+  Check(first.CriticalPathReport().find("depth") != std::string::npos, "graph", "report misses the critical node");
+}
+
+} // namespace
+
+int main(){
+  odometry::ThreadPool pool(4);
+  std::cout << "testing ThreadPool with " << pool.NumThreads() << " threads ..." << std::endl;
+  TestCoverage(pool);
+  TestNested(pool);
+  TestPriorities(pool);
+  TestSubmitAndStats();
+  TestTaskGraph(pool);
+  odometry::ThreadPool serial(1);
+  TestTaskGraph(serial);
+  Check(odometry::ConfigureDefaultThreadPool(0) == -1, "config", "0 threads accepted");
+  Check(odometry::ConfigureDefaultThreadPool(3) == 0, "config", "3 threads rejected before the first use");
+  Check(odometry::DefaultThreadPool().NumThreads() == 3, "config", "configured number of threads not used");
+  Check(odometry::ConfigureDefaultThreadPool(5) == -1, "config", "reconfiguration accepted after the first use");
+  if (num_failures > 0){
+    std::cout << num_failures << " check(s) failed." << std::endl;
+    return 1;
+  }
+  std::cout << "all scheduler checks passed." << std::endl;
+  return 0;
+}
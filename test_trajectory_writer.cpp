@@ -0,0 +1,174 @@
+// The file tests the streaming trajectory sink of trajectory_writer.h: FormatFixed() against printf, the poses of the
+// KITTI, TUM and binary files after Flush(), and the recovery of a binary log cut by a crash (read and append).
+// The files are written to the working directory and removed at the end.
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <se3.hpp>
+#include <trajectory_writer.h>
+
+namespace
+{
+
+int num_failures = 0;
+
+void Check(bool ok, const std::string& test, const std::string& what){
+  if (!ok){
+    std::cout << "  [FAILED] " << test << ": " << what << std::endl;
+    num_failures++;
+  }
+}
+
+// same digits as printf, the last one may be rounded the other way
+void TestFormatFixed(){
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<double> mantissa(-1.0, 1.0);
+  std::uniform_int_distribution<int> exponent(-8, 4); // poses, timestamps
+  char fast[32], reference[32];
+  int wrong = 0, last_digit = 0;
+  for (int i = 0; i < 100000; i++){
+    double value = mantissa(rng) * std::pow(10.0, exponent(rng));
+    int decimals = i % 10;
+    int length = odometry::FormatFixed(value, decimals, fast);
+    std::string result(fast, size_t(length));
+    std::snprintf(reference, sizeof(reference), "%.*f", decimals, value);
+    // printf keeps the sign of values rounded to 0
+    std::string expected = (std::string(reference).find_first_not_of("-0.") == std::string::npos) ?
+                           std::string(reference + (reference[0] == '-' ? 1 : 0)) : std::string(reference);
+    if (result == expected) continue;
+    if (std::fabs(std::stod(result) - std::stod(expected)) <= 1.5 * std::pow(10.0, -decimals)){
+      last_digit++;
+    } else if (wrong++ < 5){
+      Check(false, "format", result + " instead of " + expected);
+    }
+  }
+  Check(wrong == 0, "format", std::to_string(wrong) + " values differ from printf");
+  Check(last_digit < 100, "format", std::to_string(last_digit) + " values differ in the last digit");
+  int length = odometry::FormatFixed(-1e300, 6, fast);
+  Check(std::stod(std::string(fast, size_t(length))) == -1e300, "format", "large value");
+}
+
+std::vector<odometry::PoseSample> MakeSamples(int num){
+  std::vector<odometry::PoseSample> samples(num);
+  Eigen::Matrix<float, 6, 1> twist;
+  twist << 0.8f, -0.1f, 1.2f, 0.02f, 0.1f, -0.03f;
+  for (int i = 0; i < num; i++){
+    samples[i].pose = Sophus::SE3<float>::exp(float(i) * twist).matrix();
+    samples[i].timestamp = 0.1037 * i;
+    samples[i].frame_id = uint64_t(i);
+    samples[i].status = (i % 3 == 0) ? odometry::kTrackingLost : odometry::kTrackingOk;
+  }
+  return samples;
+}
+
+std::vector<std::vector<double>> ReadText(const std::string& file_name){
+  std::vector<std::vector<double>> lines;
+  std::ifstream file(file_name);
+  std::string line;
+  while (std::getline(file, line)){
+    std::istringstream values(line);
+    lines.emplace_back();
+    double value;
+    while (values >> value) lines.back().push_back(value);
+  }
+  return lines;
+}
+
+void TestFormats(){
+  std::vector<odometry::PoseSample> samples = MakeSamples(50);
+  odometry::TrajectoryWriter writer(10.0); // only the explicit flushes write
+  Check(writer.Open("test_trajectory.txt", odometry::kTrajectoryKitti) == 0, "formats", "open KITTI file failed");
+  Check(writer.Open("test_trajectory.tum", odometry::kTrajectoryTum) == 0, "formats", "open TUM file failed");
+  Check(writer.Open("test_trajectory.bin", odometry::kTrajectoryBinary) == 0, "formats", "open binary log failed");
+  for (int i = 0; i < 20; i++) writer.Append(samples[i]);
+  Check(writer.Flush() == 0 && writer.Written() == 20, "formats", "first flush");
+  // on disk before the writer is closed
+  std::vector<odometry::TrajectoryRecord> records;
+  Check(odometry::ReadTrajectoryLog("test_trajectory.bin", records) == 0 && records.size() == 20, "formats",
+        "binary log of the first flush");
+  for (int i = 20; i < 50; i++) writer.Append(samples[i]);
+  Check(writer.Close() == 0 && writer.Written() == 50, "formats", "close");
+
+  Check(odometry::ReadTrajectoryLog("test_trajectory.bin", records) == 0 && records.size() == samples.size(), "binary",
+        std::to_string(records.size()) + " records read");
+  for (size_t i = 0; i < records.size(); i++){
+    Check(records[i].frame_id == samples[i].frame_id && records[i].timestamp == samples[i].timestamp &&
+          records[i].pose == samples[i].pose.block<3,4>(0,0) && records[i].status == samples[i].status, "binary",
+          "record " + std::to_string(i) + " differs");
+  }
+  std::vector<std::vector<double>> kitti = ReadText("test_trajectory.txt");
+  Check(kitti.size() == samples.size(), "KITTI", std::to_string(kitti.size()) + " lines");
+  for (size_t i = 0; i < kitti.size() && i < samples.size(); i++){
+    bool ok = kitti[i].size() == 12;
+    for (int k = 0; ok && k < 12; k++) ok = std::fabs(kitti[i][k] - samples[i].pose(k / 4, k % 4)) <= 0.5e-6 * (1.0 + 1e-6 * std::fabs(kitti[i][k]));
+    Check(ok, "KITTI", "line " + std::to_string(i) + " differs");
+  }
+  std::vector<std::vector<double>> tum = ReadText("test_trajectory.tum");
+  Check(tum.size() == samples.size(), "TUM", std::to_string(tum.size()) + " lines");
+  for (size_t i = 0; i < tum.size() && i < samples.size(); i++){
+    bool ok = tum[i].size() == 8 && std::fabs(tum[i][0] - samples[i].timestamp) < 1e-6;
+    if (ok){
+      Eigen::Quaternionf rotation(float(tum[i][7]), float(tum[i][4]), float(tum[i][5]), float(tum[i][6]));
+      Eigen::Vector3f translation(float(tum[i][1]), float(tum[i][2]), float(tum[i][3]));
+      ok = rotation.toRotationMatrix().isApprox(samples[i].pose.block<3,3>(0,0), 1e-5f) &&
+           (translation - samples[i].pose.block<3,1>(0,3)).norm() < 1e-5f * (1.0f + translation.norm());
+    }
+    Check(ok, "TUM", "line " + std::to_string(i) + " differs");
+  }
+}
+
+// a crash while writing leaves a cut record at the end
+void TestCrashRecovery(){
+  std::vector<odometry::PoseSample> samples = MakeSamples(30);
+  {
+    odometry::TrajectoryWriter writer(0.01);
+    writer.Open("test_trajectory.bin", odometry::kTrajectoryBinary);
+    for (int i = 0; i < 10; i++) writer.Append(samples[i]);
+  }
+  {
+    std::ofstream file("test_trajectory.bin", std::ios::binary | std::ios::app);
+    std::string cut(odometry::kTrajectoryRecordBytes / 2, 'x');
+    file.write(cut.data(), std::streamsize(cut.size()));
+  }
+  std::vector<odometry::TrajectoryRecord> records;
+  Check(odometry::ReadTrajectoryLog("test_trajectory.bin", records) == 0 && records.size() == 10, "recovery",
+        "cut record not dropped");
+  {
+    odometry::TrajectoryWriter writer(0.01);
+    Check(writer.Open("test_trajectory.bin", odometry::kTrajectoryBinary, true) == 0, "recovery", "append failed");
+    for (int i = 10; i < 30; i++) writer.Append(samples[i]);
+  }
+  Check(odometry::ReadTrajectoryLog("test_trajectory.bin", records) == 0 && records.size() == 30, "recovery",
+        std::to_string(records.size()) + " records after the append");
+  for (size_t i = 0; i < records.size(); i++){
+    Check(records[i].frame_id == i && records[i].pose == samples[i].pose.block<3,4>(0,0), "recovery",
+          "record " + std::to_string(i) + " differs after the append");
+  }
+  odometry::TrajectoryWriter writer(0.01);
+  Check(writer.Open("test_trajectory.txt", odometry::kTrajectoryBinary, true) == -1, "recovery",
+        "text file appended as binary log");
+}
+
+} // namespace
+
+int main(){
+  std::cout << "testing TrajectoryWriter ..." << std::endl;
+  TestFormatFixed();
+  TestFormats();
+  TestCrashRecovery();
+  std::remove("test_trajectory.txt");
+  std::remove("test_trajectory.tum");
+  std::remove("test_trajectory.bin");
+  if (num_failures > 0){
+    std::cout << num_failures << " check(s) failed." << std::endl;
+    return 1;
+  }
+  std::cout << "all trajectory checks passed." << std::endl;
+  return 0;
+}
@@ -0,0 +1,238 @@
+// The header file contains helpers shared by the regression tests (test_*.cpp): synthetic scenes, accuracy checks and
+// the stage timing gate. Header only, the tests are single file executables.
+//
+// Timing gate: every stage is timed as the median of a few repetitions and compared against the baseline file
+// (test_data/perf_baseline.txt, one "<stage> <milli-seconds>" per line). The timings are absolute wall times of one
+// machine, so the gate is opt-in: by default they are only reported and the accuracy checks alone decide. Environment:
+//  * ODOMETRY_PERF_GATE=1: a stage slower than baseline * (1 + tolerance) or missing in the baseline fails the test,
+//    only meaningful on the machine (and with the OpenCV build) the baseline was recorded on
+//  * ODOMETRY_PERF_TOLERANCE=<fraction>: allowed slow down, default 0.3 (30%)
+//  * ODOMETRY_PERF_UPDATE=1: write the measured timings as the new baseline (on the reference machine)
+// Without ODOMETRY_PERF_UPDATE=1 the measured timings are written to the build directory (perf_measured.txt), the
+// source tree is never modified.
+
+#ifndef ODOMETRY_TEST_UTILS_H
+#define ODOMETRY_TEST_UTILS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef HOME_DIR
+#define HOME_DIR "."
+#endif
+#ifndef BUILD_DIR
+#define BUILD_DIR "."
+#endif
+
+namespace odometry
+{
+namespace test
+{
+
+// KITTI sequence 00 rectified camera, the values the estimators currently assume
+const int kKittiRows = 376;
+const int kKittiCols = 1241;
+const float kKittiFx = 718.856f;
+const float kKittiCx = 607.1928f;
+const float kKittiCy = 185.2157f;
+const float kKittiBaseline = 0.54f; // in meters
+
+/*************************************************** Checks ********************************************************/
+inline int& NumFailures(){
+  static int num_failures = 0;
+  return num_failures;
+}
+
+// accuracy check, prints the failed condition and keeps going
+inline bool Expect(bool ok, const std::string& what){
+  if (!ok){
+    std::cout << "  [FAILED] " << what << std::endl;
+    NumFailures()++;
+  }
+  return ok;
+}
+
+inline bool ExpectLessEqual(double value, double bound, const std::string& what){
+  std::ostringstream msg;
+  msg << what << ": " << value << " (bound " << bound << ")";
+  std::cout << "  " << msg.str() << std::endl;
+  return Expect(value <= bound, msg.str());
+}
+
+inline bool ExpectGreaterEqual(double value, double bound, const std::string& what){
+  std::ostringstream msg;
+  msg << what << ": " << value << " (bound " << bound << ")";
+  std::cout << "  " << msg.str() << std::endl;
+  return Expect(value >= bound, msg.str());
+}
+
+/*************************************************** Synthetic data ************************************************/
+// deterministic band limited texture: two octaves of bilinearly interpolated random lattices, values in [0, 255].
+// defined for any real coordinate, so a scene can be rendered from any view point with exact correspondences
+class SyntheticTexture{
+  public:
+    explicit SyntheticTexture(unsigned int seed, float fine_cell = 3.0f, float coarse_cell = 17.0f)
+        : fine_cell_(fine_cell), coarse_cell_(coarse_cell){
+      std::mt19937 rng(seed);
+      std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+      fine_.resize(kSize * kSize);
+      coarse_.resize(kSize * kSize);
+      for (float& v : fine_) v = dist(rng);
+      for (float& v : coarse_) v = dist(rng);
+    }
+
+    float At(float u, float v) const{
+      return 255.0f * (0.45f * Lattice(fine_, u / fine_cell_, v / fine_cell_) + 0.55f * Lattice(coarse_, u / coarse_cell_, v / coarse_cell_));
+    }
+
+  private:
+    static const int kSize = 512; // the lattices repeat after kSize cells
+
+    static float Lattice(const std::vector<float>& lattice, float u, float v){
+      float fu = std::floor(u), fv = std::floor(v);
+      float au = u - fu, av = v - fv;
+      int x0 = ((int(fu) % kSize) + kSize) % kSize, y0 = ((int(fv) % kSize) + kSize) % kSize;
+      int x1 = (x0 + 1) % kSize, y1 = (y0 + 1) % kSize;
+      float top = (1.0f - au) * lattice[y0 * kSize + x0] + au * lattice[y0 * kSize + x1];
+      float bot = (1.0f - au) * lattice[y1 * kSize + x0] + au * lattice[y1 * kSize + x1];
+      return (1.0f - av) * top + av * bot;
+    }
+
+    float fine_cell_, coarse_cell_;
+    std::vector<float> fine_, coarse_;
+};
+
+/*************************************************** Timing gate ***************************************************/
+// median wall time of fn in milli-seconds, the first call warms up caches and is not counted
+template <typename Fn>
+double MedianMs(Fn fn, int reps){
+  fn();
+  std::vector<double> samples;
+  for (int i = 0; i < reps; i++){
+    auto begin = std::chrono::steady_clock::now();
+    fn();
+    samples.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+  }
+  std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+  return samples[samples.size() / 2];
+}
+
+class PerfGate{
+  public:
+    explicit PerfGate(const std::string& baseline_file = HOME_DIR "/test_data/perf_baseline.txt",
+                      const std::string& measured_file = BUILD_DIR "/perf_measured.txt")
+        : baseline_file_(baseline_file), measured_file_(measured_file){
+      const char* tolerance = std::getenv("ODOMETRY_PERF_TOLERANCE");
+      if (tolerance != nullptr) tolerance_ = std::atof(tolerance);
+      const char* update = std::getenv("ODOMETRY_PERF_UPDATE");
+      update_ = (update != nullptr && std::string(update) == "1");
+      const char* gate = std::getenv("ODOMETRY_PERF_GATE");
+      enabled_ = (gate != nullptr && std::string(gate) == "1");
+      baseline_ = Load(baseline_file_);
+    }
+
+    // compare one stage against its baseline, stage names are "<test>.<stage>"
+    void Check(const std::string& stage, double ms){
+      std::ostringstream line;
+      line << "  " << std::left << std::setw(34) << stage << std::right << std::fixed << std::setprecision(3)
+           << std::setw(10) << ms << " ms";
+      recorded_[stage] = ms;
+      auto found = baseline_.find(stage);
+      if (update_){
+        line << (found == baseline_.end() ? "  (no baseline, recorded)" : "  (baseline updated)");
+        std::cout << line.str() << std::endl;
+        return;
+      }
+      if (found == baseline_.end()){
+        line << "  (no baseline)";
+        std::cout << line.str() << std::endl;
+        if (enabled_) Expect(false, "stage " + stage + " has no baseline, record it with ODOMETRY_PERF_UPDATE=1");
+        return;
+      }
+      // 0.05 ms absolute slack: sub-millisecond stages are dominated by timer and scheduling noise
+      double limit = found->second * (1.0 + tolerance_) + 0.05;
+      line << "  baseline " << std::setw(10) << found->second << " ms  (" << std::setprecision(2) << ms / found->second << "x)";
+      std::cout << line.str() << std::endl;
+      if (ms > limit){
+        if (enabled_){
+          std::ostringstream msg;
+          msg << "stage " << stage << " regressed: " << ms << " ms > " << limit << " ms";
+          Expect(false, msg.str());
+        } else {
+          std::cout << "  [SLOW] " << stage << " (gate disabled)" << std::endl;
+        }
+      }
+    }
+
+    // write the measured stages: into the baseline file with ODOMETRY_PERF_UPDATE=1, otherwise into the measured file
+    // of the build directory. merged into the current file content so the entries of the other tests are kept
+    void Save(){
+      if (recorded_.empty()) return;
+      const std::string& file_name = update_ ? baseline_file_ : measured_file_;
+      std::map<std::string, double> merged = Load(file_name);
+      for (const auto& entry : recorded_) merged[entry.first] = entry.second;
+      std::string tmp_file = file_name + ".tmp";
+      {
+        std::ofstream file(tmp_file);
+        if (!file.is_open()){
+          std::cout << "  can not write timing file " << file_name << std::endl;
+          return;
+        }
+        file << "# stage timing baseline of the regression tests, median milli-seconds, see test_utils.h\n";
+        file << "# record on the reference machine with a Release build: ODOMETRY_PERF_UPDATE=1 ctest -L regression\n";
+        file << std::fixed << std::setprecision(3);
+        for (const auto& entry : merged) file << entry.first << " " << entry.second << "\n";
+      }
+      std::rename(tmp_file.c_str(), file_name.c_str());
+      recorded_.clear();
+    }
+
+  private:
+    static std::map<std::string, double> Load(const std::string& file_name){
+      std::map<std::string, double> baseline;
+      std::ifstream file(file_name);
+      std::string line;
+      while (std::getline(file, line)){
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream items(line);
+        std::string stage;
+        double ms;
+        if (items >> stage >> ms) baseline[stage] = ms;
+      }
+      return baseline;
+    }
+
+    std::string baseline_file_;
+    std::string measured_file_;
+    std::map<std::string, double> baseline_;
+    double tolerance_ = 0.3;
+    bool update_ = false;
+    bool enabled_ = true;
+    std::map<std::string, double> recorded_; // stages measured by this run
+};
+
+// prints the verdict, returns the exit code of the test
+inline int Finish(const std::string& test_name){
+  if (NumFailures() == 0){
+    std::cout << test_name << ": all checks passed." << std::endl;
+    return 0;
+  }
+  std::cout << test_name << ": " << NumFailures() << " check(s) failed." << std::endl;
+  return 1;
+}
+
+} // namespace test
+} // namespace odometry
+
+#endif //ODOMETRY_TEST_UTILS_H